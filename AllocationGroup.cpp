@@ -0,0 +1,37 @@
+#include "AllocationGroup.hpp"
+
+AllocationGroup::AllocationGroup(int32_t firstCluster, int32_t clusterCount, int32_t firstInode, int32_t inodeCount)
+        : firstCluster(firstCluster), clusterCount(clusterCount), firstInode(firstInode),
+          inodeCount(inodeCount), freeClusters(0), freeInodes(0) {}
+
+int32_t AllocationGroup::getFirstCluster() const {
+    return firstCluster;
+}
+
+int32_t AllocationGroup::getClusterCount() const {
+    return clusterCount;
+}
+
+int32_t AllocationGroup::getFirstInode() const {
+    return firstInode;
+}
+
+int32_t AllocationGroup::getInodeCount() const {
+    return inodeCount;
+}
+
+int32_t AllocationGroup::getFreeClusters() const {
+    return freeClusters;
+}
+
+void AllocationGroup::addFreeClusters(int32_t delta) {
+    freeClusters += delta;
+}
+
+int32_t AllocationGroup::getFreeInodes() const {
+    return freeInodes;
+}
+
+void AllocationGroup::addFreeInodes(int32_t delta) {
+    freeInodes += delta;
+}
@@ -0,0 +1,80 @@
+#ifndef SEMESTRALNIPRACE_ALLOCATIONGROUP_HPP
+#define SEMESTRALNIPRACE_ALLOCATIONGROUP_HPP
+
+#include <cstdint>
+
+/**
+ * Class representing an allocation group - a slice of data clusters ( with its own part of the bitmap )
+ * and a slice of i-nodes with their free counters. Groups keep files near their directory and let full parts of the
+ * image be skipped; they are changed under the exclusive lock of the file system like the rest of its state.
+ */
+class AllocationGroup {
+public:
+
+    /**
+     * Constructor for allocation group
+     * @param firstCluster - first data cluster of the group
+     * @param clusterCount - number of data clusters in the group
+     * @param firstInode - first i-node of the group
+     * @param inodeCount - number of i-nodes in the group
+     */
+    AllocationGroup(int32_t firstCluster, int32_t clusterCount, int32_t firstInode, int32_t inodeCount);
+
+    /**
+     * Gets the first data cluster of the group
+     * @return first data cluster of the group
+     */
+    int32_t getFirstCluster() const;
+
+    /**
+     * Gets the number of data clusters in the group
+     * @return number of data clusters in the group
+     */
+    int32_t getClusterCount() const;
+
+    /**
+     * Gets the first i-node of the group
+     * @return first i-node of the group
+     */
+    int32_t getFirstInode() const;
+
+    /**
+     * Gets the number of i-nodes in the group
+     * @return number of i-nodes in the group
+     */
+    int32_t getInodeCount() const;
+
+    /**
+     * Gets the number of free data clusters in the group
+     * @return number of free data clusters
+     */
+    int32_t getFreeClusters() const;
+
+    /**
+     * Adds the given value to the number of free data clusters
+     * @param delta - value to add ( negative when clusters are allocated )
+     */
+    void addFreeClusters(int32_t delta);
+
+    /**
+     * Gets the number of free i-nodes in the group
+     * @return number of free i-nodes
+     */
+    int32_t getFreeInodes() const;
+
+    /**
+     * Adds the given value to the number of free i-nodes
+     * @param delta - value to add ( negative when i-nodes are allocated )
+     */
+    void addFreeInodes(int32_t delta);
+
+private:
+    int32_t firstCluster;
+    int32_t clusterCount;
+    int32_t firstInode;
+    int32_t inodeCount;
+    int32_t freeClusters;
+    int32_t freeInodes;
+};
+
+#endif //SEMESTRALNIPRACE_ALLOCATIONGROUP_HPP
@@ -0,0 +1,91 @@
+#include "ChecksumTable.hpp"
+#include "Constants.hpp"
+#include "Crc32c.hpp"
+#include <unistd.h>
+
+using std::lock_guard;
+
+void ChecksumTable::reset(int newFd, int64_t newStartAddress, int32_t newClusterSize) {
+    lock_guard<mutex> guard(cacheMutex);
+    fd = newFd;
+    startAddress = newStartAddress;
+    clusterSize = newClusterSize;
+    checksumsPerPage = newClusterSize / CHECKSUM_SIZE;
+    vector<char> zeros(static_cast<size_t>(newClusterSize), 0);
+    zeroChecksum = Crc32c::compute(zeros.data(), zeros.size());
+    pages.clear();
+    dirtyPages.clear();
+    staleClusters.clear();
+}
+
+bool ChecksumTable::isEnabled() const {
+    return startAddress != 0;
+}
+
+bool ChecksumTable::get(int64_t cluster, uint32_t& checksum) {
+    lock_guard<mutex> guard(cacheMutex);
+    if (staleClusters.count(cluster) != 0) {
+        return false;
+    }
+    checksum = getPage(cluster / checksumsPerPage)[cluster % checksumsPerPage] ^ zeroChecksum;
+    return true;
+}
+
+void ChecksumTable::set(int64_t cluster, uint32_t checksum) {
+    lock_guard<mutex> guard(cacheMutex);
+    int64_t index = cluster / checksumsPerPage;
+    getPage(index)[cluster % checksumsPerPage] = checksum ^ zeroChecksum;
+    dirtyPages.insert(index);
+    staleClusters.erase(cluster);
+}
+
+void ChecksumTable::setZero(int64_t cluster) {
+    lock_guard<mutex> guard(cacheMutex);
+    int64_t index = cluster / checksumsPerPage;
+    getPage(index)[cluster % checksumsPerPage] = 0;
+    dirtyPages.insert(index);
+    staleClusters.erase(cluster);
+}
+
+void ChecksumTable::markStale(int64_t cluster) {
+    lock_guard<mutex> guard(cacheMutex);
+    staleClusters.insert(cluster);
+}
+
+vector<int64_t> ChecksumTable::getStaleClusters() {
+    lock_guard<mutex> guard(cacheMutex);
+    vector<int64_t> stale(staleClusters.begin(), staleClusters.end());
+    return stale;
+}
+
+void ChecksumTable::flush(const function<void(int64_t, const char*, size_t)>& write) {
+    lock_guard<mutex> guard(cacheMutex);
+    for (int64_t index : dirtyPages) {
+        const vector<uint32_t>& page = pages[index];
+        write(startAddress + index * clusterSize, reinterpret_cast<const char*>(page.data()),
+              page.size() * sizeof(uint32_t));
+    }
+    dirtyPages.clear();
+}
+
+vector<uint32_t>& ChecksumTable::getPage(int64_t index) {
+    auto found = pages.find(index);
+    if (found != pages.end()) {
+        return found->second;
+    }
+
+    // Clean pages can be read again at any time, changed pages stay until the flush
+    if (pages.size() >= static_cast<size_t>(CHECKSUM_CACHE_PAGES)) {
+        for (auto it = pages.begin(); it != pages.end();) {
+            it = dirtyPages.count(it->first) == 0 ? pages.erase(it) : std::next(it);
+        }
+    }
+
+    vector<uint32_t>& page = pages[index];
+    page.assign(static_cast<size_t>(checksumsPerPage), 0);
+    size_t bytes = page.size() * sizeof(uint32_t);
+    if (::pread(fd, page.data(), bytes, startAddress + index * clusterSize) != static_cast<ssize_t>(bytes)) {
+        page.assign(page.size(), 0);
+    }
+    return page;
+}
@@ -0,0 +1,108 @@
+#ifndef SEMESTRALNIPRACE_CHECKSUMTABLE_HPP
+#define SEMESTRALNIPRACE_CHECKSUMTABLE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using std::function;
+using std::mutex;
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+/**
+ * Verification of cluster checksums on read
+ */
+enum class VerifyMode {
+    OFF,        // Checksums are kept up to date but not compared
+    WARN,       // Mismatches are reported, the data is still used
+    STRICT      // Mismatches are reported and the read fails
+};
+
+/**
+ * In-memory cache of the table of cluster checksums. The table keeps one CRC32C for every cluster of the image,
+ * stored xor-ed with the checksum of a zero cluster so that the zero filled table of a new image is valid.
+ * Changed checksums stay in memory until flush, so a command writing many clusters writes every cluster
+ * of the table once. Clusters written only partly are marked stale and checksummed again at the flush.
+ * Pages are read by readers under the shared state lock, the cache is guarded by its own mutex.
+ */
+class ChecksumTable {
+public:
+
+    /**
+     * Forgets all pages and starts caching the table of another image
+     * @param fd - descriptor of the image opened for reading
+     * @param startAddress - start address of the table, 0 for images without checksums
+     * @param clusterSize - cluster size in bytes
+     */
+    void reset(int fd, int64_t startAddress, int32_t clusterSize);
+
+    /**
+     * Checks whether the image has a table of cluster checksums
+     * @return true if checksums are kept, false otherwise
+     */
+    bool isEnabled() const;
+
+    /**
+     * Gets the stored checksum of a cluster
+     * @param cluster - cluster of the image
+     * @param checksum - stored checksum
+     * @return false if the cluster is stale and has no valid checksum yet, true otherwise
+     */
+    bool get(int64_t cluster, uint32_t& checksum);
+
+    /**
+     * Stores the checksum of a fully written cluster
+     * @param cluster - cluster of the image
+     * @param checksum - checksum of its content
+     */
+    void set(int64_t cluster, uint32_t checksum);
+
+    /**
+     * Stores the checksum of a cluster which reads as zeros without computing it
+     * @param cluster - cluster of the image
+     */
+    void setZero(int64_t cluster);
+
+    /**
+     * Marks a partly written cluster, its checksum is computed again at the next flush
+     * @param cluster - cluster of the image
+     */
+    void markStale(int64_t cluster);
+
+    /**
+     * Gets all stale clusters, they stop being stale when their new checksums are set
+     * @return stale clusters
+     */
+    vector<int64_t> getStaleClusters();
+
+    /**
+     * Writes all changed pages of the table
+     * @param write - writes the given bytes at the given address of the image
+     */
+    void flush(const function<void(int64_t, const char*, size_t)>& write);
+
+private:
+    int fd = -1;
+    int64_t startAddress = 0;
+    int32_t clusterSize = 0;
+    int32_t checksumsPerPage = 0;
+    uint32_t zeroChecksum = 0;                          // Checksum of a zero cluster, stored as zero
+    mutex cacheMutex;
+    unordered_map<int64_t, vector<uint32_t>> pages;     // Loaded clusters of the table
+    unordered_set<int64_t> dirtyPages;
+    unordered_set<int64_t> staleClusters;
+
+    /**
+     * Gets a page of the table, loads it if it is not cached, the cache mutex has to be held
+     * @param index - index of the cluster of the table
+     * @return checksums of the page
+     */
+    vector<uint32_t>& getPage(int64_t index);
+};
+
+#endif //SEMESTRALNIPRACE_CHECKSUMTABLE_HPP
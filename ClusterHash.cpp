@@ -0,0 +1,75 @@
+#include "ClusterHash.hpp"
+#include <cstring>
+
+static const uint64_t C1 = 0x87C37B91114253D5ULL;
+static const uint64_t C2 = 0x4CF5AD432745937FULL;
+
+/**
+ * Rotates the value to the left
+ * @param value - value to rotate
+ * @param bits - number of bits
+ * @return rotated value
+ */
+static uint64_t rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * Final mix of one half of the hash, every input bit affects every output bit
+ * @param value - half of the hash
+ * @return mixed half of the hash
+ */
+static uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+Hash128 ClusterHash::compute(const char* data, size_t size) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+    uint64_t h1 = 0, h2 = 0;
+
+    // Body, clusters are always a multiple of 16 bytes
+    size_t blockCount = size / 16;
+    for (size_t i = 0; i < blockCount; i++) {
+        uint64_t k1, k2;
+        memcpy(&k1, bytes + i * 16, sizeof(k1));
+        memcpy(&k2, bytes + i * 16 + 8, sizeof(k2));
+
+        k1 *= C1; k1 = rotl(k1, 31); k1 *= C2; h1 ^= k1;
+        h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52DCE729;
+        k2 *= C2; k2 = rotl(k2, 33); k2 *= C1; h2 ^= k2;
+        h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495AB5;
+    }
+
+    // Tail of up to 15 bytes
+    const uint8_t* tail = bytes + blockCount * 16;
+    size_t rest = size & 15;
+    uint64_t k1 = 0, k2 = 0;
+    for (size_t i = rest; i > 8; i--) {
+        k2 ^= static_cast<uint64_t>(tail[i - 1]) << ((i - 9) * 8);
+    }
+    if (rest > 8) {
+        k2 *= C2; k2 = rotl(k2, 33); k2 *= C1; h2 ^= k2;
+    }
+    for (size_t i = rest < 8 ? rest : 8; i > 0; i--) {
+        k1 ^= static_cast<uint64_t>(tail[i - 1]) << ((i - 1) * 8);
+    }
+    if (rest > 0) {
+        k1 *= C1; k1 = rotl(k1, 31); k1 *= C2; h1 ^= k1;
+    }
+
+    h1 ^= size; h2 ^= size;
+    h1 += h2; h2 += h1;
+    h1 = mix(h1); h2 = mix(h2);
+    h1 += h2; h2 += h1;
+
+    // The empty value marks hash slots without a hash
+    if (h1 == 0 && h2 == 0) {
+        h1 = 1;
+    }
+    return Hash128{h1, h2};
+}
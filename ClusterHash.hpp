@@ -0,0 +1,48 @@
+#ifndef SEMESTRALNIPRACE_CLUSTERHASH_HPP
+#define SEMESTRALNIPRACE_CLUSTERHASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * 128-bit hash of one data cluster, all zero bits mean no hash
+ */
+struct Hash128 {
+    uint64_t low;
+    uint64_t high;
+
+    bool operator==(const Hash128& other) const {
+        return low == other.low && high == other.high;
+    }
+
+    bool isEmpty() const {
+        return low == 0 && high == 0;
+    }
+};
+
+/**
+ * Hash functor for unordered containers keyed by Hash128
+ */
+struct Hash128Hasher {
+    size_t operator()(const Hash128& hash) const {
+        return static_cast<size_t>(hash.low ^ (hash.high * 0x9E3779B97F4A7C15ULL));
+    }
+};
+
+/**
+ * Fast non-cryptographic hash of data clusters ( MurmurHash3 x64 128-bit ). Equal hashes are only a hint,
+ * clusters are compared byte by byte before they are shared.
+ */
+class ClusterHash {
+public:
+
+    /**
+     * Computes the hash of the data
+     * @param data - data to hash
+     * @param size - size of the data
+     * @return hash of the data, never empty
+     */
+    static Hash128 compute(const char* data, size_t size);
+};
+
+#endif //SEMESTRALNIPRACE_CLUSTERHASH_HPP
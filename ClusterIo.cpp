@@ -0,0 +1,223 @@
+#include "ClusterIo.hpp"
+#include "VirtualFileSystem.hpp"
+#include "Constants.hpp"
+#include "ZeroScanner.hpp"
+#include <algorithm>
+#include <cstring>
+
+using std::min;
+
+// Data written to the image by one call when the target clusters are adjacent
+static constexpr int32_t WRITE_RUN_BYTES = 1 << 20;
+
+/**
+ * Gets binary logarithm of the cluster size at compile time
+ * @param value - power of two
+ * @return binary logarithm of the value
+ */
+static constexpr int getShift(int32_t value) {
+    return value > 1 ? 1 + getShift(value / 2) : 0;
+}
+
+/**
+ * Gets the number of data blocks under one pointer of the block map level
+ * @param pointers - number of block numbers in one cluster
+ * @param level - level of the block map
+ * @return number of data blocks
+ */
+static int64_t getLevelSpan(int64_t pointers, int level) {
+    int64_t span = 1;
+    for (int i = 1; i < level; i++) {
+        span *= pointers;
+    }
+    return span;
+}
+
+const ClusterIo* ClusterIo::forClusterSize(int32_t clusterSize) {
+    static const ClusterIoKernel<1 << 10> kernel1K;
+    static const ClusterIoKernel<1 << 11> kernel2K;
+    static const ClusterIoKernel<1 << 12> kernel4K;
+    static const ClusterIoKernel<1 << 13> kernel8K;
+    static const ClusterIoKernel<1 << 14> kernel16K;
+    static const ClusterIoKernel<1 << 15> kernel32K;
+    static const ClusterIoKernel<1 << 16> kernel64K;
+    static const ClusterIoKernel<1 << 17> kernel128K;
+    static const ClusterIoKernel<1 << 18> kernel256K;
+    static const ClusterIoKernel<1 << 19> kernel512K;
+    static const ClusterIoKernel<1 << 20> kernel1M;
+
+    switch (clusterSize) {
+        case 1 << 10: return &kernel1K;
+        case 1 << 11: return &kernel2K;
+        case 1 << 12: return &kernel4K;
+        case 1 << 13: return &kernel8K;
+        case 1 << 14: return &kernel16K;
+        case 1 << 15: return &kernel32K;
+        case 1 << 16: return &kernel64K;
+        case 1 << 17: return &kernel128K;
+        case 1 << 18: return &kernel256K;
+        case 1 << 19: return &kernel512K;
+        case 1 << 20: return &kernel1M;
+        default:      return nullptr;
+    }
+}
+
+template<int32_t ClusterSize>
+int32_t ClusterIoKernel<ClusterSize>::getClusterSize() const {
+    return ClusterSize;
+}
+
+template<int32_t ClusterSize>
+int32_t ClusterIoKernel<ClusterSize>::getPointersPerCluster() const {
+    return ClusterSize / sizeof(int32_t);
+}
+
+template<int32_t ClusterSize>
+int32_t ClusterIoKernel<ClusterSize>::getEntriesPerCluster() const {
+    return ClusterSize / DIRECTORY_ENTRY_SIZE;
+}
+
+template<int32_t ClusterSize>
+int ClusterIoKernel<ClusterSize>::getBlockCount(int64_t size, int* rest) const {
+    static_assert((ClusterSize & (ClusterSize - 1)) == 0, "Cluster size has to be a power of two");
+    constexpr int shift = getShift(ClusterSize);
+
+    int tail = static_cast<int>(size & (ClusterSize - 1));
+    if (rest != nullptr) {
+        *rest = tail;
+    }
+    return static_cast<int>(size >> shift) + (tail != 0 ? 1 : 0);
+}
+
+template<int32_t ClusterSize>
+void ClusterIoKernel<ClusterSize>::readBlockMap(VirtualFileSystem* vfs, int32_t mapBlock, int level,
+                                                vector<int32_t>& blocks, int& next, int end) const {
+    constexpr int32_t pointers = ClusterSize / sizeof(int32_t);
+    int64_t span = getLevelSpan(pointers, level);
+
+    // Only the used pointers are read
+    int count = static_cast<int>(min<int64_t>((end - next + span - 1) / span, pointers));
+    if (level == 1) {
+        vfs->readDataClusters(mapBlock, reinterpret_cast<char*>(&blocks[next]), sizeof(int32_t) * count);
+        next += count;
+        return;
+    }
+
+    vector<int32_t> numbers(count);
+    vfs->readDataClusters(mapBlock, reinterpret_cast<char*>(numbers.data()), sizeof(int32_t) * count);
+    for (int32_t number : numbers) {
+        readBlockMap(vfs, number, level - 1, blocks, next, end);
+    }
+}
+
+template<int32_t ClusterSize>
+int32_t ClusterIoKernel<ClusterSize>::writeBlockMap(VirtualFileSystem* vfs, int level, const vector<int32_t>& blocks,
+                                                    int& next, int end, int& mapBlock) const {
+    constexpr int32_t pointers = ClusterSize / sizeof(int32_t);
+    int32_t block = blocks[mapBlock++];
+
+    // Unused pointers are zero, the whole cluster is written
+    vector<int32_t> numbers(pointers, 0);
+    for (int i = 0; i < pointers && next < end; i++) {
+        numbers[i] = (level == 1) ? blocks[next++] : writeBlockMap(vfs, level - 1, blocks, next, end, mapBlock);
+    }
+
+    vfs->seekDataCluster(block);
+    vfs->writeToFile(numbers.data(), numbers.size());
+    return block;
+}
+
+template<int32_t ClusterSize>
+void ClusterIoKernel<ClusterSize>::collectMapBlocks(VirtualFileSystem* vfs, int32_t mapBlock, int level,
+                                                    int64_t dataCount, vector<int32_t>& mapBlocks) const {
+    constexpr int32_t pointers = ClusterSize / sizeof(int32_t);
+    mapBlocks.push_back(mapBlock);
+    if (level == 1) {
+        return;
+    }
+
+    int64_t span = getLevelSpan(pointers, level);
+    int count = static_cast<int>(min<int64_t>((dataCount + span - 1) / span, pointers));
+    vector<int32_t> numbers(count);
+    vfs->readDataClusters(mapBlock, reinterpret_cast<char*>(numbers.data()), sizeof(int32_t) * count);
+    for (int i = 0; i < count; i++) {
+        collectMapBlocks(vfs, numbers[i], level - 1, min(span, dataCount - i * span), mapBlocks);
+    }
+}
+
+template<int32_t ClusterSize>
+int ClusterIoKernel<ClusterSize>::findEntry(const char* cluster, int32_t inodeId, int* usedEntries) const {
+    const int32_t entries = ClusterSize / DIRECTORY_ENTRY_SIZE;
+    int found = -1;
+    int used = 0;
+
+    for (int i = 0; i < entries; i++) {
+        int32_t nodeId;
+        memcpy(&nodeId, cluster + i * DIRECTORY_ENTRY_SIZE, sizeof(int32_t));
+        if (nodeId > 0) {
+            used++;
+        }
+        if (found < 0 && nodeId == inodeId) {
+            found = i;
+            if (usedEntries == nullptr) {
+                break;
+            }
+        }
+    }
+
+    if (usedEntries != nullptr) {
+        *usedEntries = used;
+    }
+    return found;
+}
+
+template<int32_t ClusterSize>
+bool ClusterIoKernel<ClusterSize>::importClusters(VirtualFileSystem* vfs, istream& source, vector<int32_t>& target,
+                                                  int blockCount, int lastBlockSize, vector<int32_t>& holes) const {
+    constexpr int runClusters = WRITE_RUN_BYTES / ClusterSize > 0 ? WRITE_RUN_BYTES / ClusterSize : 1;
+    vector<char> run(static_cast<size_t>(runClusters) * ClusterSize);
+    bool sparse = vfs->allowsHoles();
+    int runStart = 0;
+
+    for (int i = 0; i < blockCount; i++) {
+        char* cluster = run.data() + static_cast<size_t>(i - runStart) * ClusterSize;
+        int size = (i == blockCount - 1) ? lastBlockSize : ClusterSize;
+        if (!source.read(cluster, size)) {
+            return false;
+        }
+        memset(cluster + size, 0, ClusterSize - size);
+
+        if (!endCluster(vfs, target, runStart, i, blockCount, run.data(), sparse, holes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<int32_t ClusterSize>
+bool ClusterIoKernel<ClusterSize>::endCluster(VirtualFileSystem* vfs, vector<int32_t>& target, int& runStart, int index,
+                                              int blockCount, const char* run, bool sparse, vector<int32_t>& holes) const {
+    constexpr int runClusters = WRITE_RUN_BYTES / ClusterSize > 0 ? WRITE_RUN_BYTES / ClusterSize : 1;
+    int length = index - runStart + 1;
+
+    if (sparse && ZeroScanner::isZero(run + static_cast<size_t>(length - 1) * ClusterSize, ClusterSize)) {
+        bool written = length == 1 || writeRun(vfs, target[runStart], run, length - 1);
+        holes.push_back(target[index]);
+        target[index] = ID_ITEM_FREE;
+        runStart = index + 1;
+        return written;
+    }
+
+    if (index == blockCount - 1 || length == runClusters || target[index + 1] != target[index] + 1) {
+        int32_t first = target[runStart];
+        runStart = index + 1;
+        return writeRun(vfs, first, run, length);
+    }
+    return true;
+}
+
+template<int32_t ClusterSize>
+bool ClusterIoKernel<ClusterSize>::writeRun(VirtualFileSystem* vfs, int32_t firstBlock, const char* run, int count) const {
+    vfs->seekDataCluster(firstBlock);
+    return vfs->writeToFile(run, static_cast<size_t>(count) * ClusterSize) != 0;
+}
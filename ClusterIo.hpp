@@ -0,0 +1,166 @@
+#ifndef SEMESTRALNIPRACE_CLUSTERIO_HPP
+#define SEMESTRALNIPRACE_CLUSTERIO_HPP
+
+#include <cstdint>
+#include <istream>
+#include <vector>
+
+using std::vector;
+using std::istream;
+
+class VirtualFileSystem;
+
+/**
+ * Cluster size dependent loops of the virtual file system ( block map walking, directory scans and copying ).
+ * Every supported cluster size has its own instance of ClusterIoKernel compiled with the cluster size
+ * as a constant, the instance is selected once when the file system is formatted or loaded.
+ */
+class ClusterIo {
+public:
+
+    /**
+     * Gets the loops compiled for the given cluster size
+     * @param clusterSize - cluster size in bytes
+     * @return loops for the cluster size or nullptr if the cluster size is not supported
+     */
+    static const ClusterIo* forClusterSize(int32_t clusterSize);
+
+    virtual ~ClusterIo() = default;
+
+    /**
+     * Gets the cluster size
+     * @return cluster size in bytes
+     */
+    virtual int32_t getClusterSize() const = 0;
+
+    /**
+     * Gets the number of block numbers stored in one cluster of the block map
+     * @return number of block numbers in one cluster
+     */
+    virtual int32_t getPointersPerCluster() const = 0;
+
+    /**
+     * Gets the number of directory entries stored in one cluster of a directory
+     * @return number of directory entries in one cluster
+     */
+    virtual int32_t getEntriesPerCluster() const = 0;
+
+    /**
+     * Gets the number of clusters needed for data of the given size
+     * @param size - size of data in bytes
+     * @param rest - number of bytes in the last cluster ( 0 if the last cluster is full ), may be nullptr
+     * @return number of clusters
+     */
+    virtual int getBlockCount(int64_t size, int* rest) const = 0;
+
+    /**
+     * Reads data block numbers from the block map subtree of the given level to the given vector
+     * @param vfs - virtual file system to read from
+     * @param mapBlock - block of the block map ( root of the subtree )
+     * @param level - level of the subtree ( 1 - single indirect, 2 - double indirect, 3 - triple indirect )
+     * @param blocks - vector of blocks
+     * @param next - index of the next block to fill in the vector
+     * @param end - number of blocks to fill in the vector
+     */
+    virtual void readBlockMap(VirtualFileSystem* vfs, int32_t mapBlock, int level, vector<int32_t>& blocks,
+                              int& next, int end) const = 0;
+
+    /**
+     * Writes block map subtree of the given level pointing to the data blocks
+     * @param vfs - virtual file system to write to
+     * @param level - level of the subtree ( 1 - single indirect, 2 - double indirect, 3 - triple indirect )
+     * @param blocks - data blocks followed by the blocks of the block map
+     * @param next - index of the next data block to store in the subtree
+     * @param end - number of data blocks
+     * @param mapBlock - index of the next unused block of the block map
+     * @return block of the block map which is the root of the subtree
+     */
+    virtual int32_t writeBlockMap(VirtualFileSystem* vfs, int level, const vector<int32_t>& blocks,
+                                  int& next, int end, int& mapBlock) const = 0;
+
+    /**
+     * Adds blocks of the block map subtree of the given level to the given vector
+     * @param vfs - virtual file system to read from
+     * @param mapBlock - block of the block map ( root of the subtree )
+     * @param level - level of the subtree ( 1 - single indirect, 2 - double indirect, 3 - triple indirect )
+     * @param dataCount - number of data blocks the subtree points to
+     * @param mapBlocks - vector of blocks of the block map
+     */
+    virtual void collectMapBlocks(VirtualFileSystem* vfs, int32_t mapBlock, int level, int64_t dataCount,
+                                  vector<int32_t>& mapBlocks) const = 0;
+
+    /**
+     * Finds directory entry with the given i-node in one cluster of a directory
+     * @param cluster - content of the directory cluster
+     * @param inodeId - i-node of the entry ( 0 finds the first free entry )
+     * @param usedEntries - number of used entries in the cluster, may be nullptr
+     * @return index of the entry in the cluster or -1 if there is no such entry
+     */
+    virtual int findEntry(const char* cluster, int32_t inodeId, int* usedEntries) const = 0;
+
+    /**
+     * Imports data from the stream to the given clusters, physically adjacent target clusters are written at once;
+     * zero clusters become holes if the image allows them
+     * @param vfs - virtual file system to write to
+     * @param source - stream with the data
+     * @param target - target clusters, holes are set in place
+     * @param blockCount - number of clusters to import
+     * @param lastBlockSize - number of bytes used in the last cluster
+     * @param holes - target clusters replaced by holes, they are still reserved
+     * @return true if all clusters were imported, false otherwise
+     */
+    virtual bool importClusters(VirtualFileSystem* vfs, istream& source, vector<int32_t>& target,
+                                int blockCount, int lastBlockSize, vector<int32_t>& holes) const = 0;
+};
+
+/**
+ * Loops of the virtual file system compiled for one cluster size ( a power of two )
+ * @tparam ClusterSize - cluster size in bytes
+ */
+template<int32_t ClusterSize>
+class ClusterIoKernel : public ClusterIo {
+public:
+    int32_t getClusterSize() const override;
+    int32_t getPointersPerCluster() const override;
+    int32_t getEntriesPerCluster() const override;
+    int getBlockCount(int64_t size, int* rest) const override;
+    void readBlockMap(VirtualFileSystem* vfs, int32_t mapBlock, int level, vector<int32_t>& blocks,
+                      int& next, int end) const override;
+    int32_t writeBlockMap(VirtualFileSystem* vfs, int level, const vector<int32_t>& blocks,
+                          int& next, int end, int& mapBlock) const override;
+    void collectMapBlocks(VirtualFileSystem* vfs, int32_t mapBlock, int level, int64_t dataCount,
+                          vector<int32_t>& mapBlocks) const override;
+    int findEntry(const char* cluster, int32_t inodeId, int* usedEntries) const override;
+    bool importClusters(VirtualFileSystem* vfs, istream& source, vector<int32_t>& target,
+                        int blockCount, int lastBlockSize, vector<int32_t>& holes) const override;
+
+private:
+
+    /**
+     * Ends the cluster read last into the run buffer. A zero cluster becomes a hole and the clusters before it
+     * are written, any other cluster ends the run when the buffer is full or the next target is not adjacent
+     * @param vfs - virtual file system to write to
+     * @param target - target clusters, a hole is set in place
+     * @param runStart - index of the first cluster in the run buffer, moved behind the written clusters
+     * @param index - index of the cluster read last
+     * @param blockCount - number of clusters
+     * @param run - run buffer
+     * @param sparse - true if zero clusters become holes
+     * @param holes - target clusters replaced by holes
+     * @return true if the written clusters were written, false otherwise
+     */
+    bool endCluster(VirtualFileSystem* vfs, vector<int32_t>& target, int& runStart, int index, int blockCount,
+                    const char* run, bool sparse, vector<int32_t>& holes) const;
+
+    /**
+     * Writes run of clusters to the physically adjacent target clusters
+     * @param vfs - virtual file system to write to
+     * @param firstBlock - first target cluster
+     * @param run - data of the clusters
+     * @param count - number of clusters
+     * @return true if the run was written, false otherwise
+     */
+    bool writeRun(VirtualFileSystem* vfs, int32_t firstBlock, const char* run, int count) const;
+};
+
+#endif //SEMESTRALNIPRACE_CLUSTERIO_HPP
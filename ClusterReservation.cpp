@@ -0,0 +1,67 @@
+#include "ClusterReservation.hpp"
+#include "VirtualFileSystem.hpp"
+#include "AllocationGroup.hpp"
+#include "Constants.hpp"
+#include <algorithm>
+
+using std::vector;
+using std::max;
+using std::min;
+
+ClusterReservation::ClusterReservation(VirtualFileSystem* vfs)
+        : vfs(vfs), next(0), group(0) {}
+
+vector<int32_t> ClusterReservation::take(int count, int32_t goalInode) {
+    size_t goalGroup = vfs->getGroupOfInode(goalInode);
+
+    // Clusters of another group would take the file away from its directory
+    if (getAvailable() > 0 && group != goalGroup) {
+        release();
+    }
+
+    if (getAvailable() < static_cast<size_t>(count)) {
+        // Keep the clusters we have, they are followed by the new run in the file
+        vector<int32_t> rest(clusters.begin() + static_cast<long>(next), clusters.end());
+        int wanted = max(count - static_cast<int>(rest.size()), getRefillCount(goalGroup));
+        vector<int32_t> reserved = vfs->reserveClusters(wanted, goalInode);
+
+        rest.insert(rest.end(), reserved.begin(), reserved.end());
+        clusters.swap(rest);
+        next = 0;
+        group = goalGroup;
+
+        if (clusters.size() < static_cast<size_t>(count)) {
+            return {};
+        }
+    }
+
+    vector<int32_t> taken(clusters.begin() + static_cast<long>(next), clusters.begin() + static_cast<long>(next) + count);
+    next += static_cast<size_t>(count);
+    return taken;
+}
+
+int ClusterReservation::getRefillCount(size_t goalGroup) const {
+    // Sized in bytes, so large clusters do not hold a large part of a small image
+    int refill = max(RESERVATION_BYTES / vfs->getClusterSize(), 1);
+    const vector<AllocationGroup*>& groups = vfs->getAllocationGroups();
+    if (goalGroup < groups.size()) {
+        refill = min(refill, groups[goalGroup]->getFreeClusters() / RESERVATION_GROUP_SHARE);
+    }
+    return refill;
+}
+
+void ClusterReservation::release() {
+    if (getAvailable() > 0) {
+        vfs->unreserveClusters(vector<int32_t>(clusters.begin() + static_cast<long>(next), clusters.end()));
+    }
+    discard();
+}
+
+void ClusterReservation::discard() {
+    clusters.clear();
+    next = 0;
+}
+
+size_t ClusterReservation::getAvailable() const {
+    return clusters.size() - next;
+}
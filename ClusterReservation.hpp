@@ -0,0 +1,67 @@
+#ifndef SEMESTRALNIPRACE_CLUSTERRESERVATION_HPP
+#define SEMESTRALNIPRACE_CLUSTERRESERVATION_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+using std::vector;
+
+class VirtualFileSystem;
+
+/**
+ * Pool of data clusters reserved for one session. A contiguous run of free clusters is reserved
+ * in the bitmap in one step ( marked BITMAP_RESERVED in memory only ), then handed out without
+ * any locking. Clusters which were not used are returned to the bitmap by release().
+ */
+class ClusterReservation {
+public:
+
+    /**
+     * Constructor for cluster reservation
+     * @param vfs - virtual file system the clusters are reserved in
+     */
+    explicit ClusterReservation(VirtualFileSystem* vfs);
+
+    ClusterReservation(const ClusterReservation&) = delete;
+    ClusterReservation& operator=(const ClusterReservation&) = delete;
+
+    /**
+     * Takes clusters from the pool, the pool is refilled from the allocation group of the goal i-node if needed
+     * @param count - number of clusters to take
+     * @param goalInode - i-node the clusters should be placed near to
+     * @return taken clusters ( still marked as reserved until they are written to the bitmap ) or empty vector
+     */
+    vector<int32_t> take(int count, int32_t goalInode);
+
+    /**
+     * Returns all clusters which were not taken back to the bitmap
+     */
+    void release();
+
+    /**
+     * Forgets all clusters without touching the bitmap ( the bitmap was thrown away, e.g. by format )
+     */
+    void discard();
+
+    /**
+     * Gets the number of clusters which may be taken without refilling the pool
+     * @return number of available clusters
+     */
+    size_t getAvailable() const;
+
+private:
+    VirtualFileSystem* vfs;
+    vector<int32_t> clusters;
+    size_t next;
+    size_t group;
+
+    /**
+     * Gets the number of clusters reserved at least when the pool is refilled
+     * @param goalGroup - allocation group the clusters are reserved in
+     * @return RESERVATION_BYTES worth of clusters, limited to a share of the free clusters of the group
+     */
+    int getRefillCount(size_t goalGroup) const;
+};
+
+#endif //SEMESTRALNIPRACE_CLUSTERRESERVATION_HPP
@@ -1,9 +1,16 @@
 #include <iostream>
 #include <vector>
 #include <cstring>
+#include <sstream>
+#include <thread>
+#include <algorithm>
 #include "Utils.hpp"
 #include "CommandProcessor.hpp"
 #include "VirtualFileSystem.hpp"
+#include "SubtreeExporter.hpp"
+#include "Crc32c.hpp"
+#include "ConsistencyChecker.hpp"
+#include "SpaceAnalyzer.hpp"
 
 using std::string;
 using std::vector;
@@ -12,25 +19,40 @@ using std::memset;
 using std::ifstream;
 using std::ofstream;
 using std::getline;
-
-
-CommandProcessor::CommandProcessor(VirtualFileSystem* vfs) : vfs(vfs) {
-    commandMap[HELP_COMMAND]        = [this](const string& args)    { this->processHelp(splitString(args));     }; // help         --    Display this helpful text
-    commandMap[CP_COMMAND]          = [this](const string& args)    { this->processCp(splitString(args));       }; // cp s1 s2     --    Copy file from path s1 to path s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
-    commandMap[MV_COMMAND]          = [this](const string& args)    { this->processMv(splitString(args));       }; // mv s1 s2     --    Move or rename file from path s1 to path s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
-    commandMap[RM_COMMAND]          = [this](const string& args)    { this->processRm(splitString(args));       }; // rm s1        --    Delete file s1. Possible results: OK, FILE NOT FOUND
-    commandMap[MKDIR_COMMAND]       = [this](const string& args)    { this->processMkdir(splitString(args));    }; // mkdir a1     --    Create directory a1. Possible results: OK, PATH NOT FOUND, EXIST
-    commandMap[RMDIR_COMMAND]       = [this](const string& args)    { this->processRmdir(splitString(args));    }; // rmdir a1     --    Delete empty directory a1. Possible results: OK, FILE NOT FOUND, NOT EMPTY
-    commandMap[LS_COMMAND]          = [this](const string& args)    { this->processLs(splitString(args));       }; // ls a1        --    List contents of directory a1 or current directory if a1 is omitted. Possible results: -FILE, +DIRECTORY, PATH NOT FOUND
-    commandMap[CAT_COMMAND]         = [this](const string& args)    { this->processCat(splitString(args));      }; // cat s1       --    Display contents of file s1. Possible results: CONTENT, FILE NOT FOUND
-    commandMap[CD_COMMAND]          = [this](const string& args)    { this->processCd(splitString(args));       }; // cd a1        --    Change current path to directory a1. Possible results: OK, PATH NOT FOUND
-    commandMap[PWD_COMMAND]         = [this](const string& args)    { this->processPwd(splitString(args));      }; // pwd          --    Display current path. Possible results: PATH
-    commandMap[INFO_COMMAND]        = [this](const string& args)    { this->processInfo(splitString(args));     }; // info s1/a1   --    Display information about file/directory s1/a1 (i-node number, direct and indirect links). Possible results: NAME – SIZE – i-node NUMBER, FILE NOT FOUND
-    commandMap[INCP_COMMAND]        = [this](const string& args)    { this->processIncp(splitString(args));     }; // incp s1 s2   --    Upload file s1 from hard disk to path s2 in your FS. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
-    commandMap[OUTCP_COMMAND]       = [this](const string& args)    { this->processOutcp(splitString(args));    }; // outcp s1 s2  --    Upload file s1 from your FS to path s2 on hard disk. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
-    commandMap[LOAD_COMMAND]        = [this](const string& args)    { this->processLoad(splitString(args));     }; // load s1      --    Execute commands from file s1 on hard disk, one command per line. Possible results: OK, FILE NOT FOUND
-    commandMap[FORMAT_COMMAND]      = [this](const string& args)    { this->processFormat(splitString(args));   }; // format size  --    Format the file system to the specified size (1K, 1M, 1G). If the file already contains data, it will be overwritten. Possible results: OK, CANNOT CREATE FILE
-    commandMap[HARDLINK_COMMAND]    = [this](const string& args)    { this->processLn(splitString(args));       }; // ln s1 s2     --    Create a hard link to the file s1 named s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+using std::stringstream;
+using std::thread;
+using std::max;
+
+
+CommandProcessor::CommandProcessor(VirtualFileSystem* vfs) : vfs(vfs), api(vfs), session(api.getSession()) {
+    commandMap[HELP_COMMAND]        = [this](const string& args)    { this->processHelp(splitString(args));     }; // help                            --    Display this helpful text
+    commandMap[CP_COMMAND]          = [this](const string& args)    { this->processCp(splitString(args));       }; // cp [-c] s1 s2                   --    Copy file from path s1 to path s2, -c stores the copy compressed. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+    commandMap[MV_COMMAND]          = [this](const string& args)    { this->processMv(splitString(args));       }; // mv s1 s2                        --    Move or rename file from path s1 to path s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+    commandMap[RM_COMMAND]          = [this](const string& args)    { this->processRm(splitString(args));       }; // rm s1                           --    Delete file s1. Possible results: OK, FILE NOT FOUND
+    commandMap[MKDIR_COMMAND]       = [this](const string& args)    { this->processMkdir(splitString(args));    }; // mkdir a1                        --    Create directory a1. Possible results: OK, PATH NOT FOUND, EXIST
+    commandMap[RMDIR_COMMAND]       = [this](const string& args)    { this->processRmdir(splitString(args));    }; // rmdir a1                        --    Delete empty directory a1. Possible results: OK, FILE NOT FOUND, NOT EMPTY
+    commandMap[LS_COMMAND]          = [this](const string& args)    { this->processLs(splitString(args));       }; // ls a1                           --    List contents of directory a1 or current directory if a1 is omitted. Possible results: -FILE, +DIRECTORY, PATH NOT FOUND
+    commandMap[CAT_COMMAND]         = [this](const string& args)    { this->processCat(splitString(args));      }; // cat s1                          --    Display contents of file s1. Possible results: CONTENT, FILE NOT FOUND
+    commandMap[CD_COMMAND]          = [this](const string& args)    { this->processCd(splitString(args));       }; // cd a1                           --    Change current path to directory a1. Possible results: OK, PATH NOT FOUND
+    commandMap[PWD_COMMAND]         = [this](const string& args)    { this->processPwd(splitString(args));      }; // pwd                             --    Display current path. Possible results: PATH
+    commandMap[INFO_COMMAND]        = [this](const string& args)    { this->processInfo(splitString(args));     }; // info s1/a1                      --    Display information about file/directory s1/a1 (i-node number, direct and indirect links). Possible results: NAME – SIZE – i-node NUMBER, FILE NOT FOUND
+    commandMap[INCP_COMMAND]        = [this](const string& args)    { this->processIncp(splitString(args));     }; // incp [-c] s1 s2                 --    Upload file s1 from hard disk to path s2 in your FS, -c stores the file compressed. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+    commandMap[OUTCP_COMMAND]       = [this](const string& args)    { this->processOutcp(splitString(args));    }; // outcp [-r] s1 s2                --    Upload file (or directory with -r) s1 from your FS to path s2 on hard disk. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+    commandMap[LOAD_COMMAND]        = [this](const string& args)    { this->processLoad(splitString(args));     }; // load s1                         --    Execute commands from file s1 on hard disk, one command per line. Possible results: OK, FILE NOT FOUND
+    commandMap[FORMAT_COMMAND]      = [this](const string& args)    { this->processFormat(splitString(args));   }; // format [-c] [-d] size [cluster] --    Format the file system to the specified size (1K, 1M, 1G) with the optional cluster size (power of two from 1K to 1M, default 4K), -c compresses all new files in units of 64K but at least 16 clusters, -d shares equal clusters as they are written. If the file already contains data, it will be overwritten. Possible results: OK, CANNOT CREATE FILE
+    commandMap[HARDLINK_COMMAND]    = [this](const string& args)    { this->processLn(splitString(args));       }; // ln s1 s2                        --    Create a hard link to the file s1 named s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+    commandMap[DEDUP_COMMAND]       = [this](const string& args)    { this->processDedup(splitString(args));    }; // dedup                           --    Share equal data clusters of all files and report the reclaimed space. Possible results: REPORT, NOT SUPPORTED
+    commandMap[CHECKSUM_COMMAND]    = [this](const string& args)    { this->processChecksum(splitString(args)); }; // checksum [m]                    --    Display the checksum verification and the number of mismatches found, or set it to off, warn or strict. Possible results: MODE, NOT SUPPORTED
+    commandMap[FSCK_COMMAND]        = [this](const string& args)    { this->processFsck(splitString(args));     }; // fsck [-r]                       --    Check that the bitmap, block maps, link counts and directory entries agree, -r repairs the problems found. Possible results: REPORT, OK, NOT CONSISTENT
+    commandMap[DEFRAG_COMMAND]      = [this](const string& args)    { this->processDefrag(splitString(args));   }; // defrag [p]                      --    Move the clusters of the file p, or of all files under the directory p ( whole file system if p is omitted ), into contiguous runs and report the fragments before and after; -b rate [p] runs in the background copying at most rate bytes per second, status and stop control it. Possible results: REPORT, OK, ITEM NOT FOUND
+    commandMap[FSSTAT_COMMAND]      = [this](const string& args)    { this->processFsstat(splitString(args));   }; // fsstat [-j]                     --    Display the space usage and fragmentation: free extent histogram, largest free run, fragments per file, block map overhead and i-node usage, -j prints one JSON object. Possible results: REPORT
+    commandMap[ERASE_COMMAND]       = [this](const string& args)    { this->processErase(splitString(args));    }; // erase [m]                       --    Display how the content of freed clusters is dropped, or set it to discard ( holes punched in the image, only metadata is written ) or secure ( overwritten with zeros and synced ). Possible results: MODE
+    commandMap[READ_COMMAND]        = [this](const string& args)    { this->processRead(splitString(args));     }; // read s1 o n                     --    Display n bytes of the file s1 starting at the byte offset o ( sizes like 4K are accepted ), bytes past the end of the file are not displayed. Possible results: CONTENT, FILE NOT FOUND
+    commandMap[WRITE_COMMAND]       = [this](const string& args)    { this->processWrite(splitString(args));    }; // write s1 o t                    --    Write the text t into the file s1 at the byte offset o in place, the file is created if it does not exist and grows as needed, clusters shared with other files are copied first. Possible results: BYTES WRITTEN, PATH NOT FOUND
+    commandMap[TRUNCATE_COMMAND]    = [this](const string& args)    { this->processTruncate(splitString(args)); }; // truncate s1 n                   --    Shrink or extend the file s1 to n bytes, the extended part reads as zeros. Possible results: OK, FILE NOT FOUND
+    commandMap[APPEND_COMMAND]      = [this](const string& args)    { this->processAppend(splitString(args));   }; // append s1 t                     --    Append the text t to the end of the file s1, the file is created if it does not exist. The data is buffered and written with one allocation of contiguous clusters before the next other command. Possible results: BYTES APPENDED, PATH NOT FOUND
+    commandMap[FALLOCATE_COMMAND]   = [this](const string& args)    { this->processFallocate(splitString(args)); }; // fallocate s1 n                  --    Preallocate n bytes of the file s1 as one contiguous run of clusters without writing them ( they read as zeros ), the file is created if it does not exist and grows to n bytes if it is smaller. Possible results: OK, PATH NOT FOUND
+    commandMap[SCRUB_COMMAND]       = [this](const string& args)    { this->processScrub(splitString(args));    }; // scrub [a]                       --    Start the background scrub of the used data clusters ( start [rate], rate in bytes per second like 16M ), stop it or display its progress and the clusters found unreadable, with a wrong checksum, orphaned or miscounted. Possible results: OK, STATUS
 
     // Limited functionality commands
     registerLimitedFunctionalityCommand(HELP_COMMAND);
@@ -38,15 +60,55 @@ CommandProcessor::CommandProcessor(VirtualFileSystem* vfs) : vfs(vfs) {
     registerLimitedFunctionalityCommand(LOAD_COMMAND);
     registerLimitedFunctionalityCommand(FORMAT_COMMAND);
 
+    // Commands which only read the VFS may run concurrently, others are exclusive
+    registerCommandLock(HELP_COMMAND, CommandLock::SHARED);
+    registerCommandLock(CD_COMMAND, CommandLock::SHARED);
+    registerCommandLock(PWD_COMMAND, CommandLock::SHARED);
+    registerCommandLock(INFO_COMMAND, CommandLock::SHARED);
+    registerCommandLock(CHECKSUM_COMMAND, CommandLock::SHARED);
+    registerCommandLock(FSSTAT_COMMAND, CommandLock::SHARED);
+    registerCommandLock(ERASE_COMMAND, CommandLock::SHARED);
+    registerCommandLock(LOAD_COMMAND, CommandLock::NONE); // Every loaded command takes its own lock
+    registerCommandLock(SCRUB_COMMAND, CommandLock::NONE); // Stopping waits for the scrub thread, which needs the shared lock
+    registerCommandLock(DEFRAG_COMMAND, CommandLock::NONE); // Likewise for the background defragmentation
+
+    // Commands served by the library API, every call takes the lock it needs
+    registerCommandLock(MV_COMMAND, CommandLock::NONE);
+    registerCommandLock(RM_COMMAND, CommandLock::NONE);
+    registerCommandLock(MKDIR_COMMAND, CommandLock::NONE);
+    registerCommandLock(RMDIR_COMMAND, CommandLock::NONE);
+    registerCommandLock(LS_COMMAND, CommandLock::NONE);
+    registerCommandLock(HARDLINK_COMMAND, CommandLock::NONE);
+    registerCommandLock(READ_COMMAND, CommandLock::NONE);
+    registerCommandLock(WRITE_COMMAND, CommandLock::NONE);
+    registerCommandLock(TRUNCATE_COMMAND, CommandLock::NONE);
+    registerCommandLock(APPEND_COMMAND, CommandLock::NONE);
+    registerCommandLock(FALLOCATE_COMMAND, CommandLock::NONE);
+    registerCommandLock(CP_COMMAND, CommandLock::NONE);
+    registerCommandLock(CAT_COMMAND, CommandLock::NONE);
+    registerCommandLock(INCP_COMMAND, CommandLock::NONE);
+    registerCommandLock(OUTCP_COMMAND, CommandLock::NONE);
+
     if (!vfs->getIsFormatted()) {
         log(PLEASE_FORMAT_VFS_TEXT);
     }
 }
 
+CommandProcessor::~CommandProcessor() = default;
+
 void CommandProcessor::registerLimitedFunctionalityCommand(const string& command) {
     limitedFunctionalityCommands.insert(command);
 }
 
+void CommandProcessor::registerCommandLock(const string& command, CommandLock lock) {
+    commandLocks[command] = lock;
+}
+
+CommandLock CommandProcessor::getCommandLock(const string& command) const {
+    auto it = commandLocks.find(command);
+    return it != commandLocks.end() ? it->second : CommandLock::EXCLUSIVE;
+}
+
 
 bool CommandProcessor::isCommandAvailableInLimitedMode(const string& command) const {
     return limitedFunctionalityCommands.find(command) != limitedFunctionalityCommands.end();
@@ -58,23 +120,36 @@ void CommandProcessor::processHelp(const vector<string>& args) {
         log("<===========================================================================================================================================================================>");
         log("                                                                             Available commands");
         log("<===========================================================================================================================================================================>");
-        log("help          --    Display this helpful text");
-        log("exit/quit     --    Well, goodbye");
-        log("cp s1 s2      --    Copy file from path s1 to path s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND");
-        log("mv s1 s2      --    Move or rename file from path s1 to path s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND");
-        log("rm s1         --    Delete file s1. Possible results: OK, FILE NOT FOUND");
-        log("mkdir a1      --    Create directory a1. Possible results: OK, PATH NOT FOUND, EXIST");
-        log("rmdir a1      --    Delete empty directory a1. Possible results: OK, FILE NOT FOUND, NOT EMPTY");
-        log("ls a1         --    List contents of directory a1 or current directory if a1 is omitted. Possible results: -FILE, +DIRECTORY, PATH NOT FOUND");
-        log("cat s1        --    Display contents of file s1. Possible results: CONTENT, FILE NOT FOUND");
-        log("cd a1         --    Change current path to directory a1. Possible results: OK, PATH NOT FOUND");
-        log("pwd           --    Display current path. Possible results: PATH");
-        log("info s1/a1    --    Display information about file/directory s1/a1 (i-node number, direct and indirect links). Possible results: NAME – SIZE – i-node NUMBER, FILE NOT FOUND");
-        log("incp s1 s2    --    Upload file s1 from hard disk to path s2 in your FS. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND");
-        log("outcp s1 s2   --    Upload file s1 from your FS to path s2 on hard disk. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND");
-        log("load s1       --    Execute commands from file s1 on hard disk, one command per line. Possible results: OK, FILE NOT FOUND");
-        log("format size   --    Format the file system to the specified size (1K, 1M, 1G). If the file already contains data, it will be overwritten. Possible results: OK, CANNOT CREATE FILE");
-        log("ln s1 s2      --    Create a hard link to the file s1 named s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND");
+        log("help                            --    Display this helpful text");
+        log("exit/quit                       --    Well, goodbye");
+        log("cp [-c] s1 s2                   --    Copy file from path s1 to path s2, -c stores the copy compressed. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND");
+        log("mv s1 s2                        --    Move or rename file from path s1 to path s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND");
+        log("rm s1                           --    Delete file s1. Possible results: OK, FILE NOT FOUND");
+        log("mkdir a1                        --    Create directory a1. Possible results: OK, PATH NOT FOUND, EXIST");
+        log("rmdir a1                        --    Delete empty directory a1. Possible results: OK, FILE NOT FOUND, NOT EMPTY");
+        log("ls a1                           --    List contents of directory a1 or current directory if a1 is omitted. Possible results: -FILE, +DIRECTORY, PATH NOT FOUND");
+        log("cat s1                          --    Display contents of file s1. Possible results: CONTENT, FILE NOT FOUND");
+        log("cd a1                           --    Change current path to directory a1. Possible results: OK, PATH NOT FOUND");
+        log("pwd                             --    Display current path. Possible results: PATH");
+        log("info s1/a1                      --    Display information about file/directory s1/a1 (i-node number, direct and indirect links). Possible results: NAME – SIZE – i-node NUMBER, FILE NOT FOUND");
+        log("incp [-c] s1 s2                 --    Upload file s1 from hard disk to path s2 in your FS, -c stores the file compressed. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND");
+        log("outcp s1 s2                     --    Upload file s1 from your FS to path s2 on hard disk. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND");
+        log("outcp -r a1 a2                  --    Upload directory a1 with all its content from your FS to directory a2 on hard disk in parallel. Possible results: OK, PATH NOT FOUND");
+        log("load s1                         --    Execute commands from file s1 on hard disk, one command per line. Possible results: OK, FILE NOT FOUND");
+        log("format [-c] [-d] size [cluster] --    Format the file system to the specified size (1K, 1M, 1G) with the optional cluster size (power of two from 1K to 1M, default 4K), -c compresses all new files in units of 64K but at least 16 clusters, -d shares equal clusters as they are written. If the file already contains data, it will be overwritten. Possible results: OK, CANNOT CREATE FILE");
+        log("ln s1 s2                        --    Create a hard link to the file s1 named s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND");
+        log("dedup                           --    Share equal data clusters of all files and report the reclaimed space. Possible results: REPORT, NOT SUPPORTED");
+        log("checksum [m]                    --    Display the checksum verification and the number of mismatches found, or set it to off, warn or strict. Possible results: MODE, NOT SUPPORTED");
+        log("fsck [-r]                       --    Check that the bitmap, block maps, link counts and directory entries agree, -r repairs the problems found. Possible results: REPORT, OK, NOT CONSISTENT");
+        log("defrag [p]                      --    Move the clusters of the file p, or of all files under the directory p ( whole file system if p is omitted ), into contiguous runs and report the fragments before and after; -b rate [p] runs in the background copying at most rate bytes per second, status and stop control it. Possible results: REPORT, OK, ITEM NOT FOUND");
+        log("fsstat [-j]                     --    Display the space usage and fragmentation: free extent histogram, largest free run, fragments per file, block map overhead and i-node usage, -j prints one JSON object. Possible results: REPORT");
+        log("erase [m]                       --    Display how the content of freed clusters is dropped, or set it to discard ( holes punched in the image, only metadata is written ) or secure ( overwritten with zeros and synced ). Possible results: MODE");
+        log("read s1 o n                     --    Display n bytes of the file s1 starting at the byte offset o ( sizes like 4K are accepted ), bytes past the end of the file are not displayed. Possible results: CONTENT, FILE NOT FOUND");
+        log("write s1 o t                    --    Write the text t into the file s1 at the byte offset o in place, the file is created if it does not exist and grows as needed, clusters shared with other files are copied first. Possible results: BYTES WRITTEN, PATH NOT FOUND");
+        log("truncate s1 n                   --    Shrink or extend the file s1 to n bytes, the extended part reads as zeros. Possible results: OK, FILE NOT FOUND");
+        log("append s1 t                     --    Append the text t to the end of the file s1, the file is created if it does not exist. The data is buffered and written with one allocation of contiguous clusters before the next other command. Possible results: BYTES APPENDED, PATH NOT FOUND");
+        log("fallocate s1 n                  --    Preallocate n bytes of the file s1 as one contiguous run of clusters without writing them ( they read as zeros ), the file is created if it does not exist and grows to n bytes if it is smaller. Possible results: OK, PATH NOT FOUND");
+        log("scrub [a]                       --    Start the background scrub of the used data clusters ( start [rate], rate in bytes per second like 16M ), stop it or display its progress and the clusters found unreadable, with a wrong checksum, orphaned or miscounted. Possible results: OK, STATUS");
         log("<===========================================================================================================================================================================>");
         log("");
     } else {
@@ -82,11 +157,11 @@ void CommandProcessor::processHelp(const vector<string>& args) {
         log("<===========================================================================================================================================================================>");
         log("                                                                     Limited Mode Available commands");
         log("<===========================================================================================================================================================================>");
-        log("help          --    Display this helpful text");
-        log("exit/quit     --    Well, goodbye");
-        log("pwd           --    Display current path. Possible results: PATH");
-        log("load s1       --    Execute commands from file s1 on hard disk, one command per line. Possible results: OK, FILE NOT FOUND");
-        log("format size   --    Format the file system to the specified size (1K, 1M, 1G). If the file already contains data, it will be overwritten. Possible results: OK, CANNOT CREATE FILE");
+        log("help                            --    Display this helpful text");
+        log("exit/quit                       --    Well, goodbye");
+        log("pwd                             --    Display current path. Possible results: PATH");
+        log("load s1                         --    Execute commands from file s1 on hard disk, one command per line. Possible results: OK, FILE NOT FOUND");
+        log("format [-c] [-d] size [cluster] --    Format the file system to the specified size (1K, 1M, 1G) with the optional cluster size (power of two from 1K to 1M, default 4K), -c compresses all new files in units of 64K but at least 16 clusters, -d shares equal clusters as they are written. If the file already contains data, it will be overwritten. Possible results: OK, CANNOT CREATE FILE");
         log("<===========================================================================================================================================================================>");
         log("Use 'format' command to create VFS necessaries and leave limited mode.");
         log("");
@@ -95,90 +170,57 @@ void CommandProcessor::processHelp(const vector<string>& args) {
 
 
 void CommandProcessor::processCp(const vector<string>& args) {
-    if (args.size() != 2) {
+    bool compress = args.size() == 3 && args[0] == COMPRESS_FLAG;
+    if (args.size() != (compress ? 3U : 2U)) {
         log(WRONG_NUMBER_OF_ARGS_TEXT);
         return;
     }
 
-    const string& srcPath = args[0];
-    const string& destPath = args[1];
-
-    string srcDirPath = getDirPath(srcPath);
-    string srcFileName = getFileName(srcPath);
-
-    string destDirPath = getDirPath(destPath);
-    string destFileName = getFileName(destPath);
+    const string& srcPath = args[compress ? 1 : 0];
+    const string& destPath = args[compress ? 2 : 1];
 
-    if (destFileName.empty()) {
-        destFileName = srcFileName;
-    }
-
-    Directory* srcDir = vfs->findDirectory(srcDirPath);
-    if (!srcDir) {
-        log(SOURCE_DIR_NOT_FOUND_TEXT);
+    VfsResult<VfsStat> source = api.lookup(srcPath);
+    if (!source.ok() || source.value.isDirectory) {
+        log(source.status == VfsStatus::PATH_NOT_FOUND ? SOURCE_DIR_NOT_FOUND_TEXT : SOURCE_FILE_NOT_FOUND_TEXT);
         return;
     }
 
-    DirectoryItem* srcItem = findItem(srcDir->getFile(), srcFileName.c_str());
-    if (!srcItem) {
-        log(SOURCE_FILE_NOT_FOUND_TEXT);
+    // A destination ending with a slash keeps the name of the source
+    string target = getFileName(destPath).empty() ? destPath + getFileName(srcPath) : destPath;
+    VfsResult<VfsStat> existing = api.lookup(target);
+    if (existing.ok()) {
+        log(FILE_ALREADY_EXISTS_IN_DESTINATION_DIR_TEXT);
         return;
     }
-
-    Directory* destDir = vfs->findDirectory(destDirPath);
-    if (!destDir) {
+    if (existing.status == VfsStatus::PATH_NOT_FOUND) {
         log(DESTINATION_DIR_NOT_FOUND_TEXT);
         return;
     }
 
-    if (findItem(destDir->getFile(), destFileName.c_str())) {
-        log(FILE_ALREADY_EXISTS_IN_DESTINATION_DIR_TEXT);
-        return;
-    }
-
-    int blockCount, rest;
-    vector<int32_t> sourceBlocks = vfs->getDataBlocks(srcItem->getInode(), &blockCount, &rest);
-
-    int realBlockCount = vfs->getBlockCountWithIndirect(blockCount);
-
-    vector<int32_t> freeBlocks = vfs->findFreeDataBlocks(realBlockCount);
-    if (freeBlocks.empty()) {
-        log(NOT_ENOUGH_SPACE_BLOCKS_TEXT);
+    // The copy is created empty and written chunk by chunk at its end, a compressed source gives a compressed copy
+    bool compressed = compress || source.value.isCompressed;
+    VfsResult<int64_t> written = api.write(target, 0, nullptr, 0, compressed);
+    if (!written.ok()) {
+        logStatus(written.status);
         return;
     }
+    int64_t offset = 0;
+    VfsStatus read = readFile(srcPath, source.value.size, [&](const char* data, size_t length) {
+        written = api.write(target, offset, data, static_cast<int64_t>(length), compressed);
+        offset += static_cast<int64_t>(length);
+        return written.ok();
+    });
 
-    int32_t freeInode = vfs->findFreeInode();
-    if (freeInode == ERROR_CODE) {
-        log(NO_FREE_INODES_TEXT);
+    if (read == VfsStatus::OK) {
+        log(FILE_COPIED_SECCESSFULLY_TEXT);
         return;
     }
-
-    int lastBlockIndex = vfs->initializeInode(freeInode, vfs->getInodes()[srcItem->getInode()].getFileSize(), blockCount, freeBlocks);
-    DirectoryItem* newItem = new DirectoryItem(freeInode, destFileName.c_str());
-    destDir->addFile(newItem);
-
-    vfs->updateBitmapInFile(newItem, 1, freeBlocks);
-    vfs->writeInodeToVfs(freeInode);
-    vfs->updateSizesInFile(destDir, vfs->getInodes()[newItem->getInode()].getFileSize());
-    vfs->updateDirectoryInFile(destDir, newItem, true);
-
-    char buffer[CLUSTER_SIZE];
-    for (int i = 0; i < blockCount - 1; i++) {
-        vfs->seekDataCluster(sourceBlocks[i]);
-        vfs->readFromFile<char>(buffer, CLUSTER_SIZE);
-        vfs->seekDataCluster(freeBlocks[i]);
-        vfs->writeToFile<char>(buffer, CLUSTER_SIZE);
-        vfs->flushVfs();
+    api.remove(target);     // No partial copy is left behind
+    if (!written.ok()) {
+        logStatus(written.status);
+    } else {
+        log(FILE_DATA_NOT_COPIED_TEXT);
     }
-
-    memset(buffer, 0, CLUSTER_SIZE);
-    int lastBlockSize = (rest == 0) ? CLUSTER_SIZE : rest;
-    vfs->seekDataCluster(sourceBlocks.back());
-    vfs->readFromFile<char>(buffer, lastBlockSize);
-    vfs->seekDataCluster(freeBlocks[lastBlockIndex]);
-    vfs->writeToFile<char>(buffer, lastBlockSize);
-
-    log(FILE_COPIED_SECCESSFULLY_TEXT);
 }
 
 
@@ -188,73 +230,7 @@ void CommandProcessor::processMv(const vector<string>& args) {
         return;
     }
 
-    const string& srcPath = args[0];
-    const string& destPath = args[1];
-
-    string srcDirPath = getDirPath(srcPath);
-    string srcFileName = getFileName(srcPath);
-
-    string destDirPath = getDirPath(destPath);
-    string destFileName = getFileName(destPath);
-
-    if (destFileName.empty()) {
-        destFileName = srcFileName;
-    }
-
-    Directory* srcDir = vfs->findDirectory(srcDirPath);
-    if (!srcDir) {
-        log(SOURCE_DIR_NOT_FOUND_TEXT);
-        return;
-    }
-
-    Directory* destDir = vfs->findDirectory(destDirPath);
-    if (!destDir) {
-        log(DESTINATION_DIR_NOT_FOUND_TEXT);
-        return;
-    }
-
-    DirectoryItem* srcItem = findItem(srcDir->getFile(), srcFileName.c_str());
-    if (!srcItem) {
-        log(SOURCE_FILE_NOT_FOUND_TEXT);
-        return;
-    }
-
-    if (findItem(destDir->getFile(), destFileName.c_str())) {
-        log(FILE_ALREADY_EXISTS_IN_DESTINATION_DIR_TEXT);
-        return;
-    }
-
-    DirectoryItem* item = srcDir->getFile();
-    DirectoryItem** prevItem = &srcDir->getFile();
-    bool removed = false;
-    while (item != nullptr) {
-        if (item->getItemName() == srcFileName) {
-            *prevItem = item->getNext();
-            vfs->updateSizesInFile(srcDir, -vfs->getInodes()[item->getInode()].getFileSize());
-            vfs->updateDirectoryInFile(srcDir, item, false);
-            removed = true;
-            break;
-        }
-        prevItem =  &(item->getNextRef());
-        item = item->getNext();
-    }
-
-    if (!removed) {
-        log(SOURCE_FILE_NOT_FOUND_TEXT);
-        return;
-    }
-
-    DirectoryItem** newItem = &(destDir->getFile());
-    while (*newItem != nullptr) {
-        newItem = &(*newItem)->getNextRef();
-    }
-
-    *newItem = item;
-
-    vfs->updateSizesInFile(destDir, vfs->getInodes()[item->getInode()].getFileSize());
-    vfs->updateDirectoryInFile(destDir, item, true);
-
-    log(OK_TEXT);
+    logStatus(api.move(args[0], args[1]));
 }
 
 void CommandProcessor::processRm(const vector<string>& args) {
@@ -263,26 +239,7 @@ void CommandProcessor::processRm(const vector<string>& args) {
         return;
     }
 
-    const string& filePath = args[0];
-
-    string dirPath = getDirPath(filePath);
-    string fileName = getFileName(filePath);
-
-    Directory* dir = vfs->findDirectory(dirPath);
-    if (dir == nullptr) {
-        log(DIRECTORY_NOT_FOUND_TEXT);
-        return;
-    }
-
-    DirectoryItem* item = dir->deleteFileFromDirectory(fileName);
-    if (item == nullptr) {
-        log(FILE_NOT_FOUND_TEXT);
-        return;
-    }
-
-    vfs->removeFile(dir, item);
-
-    log(OK_TEXT);
+    logStatus(api.remove(args[0]));
 }
 
 
@@ -292,66 +249,7 @@ void CommandProcessor::processMkdir(const vector<string>& args) {
         return;
     }
 
-    string parentPath;
-    const string& name = args[0];
-
-    Directory* parentDir = vfs->findDirectory(parentPath);
-    if (parentDir == nullptr) {
-        log(PARENT_DIR_NOT_EXISTS_TEXT);
-        return;
-    }
-
-    if (name.length() >= FILENAME_LENGTH) {
-        log(FIlENAME_IS_TOO_LONG_TEXT);
-        return;
-    }
-
-    if (findItem(parentDir->getSubdir(), name.c_str()) != nullptr) {
-        log(DIRECTORY_ALREADY_EXISTS_TEXT);
-        return;
-    }
-
-    // Getting free inode
-    int32_t inode_id = vfs->findFreeInode();
-    if (inode_id == ERROR_CODE) {
-        log(NOT_ENOUGH_SPACE_BLOCKS_TEXT);
-        return;
-    }
-
-    // Getting free data block
-    vector<int32_t> data_blocks = vfs->findFreeDataBlocks(1);
-    if (data_blocks.empty()) {
-        log(NOT_ENOUGH_SPACE_BLOCKS_TEXT);
-        return;
-    }
-
-    // Creating new directory and directory item
-    auto newDir = new Directory();
-    auto newDirItem = new DirectoryItem(inode_id, name.c_str());
-    newDir->setParent(parentDir);
-    newDir->setCurrent(newDirItem);
-
-    vfs->addDirectory(newDir, inode_id);
-
-    // Updating bitmap and inode
-    vfs->getDataBitmap()[data_blocks[0]] = 1;
-
-    Inode& newInode = vfs->getInodes()[inode_id];
-    newInode.setNodeId(inode_id);
-    newInode.setIsDirectory(true);
-    newInode.setReferences(1);
-    newInode.setFileSize(0);
-    newInode.setDirect(0, data_blocks[0]);
-
-    parentDir->addSubdirectory(vfs->getDirectory(inode_id)->getCurrent());
-
-    vfs->updateDirectoryInFile(parentDir, newDir->getCurrent(), true);
-
-    // Saving new directory to VFS
-    vfs->writeInodeToVfs(inode_id);
-    vfs->updateBitmapInFile(newDir->getCurrent(), true, data_blocks);
-
-    log(OK_TEXT);
+    logStatus(api.makeDirectory(args[0]));
 }
 
 void CommandProcessor::processRmdir(const vector<string>& args) {
@@ -360,54 +258,24 @@ void CommandProcessor::processRmdir(const vector<string>& args) {
         return;
     }
 
-    string parentPath;
-    const string& name = args[0];
-
-    Directory* parentDir = vfs->findDirectory(parentPath);
-    if (parentDir == nullptr) {
-        log(PARENT_DIR_NOT_EXISTS_TEXT);
-        return;
-    }
-
-    if (vfs->removeDirectory(parentDir, name)) {
-        log(OK_TEXT);
-    } else {
-        log(DIR_NOT_FOUND_OR_NOT_EMPTY_TEXT);
-    }
-
+    logStatus(api.removeDirectory(args[0]));
 }
 
 
 void CommandProcessor::processLs(const vector<string>& args) {
-    string currentPath = vfs->getCurrentPath();
-
     if (args.size() > 1) {
         log(WRONG_NUMBER_OF_ARGS_TEXT);
         return;
     }
 
-    if (args.size() == 1) {
-        currentPath = args[0];
-    }
-
-    Directory* dir = vfs->findDirectory(currentPath);
-    if (dir == nullptr) {
+    // Subdirectories are listed first
+    VfsResult<vector<VfsEntry>> entries = api.list(args.size() == 1 ? args[0] : vfs->getCurrentPath(session));
+    if (!entries.ok()) {
         log(PATH_NOT_FOUND_TEXT);
         return;
     }
-
-    // Output all subdirectories
-    DirectoryItem* subdirItem = dir->getSubdir();
-    while (subdirItem != nullptr) {
-        log("+" + string(subdirItem->getItemName()));
-        subdirItem = subdirItem->getNext();
-    }
-
-    // Output all files
-    DirectoryItem* fileItem = dir->getFile();
-    while (fileItem != nullptr) {
-        log("-" + string(fileItem->getItemName()));
-        fileItem = fileItem->getNext();
+    for (const VfsEntry& entry : entries.value) {
+        log((entry.isDirectory ? "+" : "-") + entry.name);
     }
 }
 
@@ -417,44 +285,21 @@ void CommandProcessor::processCat(const vector<string>& args) {
         return;
     }
 
-    const string& filepath = args[0];
-
-    // Parse the file path to get directory path and file name
-    string dirPath = getDirPath(filepath);
-    string fileName = getFileName(filepath);
-
-    // Find the directory
-    Directory* dir = vfs->findDirectory(dirPath);
-    if (dir == nullptr) {
-        log(DIRECTORY_NOT_FOUND_TEXT);
-        return;
-    }
-
-    // Find the file item within the directory
-    DirectoryItem* item = findItem(dir->getFile(), fileName.c_str());
-    if (item == nullptr) {
+    VfsResult<VfsStat> stat = api.lookup(args[0]);
+    if (!stat.ok() || stat.value.isDirectory) {
         log(FILE_NOT_FOUND_TEXT);
         return;
     }
 
-    int blockCount, rest;
-    vector<int32_t> blocks = vfs->getDataBlocks(item->getInode(), &blockCount, &rest);
-    char buffer[CLUSTER_SIZE];
-    memset(buffer, 0, CLUSTER_SIZE);
-
-    for (int i = 0; i < blockCount - 1; i++) {
-        memset(buffer, 0, CLUSTER_SIZE);
-        vfs->seekDataCluster(blocks[i]);
-        vfs->readFromFile<char>(buffer, CLUSTER_SIZE);
-        log(buffer, false);
+    VfsStatus status = readFile(args[0], stat.value.size, [this](const char* data, size_t length) {
+        log(string(data, length), false);
+        return true;
+    });
+    if (status == VfsStatus::OK) {
+        log("");
+    } else {
+        logStatus(status);
     }
-
-    // Handle the last block
-    int lastBlockSize = (rest == 0) ? CLUSTER_SIZE : rest;
-    memset(buffer, 0, CLUSTER_SIZE);
-    vfs->seekDataCluster(blocks.back());
-    vfs->readFromFile<char>(buffer, CLUSTER_SIZE);
-    log(buffer);
 }
 
 
@@ -464,18 +309,18 @@ void CommandProcessor::processCd(const vector<string>& args) {
         return;
     }
 
-    Directory* dir = vfs->findDirectory(args[0]);
+    Directory* dir = vfs->findDirectory(args[0], session);
     if (dir == nullptr) {
         log(PATH_NOT_FOUND_TEXT);
         return;
     }
 
-    vfs->setCurrentDir(dir);
+    session->setCurrentDir(dir);
     processPwd(args);
 }
 
 void CommandProcessor::processPwd(const vector<string>& args) {
-    log(vfs->getCurrentPath());
+    log(vfs->getCurrentPath(session));
 }
 
 void CommandProcessor::processInfo(const vector<string>& args) {
@@ -487,7 +332,7 @@ void CommandProcessor::processInfo(const vector<string>& args) {
     const string& path = args[0];
 
     if (args.empty()) {
-        vfs->printDirItemInfo(vfs->getCurrentDir()->getCurrent());
+        vfs->printDirItemInfo(session->getCurrentDir()->getCurrent());
         return;
     }
 
@@ -495,7 +340,7 @@ void CommandProcessor::processInfo(const vector<string>& args) {
     string itemName = getFileName(path);
 
     // Find directory
-    Directory* dir = vfs->findDirectory(dirPath);
+    Directory* dir = vfs->findDirectory(dirPath, session);
     if (!dir) {
         log(DIRECTORY_NOT_FOUND_WITH_NAME_TEXT + dirPath);
         return;
@@ -528,34 +373,16 @@ void CommandProcessor::processInfo(const vector<string>& args) {
 }
 
 void CommandProcessor::processIncp(const vector<string>& args) {
-    if (args.size() != 2) {
+    bool compress = args.size() == 3 && args[0] == COMPRESS_FLAG;
+    if (args.size() != (compress ? 3U : 2U)) {
         log(WRONG_NUMBER_OF_ARGS_TEXT);
         return;
     }
 
-    const string& filepath_src = args[0];
-    const string& filepath_dest = args[1];
+    const string& filepath_src = args[compress ? 1 : 0];
+    const string& filepath_dest = args[compress ? 2 : 1];
 
-    string dirPath = getDirPath(filepath_dest);
-    string fileName = getFileName(filepath_dest);
-
-    if (fileName.length() >= FILENAME_LENGTH) {
-        log(FIlENAME_IS_TOO_LONG_TEXT);
-        return;
-    }
-
-    if (fileName.length() >= FILENAME_LENGTH) {
-        log(FIlENAME_IS_TOO_LONG_TEXT);
-        return;
-    }
-
-    // Find destination directory
-    Directory* dir = vfs->findDirectory(dirPath);
-    if (dir == nullptr) {
-        log(DESTINATION_PATH_NOT_FOUND_TEXT);
-        return;
-    }
-    if (findItem(dir->getFile(), fileName.c_str()) != nullptr) {
+    if (api.lookup(filepath_dest).ok()) {
         log(FILE_ALREADY_EXISTS_TEXT);
         return;
     }
@@ -567,61 +394,44 @@ void CommandProcessor::processIncp(const vector<string>& args) {
     }
 
     src_file.seekg(0, ios::end);
-    int32_t fileSize = static_cast<int32_t>(src_file.tellg());
+    int64_t fileSize = static_cast<int64_t>(src_file.tellg());
     src_file.seekg(0, ios::beg);
 
-    int blockCount = fileSize / CLUSTER_SIZE;
-    if (fileSize % CLUSTER_SIZE != 0) blockCount++;
-
-    int realBlockCount = vfs->getBlockCountWithIndirect(blockCount);
-
-    vector<int32_t> blocks = vfs->findFreeDataBlocks(realBlockCount);
-    if (blocks.empty()) {
-        log(NOT_ENOUGH_SPACE_BLOCKS_TEXT);
-        return;
-    }
-
-    int32_t inodeId = vfs->findFreeInode();
-    if (inodeId == ERROR_CODE) {
-        log(NO_FREE_INODES_TEXT);
+    if (fileSize > vfs->getMaxFileSize()) {
+        log(FILE_IS_TOO_LARGE_TEXT);
         return;
     }
 
-    auto* newItem = new DirectoryItem(inodeId, fileName.c_str());
-    dir->addFile(newItem);
-
-    int lastBlockIndex = vfs->initializeInode(inodeId, fileSize, blockCount, blocks);
-
-    vfs->updateBitmapInFile(newItem, true, blocks);
-    vfs->writeInodeToVfs(inodeId);
-    vfs->updateDirectoryInFile(dir, newItem, true);
-    vfs->updateSizesInFile(dir, fileSize);
-
-    char buffer[CLUSTER_SIZE];
-    memset(buffer, 0, CLUSTER_SIZE);
-
-    for (int i = 0; i < blockCount - 1; i++) {
-        src_file.read(buffer, CLUSTER_SIZE);
-        vfs->seekDataCluster(blocks[i]);
-        vfs->writeToFile(buffer, CLUSTER_SIZE);
-    }
-
-    int lastBlockSize = fileSize % CLUSTER_SIZE;
-    if (lastBlockSize == 0) lastBlockSize = CLUSTER_SIZE;
-    char partBuffer[lastBlockSize];
-
-    src_file.read(partBuffer, lastBlockSize);
-    vfs->seekDataCluster(blocks[lastBlockIndex]);
-    vfs->writeToFile(partBuffer, lastBlockSize);
-
-    vfs->flushVfs();
-
-    src_file.close();
+    // The file is written chunk by chunk at its end, the first write creates it ( an empty file too )
+    vector<char> buffer(static_cast<size_t>(std::min<int64_t>(fileSize, COPY_CHUNK_BYTES)));
+    int64_t offset = 0;
+    do {
+        int64_t length = std::min(fileSize - offset, static_cast<int64_t>(buffer.size()));
+        if (!src_file.read(buffer.data(), static_cast<streamsize>(length))) {
+            api.remove(filepath_dest);
+            log(FILE_DATA_NOT_COPIED_TEXT);
+            return;
+        }
+        VfsResult<int64_t> written = api.write(filepath_dest, offset, buffer.data(), length, compress);
+        if (!written.ok()) {
+            if (offset > 0) {
+                api.remove(filepath_dest);  // No partial file is left behind
+            }
+            logStatus(written.status);
+            return;
+        }
+        offset += length;
+    } while (offset < fileSize);
 
     log(FILE_COPIED_SECCESSFULLY_TEXT);
 }
 
 void CommandProcessor::processOutcp(const vector<string>& args) {
+    if (args.size() == 3 && args[0] == RECURSIVE_FLAG) {
+        processRecursiveOutcp(args[1], args[2]);
+        return;
+    }
+
     if (args.size() != 2) {
         log(WRONG_NUMBER_OF_ARGS_TEXT);
         return;
@@ -630,18 +440,13 @@ void CommandProcessor::processOutcp(const vector<string>& args) {
     const string& vfsFilePath = args[0];
     const string& externalFilePath = args[1];
 
-    string dirPath = getDirPath(vfsFilePath);
-    string fileName = getFileName(vfsFilePath);
-
-    Directory* dir = vfs->findDirectory(dirPath);
-    if (!dir) {
-        log(DIRECTORY_NOT_FOUND_IN_VFS_TEXT + dirPath);
+    VfsResult<VfsStat> stat = api.lookup(vfsFilePath);
+    if (stat.status == VfsStatus::PATH_NOT_FOUND) {
+        log(DIRECTORY_NOT_FOUND_IN_VFS_TEXT + getDirPath(vfsFilePath));
         return;
     }
-
-    DirectoryItem* item = findItem(dir->getFile(), fileName.c_str());
-    if (!item) {
-        log(FILE_NOT_FOUND_IN_VFS_TEXT + fileName);
+    if (!stat.ok() || stat.value.isDirectory) {
+        log(FILE_NOT_FOUND_IN_VFS_TEXT + getFileName(vfsFilePath));
         return;
     }
 
@@ -652,26 +457,45 @@ void CommandProcessor::processOutcp(const vector<string>& args) {
         return;
     }
 
-    // get data blocks
-    int blockCount, rest;
-    vector<int32_t> blocks = vfs->getDataBlocks(item->getInode(), &blockCount, &rest);
-    char buffer[CLUSTER_SIZE];
+    VfsStatus status = readFile(vfsFilePath, stat.value.size, [&outputFile](const char* data, size_t length) {
+        outputFile.write(data, static_cast<streamsize>(length));
+        return static_cast<bool>(outputFile);
+    });
+    outputFile.close();
 
-    // Copying all blocks except the last one
-    for (int i = 0; i < blockCount - 1; i++) {
-        vfs->seekDataCluster(blocks[i]);
-        vfs->readFromFile<char>(buffer, CLUSTER_SIZE);
-        outputFile.write(buffer, CLUSTER_SIZE);
+    if (status != VfsStatus::OK) {
+        logStatus(status);
+        return;
     }
+    log(FILE_SUCESSFULLY_COPIED_FROM_VFS_TO_TEXT + externalFilePath);
+}
 
-    // Copying the last block
-    int lastBlockSize = (rest == 0) ? CLUSTER_SIZE : rest;
-    vfs->seekDataCluster(blocks.back());
-    vfs->readFromFile<char>(buffer, lastBlockSize);
-    outputFile.write(buffer, lastBlockSize);
+void CommandProcessor::processRecursiveOutcp(const string& vfsDirPath, const string& externalDirPath) {
+    auto lock = vfs->lockShared();     // The command is registered without a lock for the API served single files
+    Directory* dir = vfs->findDirectory(vfsDirPath, session);
+    if (!dir) {
+        log(DIRECTORY_NOT_FOUND_IN_VFS_TEXT + vfsDirPath);
+        return;
+    }
 
-    outputFile.close();
-    log(FILE_SUCESSFULLY_COPIED_FROM_VFS_TO_TEXT + externalFilePath);
+    // Export is bound by disk latency, so keep more requests in flight than there are cores
+    size_t threadCount = max<size_t>(4, 2 * thread::hardware_concurrency());
+    SubtreeExporter exporter(vfs, threadCount);
+    bool success = exporter.exportDirectory(dir, externalDirPath);
+
+    double seconds = exporter.getElapsedSeconds();
+    double megabytes = exporter.getExportedBytes() / 1000000.0;
+    stringstream ss;
+    ss << "Files: " << exporter.getExportedFiles()
+       << ", bytes: " << exporter.getExportedBytes()
+       << ", time: " << seconds << " s"
+       << ", throughput: " << (seconds > 0 ? megabytes / seconds : 0) << " MB/s";
+
+    if (!success) {
+        log(SUBTREE_EXPORT_FAILED_TEXT + intToString(exporter.getFailedItems()));
+    }
+    log(ss.str());
+    log(SUBTREE_EXPORTED_TEXT + externalDirPath);
 }
 
 void CommandProcessor::processLoad(const vector<string>& args) {
@@ -701,18 +525,43 @@ void CommandProcessor::processLoad(const vector<string>& args) {
 }
 
 void CommandProcessor::processFormat(const vector<string>& args) {
-    if (args.size() != 1) {
+    // Options come before the sizes
+    int32_t optionalFeatures = 0;
+    size_t first = 0;
+    for (; first < args.size(); first++) {
+        if (args[first] == COMPRESS_FLAG) {
+            optionalFeatures |= FEATURE_COMPRESSION;
+        } else if (args[first] == DEDUP_FLAG) {
+            optionalFeatures |= FEATURE_INLINE_DEDUP;
+        } else {
+            break;
+        }
+    }
+    vector<string> sizes(args.begin() + static_cast<long>(first), args.end());
+    if (sizes.empty() || sizes.size() > 2) {
         log(WRONG_NUMBER_OF_ARGS_TEXT);
         return;
     }
 
-    int32_t vfsSize = getSizeFromString(args[0]);
+    int64_t vfsSize = getSizeFromString(sizes[0]);
     if (vfsSize <= 0) {
         log(NUMBER_PROBABLY_IS_WRONG);
         return;
     }
 
-    if (vfs->format(vfsSize)) {
+    int32_t clusterSize = (sizes.size() == 2) ? getClusterSizeFromString(sizes[1]) : CLUSTER_SIZE;
+    if (clusterSize == ERROR_CODE) {
+        log(WRONG_CLUSTER_SIZE_TEXT);
+        return;
+    }
+
+    // Block pointers in i-nodes are 32-bit cluster numbers
+    if (vfsSize / clusterSize > INT32_MAX) {
+        log(FILE_SYSTEM_IS_TOO_LARGE_TEXT);
+        return;
+    }
+
+    if (vfs->format(vfsSize, clusterSize, optionalFeatures)) {
         log(FORMAT_SUCCESSFUL_TEXT);
     } else {
         log(FORMAT_ERROR_TEXT);
@@ -725,50 +574,399 @@ void CommandProcessor::processLn(const vector<string>& args) {
         return;
     }
 
-    const string& sourcePath = args[0];
-    string linkDir = getDirPath(args[1]), linkName = getFileName(args[1]);
+    logStatus(api.link(args[0], args[1]));
+}
 
-    // Find source directory
-    Directory* sourceDir = vfs->findDirectory(getDirPath(sourcePath));
-    if (!sourceDir) {
-        log(SOURCE_DIR_NOT_FOUND_TEXT);
+void CommandProcessor::processDedup(const vector<string>& args) {
+    if (!args.empty()) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
         return;
     }
-    DirectoryItem* sourceItem = findItem(sourceDir->getFile(), getFileName(sourcePath).c_str());
-    if (!sourceItem) {
-        log(SOURCE_FILE_NOT_FOUND_TEXT);
+    if (!vfs->getSuperblock()->hasFeature(FEATURE_DEDUP)) {
+        log(DEDUP_NOT_SUPPORTED_TEXT);
+        return;
+    }
+
+    DedupReport report = vfs->deduplicate(max(1U, thread::hardware_concurrency()));
+
+    stringstream ss;
+    ss << "Hashed clusters: " << report.hashedClusters
+       << ", shared clusters: " << report.sharedClusters
+       << ", changed files: " << report.changedFiles
+       << ", time: " << report.elapsedSeconds << " s";
+    log(ss.str());
+    log(DEDUP_FINISHED_TEXT + std::to_string(report.reclaimedBytes));
+}
+
+void CommandProcessor::processFsck(const vector<string>& args) {
+    bool repair = args.size() == 1 && args[0] == REPAIR_FLAG;
+    if (args.size() != (repair ? 1U : 0U)) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
+        return;
+    }
+
+    ConsistencyChecker checker(vfs, max(1U, thread::hardware_concurrency()));
+    FsckReport report = checker.check(repair);
+    log(report.summary());
+    log(report.isClean() ? FSCK_CLEAN_TEXT : report.repaired ? FSCK_REPAIRED_TEXT : FSCK_PROBLEMS_TEXT);
+}
+
+void CommandProcessor::processScrub(const vector<string>& args) {
+    if (args.size() > 2) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
+        return;
+    }
+    const string& action = args.empty() ? SCRUB_STATUS : args[0];
+    Scrubber* scrubber = vfs->getScrubber();
+
+    if (action == SCRUB_STOP && args.size() == 1) {
+        scrubber->stop();
+        log(SCRUB_STOPPED_TEXT);
+        return;
+    }
+
+    if (action == SCRUB_START) {
+        int64_t rateLimit = args.size() == 2 ? getSizeFromString(args[1]) : SCRUB_DEFAULT_RATE;
+        if (rateLimit <= 0) {
+            log(NUMBER_PROBABLY_IS_WRONG);
+            return;
+        }
+        auto lock = vfs->lockShared();
+        log(scrubber->start(rateLimit) ? SCRUB_STARTED_TEXT + std::to_string(rateLimit) : SCRUB_ALREADY_RUNNING_TEXT);
+        return;
+    }
+
+    if (action != SCRUB_STATUS || args.size() == 2) {
+        log(WRONG_SCRUB_ACTION_TEXT);
+        return;
+    }
+    ScrubStatus status = scrubber->getStatus();
+    if (status.state == ScrubState::IDLE) {
+        log(SCRUB_NOT_RUN_TEXT);
+        return;
+    }
+    log(status.summary());
+    for (const ScrubFinding& finding : status.findings) {
+        log(SCRUB_FINDING_TEXT + std::to_string(finding.cluster) + " ( "
+            + (finding.problem == ScrubProblem::READ_ERROR ? "read error"
+               : finding.problem == ScrubProblem::CHECKSUM_MISMATCH ? "checksum mismatch"
+               : finding.problem == ScrubProblem::ORPHANED ? "orphaned" : "miscounted") + " )");
+    }
+}
+
+void CommandProcessor::processDefrag(const vector<string>& args) {
+    Defragmenter* defragmenter = vfs->getDefragmenter();
+    if (args.size() == 1 && args[0] == DEFRAG_STOP) {
+        defragmenter->stop();
+        log(DEFRAG_STOPPED_TEXT);
+        return;
+    }
+    if (args.size() == 1 && args[0] == DEFRAG_STATUS) {
+        DefragReport report;
+        if (!defragmenter->getStatus(report)) {
+            log(DEFRAG_NOT_RUN_TEXT);
+            return;
+        }
+        log(report.running ? DEFRAG_RUNNING_TEXT : DEFRAG_FINISHED_TEXT);
+        log(report.summary());
+        return;
+    }
+
+    bool background = !args.empty() && args[0] == BACKGROUND_FLAG;
+    size_t pathIndex = background ? 2 : 0;
+    if (args.size() > pathIndex + 1 || (background && args.size() < 2)) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
+        return;
+    }
+    int64_t rateLimit = background ? getSizeFromString(args[1]) : 0;
+    if (background && rateLimit <= 0) {
+        log(NUMBER_PROBABLY_IS_WRONG);
         return;
     }
-    int32_t sourceInodeId = sourceItem->getInode();
 
-    Directory* targetDir = vfs->findDirectory(linkDir);
-    if (!targetDir) {
-        log(TARGET_DIR_NOT_FOUND_TEXT);
+    string path = args.size() > pathIndex ? args[pathIndex] : "";
+    vector<int32_t> inodeIds;
+    {
+        auto lock = vfs->lockShared();
+        if (!collectFiles(path, inodeIds)) {
+            log(ITEM_NOT_FOUND_TEXT + path);
+            return;
+        }
+    }
+
+    if (background) {
+        log(defragmenter->start(inodeIds, rateLimit) ? DEFRAG_STARTED_TEXT + std::to_string(rateLimit) : DEFRAG_ALREADY_RUNNING_TEXT);
         return;
     }
 
-    // Check if file or directory with the same name already exists
-    if (findItem(targetDir->getFile(), linkName.c_str()) || findItem(targetDir->getSubdir(), linkName.c_str())) {
-        log("A file or directory with the name '" + linkName + "' already exists."); // I'v decided not to put it in consts
+    // Files removed after they were collected are skipped by the defragmenter
+    auto lock = vfs->lockExclusive();
+    DefragReport report = defragmenter->defragment(inodeIds);
+    vfs->syncChecksums();
+    log(report.summary());
+}
+
+void CommandProcessor::processFsstat(const vector<string>& args) {
+    bool json = args.size() == 1 && args[0] == JSON_FLAG;
+    if (args.size() != (json ? 1U : 0U)) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
         return;
     }
 
-    // Initialize directory item
-    DirectoryItem* newLinkItem = createDirectoryItem(sourceInodeId, linkName.c_str());
+    SpaceAnalyzer analyzer(vfs);
+    FsStatReport report = analyzer.analyze();
+    log(json ? report.toJson() : report.summary());
+}
+
+bool CommandProcessor::collectFiles(const string& path, vector<int32_t>& inodeIds) {
+    Directory* dir = path.empty() ? vfs->getDirectory(0) : vfs->findDirectory(path, session);
+    if (dir == nullptr) {
+        Directory* parent = vfs->findDirectory(getDirPath(path), session);
+        DirectoryItem* item = parent != nullptr ? findItem(parent->getFile(), getFileName(path).c_str()) : nullptr;
+        if (item == nullptr) {
+            return false;
+        }
+        inodeIds.push_back(item->getInode());
+        return true;
+    }
+
+    // Hard links of one file are collected once
+    set<int32_t> seen;
+    vector<Directory*> pending{dir};
+    while (!pending.empty()) {
+        Directory* current = pending.back();
+        pending.pop_back();
+        for (DirectoryItem* item = current->getFile(); item != nullptr; item = item->getNext()) {
+            if (seen.insert(item->getInode()).second) {
+                inodeIds.push_back(item->getInode());
+            }
+        }
+        for (DirectoryItem* item = current->getSubdir(); item != nullptr; item = item->getNext()) {
+            Directory* subdir = vfs->getDirectory(item->getInode());
+            if (subdir != nullptr) {
+                pending.push_back(subdir);
+            }
+        }
+    }
+    return true;
+}
 
-    targetDir->addFile(newLinkItem);
+void CommandProcessor::processChecksum(const vector<string>& args) {
+    if (args.size() > 1) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
+        return;
+    }
+    if (!vfs->hasChecksums()) {
+        log(CHECKSUM_NOT_SUPPORTED_TEXT);
+        return;
+    }
 
-    Inode& inode = vfs->getInodes()[sourceItem->getInode()];
-    inode.setReferences(inode.getReferences() + 1);
+    if (args.size() == 1) {
+        if (args[0] == CHECKSUM_OFF) {
+            vfs->setVerifyMode(VerifyMode::OFF);
+        } else if (args[0] == CHECKSUM_WARN) {
+            vfs->setVerifyMode(VerifyMode::WARN);
+        } else if (args[0] == CHECKSUM_STRICT) {
+            vfs->setVerifyMode(VerifyMode::STRICT);
+        } else {
+            log(WRONG_CHECKSUM_MODE_TEXT);
+            return;
+        }
+    }
 
-    // Update inode in VFS
-    vfs->writeInodeToVfs(sourceInodeId);
+    VerifyMode mode = vfs->getVerifyMode();
+    log(CHECKSUM_MODE_TEXT + (mode == VerifyMode::OFF ? CHECKSUM_OFF : mode == VerifyMode::WARN ? CHECKSUM_WARN : CHECKSUM_STRICT)
+        + (Crc32c::isAccelerated() ? " ( SSE4.2 )" : ""));
+    log(CHECKSUM_ERRORS_TEXT + std::to_string(vfs->getChecksumErrors()));
+}
 
-    vfs->updateDirectoryInFile(targetDir, newLinkItem, true);
+void CommandProcessor::processErase(const vector<string>& args) {
+    if (args.size() > 1) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
+        return;
+    }
 
-    vfs->flushVfs();
+    if (args.size() == 1) {
+        if (args[0] == ERASE_DISCARD) {
+            vfs->setEraseMode(EraseMode::DISCARD);
+        } else if (args[0] == ERASE_SECURE) {
+            vfs->setEraseMode(EraseMode::SECURE);
+        } else {
+            log(WRONG_ERASE_MODE_TEXT);
+            return;
+        }
+    }
 
-    log(OK_TEXT);
+    if (vfs->getEraseMode() == EraseMode::SECURE) {
+        log(ERASE_MODE_TEXT + ERASE_SECURE);
+    } else {
+        log(ERASE_MODE_TEXT + ERASE_DISCARD + (vfs->canPunchHoles() ? "" : " ( zero filled, the host file system cannot punch holes )"));
+    }
+}
+
+void CommandProcessor::processRead(const vector<string>& args) {
+    if (args.size() != 3) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
+        return;
+    }
+
+    int64_t offset = getOffsetFromString(args[1]);
+    int64_t length = getOffsetFromString(args[2]);
+    if (offset == ERROR_CODE || length == ERROR_CODE) {
+        return;
+    }
+
+    VfsResult<VfsStat> stat = api.lookup(args[0]);
+    if (!stat.ok() || stat.value.isDirectory) {
+        log(FILE_NOT_FOUND_TEXT);
+        return;
+    }
+
+    // Only the bytes up to the end of the file are buffered
+    int64_t available = std::max<int64_t>(0, std::min(length, stat.value.size - offset));
+    vector<char> buffer(static_cast<size_t>(available));
+    VfsResult<int64_t> read = api.read(args[0], offset, buffer.data(), available);
+    if (!read.ok()) {
+        logStatus(read.status);
+        return;
+    }
+    log(string(buffer.data(), static_cast<size_t>(read.value)));
+}
+
+void CommandProcessor::processWrite(const vector<string>& args) {
+    if (args.size() < 3) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
+        return;
+    }
+
+    int64_t offset = getOffsetFromString(args[1]);
+    if (offset == ERROR_CODE) {
+        return;
+    }
+
+    // The text is the rest of the line, words are joined by single spaces
+    string text = args[2];
+    for (size_t i = 3; i < args.size(); i++) {
+        text += " " + args[i];
+    }
+
+    VfsResult<int64_t> written = api.write(args[0], offset, text.data(), static_cast<int64_t>(text.size()));
+    if (written.ok()) {
+        log(BYTES_WRITTEN_TEXT + std::to_string(written.value));
+    } else {
+        logStatus(written.status);
+    }
+}
+
+void CommandProcessor::processTruncate(const vector<string>& args) {
+    if (args.size() != 2) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
+        return;
+    }
+
+    int64_t size = getOffsetFromString(args[1]);
+    if (size == ERROR_CODE) {
+        return;
+    }
+
+    logStatus(api.truncate(args[0], size));
+}
+
+void CommandProcessor::processAppend(const vector<string>& args) {
+    if (args.size() < 2) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
+        return;
+    }
+
+    // The text is the rest of the line, words are joined by single spaces
+    string text = args[1];
+    for (size_t i = 2; i < args.size(); i++) {
+        text += " " + args[i];
+    }
+
+    VfsResult<int64_t> appended = api.append(args[0], text.data(), static_cast<int64_t>(text.size()));
+    if (appended.ok()) {
+        log(BYTES_APPENDED_TEXT + std::to_string(appended.value));
+    } else {
+        logStatus(appended.status);
+    }
+}
+
+void CommandProcessor::processFallocate(const vector<string>& args) {
+    if (args.size() != 2) {
+        log(WRONG_NUMBER_OF_ARGS_TEXT);
+        return;
+    }
+
+    int64_t size = getOffsetFromString(args[1]);
+    if (size == ERROR_CODE) {
+        return;
+    }
+
+    logStatus(api.fallocate(args[0], size));
+}
+
+VfsStatus CommandProcessor::readFile(const string& path, int64_t size, const function<bool(const char*, size_t)>& sink) {
+    // Every chunk is read under its own lock, so other clients of the image are not stopped for a whole large file
+    vector<char> buffer(static_cast<size_t>(std::min<int64_t>(size, COPY_CHUNK_BYTES)));
+    for (int64_t offset = 0; offset < size;) {
+        VfsResult<int64_t> read = api.read(path, offset, buffer.data(), static_cast<int64_t>(buffer.size()));
+        if (!read.ok()) {
+            return read.status;
+        }
+        if (read.value == 0) {
+            break;      // Shrunk meanwhile
+        }
+        if (!sink(buffer.data(), static_cast<size_t>(read.value))) {
+            return VfsStatus::IO_ERROR;
+        }
+        offset += read.value;
+    }
+    return VfsStatus::OK;
+}
+
+void CommandProcessor::flushAppends() {
+    if (api.flush() != VfsStatus::OK) {
+        log(APPENDS_NOT_FLUSHED_TEXT);
+    }
+}
+
+void CommandProcessor::logStatus(VfsStatus status) {
+    switch (status) {
+        case VfsStatus::OK:
+            log(OK_TEXT);
+            break;
+        case VfsStatus::NOT_FORMATTED:
+            log(PLEASE_FORMAT_VFS_TEXT);
+            break;
+        case VfsStatus::NOT_FOUND:
+            log(FILE_NOT_FOUND_TEXT);
+            break;
+        case VfsStatus::PATH_NOT_FOUND:
+            log(PATH_NOT_FOUND_TEXT);
+            break;
+        case VfsStatus::ALREADY_EXISTS:
+            log(ITEM_ALREADY_EXISTS_TEXT);
+            break;
+        case VfsStatus::NOT_EMPTY:
+            log(DIRECTORY_NOT_EMPTY_TEXT);
+            break;
+        case VfsStatus::IS_DIRECTORY:
+            log(ITEM_IS_DIRECTORY_TEXT);
+            break;
+        case VfsStatus::NAME_TOO_LONG:
+            log(FIlENAME_IS_TOO_LONG_TEXT);
+            break;
+        case VfsStatus::INVALID_ARGUMENT:
+            log(INVALID_RANGE_TEXT);
+            break;
+        case VfsStatus::NO_SPACE:
+            log(NOT_ENOUGH_SPACE_BLOCKS_TEXT);
+            break;
+        case VfsStatus::IO_ERROR:
+            log(FILE_DATA_NOT_READ_TEXT);
+            break;
+    }
 }
 
 void CommandProcessor::processCommandLine(const string& input) {
@@ -777,19 +975,40 @@ void CommandProcessor::processCommandLine(const string& input) {
     string command = input.substr(0, pos);
     string args = pos + 1 >= input.length() ? "" : input.substr(pos + 1);
 
+    // Appended data is written before any other command sees the file system, consecutive appends are batched
+    if (command != APPEND_COMMAND && vfs->hasPendingAppends()) {
+        flushAppends();
+    }
+
     if (command == EXIT_COMMAND || command == QUIT_COMMAND) {
+        vfs->getScrubber()->stop();
+        vfs->getDefragmenter()->stop();
         log(END_OF_PROGRAM_TEXT);
         exit(0);
     }
 
     auto it = commandMap.find(command);
     if (it != commandMap.end()) {
+        shared_lock<shared_mutex> sharedLock;
+        unique_lock<shared_mutex> exclusiveLock;
+        CommandLock lock = getCommandLock(command);
+        if (lock == CommandLock::SHARED) {
+            sharedLock = vfs->lockShared();
+        } else if (lock == CommandLock::EXCLUSIVE) {
+            exclusiveLock = vfs->lockExclusive();
+        }
+
         if (!vfs->getIsFormatted() && !isCommandAvailableInLimitedMode(command)) {
             log(COMMAND_IS_NOT_AVAILABLE_TEXT);
             log(PLEASE_FORMAT_VFS_TEXT);
             return;
         }
         it->second(args);
+
+        // Checksums of all clusters written by the command are written at once
+        if (exclusiveLock.owns_lock()) {
+            vfs->syncChecksums();
+        }
     } else {
         log(UNKNOWN_COMMAND_TEXT + command);
     }
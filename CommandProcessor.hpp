@@ -7,6 +7,7 @@
 #include <set>
 #include <functional>
 #include "VirtualFileSystem.hpp"
+#include "VfsApi.hpp"
 #include "Constants.hpp"
 
 using std::string;
@@ -15,31 +16,65 @@ using std::set;
 using std::unordered_map;
 using std::function;
 
+/**
+ * Lock of the virtual file system held while a command runs
+ */
+enum class CommandLock {
+    EXCLUSIVE,  // Command modifies the VFS
+    SHARED,     // Command only reads the VFS, may run together with other readers
+    NONE        // Command takes the locks itself ( e.g. load )
+};
+
+/**
+ * Parses and executes commands of one client, every command processor has its own session ( current directory ).
+ * File and directory commands are thin calls of the library API ( VfsApi ), the others use the engine directly.
+ */
 class CommandProcessor {
 public:
     /**
      * Constructor for command processor
      * Possible commands:
-     * help          --    Display this helpful text
-     * cp s1 s2      --    Copy file from path s1 to path s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
-     * mv s1 s2      --    Move or rename file from path s1 to path s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
-     * rm s1         --    Delete file s1. Possible results: OK, FILE NOT FOUND
-     * mkdir a1      --    Create directory a1. Possible results: OK, PATH NOT FOUND, EXIST
-     * rmdir a1      --    Delete empty directory a1. Possible results: OK, FILE NOT FOUND, NOT EMPTY
-     * ls a1         --    List contents of directory a1 or current directory if a1 is omitted. Possible results: -FILE, +DIRECTORY, PATH NOT FOUND
-     * cat s1        --    Display contents of file s1. Possible results: CONTENT, FILE NOT FOUND
-     * cd a1         --    Change current path to directory a1. Possible results: OK, PATH NOT FOUND
-     * pwd           --    Display current path. Possible results: PATH
-     * info s1/a1    --    Display information about file/directory s1/a1 (i-node number, direct and indirect links). Possible results: NAME – SIZE – i-node NUMBER, FILE NOT FOUND
-     * incp s1 s2    --    Upload file s1 from hard disk to path s2 in your FS. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
-     * outcp s1 s2   --    Upload file s1 from your FS to path s2 on hard disk. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
-     * load s1       --    Execute commands from file s1 on hard disk, one command per line. Possible results: OK, FILE NOT FOUND
-     * format size   --    Format the file system to the specified size (1K, 1M, 1G). If the file already contains data, it will be overwritten. Possible results: OK, CANNOT CREATE FILE
-     * ln s1 s2      --    Create a hard link to the file s1 named s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+     * help                            --    Display this helpful text
+     * cp [-c] s1 s2                   --    Copy file from path s1 to path s2, -c stores the copy compressed. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+     * mv s1 s2                        --    Move or rename file from path s1 to path s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+     * rm s1                           --    Delete file s1. Possible results: OK, FILE NOT FOUND
+     * mkdir a1                        --    Create directory a1. Possible results: OK, PATH NOT FOUND, EXIST
+     * rmdir a1                        --    Delete empty directory a1. Possible results: OK, FILE NOT FOUND, NOT EMPTY
+     * ls a1                           --    List contents of directory a1 or current directory if a1 is omitted. Possible results: -FILE, +DIRECTORY, PATH NOT FOUND
+     * cat s1                          --    Display contents of file s1. Possible results: CONTENT, FILE NOT FOUND
+     * cd a1                           --    Change current path to directory a1. Possible results: OK, PATH NOT FOUND
+     * pwd                             --    Display current path. Possible results: PATH
+     * info s1/a1                      --    Display information about file/directory s1/a1 (i-node number, direct and indirect links). Possible results: NAME – SIZE – i-node NUMBER, FILE NOT FOUND
+     * incp [-c] s1 s2                 --    Upload file s1 from hard disk to path s2 in your FS, -c stores the file compressed. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+     * outcp s1 s2                     --    Upload file s1 from your FS to path s2 on hard disk. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+     * outcp -r a1 a2                  --    Upload directory a1 with all its content from your FS to directory a2 on hard disk in parallel. Possible results: OK, PATH NOT FOUND
+     * load s1                         --    Execute commands from file s1 on hard disk, one command per line. Possible results: OK, FILE NOT FOUND
+     * format [-c] [-d] size [cluster] --    Format the file system to the specified size (1K, 1M, 1G) with the optional cluster size (power of two from 1K to 1M, default 4K), -c compresses all new files in units of 64K but at least 16 clusters, -d shares equal clusters as they are written. If the file already contains data, it will be overwritten. Possible results: OK, CANNOT CREATE FILE
+     * ln s1 s2                        --    Create a hard link to the file s1 named s2. Possible results: OK, FILE NOT FOUND, PATH NOT FOUND
+     * dedup                           --    Share equal data clusters of all files and report the reclaimed space. Possible results: REPORT, NOT SUPPORTED
+     * checksum [m]                    --    Display the checksum verification and the number of mismatches found, or set it to off, warn or strict. Possible results: MODE, NOT SUPPORTED
+     * fsck [-r]                       --    Check that the bitmap, block maps, link counts and directory entries agree, -r repairs the problems found. Possible results: REPORT, OK, NOT CONSISTENT
+     * defrag [p]                      --    Move the clusters of the file p, or of all files under the directory p ( whole file system if p is omitted ), into contiguous runs and report the fragments before and after; -b rate [p] runs in the background copying at most rate bytes per second, status and stop control it. Possible results: REPORT, OK, ITEM NOT FOUND
+     * fsstat [-j]                     --    Display the space usage and fragmentation: free extent histogram, largest free run, fragments per file, block map overhead and i-node usage, -j prints one JSON object. Possible results: REPORT
+     * erase [m]                       --    Display how the content of freed clusters is dropped, or set it to discard ( holes punched in the image, only metadata is written ) or secure ( overwritten with zeros and synced ). Possible results: MODE
+     * read s1 o n                     --    Display n bytes of the file s1 starting at the byte offset o ( sizes like 4K are accepted ), bytes past the end of the file are not displayed. Possible results: CONTENT, FILE NOT FOUND
+     * write s1 o t                    --    Write the text t into the file s1 at the byte offset o in place, the file is created if it does not exist and grows as needed, clusters shared with other files are copied first. Possible results: BYTES WRITTEN, PATH NOT FOUND
+     * truncate s1 n                   --    Shrink or extend the file s1 to n bytes, the extended part reads as zeros. Possible results: OK, FILE NOT FOUND
+     * append s1 t                     --    Append the text t to the end of the file s1, the file is created if it does not exist. The data is buffered and written with one allocation of contiguous clusters before the next other command. Possible results: BYTES APPENDED, PATH NOT FOUND
+     * fallocate s1 n                  --    Preallocate n bytes of the file s1 as one contiguous run of clusters without writing them ( they read as zeros ), the file is created if it does not exist and grows to n bytes if it is smaller. Possible results: OK, PATH NOT FOUND
+     * scrub [a]                       --    Start the background scrub of the used data clusters ( start [rate], rate in bytes per second like 16M ), stop it or display its progress and the clusters found unreadable, with a wrong checksum, orphaned or miscounted. Possible results: OK, STATUS
      * @param vfs
      */
     explicit CommandProcessor(VirtualFileSystem* vfs);
 
+    /**
+     * Destructor for command processor, its session is closed by the API
+     */
+    ~CommandProcessor();
+
+    CommandProcessor(const CommandProcessor&) = delete;
+    CommandProcessor& operator=(const CommandProcessor&) = delete;
+
     /**
      * Register command as available in limited mode
      * @param command - command to register
@@ -53,6 +88,20 @@ public:
      */
     bool isCommandAvailableInLimitedMode(const string& command) const;
 
+    /**
+     * Register lock of the VFS the command runs under ( exclusive if not registered )
+     * @param command - command to register
+     * @param lock - lock to hold while the command runs
+     */
+    void registerCommandLock(const string& command, CommandLock lock);
+
+    /**
+     * Gets lock of the VFS the command runs under
+     * @param command - command to check
+     * @return lock to hold while the command runs
+     */
+    CommandLock getCommandLock(const string& command) const;
+
     /**
      * Process command line by splitting it into command and arguments and calling appropriate method
      * @param input command line to process
@@ -61,8 +110,11 @@ public:
 
 private:
     VirtualFileSystem* vfs;
+    VfsApi api;
+    Session* session;
     unordered_map<string, function<void(const string&)>> commandMap;
     set<string> limitedFunctionalityCommands;
+    unordered_map<string, CommandLock> commandLocks;
 
     void processCp(const vector<string>& args);
     void processMv(const vector<string>& args);
@@ -76,9 +128,50 @@ private:
     void processInfo(const vector<string>& args);
     void processIncp(const vector<string>& args);
     void processOutcp(const vector<string>& args);
+    void processRecursiveOutcp(const string& vfsDirPath, const string& externalDirPath);
     void processLoad(const vector<string>& args);
     void processFormat(const vector<string>& args);
     void processLn(const vector<string>& args);
+    void processDedup(const vector<string>& args);
+    void processChecksum(const vector<string>& args);
+    void processFsck(const vector<string>& args);
+    void processScrub(const vector<string>& args);
+    void processDefrag(const vector<string>& args);
+    void processFsstat(const vector<string>& args);
+    void processErase(const vector<string>& args);
+    void processRead(const vector<string>& args);
+    void processWrite(const vector<string>& args);
+    void processTruncate(const vector<string>& args);
+    void processAppend(const vector<string>& args);
+    void processFallocate(const vector<string>& args);
+
+    /**
+     * Writes data buffered by append commands to the clusters of the files, under the exclusive lock
+     */
+    void flushAppends();
+
+    /**
+     * Logs the result of a library API call
+     * @param status - status returned by the API
+     */
+    void logStatus(VfsStatus status);
+
+    /**
+     * Reads a file through the library API chunk by chunk
+     * @param path - path of the file
+     * @param size - size of the file found by lookup
+     * @param sink - receives every chunk, returns false to stop reading
+     * @return OK, the status of the failed read or IO_ERROR if the sink stopped reading
+     */
+    VfsStatus readFile(const string& path, int64_t size, const function<bool(const char*, size_t)>& sink);
+
+    /**
+     * Collects the i-nodes of the file with the given path or of all files in the subtree of the directory
+     * @param path - path of a file or a directory, empty for the whole file system
+     * @param inodeIds - i-nodes of the files, every file once
+     * @return false if the path was not found, true otherwise
+     */
+    bool collectFiles(const string& path, vector<int32_t>& inodeIds);
     void processHelp(const vector<string>& args);
 
 };
@@ -0,0 +1,304 @@
+#include "ConsistencyChecker.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+using std::lock_guard;
+using std::min;
+using std::to_string;
+using std::stringstream;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+static const uint16_t PACK_CLUSTER_FLAG = 0x8000;
+static const int32_t INODES_PER_JOB = 4096;
+
+bool FsckReport::isClean() const {
+    return badEntries == 0 && linkMismatches == 0 && orphanInodes == 0 && badPointers == 0
+           && bitmapMismatches == 0 && crossLinkedClusters == 0;
+}
+
+string FsckReport::summary() const {
+    stringstream ss;
+    ss << "I-nodes: " << checkedInodes
+       << ", directories: " << checkedDirectories
+       << ", bad entries: " << badEntries
+       << ", link mismatches: " << linkMismatches
+       << ", orphan i-nodes: " << orphanInodes
+       << ", bad block pointers: " << badPointers
+       << ", bitmap mismatches: " << bitmapMismatches
+       << " ( leaked " << leakedClusters << ", unmarked " << unmarkedClusters
+       << ", cross-linked " << crossLinkedClusters << " )"
+       << ", time: " << elapsedSeconds << " s";
+    return ss.str();
+}
+
+ConsistencyChecker::ConsistencyChecker(VirtualFileSystem* vfs, size_t threadCount)
+        : vfs(vfs), pool(threadCount), report(), reportedProblems(0) {}
+
+FsckReport ConsistencyChecker::check(bool repair) {
+    auto start = steady_clock::now();
+    report = FsckReport();
+    reportedProblems = 0;
+    badEntries.clear();
+
+    // Reserved clusters are free in the image, the pools are filled again on the next allocation
+    if (repair) {
+        vfs->releaseAllReservations();
+    }
+    vfs->flushVfs();
+
+    // Link counts go first, orphans freed by the repair do not own clusters any more
+    scanDirectories();
+    checkLinks(repair);
+    vector<int32_t> expected = countReferences();
+    report.badPointers = static_cast<int32_t>(badPointerInodes.size());
+    for (int32_t id : badPointerInodes) {
+        reportProblem("I-node " + to_string(id) + " points outside of the data region");
+    }
+    checkBitmap(expected, repair);
+
+    if (repair && !report.isClean()) {
+        vfs->reloadVfs();
+        report.repaired = true;
+    }
+
+    report.elapsedSeconds = duration<double>(steady_clock::now() - start).count();
+    return report;
+}
+
+void ConsistencyChecker::scanDirectories() {
+    const Inode* inodes = vfs->getInodes();
+    int32_t inodeCount = vfs->getSuperblock()->getInodeCount();
+    linkCounts = vector<atomic<int32_t>>(static_cast<size_t>(inodeCount));
+
+    for (int32_t id = 0; id < inodeCount; id++) {
+        if (inodes[id].getNodeId() != ID_ITEM_FREE && inodes[id].getIsDirectory()) {
+            report.checkedDirectories++;
+            pool.submit([this, id]() { scanDirectory(id); });
+        }
+    }
+    pool.wait();
+
+    for (const BadEntry& entry : badEntries) {
+        reportProblem("Directory " + to_string(entry.directory) + " has an entry of the free i-node " + to_string(entry.inode));
+    }
+    report.badEntries = static_cast<int32_t>(badEntries.size());
+}
+
+void ConsistencyChecker::scanDirectory(int32_t directory) {
+    const Inode* inodes = vfs->getInodes();
+    int32_t inodeCount = vfs->getSuperblock()->getInodeCount();
+    int64_t dataClusterCount = vfs->getSuperblock()->getDataClusterCount();
+    int32_t entriesPerCluster = vfs->getClusterIo()->getEntriesPerCluster();
+    vector<char> cluster(static_cast<size_t>(vfs->getClusterSize()));
+
+    int blockCount;
+    vector<int32_t> blocks = vfs->getDataBlocks(directory, &blockCount, nullptr);
+    for (int i = 0; i < blockCount; i++) {
+        // Pointers outside of the data region are reported by the i-node scan
+        if (blocks[i] < 0 || blocks[i] >= dataClusterCount) {
+            continue;
+        }
+        vfs->readDataClusters(blocks[i], cluster.data(), cluster.size());
+        for (int32_t j = 0; j < entriesPerCluster; j++) {
+            int32_t nodeId;
+            memcpy(&nodeId, cluster.data() + static_cast<size_t>(j) * DIRECTORY_ENTRY_SIZE, sizeof(nodeId));
+            if (nodeId == 0) {
+                continue;   // Empty entry
+            }
+            if (nodeId < 0 || nodeId >= inodeCount || inodes[nodeId].getNodeId() == ID_ITEM_FREE) {
+                lock_guard<mutex> lock(resultMutex);
+                badEntries.push_back(BadEntry{directory, blocks[i], j, nodeId});
+                continue;
+            }
+            linkCounts[nodeId]++;
+        }
+    }
+}
+
+void ConsistencyChecker::checkLinks(bool repair) {
+    const Superblock* superblock = vfs->getSuperblock();
+    Inode* inodes = vfs->getInodes();
+
+    if (repair) {
+        vector<char> empty(DIRECTORY_ENTRY_SIZE, 0);
+        for (const BadEntry& entry : badEntries) {
+            vfs->seekSet(superblock->getDataStartAddress() + static_cast<int64_t>(entry.cluster) * superblock->getClusterSize()
+                         + static_cast<int64_t>(entry.index) * DIRECTORY_ENTRY_SIZE);
+            vfs->writeToFile(empty.data(), empty.size());
+        }
+    }
+
+    for (int32_t id = 0; id < superblock->getInodeCount(); id++) {
+        Inode& node = inodes[id];
+        if (node.getNodeId() == ID_ITEM_FREE) {
+            continue;
+        }
+        report.checkedInodes++;
+
+        // The root directory has no entry in another directory
+        int32_t expected = id == 0 ? 1 : linkCounts[id].load();
+        if (expected == 0) {
+            report.orphanInodes++;
+            reportProblem("I-node " + to_string(id) + " is in use but no directory entry refers to it");
+            if (repair) {
+                if (node.getTailCluster() != ID_ITEM_FREE) {
+                    vfs->releasePackedTail(id);
+                }
+                vfs->freeInode(id);
+                vfs->writeInodeToVfs(id);
+            }
+            continue;
+        }
+
+        if (node.getReferences() != expected) {
+            report.linkMismatches++;
+            reportProblem("I-node " + to_string(id) + " has " + to_string(node.getReferences()) + " references but "
+                          + to_string(expected) + " directory entries");
+            if (repair) {
+                node.setReferences(static_cast<int8_t>(min<int32_t>(expected, INT8_MAX)));
+                vfs->writeInodeToVfs(id);
+            }
+        }
+    }
+}
+
+vector<int32_t> ConsistencyChecker::countReferences() {
+    int32_t inodeCount = vfs->getSuperblock()->getInodeCount();
+    references = vector<atomic<uint16_t>>(static_cast<size_t>(vfs->getSuperblock()->getDataClusterCount()));
+    badPointerInodes.clear();
+
+    for (int32_t first = 0; first < inodeCount; first += INODES_PER_JOB) {
+        int32_t end = min(first + INODES_PER_JOB, inodeCount);
+        pool.submit([this, first, end]() { scanInodeRange(first, end); });
+    }
+    pool.wait();
+
+    std::sort(badPointerInodes.begin(), badPointerInodes.end());
+    badPointerInodes.erase(std::unique(badPointerInodes.begin(), badPointerInodes.end()), badPointerInodes.end());
+
+    vector<int32_t> counts(references.size());
+    for (size_t cluster = 0; cluster < counts.size(); cluster++) {
+        uint16_t value = references[cluster];
+        counts[cluster] = (value & ~PACK_CLUSTER_FLAG) + ((value & PACK_CLUSTER_FLAG) ? 1 : 0);
+    }
+    return counts;
+}
+
+void ConsistencyChecker::scanInodeRange(int32_t first, int32_t end) {
+    const Inode* inodes = vfs->getInodes();
+
+    for (int32_t id = first; id < end; id++) {
+        const Inode& node = inodes[id];
+        if (node.getNodeId() == ID_ITEM_FREE || node.getIsInline()) {
+            continue;
+        }
+        if (node.getTailCluster() != ID_ITEM_FREE) {
+            addReference(id, node.getTailCluster(), true);
+            continue;
+        }
+
+        // Every pointer counts, a file may share one cluster several times
+        int blockCount;
+        vector<int32_t> blocks = vfs->getDataBlocks(id, &blockCount, nullptr);
+        for (int i = 0; i < blockCount; i++) {
+            if (blocks[i] != ID_ITEM_FREE) {
+                addReference(id, blocks[i], false);
+            }
+        }
+        for (int32_t mapBlock : vfs->getMapBlocks(id)) {
+            addReference(id, mapBlock, false);
+        }
+    }
+}
+
+void ConsistencyChecker::addReference(int32_t inodeId, int32_t cluster, bool packed) {
+    if (cluster < 0 || cluster >= static_cast<int64_t>(references.size())) {
+        lock_guard<mutex> lock(resultMutex);
+        badPointerInodes.push_back(inodeId);
+        return;
+    }
+    if (packed) {
+        references[cluster] |= PACK_CLUSTER_FLAG;
+    } else {
+        references[cluster]++;
+    }
+}
+
+void ConsistencyChecker::checkBitmap(const vector<int32_t>& expectedReferences, bool repair) {
+    const Superblock* superblock = vfs->getSuperblock();
+    int64_t clusterCount = superblock->getDataClusterCount();
+    bool shared = superblock->hasFeature(FEATURE_DEDUP);
+
+    vector<int8_t> stored(static_cast<size_t>(clusterCount), 0);
+    vfs->readAt(superblock->getBitmapStartAddress(), reinterpret_cast<char*>(stored.data()), stored.size());
+    vector<int8_t> fixed(stored);
+
+    for (int64_t cluster = 0; cluster < clusterCount; cluster++) {
+        int32_t expected = expectedReferences[cluster];
+        if (expected > 1 && !shared) {
+            report.crossLinkedClusters++;
+            reportProblem("Cluster " + to_string(cluster) + " is used " + to_string(expected) + " times");
+        }
+
+        auto wanted = static_cast<int8_t>(min<int32_t>(expected, shared ? DEDUP_MAX_REFERENCES : 1));
+        if (stored[cluster] == wanted) {
+            continue;
+        }
+        report.bitmapMismatches++;
+        if (wanted == 0) {
+            report.leakedClusters++;
+        } else if (stored[cluster] == 0) {
+            report.unmarkedClusters++;
+        }
+        reportProblem("Cluster " + to_string(cluster) + " has " + to_string(stored[cluster]) + " in the bitmap but "
+                      + to_string(wanted) + " references");
+        fixed[cluster] = wanted;
+    }
+
+    if (!repair || report.bitmapMismatches == 0) {
+        return;
+    }
+
+    // Leaked clusters are discarded like clusters of removed files, with their hash slots
+    vector<int32_t> leaked;
+    vector<pair<int32_t, Hash128>> clearedSlots;
+    for (int64_t cluster = 0; cluster < clusterCount; cluster++) {
+        if (fixed[cluster] == 0 && stored[cluster] != 0) {
+            leaked.push_back(static_cast<int32_t>(cluster));
+            clearedSlots.emplace_back(static_cast<int32_t>(cluster), Hash128{0, 0});
+        }
+    }
+    vfs->discardClusters(leaked);
+    if (shared) {
+        vfs->writeDedupSlots(clearedSlots);
+    }
+
+    // Changed entries are written in runs
+    int64_t cluster = 0;
+    while (cluster < clusterCount) {
+        if (fixed[cluster] == stored[cluster]) {
+            cluster++;
+            continue;
+        }
+        int64_t runEnd = cluster + 1;
+        while (runEnd < clusterCount && fixed[runEnd] != stored[runEnd]) {
+            runEnd++;
+        }
+        vfs->seekSet(superblock->getBitmapStartAddress() + cluster);
+        vfs->writeToFile(reinterpret_cast<const char*>(fixed.data() + cluster), static_cast<size_t>(runEnd - cluster));
+        cluster = runEnd;
+    }
+    vfs->flushVfs();
+}
+
+void ConsistencyChecker::reportProblem(const string& text) {
+    if (reportedProblems++ < FSCK_REPORT_LIMIT) {
+        log(text);
+    } else if (reportedProblems == FSCK_REPORT_LIMIT + 1) {
+        log(FSCK_MORE_PROBLEMS_TEXT);
+    }
+}
@@ -0,0 +1,145 @@
+#ifndef SEMESTRALNIPRACE_CONSISTENCYCHECKER_HPP
+#define SEMESTRALNIPRACE_CONSISTENCYCHECKER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "VirtualFileSystem.hpp"
+#include "ThreadPool.hpp"
+
+using std::atomic;
+using std::mutex;
+using std::string;
+using std::vector;
+
+/**
+ * Result of a consistency check
+ */
+struct FsckReport {
+    int32_t checkedInodes;           // I-nodes in use
+    int32_t checkedDirectories;
+    int32_t badEntries;              // Directory entries of free or invalid i-nodes
+    int32_t linkMismatches;          // I-nodes whose reference count differs from their directory entries
+    int32_t orphanInodes;            // I-nodes in use without a directory entry
+    int32_t badPointers;             // Block pointers outside of the data region
+    int64_t bitmapMismatches;        // Bitmap entries differing from the references of the block maps
+    int64_t leakedClusters;          // Marked as used, referenced by no i-node
+    int64_t unmarkedClusters;        // Referenced by an i-node, marked as free
+    int64_t crossLinkedClusters;     // Referenced more than once on an image without shared clusters
+    bool repaired;
+    double elapsedSeconds;
+
+    /**
+     * Checks whether the check found any problem
+     * @return true if the file system is consistent, false otherwise
+     */
+    bool isClean() const;
+
+    /**
+     * Describes the numbers of the report on one line
+     * @return summary of the check
+     */
+    string summary() const;
+};
+
+/**
+ * Checks that the bitmap, the block maps of the i-nodes, the reference counts of the i-nodes and
+ * the directory entries agree. Directory clusters and the i-node table are scanned by a pool of
+ * worker threads using positional reads, the expected bitmap and link counts are built from them
+ * and compared with the image. Problems are reported and optionally repaired; the caller holds
+ * the exclusive state lock of the virtual file system for the whole check.
+ */
+class ConsistencyChecker {
+public:
+
+    /**
+     * Constructor for consistency checker
+     * @param vfs - virtual file system to check
+     * @param threadCount - number of worker threads
+     */
+    ConsistencyChecker(VirtualFileSystem* vfs, size_t threadCount);
+
+    /**
+     * Checks the file system and reports every problem found
+     * @param repair - true to repair the problems, the file system is loaded again after a repair
+     * @return report of the check
+     */
+    FsckReport check(bool repair);
+
+    /**
+     * Counts the block pointers referencing every data cluster from the block maps, i-nodes are split among
+     * the worker threads; the caller holds at least the shared state lock of the virtual file system
+     * @return references of every data cluster, a pack cluster counts once for all its tails
+     */
+    vector<int32_t> countReferences();
+
+private:
+    /**
+     * Directory entry of an i-node which is free or does not exist
+     */
+    struct BadEntry {
+        int32_t directory;      // I-node of the directory
+        int32_t cluster;        // Data cluster holding the entry
+        int32_t index;          // Entry in the cluster
+        int32_t inode;
+    };
+
+    /**
+     * Counts the directory entries of every i-node, directories are split among the worker threads
+     */
+    void scanDirectories();
+
+    /**
+     * Scans the entries of one directory
+     * @param directory - i-node of the directory
+     */
+    void scanDirectory(int32_t directory);
+
+    /**
+     * Compares the reference counts of the i-nodes with their directory entries and repairs them
+     * @param repair - true to repair the problems
+     */
+    void checkLinks(bool repair);
+
+    /**
+     * Counts the references of the clusters of the given i-nodes
+     * @param first - first i-node
+     * @param end - i-node behind the last one
+     */
+    void scanInodeRange(int32_t first, int32_t end);
+
+    /**
+     * Counts one reference of a data cluster
+     * @param inodeId - i-node referencing the cluster
+     * @param cluster - data cluster
+     * @param packed - true for a pack cluster, counted once for all its tails
+     */
+    void addReference(int32_t inodeId, int32_t cluster, bool packed);
+
+    /**
+     * Compares the bitmap in the image with the counted references and repairs it
+     * @param expectedReferences - references of every data cluster
+     * @param repair - true to repair the problems
+     */
+    void checkBitmap(const vector<int32_t>& expectedReferences, bool repair);
+
+    /**
+     * Logs a problem, only the first FSCK_REPORT_LIMIT problems are logged
+     * @param text - description of the problem
+     */
+    void reportProblem(const string& text);
+
+    VirtualFileSystem* vfs;
+    ThreadPool pool;
+    FsckReport report;
+    int32_t reportedProblems;
+    vector<atomic<int32_t>> linkCounts;         // Directory entries of every i-node
+    vector<atomic<uint16_t>> references;        // References of every data cluster, the top bit marks a pack cluster
+    mutex resultMutex;
+    vector<BadEntry> badEntries;
+    vector<int32_t> badPointerInodes;           // I-node of every block pointer outside of the data region
+};
+
+#endif //SEMESTRALNIPRACE_CONSISTENCYCHECKER_HPP
@@ -5,12 +5,75 @@ using std::string;
 const char* SIGNATURE            = "Maxim Lyutikov";
 const int   SIGNATURE_LENGTH     = 20;
 
-const int CLUSTER_SIZE           = 4096;
-const int INT32_COUNT_IN_BLOCK   = CLUSTER_SIZE / 4;
+const int CLUSTER_SIZE           = 4096;    // Default for new images, the image stores its own cluster size
+const int MIN_CLUSTER_SIZE       = 1 << 10;
+const int MAX_CLUSTER_SIZE       = 1 << 20;
+const int DIRECTORY_ENTRY_SIZE   = 16;      // i-node id and the filename
 const int FILENAME_LENGTH        = 12;
 const int NEGATIVE_SIZE_OF_INT32 = -4;
-const int INODE_SIZE             = 38;
+const int INODE_SIZE             = 38;    // Legacy revision: 32-bit size, direct and two indirect pointers
+const int INODE_LARGE_SIZE       = 50;    // 64-bit size, double and triple indirect pointers added
+const int INODE_INLINE_SIZE      = 256;   // Large i-node, inline flag and data of tiny files
+const int INLINE_DATA_SIZE       = INODE_INLINE_SIZE - INODE_LARGE_SIZE - 1;
 const int ID_ITEM_FREE           = -1;
+const int EXPORT_RUN_BYTES       = 256 * 1024;
+const int TABLE_IO_BYTES         = 1 << 20; // Part of the i-node table read or written at once
+
+const int FEATURE_ALLOCATION_GROUPS = 0x1;
+const int FEATURE_LARGE_FILES       = 0x2;
+const int FEATURE_64BIT             = 0x4;
+const int FEATURE_INLINE_DATA       = 0x8;
+const int FEATURE_TAIL_PACKING      = 0x10;
+const int FEATURE_COMPRESSION       = 0x20;    // Files are compressed unless they are small
+const int FEATURE_DEDUP             = 0x40;    // Table of cluster hashes after the i-node table
+const int FEATURE_INLINE_DEDUP      = 0x80;    // Written clusters are shared with equal clusters at once
+const int FEATURE_CHECKSUMS         = 0x100;   // Table of cluster checksums after the table of cluster hashes
+const int FEATURE_SPARSE_FILES      = 0x200;   // Zero clusters of files are holes ( ID_ITEM_FREE ) in the block map
+const int FEATURE_WIDE_UNITS        = 0x400;   // Compression units span at least COMPRESSION_MIN_CLUSTERS clusters
+
+const int8_t DATA_IN_CLUSTERS       = 0;     // Layout byte of the i-node record
+const int8_t DATA_INLINE            = 1;
+const int8_t DATA_PACKED_TAIL       = 2;
+const int8_t DATA_COMPRESSED        = 3;
+
+const int COMPRESSION_UNIT_BYTES    = 64 * 1024;   // Compressed independently, stored in its own clusters
+const int COMPRESSION_MIN_CLUSTERS  = 16;          // A unit has to be able to save clusters with large clusters too
+const int COMPRESSION_BATCH_BYTES   = 4 << 20;     // Read and compressed in parallel at once
+
+const int DEDUP_SLOT_SIZE           = 16;          // 128-bit hash of one data cluster, zero for no hash
+const int8_t DEDUP_MAX_REFERENCES   = INT8_MAX;    // Bitmap entries hold reference counts of shared clusters
+const int DEDUP_BATCH_BYTES         = 4 << 20;     // Read and hashed in parallel at once
+
+const int CHECKSUM_SIZE             = 4;           // CRC32C of one cluster of the image
+const int CHECKSUM_CACHE_PAGES      = 1024;        // Clusters of the table of cluster checksums kept in memory
+
+const int FSCK_REPORT_LIMIT         = 32;          // Problems logged one by one, the rest is only counted
+
+const int64_t SCRUB_DEFAULT_RATE    = 32 << 20;    // Bytes read per second by the background scrub
+const int SCRUB_BATCH_BYTES         = 1 << 20;     // Data clusters read at once under one shared lock
+const int SCRUB_RECORD_LIMIT        = 32;          // Clusters with a problem kept for scrub status
+const int SCRUB_NICE                = 19;          // Priority of the scrub thread
+
+const int DEFRAG_CHUNK_BYTES        = 1 << 20;     // Data copied at once under one exclusive lock
+
+const int FSSTAT_TOP_FILES          = 10;          // Most fragmented files listed by fsstat
+
+const int ERASE_CHUNK_BYTES         = 1 << 20;     // Zeros written at once by secure erase
+
+const int APPEND_BUFFER_BYTES       = 4 << 20;     // Appended data of one file buffered before its clusters are allocated
+
+const int COPY_CHUNK_BYTES          = 16 << 20;    // Read or written through the API at once by cat, cp, incp and outcp,
+                                                   // a multiple of every compression unit so copies grow by whole units
+
+const int MAX_INODE_COUNT           = 1 << 20;
+
+const int    RESERVATION_BYTES         = 512 * 1024;   // Reserved for a session at once, at least one cluster
+const int    RESERVATION_GROUP_SHARE   = 8;            // ... but at most this part of the free clusters of the group
+const int8_t BITMAP_RESERVED           = -1;           // In memory only, never written to the file
+
+const int READAHEAD_MIN_CLUSTERS     = 4;
+const int READAHEAD_INITIAL_CLUSTERS = 16;
+const int READAHEAD_MAX_BYTES        = 1 << 20; // Per read request
 
 const int ERROR_CODE             = -1;
 const int NO_ERROR_CODE          = 0;
@@ -33,6 +96,35 @@ const string FORMAT_COMMAND      = "format";
 const string HARDLINK_COMMAND    = "ln";
 const string EXIT_COMMAND        = "exit";
 const string QUIT_COMMAND        = "quit";
+const string DEDUP_COMMAND       = "dedup";
+const string CHECKSUM_COMMAND    = "checksum";
+const string FSCK_COMMAND        = "fsck";
+const string SCRUB_COMMAND       = "scrub";
+const string DEFRAG_COMMAND      = "defrag";
+const string FSSTAT_COMMAND      = "fsstat";
+const string ERASE_COMMAND       = "erase";
+const string READ_COMMAND        = "read";
+const string WRITE_COMMAND       = "write";
+const string TRUNCATE_COMMAND    = "truncate";
+const string APPEND_COMMAND      = "append";
+const string FALLOCATE_COMMAND   = "fallocate";
+const string RECURSIVE_FLAG      = "-r";
+const string COMPRESS_FLAG       = "-c";
+const string DEDUP_FLAG          = "-d";
+const string REPAIR_FLAG         = "-r";
+const string CHECKSUM_OFF        = "off";
+const string CHECKSUM_WARN       = "warn";
+const string CHECKSUM_STRICT     = "strict";
+const string SCRUB_START         = "start";
+const string SCRUB_STOP          = "stop";
+const string SCRUB_STATUS        = "status";
+const string BACKGROUND_FLAG     = "-b";
+const string DEFRAG_STOP         = "stop";
+const string DEFRAG_STATUS       = "status";
+const string JSON_FLAG           = "-j";
+const string SERVE_FLAG          = "--serve";
+const string ERASE_DISCARD       = "discard";
+const string ERASE_SECURE        = "secure";
 
 
 
@@ -64,10 +156,54 @@ const string ITEM_NOT_FOUND_TEXT                            = "Item was not foun
 const string USAGE_INFO_TEXT                                = "Usage: info <path>";
 const string PROGRAM_ERROR_EXIT_TEXT                        = "Incorrect parameters! End of program!";
 const string LOADING_FILE_TEXT                              = "Loading file name : ";
+const string SERVER_LISTENING_TEXT                          = "Serving the file system on socket : ";
+const string SERVER_NOT_STARTED_TEXT                        = "Server could not be started on socket : ";
+const string SERVER_STOPPED_TEXT                            = "Server stopped.";
 const string FILE_ALREADY_EXISTS_TEXT                       = "File with this name already exists!";
 const string FILE_ALREADY_EXISTS_IN_DESTINATION_DIR_TEXT    = "File with this name already exists in destination directory!";
 const string NOT_ENOUGH_SPACE_BLOCKS_TEXT                   = "Not enough data blocks found. Probably need more space.";
+const string FILE_IS_TOO_LARGE_TEXT                         = "File is too large for this file system.";
+const string FILE_SYSTEM_IS_TOO_LARGE_TEXT                  = "File system is too large, data clusters are addressed by 32-bit numbers.";
+const string WRONG_CLUSTER_SIZE_TEXT                        = "Cluster size has to be a power of two from 1K to 1M.";
+const string UNSUPPORTED_CLUSTER_SIZE_TEXT                  = "Unsupported cluster size of the file system: ";
 const string FILE_COPIED_SECCESSFULLY_TEXT                  = "File copied successfully!";
+const string FILE_DATA_NOT_COPIED_TEXT                      = "File data could not be copied!";
+const string FILE_DATA_NOT_READ_TEXT                        = "File data could not be read!";
+const string COMPRESSED_DATA_DAMAGED_TEXT                   = "Compressed file data is damaged!";
+const string DEDUP_NOT_SUPPORTED_TEXT                       = "This file system has no table of cluster hashes, format it again to use deduplication.";
+const string DEDUP_FINISHED_TEXT                            = "Deduplication finished, reclaimed bytes : ";
+const string CHECKSUM_NOT_SUPPORTED_TEXT                    = "This file system has no table of cluster checksums, format it again to use checksums.";
+const string CHECKSUM_MISMATCH_TEXT                         = "Checksum mismatch in cluster of the image : ";
+const string CHECKSUM_MODE_TEXT                             = "Checksum verification : ";
+const string CHECKSUM_ERRORS_TEXT                           = "Checksum mismatches found : ";
+const string FSCK_MORE_PROBLEMS_TEXT                        = "More problems were found, only their number is reported.";
+const string FSCK_CLEAN_TEXT                                = "File system is consistent.";
+const string FSCK_PROBLEMS_TEXT                             = "File system is not consistent, run fsck -r to repair it.";
+const string FSCK_REPAIRED_TEXT                             = "File system was repaired.";
+const string WRONG_CHECKSUM_MODE_TEXT                       = "Checksum verification has to be off, warn or strict.";
+const string SCRUB_STARTED_TEXT                             = "Scrub started in the background, limit in bytes per second : ";
+const string SCRUB_ALREADY_RUNNING_TEXT                     = "Scrub is already running.";
+const string SCRUB_STOPPED_TEXT                             = "Scrub stopped.";
+const string SCRUB_NOT_RUN_TEXT                             = "No scrub has run yet.";
+const string SCRUB_FINDING_TEXT                             = "Data cluster with a problem : ";
+const string WRONG_SCRUB_ACTION_TEXT                        = "Scrub action has to be start [rate], stop or status.";
+const string DEFRAG_STARTED_TEXT                            = "Defragmentation started in the background, limit in bytes per second : ";
+const string DEFRAG_ALREADY_RUNNING_TEXT                    = "Background defragmentation is already running.";
+const string DEFRAG_STOPPED_TEXT                            = "Background defragmentation stopped.";
+const string DEFRAG_NOT_RUN_TEXT                            = "No background defragmentation has run yet.";
+const string DEFRAG_RUNNING_TEXT                            = "Background defragmentation is running.";
+const string DEFRAG_FINISHED_TEXT                           = "Background defragmentation is not running.";
+const string ERASE_MODE_TEXT                                = "Erase of freed clusters : ";
+const string WRONG_ERASE_MODE_TEXT                          = "Erase mode has to be discard or secure.";
+const string BYTES_WRITTEN_TEXT                             = "Bytes written : ";
+const string BYTES_APPENDED_TEXT                            = "Bytes appended : ";
+const string APPENDS_NOT_FLUSHED_TEXT                       = "Appended data could not be written ( out of space ), it stays buffered.";
+const string FILE_NOT_WRITTEN_TEXT                          = "File could not be written ( beyond the maximum file size, out of space or damaged data )!";
+const string ERROR_PARSING_OFFSET_STRING_TEXT               = "Error parsing offset string : ";
+const string ITEM_ALREADY_EXISTS_TEXT                       = "A file or directory with this name already exists!";
+const string DIRECTORY_NOT_EMPTY_TEXT                       = "Directory is not empty!";
+const string ITEM_IS_DIRECTORY_TEXT                         = "The path is a directory, not a file!";
+const string INVALID_RANGE_TEXT                             = "Offset or size is negative or beyond the maximum file size!";
 const string FILE_SUCESSFULLY_COPIED_FROM_VFS_TO_TEXT       = "File copied successfully from VFS to : ";
 const string TARGET_DIR_NOT_FOUND_TEXT                      = "Target directory was not found!";
 const string FORMAT_SUCCESSFUL_TEXT                         = "VFS formatted successfully!";
@@ -76,6 +212,8 @@ const string OK_TEXT                                        = "Em... OK";
 const string COMMAND_IS_NOT_AVAILABLE_TEXT                  = "You are using program in limited mode. This command is not available.";
 const string DIR_NOT_FOUND_OR_NOT_EMPTY_TEXT                = "Directory was not found or not empty!";
 const string NUMBER_PROBABLY_IS_WRONG                       = "This number is probably wrong!";
+const string SUBTREE_EXPORTED_TEXT                          = "Directory exported from VFS to : ";
+const string SUBTREE_EXPORT_FAILED_TEXT                     = "Some files or directories could not be exported, count : ";
 
 const string PATH_DELIMETER         = "/";
 const string M_SIZE                 = "M";
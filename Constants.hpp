@@ -2,6 +2,7 @@
 #define SEMESTRALNIPRACE_CONSTANTS_HPP
 
 #include <string>
+#include <cstdint>
 
 using std::string;
 
@@ -9,11 +10,58 @@ extern const char* SIGNATURE;
 extern const int SIGNATURE_LENGTH;
 
 extern const int CLUSTER_SIZE;
-extern const int INT32_COUNT_IN_BLOCK;
+extern const int MIN_CLUSTER_SIZE;
+extern const int MAX_CLUSTER_SIZE;
+extern const int DIRECTORY_ENTRY_SIZE;
 extern const int FILENAME_LENGTH;
 extern const int NEGATIVE_SIZE_OF_INT32;
 extern const int INODE_SIZE;
+extern const int INODE_LARGE_SIZE;
+extern const int INODE_INLINE_SIZE;
+extern const int INLINE_DATA_SIZE;
 extern const int ID_ITEM_FREE;
+extern const int EXPORT_RUN_BYTES;
+extern const int TABLE_IO_BYTES;
+extern const int FEATURE_ALLOCATION_GROUPS;
+extern const int FEATURE_LARGE_FILES;
+extern const int FEATURE_64BIT;
+extern const int FEATURE_INLINE_DATA;
+extern const int FEATURE_TAIL_PACKING;
+extern const int FEATURE_COMPRESSION;
+extern const int FEATURE_DEDUP;
+extern const int FEATURE_INLINE_DEDUP;
+extern const int FEATURE_CHECKSUMS;
+extern const int FEATURE_SPARSE_FILES;
+extern const int FEATURE_WIDE_UNITS;
+extern const int8_t DATA_IN_CLUSTERS;
+extern const int8_t DATA_INLINE;
+extern const int8_t DATA_PACKED_TAIL;
+extern const int8_t DATA_COMPRESSED;
+extern const int COMPRESSION_UNIT_BYTES;
+extern const int COMPRESSION_MIN_CLUSTERS;
+extern const int COMPRESSION_BATCH_BYTES;
+extern const int DEDUP_SLOT_SIZE;
+extern const int8_t DEDUP_MAX_REFERENCES;
+extern const int DEDUP_BATCH_BYTES;
+extern const int CHECKSUM_SIZE;
+extern const int CHECKSUM_CACHE_PAGES;
+extern const int FSCK_REPORT_LIMIT;
+extern const int64_t SCRUB_DEFAULT_RATE;
+extern const int SCRUB_BATCH_BYTES;
+extern const int SCRUB_RECORD_LIMIT;
+extern const int SCRUB_NICE;
+extern const int DEFRAG_CHUNK_BYTES;
+extern const int FSSTAT_TOP_FILES;
+extern const int ERASE_CHUNK_BYTES;
+extern const int APPEND_BUFFER_BYTES;
+extern const int COPY_CHUNK_BYTES;
+extern const int MAX_INODE_COUNT;
+extern const int RESERVATION_BYTES;
+extern const int RESERVATION_GROUP_SHARE;
+extern const int8_t BITMAP_RESERVED;
+extern const int READAHEAD_MIN_CLUSTERS;
+extern const int READAHEAD_INITIAL_CLUSTERS;
+extern const int READAHEAD_MAX_BYTES;
 
 extern const int ERROR_CODE;
 extern const int NO_ERROR_CODE;
@@ -36,10 +84,42 @@ extern const string FORMAT_COMMAND;
 extern const string HARDLINK_COMMAND;
 extern const string EXIT_COMMAND;
 extern const string QUIT_COMMAND;
+extern const string DEDUP_COMMAND;
+extern const string CHECKSUM_COMMAND;
+extern const string FSCK_COMMAND;
+extern const string SCRUB_COMMAND;
+extern const string DEFRAG_COMMAND;
+extern const string FSSTAT_COMMAND;
+extern const string ERASE_COMMAND;
+extern const string READ_COMMAND;
+extern const string WRITE_COMMAND;
+extern const string TRUNCATE_COMMAND;
+extern const string APPEND_COMMAND;
+extern const string FALLOCATE_COMMAND;
+extern const string RECURSIVE_FLAG;
+extern const string COMPRESS_FLAG;
+extern const string DEDUP_FLAG;
+extern const string REPAIR_FLAG;
+extern const string CHECKSUM_OFF;
+extern const string CHECKSUM_WARN;
+extern const string CHECKSUM_STRICT;
+extern const string SCRUB_START;
+extern const string SCRUB_STOP;
+extern const string SCRUB_STATUS;
+extern const string BACKGROUND_FLAG;
+extern const string DEFRAG_STOP;
+extern const string DEFRAG_STATUS;
+extern const string JSON_FLAG;
+extern const string SERVE_FLAG;
+extern const string ERASE_DISCARD;
+extern const string ERASE_SECURE;
 
 extern const string PROGRAM_INTRODUCTIONS_TEXT;
 extern const string PROGRAM_ERROR_EXIT_TEXT;
 extern const string LOADING_FILE_TEXT;
+extern const string SERVER_LISTENING_TEXT;
+extern const string SERVER_NOT_STARTED_TEXT;
+extern const string SERVER_STOPPED_TEXT;
 extern const string UNKNOWN_COMMAND_TEXT;
 extern const string END_OF_PROGRAM_TEXT;
 extern const string PLEASE_FORMAT_VFS_TEXT;
@@ -48,6 +128,43 @@ extern const string NO_FREE_INODES_TEXT;
 extern const string SOURCE_FILE_NOT_FOUND_TEXT;
 extern const string FILE_COMPLETE_TEXT;
 extern const string FILE_COPIED_SECCESSFULLY_TEXT;
+extern const string FILE_DATA_NOT_COPIED_TEXT;
+extern const string FILE_DATA_NOT_READ_TEXT;
+extern const string COMPRESSED_DATA_DAMAGED_TEXT;
+extern const string DEDUP_NOT_SUPPORTED_TEXT;
+extern const string DEDUP_FINISHED_TEXT;
+extern const string CHECKSUM_NOT_SUPPORTED_TEXT;
+extern const string CHECKSUM_MISMATCH_TEXT;
+extern const string CHECKSUM_MODE_TEXT;
+extern const string CHECKSUM_ERRORS_TEXT;
+extern const string WRONG_CHECKSUM_MODE_TEXT;
+extern const string FSCK_MORE_PROBLEMS_TEXT;
+extern const string FSCK_CLEAN_TEXT;
+extern const string FSCK_PROBLEMS_TEXT;
+extern const string FSCK_REPAIRED_TEXT;
+extern const string SCRUB_STARTED_TEXT;
+extern const string SCRUB_ALREADY_RUNNING_TEXT;
+extern const string SCRUB_STOPPED_TEXT;
+extern const string SCRUB_NOT_RUN_TEXT;
+extern const string SCRUB_FINDING_TEXT;
+extern const string WRONG_SCRUB_ACTION_TEXT;
+extern const string DEFRAG_STARTED_TEXT;
+extern const string DEFRAG_ALREADY_RUNNING_TEXT;
+extern const string DEFRAG_STOPPED_TEXT;
+extern const string DEFRAG_NOT_RUN_TEXT;
+extern const string DEFRAG_RUNNING_TEXT;
+extern const string DEFRAG_FINISHED_TEXT;
+extern const string ERASE_MODE_TEXT;
+extern const string WRONG_ERASE_MODE_TEXT;
+extern const string BYTES_WRITTEN_TEXT;
+extern const string BYTES_APPENDED_TEXT;
+extern const string APPENDS_NOT_FLUSHED_TEXT;
+extern const string FILE_NOT_WRITTEN_TEXT;
+extern const string ERROR_PARSING_OFFSET_STRING_TEXT;
+extern const string ITEM_ALREADY_EXISTS_TEXT;
+extern const string DIRECTORY_NOT_EMPTY_TEXT;
+extern const string ITEM_IS_DIRECTORY_TEXT;
+extern const string INVALID_RANGE_TEXT;
 extern const string FILE_SUCESSFULLY_COPIED_FROM_VFS_TO_TEXT;
 extern const string TARGET_DIR_NOT_FOUND_TEXT;
 extern const string PATH_NOT_FOUND_TEXT;
@@ -69,6 +186,10 @@ extern const string DESTINATION_DIR_NOT_FOUND_TEXT;
 extern const string FILE_ALREADY_EXISTS_TEXT;
 extern const string FILE_ALREADY_EXISTS_IN_DESTINATION_DIR_TEXT;
 extern const string NOT_ENOUGH_SPACE_BLOCKS_TEXT;
+extern const string FILE_IS_TOO_LARGE_TEXT;
+extern const string FILE_SYSTEM_IS_TOO_LARGE_TEXT;
+extern const string WRONG_CLUSTER_SIZE_TEXT;
+extern const string UNSUPPORTED_CLUSTER_SIZE_TEXT;
 extern const string FORMAT_SUCCESSFUL_TEXT;
 extern const string FORMAT_ERROR_TEXT;
 extern const string OK_TEXT;
@@ -77,6 +198,8 @@ extern const string DIR_NOT_FOUND_OR_NOT_EMPTY_TEXT;
 extern const string NUMBER_PROBABLY_IS_WRONG;
 extern const string THE_INDEX_VALUE_HAS_TO_BE_BETWEEN_0_AND_4_TEXT;
 extern const string THE_INDEX_VALUE_HAS_TO_BE_BETWEEN_0_AND_1_TEXT;
+extern const string SUBTREE_EXPORTED_TEXT;
+extern const string SUBTREE_EXPORT_FAILED_TEXT;
 
 extern const string PATH_DELIMETER;
 extern const string M_SIZE;
@@ -0,0 +1,114 @@
+#include "Crc32c.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_HAS_SSE42 1
+#endif
+
+static const uint32_t POLYNOMIAL = 0x82F63B78;     // Reversed Castagnoli polynomial
+
+/**
+ * Lookup tables for eight bytes at once, table[k][b] is the checksum of byte b followed by k zero bytes
+ */
+struct Crc32cTables {
+    uint32_t table[8][256];
+
+    Crc32cTables() {
+        for (uint32_t b = 0; b < 256; b++) {
+            uint32_t crc = b;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+            }
+            table[0][b] = crc;
+        }
+        for (uint32_t b = 0; b < 256; b++) {
+            for (int k = 1; k < 8; k++) {
+                table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xFF];
+            }
+        }
+    }
+};
+
+/**
+ * Computes the checksum with the lookup tables
+ * @param data - data to checksum
+ * @param size - size of the data
+ * @param crc - inverted checksum of the preceding data
+ * @return inverted checksum of the data
+ */
+static uint32_t computeTable(const uint8_t* data, size_t size, uint32_t crc) {
+    static const Crc32cTables tables;
+    const auto& t = tables.table;
+
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        word ^= crc;
+        crc = t[7][word & 0xFF] ^ t[6][(word >> 8) & 0xFF] ^ t[5][(word >> 16) & 0xFF] ^ t[4][(word >> 24) & 0xFF]
+              ^ t[3][(word >> 32) & 0xFF] ^ t[2][(word >> 40) & 0xFF] ^ t[1][(word >> 48) & 0xFF] ^ t[0][word >> 56];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HAS_SSE42
+/**
+ * Computes the checksum with the crc32 instruction
+ * @param data - data to checksum
+ * @param size - size of the data
+ * @param crc - inverted checksum of the preceding data
+ * @return inverted checksum of the data
+ */
+__attribute__((target("sse4.2")))
+static uint32_t computeHardware(const uint8_t* data, size_t size, uint32_t crc) {
+#ifdef __x86_64__
+    uint64_t wide = crc;
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = static_cast<uint32_t>(wide);
+#endif
+    while (size-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+using ComputeFunction = uint32_t (*)(const uint8_t*, size_t, uint32_t);
+
+/**
+ * Selects the fastest variant supported by the processor
+ * @return function computing the checksum
+ */
+static ComputeFunction selectCompute() {
+#ifdef CRC32C_HAS_SSE42
+    if (__builtin_cpu_supports("sse4.2")) {
+        return computeHardware;
+    }
+#endif
+    return computeTable;
+}
+
+static const ComputeFunction COMPUTE = selectCompute();
+
+uint32_t Crc32c::compute(const char* data, size_t size, uint32_t crc) {
+    return ~COMPUTE(reinterpret_cast<const uint8_t*>(data), size, ~crc);
+}
+
+bool Crc32c::isAccelerated() {
+#ifdef CRC32C_HAS_SSE42
+    return COMPUTE == computeHardware;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,30 @@
+#ifndef SEMESTRALNIPRACE_CRC32C_HPP
+#define SEMESTRALNIPRACE_CRC32C_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * CRC32C ( Castagnoli ) checksum of clusters. The SSE4.2 crc32 instruction is used when the processor has it,
+ * otherwise an eight byte wide table is used; the variant is selected once on first use.
+ */
+class Crc32c {
+public:
+
+    /**
+     * Computes the checksum of the data
+     * @param data - data to checksum
+     * @param size - size of the data
+     * @param crc - checksum of the preceding data, 0 for the start
+     * @return checksum of the data
+     */
+    static uint32_t compute(const char* data, size_t size, uint32_t crc = 0);
+
+    /**
+     * Checks whether the checksum is computed by the crc32 instruction
+     * @return true if the instruction is used, false if the table is used
+     */
+    static bool isAccelerated();
+};
+
+#endif //SEMESTRALNIPRACE_CRC32C_HPP
@@ -0,0 +1,41 @@
+#include "DedupIndex.hpp"
+#include "Constants.hpp"
+
+void DedupIndex::reset() {
+    loaded = false;
+    byHash.clear();
+    byCluster.clear();
+}
+
+bool DedupIndex::isLoaded() const {
+    return loaded;
+}
+
+void DedupIndex::setLoaded() {
+    loaded = true;
+}
+
+void DedupIndex::add(int32_t cluster, const Hash128& hash) {
+    remove(cluster);
+    byHash[hash] = cluster;
+    byCluster[cluster] = hash;
+}
+
+int32_t DedupIndex::find(const Hash128& hash) const {
+    auto found = byHash.find(hash);
+    return found != byHash.end() ? found->second : ID_ITEM_FREE;
+}
+
+void DedupIndex::remove(int32_t cluster) {
+    auto found = byCluster.find(cluster);
+    if (found == byCluster.end()) {
+        return;
+    }
+
+    // Another cluster with the same content may be the match of the hash
+    auto match = byHash.find(found->second);
+    if (match != byHash.end() && match->second == cluster) {
+        byHash.erase(match);
+    }
+    byCluster.erase(found);
+}
@@ -0,0 +1,71 @@
+#ifndef SEMESTRALNIPRACE_DEDUPINDEX_HPP
+#define SEMESTRALNIPRACE_DEDUPINDEX_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include "ClusterHash.hpp"
+
+using std::unordered_map;
+
+/**
+ * Result of an offline deduplication
+ */
+struct DedupReport {
+    int64_t hashedClusters;     // Distinct data clusters of all files
+    int64_t sharedClusters;     // Clusters replaced by an equal cluster and freed
+    int32_t changedFiles;       // Files whose block pointers were rewritten
+    int64_t reclaimedBytes;     // Space returned to the bitmap
+    double elapsedSeconds;
+};
+
+/**
+ * In-memory index from cluster hashes to data clusters. The table of cluster hashes in the image keeps one
+ * slot per data cluster and is the persistent copy, the index is built from it on first use. The virtual
+ * file system does all I/O and calls this class under its exclusive state lock.
+ */
+class DedupIndex {
+public:
+
+    /**
+     * Forgets all hashes, the index has to be loaded again
+     */
+    void reset();
+
+    /**
+     * Gets whether the index was built from the table of cluster hashes
+     * @return true if the index is loaded, false otherwise
+     */
+    bool isLoaded() const;
+
+    /**
+     * Marks the index as built from the table of cluster hashes
+     */
+    void setLoaded();
+
+    /**
+     * Registers the hash of a data cluster, the cluster becomes the match for the hash
+     * @param cluster - data cluster
+     * @param hash - hash of its content
+     */
+    void add(int32_t cluster, const Hash128& hash);
+
+    /**
+     * Finds a data cluster with the given hash
+     * @param hash - hash of the content
+     * @return data cluster or ID_ITEM_FREE if no cluster has the hash
+     */
+    int32_t find(const Hash128& hash) const;
+
+    /**
+     * Forgets the hash of a freed data cluster
+     * @param cluster - data cluster
+     */
+    void remove(int32_t cluster);
+
+private:
+    bool loaded = false;
+    unordered_map<Hash128, int32_t, Hash128Hasher> byHash;     // Match for every hash
+    unordered_map<int32_t, Hash128> byCluster;                  // Hash of every hashed cluster
+};
+
+#endif //SEMESTRALNIPRACE_DEDUPINDEX_HPP
@@ -0,0 +1,403 @@
+#include "Defragmenter.hpp"
+#include "VirtualFileSystem.hpp"
+#include <algorithm>
+#include <sstream>
+
+using std::lock_guard;
+using std::unique_lock;
+using std::min;
+using std::max;
+using std::stringstream;
+using std::chrono::duration;
+using std::chrono::duration_cast;
+
+string DefragReport::summary() const {
+    stringstream ss;
+    ss << "Files: " << checkedFiles << " / " << files
+       << ", moved: " << movedFiles
+       << ", skipped: " << skippedFiles
+       << ", fragments before: " << fragmentsBefore
+       << ", after: " << fragmentsAfter
+       << ", moved bytes: " << movedBytes
+       << ", time: " << elapsedSeconds << " s";
+    return ss.str();
+}
+
+Defragmenter::Defragmenter(VirtualFileSystem* vfs)
+        : vfs(vfs), stopping(false), started(false), status(), rateLimit(0) {}
+
+Defragmenter::~Defragmenter() {
+    stop();
+}
+
+int64_t Defragmenter::countFragments(const vector<int32_t>& blocks) {
+    int64_t fragments = 0;
+    int32_t previous = ID_ITEM_FREE;
+    for (int32_t block : blocks) {
+        if (block == ID_ITEM_FREE) {
+            continue;
+        }
+        if (previous == ID_ITEM_FREE || block != previous + 1) {
+            fragments++;
+        }
+        previous = block;
+    }
+    return fragments;
+}
+
+DefragReport Defragmenter::defragment(const vector<int32_t>& inodeIds) {
+    auto start = steady_clock::now();
+    DefragReport report = DefragReport();
+    report.files = static_cast<int32_t>(inodeIds.size());
+
+    // Clusters held by the reservations of sessions may be needed for the runs
+    vfs->releaseAllReservations();
+
+    for (int32_t inodeId : inodeIds) {
+        Relocation relocation;
+        PlanResult result = plan(inodeId, relocation);
+        int64_t fragments = countFragments(relocation.blocks);
+        report.checkedFiles++;
+        report.fragmentsBefore += fragments;
+
+        bool moved = false;
+        if (result == PlanResult::PLANNED) {
+            int64_t bytes = 0;
+            while (bytes >= 0 && relocation.copied < relocation.moved.size()) {
+                bytes = copyChunk(relocation);
+                report.movedBytes += max<int64_t>(bytes, 0);
+            }
+            if (bytes >= 0) {
+                commit(relocation);
+                moved = true;
+            } else {
+                abort(relocation);
+            }
+        }
+
+        report.movedFiles += moved ? 1 : 0;
+        report.skippedFiles += !moved && result != PlanResult::NOT_NEEDED ? 1 : 0;
+        report.fragmentsAfter += moved ? relocation.fragmentsAfter : fragments;
+    }
+
+    report.elapsedSeconds = duration<double>(steady_clock::now() - start).count();
+    return report;
+}
+
+bool Defragmenter::start(const vector<int32_t>& inodeIds, int64_t newRateLimit) {
+    lock_guard<mutex> lock(statusMutex);
+    if (status.running) {
+        return false;
+    }
+    if (worker.joinable()) {
+        worker.join();      // The last run has finished, its thread only has to be collected
+    }
+
+    status = DefragReport();
+    status.files = static_cast<int32_t>(inodeIds.size());
+    status.running = true;
+    started = true;
+    stopping = false;
+    rateLimit = newRateLimit;
+    startTime = steady_clock::now();
+    worker = thread([this, inodeIds]() { run(inodeIds); });
+    return true;
+}
+
+void Defragmenter::stop() {
+    {
+        lock_guard<mutex> lock(statusMutex);
+        stopping = true;
+    }
+    stopRequested.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool Defragmenter::getStatus(DefragReport& report) const {
+    lock_guard<mutex> lock(statusMutex);
+    report = status;
+    report.elapsedSeconds = duration<double>((status.running ? steady_clock::now() : endTime) - startTime).count();
+    return started;
+}
+
+Defragmenter::PlanResult Defragmenter::plan(int32_t inodeId, Relocation& relocation) {
+    const Superblock* superblock = vfs->getSuperblock();
+    relocation = Relocation();
+    relocation.inodeId = inodeId;
+    if (inodeId < 0 || inodeId >= superblock->getInodeCount()) {
+        return PlanResult::NOT_NEEDED;
+    }
+
+    const Inode& node = vfs->getInodes()[inodeId];
+    if (node.getNodeId() == ID_ITEM_FREE || node.getIsDirectory() || node.getIsInline() || node.getTailCluster() != ID_ITEM_FREE) {
+        return PlanResult::NOT_NEEDED;
+    }
+
+    int blockCount;
+    relocation.fileSize = node.getFileSize();
+    relocation.fileWrites = vfs->getFileWrites(inodeId);
+    relocation.dataClusterCount = superblock->getDataClusterCount();
+    relocation.blocks = vfs->getDataBlocks(inodeId, &blockCount, nullptr);
+    relocation.blocks.resize(static_cast<size_t>(blockCount));
+    relocation.mapBlocks = vfs->getMapBlocks(inodeId);
+
+    // Shared clusters stay, moving them would change the block maps of other files
+    const int8_t* bitmap = vfs->getDataBitmap();
+    bool previousMoved = false;
+    int32_t previous = ID_ITEM_FREE;
+    for (int i = 0; i < blockCount; i++) {
+        int32_t block = relocation.blocks[i];
+        if (block == ID_ITEM_FREE) {
+            continue;
+        }
+        bool moved = bitmap[block] == 1;
+        if (moved) {
+            relocation.moved.push_back(i);
+        }
+        bool follows = previous != ID_ITEM_FREE && (moved ? previousMoved : !previousMoved && block == previous + 1);
+        relocation.fragmentsAfter += follows ? 0 : 1;
+        previousMoved = moved;
+        previous = block;
+    }
+    if (relocation.moved.empty() || relocation.fragmentsAfter >= countFragments(relocation.blocks)) {
+        return PlanResult::NOT_NEEDED;
+    }
+
+    relocation.runLength = static_cast<int32_t>(relocation.moved.size()) + vfs->getBlockCountWithIndirect(blockCount) - blockCount;
+    relocation.runStart = findFreeRun(relocation.runLength, inodeId);
+    if (relocation.runStart == ID_ITEM_FREE) {
+        return PlanResult::NO_SPACE;
+    }
+    for (int32_t cluster = relocation.runStart; cluster < relocation.runStart + relocation.runLength; cluster++) {
+        vfs->markCluster(cluster, BITMAP_RESERVED);
+    }
+    return PlanResult::PLANNED;
+}
+
+int32_t Defragmenter::findFreeRun(int32_t length, int32_t inodeId) const {
+    const int8_t* bitmap = vfs->getDataBitmap();
+    const vector<AllocationGroup*>& groups = vfs->getAllocationGroups();
+    int64_t clusterCount = vfs->getSuperblock()->getDataClusterCount();
+    int64_t goal = groups.empty() ? 1 : max<int64_t>(1, groups[vfs->getGroupOfInode(inodeId)]->getFirstCluster());
+
+    // From the group of the i-node to the end, then from the beginning up to the group
+    auto scan = [bitmap, length](int64_t from, int64_t to) {
+        int64_t runStart = -1;
+        for (int64_t cluster = from; cluster < to; cluster++) {
+            if (bitmap[cluster] != 0) {
+                runStart = -1;
+                continue;
+            }
+            if (runStart < 0) {
+                runStart = cluster;
+            }
+            if (cluster - runStart + 1 == length) {
+                return static_cast<int32_t>(runStart);
+            }
+        }
+        return ID_ITEM_FREE;
+    };
+    int32_t found = scan(goal, clusterCount);
+    return found != ID_ITEM_FREE ? found : scan(1, min(goal + length - 1, clusterCount));
+}
+
+int64_t Defragmenter::copyChunk(Relocation& relocation) {
+    int64_t clusterSize = vfs->getClusterSize();
+    size_t first = relocation.copied;
+    size_t end = min(first + static_cast<size_t>(max<int64_t>(1, DEFRAG_CHUNK_BYTES / clusterSize)), relocation.moved.size());
+    vector<char> buffer((end - first) * static_cast<size_t>(clusterSize));
+
+    // Old clusters are read in runs of consecutive clusters, the chunk is written to the run at once
+    for (size_t i = first; i < end;) {
+        int32_t block = relocation.blocks[relocation.moved[i]];
+        size_t run = 1;
+        while (i + run < end && relocation.blocks[relocation.moved[i + run]] == block + static_cast<int32_t>(run)) {
+            run++;
+        }
+        auto size = static_cast<streamsize>(run * clusterSize);
+        if (vfs->readDataClusters(block, buffer.data() + (i - first) * clusterSize, static_cast<size_t>(size)) != size) {
+            return -1;
+        }
+        i += run;
+    }
+
+    vfs->seekDataCluster(relocation.runStart + static_cast<int32_t>(first));
+    vfs->writeToFile(buffer.data(), buffer.size());
+    relocation.copied = end;
+    return static_cast<int64_t>(buffer.size());
+}
+
+bool Defragmenter::isUnchanged(const Relocation& relocation) const {
+    const Superblock* superblock = vfs->getSuperblock();
+    if (!vfs->getIsFormatted() || superblock->getDataClusterCount() != relocation.dataClusterCount
+        || relocation.inodeId >= superblock->getInodeCount()) {
+        return false;
+    }
+
+    const Inode& node = vfs->getInodes()[relocation.inodeId];
+    if (node.getNodeId() == ID_ITEM_FREE || node.getIsInline() || node.getTailCluster() != ID_ITEM_FREE
+        || node.getFileSize() != relocation.fileSize || vfs->getFileWrites(relocation.inodeId) != relocation.fileWrites) {
+        return false;
+    }
+    int blockCount;
+    vector<int32_t> blocks = vfs->getDataBlocks(relocation.inodeId, &blockCount, nullptr);
+    blocks.resize(static_cast<size_t>(blockCount));
+    if (blocks != relocation.blocks || vfs->getMapBlocks(relocation.inodeId) != relocation.mapBlocks) {
+        return false;
+    }
+
+    // A moved cluster may have been shared meanwhile, the run may have been released by a reload
+    const int8_t* bitmap = vfs->getDataBitmap();
+    for (int slot : relocation.moved) {
+        if (bitmap[relocation.blocks[slot]] != 1) {
+            return false;
+        }
+    }
+    for (int32_t cluster = relocation.runStart; cluster < relocation.runStart + relocation.runLength; cluster++) {
+        if (bitmap[cluster] != BITMAP_RESERVED) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Defragmenter::commit(const Relocation& relocation) {
+    int blockCount = static_cast<int>(relocation.blocks.size());
+    vector<int32_t> newBlocks(relocation.blocks);
+    vector<int32_t> oldClusters;
+    vector<pair<int32_t, int32_t>> moves;
+    for (size_t i = 0; i < relocation.moved.size(); i++) {
+        int32_t target = relocation.runStart + static_cast<int32_t>(i);
+        oldClusters.push_back(relocation.blocks[relocation.moved[i]]);
+        moves.emplace_back(relocation.blocks[relocation.moved[i]], target);
+        newBlocks[relocation.moved[i]] = target;
+    }
+    vector<int32_t> run;
+    for (int32_t cluster = relocation.runStart; cluster < relocation.runStart + relocation.runLength; cluster++) {
+        run.push_back(cluster);
+        if (cluster >= relocation.runStart + static_cast<int32_t>(relocation.moved.size())) {
+            newBlocks.push_back(cluster);     // The new block map follows the data
+        }
+    }
+
+    // The run is marked used before the i-node refers to it, the old clusters are freed after the switch
+    writeRuns(run, 1, false);
+    vfs->flushVfs();
+    vfs->writeBlockPointers(relocation.inodeId, blockCount, newBlocks);
+    vfs->writeInodeToVfs(relocation.inodeId);
+    vfs->flushVfs();
+
+    if (vfs->getSuperblock()->hasFeature(FEATURE_DEDUP)) {
+        vfs->moveDedupSlots(moves);
+    }
+    oldClusters.insert(oldClusters.end(), relocation.mapBlocks.begin(), relocation.mapBlocks.end());
+    std::sort(oldClusters.begin(), oldClusters.end());
+    writeRuns(oldClusters, 0, true);
+    vfs->flushVfs();
+}
+
+void Defragmenter::abort(const Relocation& relocation) {
+    if (vfs->getSuperblock() == nullptr || vfs->getSuperblock()->getDataClusterCount() != relocation.dataClusterCount) {
+        return;     // Formatted again, the run does not exist any more
+    }
+
+    // Only the copied part of the run was written
+    const int8_t* bitmap = vfs->getDataBitmap();
+    vector<int32_t> written, unwritten;
+    for (int32_t i = 0; i < relocation.runLength; i++) {
+        int32_t cluster = relocation.runStart + i;
+        if (bitmap[cluster] == BITMAP_RESERVED) {
+            (static_cast<size_t>(i) < relocation.copied ? written : unwritten).push_back(cluster);
+        }
+    }
+    writeRuns(written, 0, true);
+    vfs->unreserveClusters(unwritten);
+    vfs->flushVfs();
+}
+
+void Defragmenter::writeRuns(const vector<int32_t>& clusters, int8_t value, bool clear) {
+    const Superblock* superblock = vfs->getSuperblock();
+    if (clear) {
+        vfs->discardClusters(clusters);
+    }
+    for (size_t i = 0; i < clusters.size();) {
+        size_t run = 1;
+        while (i + run < clusters.size() && clusters[i + run] == clusters[i] + static_cast<int32_t>(run)) {
+            run++;
+        }
+        for (size_t j = i; j < i + run; j++) {
+            vfs->markCluster(clusters[j], value);
+        }
+        vector<char> entries(run, static_cast<char>(value));
+        vfs->seekSet(superblock->getBitmapStartAddress() + clusters[i]);
+        vfs->writeToFile(entries.data(), entries.size());
+        i += run;
+    }
+}
+
+void Defragmenter::run(vector<int32_t> inodeIds) {
+    for (int32_t inodeId : inodeIds) {
+        if (!pace()) {
+            break;
+        }
+
+        Relocation relocation;
+        PlanResult result;
+        uint64_t modifications;
+        {
+            auto lock = vfs->lockExclusive();
+            if (!vfs->getIsFormatted()) {
+                break;
+            }
+            result = plan(inodeId, relocation);
+            modifications = vfs->getModificationCount();
+        }
+
+        // Every chunk is copied under its own exclusive lock, commands may change the file in between
+        bool moved = false, stopped = false;
+        while (result == PlanResult::PLANNED) {
+            stopped = !pace();
+            auto lock = vfs->lockExclusive();
+            bool failed = stopped || (vfs->getModificationCount() != modifications && !isUnchanged(relocation));
+            int64_t bytes = failed ? -1 : copyChunk(relocation);
+            if (bytes < 0) {
+                abort(relocation);
+            } else if (relocation.copied == relocation.moved.size()) {
+                commit(relocation);
+                moved = true;
+            }
+            vfs->syncChecksums();
+            modifications = vfs->getModificationCount();
+
+            lock_guard<mutex> statusLock(statusMutex);
+            status.movedBytes += max<int64_t>(bytes, 0);
+            if (bytes < 0 || moved) {
+                break;
+            }
+        }
+        if (stopped) {
+            break;
+        }
+
+        int64_t fragments = countFragments(relocation.blocks);
+        lock_guard<mutex> statusLock(statusMutex);
+        status.checkedFiles++;
+        status.movedFiles += moved ? 1 : 0;
+        status.skippedFiles += !moved && result != PlanResult::NOT_NEEDED ? 1 : 0;
+        status.fragmentsBefore += fragments;
+        status.fragmentsAfter += moved ? relocation.fragmentsAfter : fragments;
+    }
+
+    lock_guard<mutex> lock(statusMutex);
+    status.running = false;
+    endTime = steady_clock::now();
+}
+
+bool Defragmenter::pace() {
+    unique_lock<mutex> lock(statusMutex);
+    auto due = startTime + duration_cast<steady_clock::duration>(duration<double>(
+            static_cast<double>(status.movedBytes) / static_cast<double>(rateLimit)));
+    return !stopRequested.wait_until(lock, due, [this]() { return stopping; });
+}
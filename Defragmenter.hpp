@@ -0,0 +1,202 @@
+#ifndef SEMESTRALNIPRACE_DEFRAGMENTER_HPP
+#define SEMESTRALNIPRACE_DEFRAGMENTER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::condition_variable;
+using std::mutex;
+using std::string;
+using std::thread;
+using std::vector;
+using std::chrono::steady_clock;
+
+class VirtualFileSystem;
+
+/**
+ * Result of a defragmentation, also the progress of the background one
+ */
+struct DefragReport {
+    int32_t files;                  // Files to defragment
+    int32_t checkedFiles;           // Files processed so far
+    int32_t movedFiles;
+    int32_t skippedFiles;           // No free run was long enough, a cluster was not readable or the file changed meanwhile
+    int64_t fragmentsBefore;        // Runs of physically consecutive data clusters of the checked files
+    int64_t fragmentsAfter;
+    int64_t movedBytes;
+    double elapsedSeconds;
+    bool running;                   // The background defragmentation still runs
+
+    /**
+     * Describes the numbers of the report on one line
+     * @return summary of the defragmentation
+     */
+    string summary() const;
+};
+
+/**
+ * Moves the data clusters of fragmented files into one contiguous run of free clusters followed by a new
+ * block map. The move is copy-on-write: the clusters of the run are reserved and the data is copied first,
+ * then the new block map is written and the i-node written last switches the file to the run; the old
+ * clusters are freed only after that, so the file is complete at every moment. Clusters shared with other
+ * files stay where they are. The background defragmentation copies one chunk at a time under the exclusive
+ * state lock limited to the given bandwidth, a file changed between two chunks is left as it was.
+ */
+class Defragmenter {
+public:
+
+    /**
+     * Constructor for defragmenter, no thread is started until start is called
+     * @param vfs - virtual file system to defragment
+     */
+    explicit Defragmenter(VirtualFileSystem* vfs);
+
+    /**
+     * Destructor, stops the background defragmentation
+     */
+    ~Defragmenter();
+
+    Defragmenter(const Defragmenter&) = delete;
+    Defragmenter& operator=(const Defragmenter&) = delete;
+
+    /**
+     * Counts runs of physically consecutive clusters, holes of compressed files are skipped
+     * @param blocks - data blocks of a file
+     * @return number of fragments
+     */
+    static int64_t countFragments(const vector<int32_t>& blocks);
+
+    /**
+     * Defragments the files at once, the caller holds the exclusive state lock
+     * @param inodeIds - i-nodes of the files
+     * @return report of the defragmentation
+     */
+    DefragReport defragment(const vector<int32_t>& inodeIds);
+
+    /**
+     * Starts defragmenting the files in the background, the caller must not hold the state lock
+     * @param inodeIds - i-nodes of the files
+     * @param rateLimit - bytes copied per second at most
+     * @return false if a background defragmentation already runs, true otherwise
+     */
+    bool start(const vector<int32_t>& inodeIds, int64_t rateLimit);
+
+    /**
+     * Stops the background defragmentation and waits for its thread, the caller must not hold the state lock
+     */
+    void stop();
+
+    /**
+     * Gets the progress of the running or the last background defragmentation
+     * @param report - progress of the defragmentation
+     * @return false if no background defragmentation was started yet, true otherwise
+     */
+    bool getStatus(DefragReport& report) const;
+
+private:
+    /**
+     * Outcome of planning the move of a file
+     */
+    enum class PlanResult {
+        NOT_NEEDED,     // Not a file with clusters, or the move would not lower its fragments
+        NO_SPACE,       // No run of free clusters is long enough
+        PLANNED
+    };
+
+    /**
+     * Move of one file in progress
+     */
+    struct Relocation {
+        int32_t inodeId;
+        int64_t fileSize;
+        uint64_t fileWrites;            // Writes through open handles, they change clusters in place
+        int64_t dataClusterCount;       // Size of the data region when the move was planned
+        vector<int32_t> blocks;         // Data blocks of the file, holes included
+        vector<int32_t> mapBlocks;
+        vector<int32_t> moved;          // Slots of the data blocks which are moved
+        int32_t runStart;               // First cluster of the reserved run, the new block map follows the data
+        int32_t runLength;
+        size_t copied;                  // Moved slots copied so far
+        int64_t fragmentsAfter;
+    };
+
+    /**
+     * Plans the move of a file and reserves the run of free clusters
+     * @param inodeId - i-node of the file
+     * @param relocation - planned move, its blocks are filled whenever the i-node is a file with clusters
+     * @return PLANNED if the run was reserved
+     */
+    PlanResult plan(int32_t inodeId, Relocation& relocation);
+
+    /**
+     * Finds the first run of free clusters of the given length, the search starts in the group of the i-node
+     * @param length - number of clusters
+     * @param inodeId - i-node the run is for
+     * @return first cluster of the run, ID_ITEM_FREE if there is no such run
+     */
+    int32_t findFreeRun(int32_t length, int32_t inodeId) const;
+
+    /**
+     * Copies the next chunk of moved clusters into the run
+     * @param relocation - move in progress
+     * @return number of copied bytes, -1 if the clusters could not be read
+     */
+    int64_t copyChunk(Relocation& relocation);
+
+    /**
+     * Checks that neither the file nor the reserved run changed since the move was planned
+     * @param relocation - move in progress
+     * @return true if the move can go on, false otherwise
+     */
+    bool isUnchanged(const Relocation& relocation) const;
+
+    /**
+     * Switches the file to the run and frees its old clusters
+     * @param relocation - fully copied move
+     */
+    void commit(const Relocation& relocation);
+
+    /**
+     * Returns the reserved run, clusters which stayed reserved are cleared
+     * @param relocation - move in progress
+     */
+    void abort(const Relocation& relocation);
+
+    /**
+     * Discards data clusters and sets their bitmap entries, consecutive entries are written at once
+     * @param clusters - data clusters, sorted
+     * @param value - new bitmap entry
+     * @param clear - true to discard the clusters
+     */
+    void writeRuns(const vector<int32_t>& clusters, int8_t value, bool clear);
+
+    /**
+     * Defragments the files of the background defragmentation, runs on its thread
+     * @param inodeIds - i-nodes of the files
+     */
+    void run(vector<int32_t> inodeIds);
+
+    /**
+     * Waits until the bytes copied so far fit into the rate limit
+     * @return false if the background defragmentation was stopped meanwhile, true otherwise
+     */
+    bool pace();
+
+    VirtualFileSystem* vfs;
+    thread worker;
+    mutable mutex statusMutex;
+    condition_variable stopRequested;
+    bool stopping;
+    bool started;                       // A background defragmentation was started
+    DefragReport status;
+    int64_t rateLimit;
+    steady_clock::time_point startTime;
+    steady_clock::time_point endTime;
+};
+
+#endif //SEMESTRALNIPRACE_DEFRAGMENTER_HPP
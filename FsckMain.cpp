@@ -0,0 +1,52 @@
+#include <string>
+#include <thread>
+#include <algorithm>
+#include "Utils.hpp"
+#include "VirtualFileSystem.hpp"
+#include "ConsistencyChecker.hpp"
+
+using std::string;
+using std::thread;
+using std::max;
+
+static const int FSCK_EXIT_CLEAN = 0;
+static const int FSCK_EXIT_REPAIRED = 1;
+static const int FSCK_EXIT_PROBLEMS = 4;
+static const int FSCK_EXIT_USAGE = 8;
+
+/**
+ * Standalone consistency check of an image, the image is not used by any other program meanwhile
+ * Usage: SemestralFsck image [-r]
+ */
+int main(int argc, const char* argv[]) {
+    bool repair = argc == 3 && REPAIR_FLAG == argv[2];
+    if (argc != (repair ? 3 : 2)) {
+        log("Usage: SemestralFsck image [" + REPAIR_FLAG + "]");
+        return FSCK_EXIT_USAGE;
+    }
+
+    string filename = argv[1];
+    log(LOADING_FILE_TEXT + filename);
+
+    VirtualFileSystem vfs(filename);
+    if (!vfs.getIsFormatted()) {
+        log(PLEASE_FORMAT_VFS_TEXT);
+        return FSCK_EXIT_USAGE;
+    }
+
+    FsckReport report;
+    {
+        auto lock = vfs.lockExclusive();
+        ConsistencyChecker checker(&vfs, max(1U, thread::hardware_concurrency()));
+        report = checker.check(repair);
+        vfs.syncChecksums();
+    }
+
+    log(report.summary());
+    if (report.isClean()) {
+        log(FSCK_CLEAN_TEXT);
+        return FSCK_EXIT_CLEAN;
+    }
+    log(report.repaired ? FSCK_REPAIRED_TEXT : FSCK_PROBLEMS_TEXT);
+    return report.repaired ? FSCK_EXIT_REPAIRED : FSCK_EXIT_PROBLEMS;
+}
@@ -27,11 +27,11 @@ void Inode::setReferences(int8_t references) {
     this->references = references;
 }
 
-int32_t Inode::getFileSize() const {
+int64_t Inode::getFileSize() const {
     return fileSize;
 }
 
-void Inode::setFileSize(int32_t fileSize) {
+void Inode::setFileSize(int64_t fileSize) {
     this->fileSize = fileSize;
 }
 
@@ -66,4 +66,60 @@ void Inode::setIndirect(int index, int32_t value) {
         throw invalid_argument(THE_INDEX_VALUE_HAS_TO_BE_BETWEEN_0_AND_1_TEXT);
     }
 
-}
\ No newline at end of file
+}
+
+int32_t Inode::getDoubleIndirect() const {
+    return doubleIndirect;
+}
+
+void Inode::setDoubleIndirect(int32_t value) {
+    doubleIndirect = value;
+}
+
+int32_t Inode::getTripleIndirect() const {
+    return tripleIndirect;
+}
+
+void Inode::setTripleIndirect(int32_t value) {
+    tripleIndirect = value;
+}
+
+bool Inode::getIsInline() const {
+    return isInline;
+}
+
+void Inode::setIsInline(bool isInline) {
+    this->isInline = isInline;
+}
+
+const string& Inode::getInlineData() const {
+    return inlineData;
+}
+
+void Inode::setInlineData(const string& data) {
+    inlineData = data;
+}
+
+int32_t Inode::getTailCluster() const {
+    return tailCluster;
+}
+
+void Inode::setTailCluster(int32_t cluster) {
+    tailCluster = cluster;
+}
+
+int32_t Inode::getTailOffset() const {
+    return tailOffset;
+}
+
+void Inode::setTailOffset(int32_t offset) {
+    tailOffset = offset;
+}
+
+bool Inode::getIsCompressed() const {
+    return isCompressed;
+}
+
+void Inode::setIsCompressed(bool isCompressed) {
+    this->isCompressed = isCompressed;
+}
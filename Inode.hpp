@@ -3,6 +3,9 @@
 
 #include <cstdint>
 #include <stdexcept>
+#include <string>
+
+using std::string;
 
 /**
  * Class representing an inode
@@ -55,13 +58,13 @@ public:
      * Gets the file size
      * @return file size
      */
-    int32_t getFileSize() const;
+    int64_t getFileSize() const;
 
     /**
      * Sets the file size
      * @param fileSize - new file size
      */
-    void setFileSize(int32_t fileSize);
+    void setFileSize(int64_t fileSize);
 
     /**
      * Gets the direct pointer at the given index, if the index is valid (0-4)
@@ -91,13 +94,104 @@ public:
      */
     void setIndirect(int index, int32_t value);
 
+    /**
+     * Gets the double indirect pointer ( only stored by the large file i-node revision )
+     * @return double indirect pointer
+     */
+    int32_t getDoubleIndirect() const;
+
+    /**
+     * Sets the double indirect pointer
+     * @param value - new value of the double indirect pointer
+     */
+    void setDoubleIndirect(int32_t value);
+
+    /**
+     * Gets the triple indirect pointer ( only stored by the large file i-node revision )
+     * @return triple indirect pointer
+     */
+    int32_t getTripleIndirect() const;
+
+    /**
+     * Sets the triple indirect pointer
+     * @param value - new value of the triple indirect pointer
+     */
+    void setTripleIndirect(int32_t value);
+
+    /**
+     * Gets whether the file data is stored in the i-node record instead of data clusters
+     * @return true if the data is inline, false otherwise
+     */
+    bool getIsInline() const;
+
+    /**
+     * Sets whether the file data is stored in the i-node record
+     * @param isInline - true if the data is inline, false otherwise
+     */
+    void setIsInline(bool isInline);
+
+    /**
+     * Gets the inline data of the file ( at most INLINE_DATA_SIZE bytes )
+     * @return inline data
+     */
+    const string& getInlineData() const;
+
+    /**
+     * Sets the inline data of the file
+     * @param data - new inline data
+     */
+    void setInlineData(const string& data);
+
+    /**
+     * Gets the pack cluster holding the data of the file ( tail packing )
+     * @return pack cluster or ID_ITEM_FREE if the data is not packed
+     */
+    int32_t getTailCluster() const;
+
+    /**
+     * Sets the pack cluster holding the data of the file
+     * @param cluster - new pack cluster or ID_ITEM_FREE
+     */
+    void setTailCluster(int32_t cluster);
+
+    /**
+     * Gets the offset of the file data in its pack cluster, the length is the file size
+     * @return offset in bytes
+     */
+    int32_t getTailOffset() const;
+
+    /**
+     * Sets the offset of the file data in its pack cluster
+     * @param offset - new offset in bytes
+     */
+    void setTailOffset(int32_t offset);
+
+    /**
+     * Gets whether the data clusters of the file hold compressed units
+     * @return true if the file is compressed, false otherwise
+     */
+    bool getIsCompressed() const;
+
+    /**
+     * Sets whether the data clusters of the file hold compressed units
+     * @param isCompressed - true if the file is compressed, false otherwise
+     */
+    void setIsCompressed(bool isCompressed);
+
 private:
     int32_t nodeId;
     bool isDirectory;
     int8_t references;
-    int32_t fileSize;
+    int64_t fileSize;
     int32_t direct[5];
     int32_t indirect[2];
+    int32_t doubleIndirect;
+    int32_t tripleIndirect;
+    bool isInline = false;
+    string inlineData;
+    int32_t tailCluster = -1;   // ID_ITEM_FREE
+    int32_t tailOffset = 0;
+    bool isCompressed = false;
 };
 
 #endif //SEMESTRALNIPRACE_INODE_HPP
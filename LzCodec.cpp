@@ -0,0 +1,176 @@
+#include "LzCodec.hpp"
+#include <cstring>
+#include <vector>
+
+using std::vector;
+
+static const int MIN_MATCH     = 4;
+static const int MAX_OFFSET    = 65535;
+static const int LAST_LITERALS = 5;         // The tail of the input is never searched for matches
+static const int HASH_BITS     = 12;
+
+/**
+ * Loads four bytes of the input
+ * @param data - input
+ * @return loaded bytes
+ */
+static uint32_t read32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/**
+ * Gets index of the four bytes in the hash table
+ * @param value - four bytes of the input
+ * @return index in the hash table
+ */
+static uint32_t hash(uint32_t value) {
+    return (value * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/**
+ * Writes extension of a length which did not fit into its nibble of the token
+ * @param out - output position, moved behind the written bytes
+ * @param end - end of the output
+ * @param length - rest of the length ( length - 15 )
+ * @return true if the bytes fit into the output, false otherwise
+ */
+static bool putLength(uint8_t*& out, const uint8_t* end, int length) {
+    while (length >= 255) {
+        if (out >= end) return false;
+        *out++ = 255;
+        length -= 255;
+    }
+    if (out >= end) return false;
+    *out++ = static_cast<uint8_t>(length);
+    return true;
+}
+
+/**
+ * Reads extension of a length from the input
+ * @param in - input position, moved behind the read bytes
+ * @param end - end of the input
+ * @param length - length from the token, extended in place
+ * @return true if the input was long enough, false otherwise
+ */
+static bool getLength(const uint8_t*& in, const uint8_t* end, int& length) {
+    uint8_t byte;
+    do {
+        if (in >= end) return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/**
+ * Writes one token with its literals and match
+ * @param out - output position, moved behind the token
+ * @param end - end of the output
+ * @param literals - literals of the token
+ * @param literalCount - number of literals
+ * @param offset - offset of the match ( ignored for the last token )
+ * @param matchLength - length of the match, 0 for the last token
+ * @return true if the token fit into the output, false otherwise
+ */
+static bool putToken(uint8_t*& out, const uint8_t* end, const uint8_t* literals, int literalCount,
+                     int offset, int matchLength) {
+    if (out >= end) return false;
+    uint8_t* token = out++;
+    int matchCode = matchLength > 0 ? matchLength - MIN_MATCH : 0;
+    *token = static_cast<uint8_t>(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+
+    if (literalCount >= 15 && !putLength(out, end, literalCount - 15)) return false;
+    if (end - out < literalCount) return false;
+    memcpy(out, literals, static_cast<size_t>(literalCount));
+    out += literalCount;
+
+    if (matchLength == 0) return true;
+    if (end - out < 2) return false;
+    *out++ = static_cast<uint8_t>(offset & 0xFF);
+    *out++ = static_cast<uint8_t>(offset >> 8);
+    return matchCode < 15 || putLength(out, end, matchCode - 15);
+}
+
+int LzCodec::compress(const char* source, int size, char* target, int capacity) {
+    if (capacity <= 0) {
+        return -1;
+    }
+
+    const auto* in = reinterpret_cast<const uint8_t*>(source);
+    auto* out = reinterpret_cast<uint8_t*>(target);
+    const uint8_t* outEnd = out + capacity;
+    vector<int32_t> table(1 << HASH_BITS, -1);
+
+    int anchor = 0;
+    int position = 0;
+    int limit = size - LAST_LITERALS;
+    while (position + MIN_MATCH <= limit) {
+        uint32_t sequence = read32(in + position);
+        uint32_t slot = hash(sequence);
+        int candidate = table[slot];
+        table[slot] = position;
+
+        if (candidate < 0 || position - candidate > MAX_OFFSET || read32(in + candidate) != sequence) {
+            position++;
+            continue;
+        }
+
+        int length = MIN_MATCH;
+        while (position + length < limit && in[candidate + length] == in[position + length]) {
+            length++;
+        }
+        if (!putToken(out, outEnd, in + anchor, position - anchor, position - candidate, length)) {
+            return -1;
+        }
+        position += length;
+        anchor = position;
+    }
+
+    if (!putToken(out, outEnd, in + anchor, size - anchor, 0, 0)) {
+        return -1;
+    }
+    return static_cast<int>(out - reinterpret_cast<uint8_t*>(target));
+}
+
+bool LzCodec::decompress(const char* source, int size, char* target, int rawSize) {
+    const auto* in = reinterpret_cast<const uint8_t*>(source);
+    const uint8_t* inEnd = in + size;
+    auto* out = reinterpret_cast<uint8_t*>(target);
+    uint8_t* outStart = out;
+    uint8_t* outEnd = out + rawSize;
+
+    while (in < inEnd) {
+        uint8_t token = *in++;
+
+        int literalCount = token >> 4;
+        if (literalCount == 15 && !getLength(in, inEnd, literalCount)) return false;
+        if (inEnd - in < literalCount || outEnd - out < literalCount) return false;
+        memcpy(out, in, static_cast<size_t>(literalCount));
+        in += literalCount;
+        out += literalCount;
+
+        // Only the last token has no match
+        if (in == inEnd) {
+            break;
+        }
+
+        if (inEnd - in < 2) return false;
+        int offset = in[0] | (in[1] << 8);
+        in += 2;
+        int matchLength = token & 0x0F;
+        if (matchLength == 15 && !getLength(in, inEnd, matchLength)) return false;
+        matchLength += MIN_MATCH;
+
+        if (offset == 0 || offset > out - outStart || outEnd - out < matchLength) return false;
+        // Matches may overlap their own output, so bytes are copied one by one
+        const uint8_t* match = out - offset;
+        for (int i = 0; i < matchLength; i++) {
+            out[i] = match[i];
+        }
+        out += matchLength;
+    }
+
+    return out == outEnd;
+}
@@ -0,0 +1,35 @@
+#ifndef SEMESTRALNIPRACE_LZCODEC_HPP
+#define SEMESTRALNIPRACE_LZCODEC_HPP
+
+#include <cstdint>
+
+/**
+ * Fast LZ77 codec used for compressed files. The format is a sequence of tokens, every token holds the length
+ * of literals copied from the input followed by a match ( 16-bit offset back into the output and its length ),
+ * the last token holds literals only. Both functions are stateless, so units may be compressed in parallel.
+ */
+class LzCodec {
+public:
+
+    /**
+     * Compresses the data
+     * @param source - data to compress
+     * @param size - size of the data
+     * @param target - buffer for the compressed data
+     * @param capacity - size of the buffer
+     * @return size of the compressed data or -1 if it does not fit into the buffer
+     */
+    static int compress(const char* source, int size, char* target, int capacity);
+
+    /**
+     * Decompresses the data, corrupted input is detected and never written outside of the buffer
+     * @param source - compressed data
+     * @param size - size of the compressed data
+     * @param target - buffer for the decompressed data
+     * @param rawSize - size of the decompressed data
+     * @return true if exactly rawSize bytes were decompressed, false otherwise
+     */
+    static bool decompress(const char* source, int size, char* target, int rawSize);
+};
+
+#endif //SEMESTRALNIPRACE_LZCODEC_HPP
@@ -1,11 +1,16 @@
 #include <string>
 #include <iostream>
+#include <thread>
+#include <algorithm>
 #include "Utils.hpp"
 #include "VirtualFileSystem.hpp"
 #include "CommandProcessor.hpp"
+#include "VfsServer.hpp"
 
 using std::string;
 using std::cout;
+using std::thread;
+using std::max;
 
 
 void startLoop(VirtualFileSystem* vfs) {
@@ -25,11 +30,42 @@ void startLoop(VirtualFileSystem* vfs) {
 }
 
 
+/**
+ * Keeps the image mounted and serves local clients until SIGINT or SIGTERM
+ * @param socketPath - path of the Unix domain socket
+ * @param filename - path of the image
+ * @return exit code of the program
+ */
+int serve(const string& socketPath, const string& filename) {
+    log(LOADING_FILE_TEXT + filename);
+    VirtualFileSystem vfs(filename);
+    if (!vfs.getIsFormatted()) {
+        log(PLEASE_FORMAT_VFS_TEXT);
+        return 1;
+    }
+
+    {
+        VfsServer server(&vfs, max(1U, thread::hardware_concurrency()));
+        if (!server.start(socketPath)) {
+            log(SERVER_NOT_STARTED_TEXT + socketPath);
+            return 1;
+        }
+        log(SERVER_LISTENING_TEXT + socketPath);
+        server.run();
+    }
+
+    log(SERVER_STOPPED_TEXT);
+    return 0;
+}
+
+
 int main(int argc, const char* argv[]) {
     log(SIGNATURE);
     log(PROGRAM_INTRODUCTIONS_TEXT);
 
-    if (argc == 2) {
+    if (argc == 4 && SERVE_FLAG == argv[1]) {
+        return serve(argv[2], argv[3]);
+    } else if (argc == 2) {
         string filename = argv[1];
         log(LOADING_FILE_TEXT + filename);
 
@@ -0,0 +1,20 @@
+#include "OpenFile.hpp"
+
+OpenFile::OpenFile(int32_t inodeId, Directory* parentDir, Session* session)
+        : inodeId(inodeId), parentDir(parentDir), session(session) {}
+
+int32_t OpenFile::getInodeId() const {
+    return inodeId;
+}
+
+Directory* OpenFile::getParentDir() const {
+    return parentDir;
+}
+
+void OpenFile::setParentDir(Directory* newParentDir) {
+    parentDir = newParentDir;
+}
+
+Session* OpenFile::getSession() const {
+    return session;
+}
@@ -0,0 +1,63 @@
+#ifndef SEMESTRALNIPRACE_OPENFILE_HPP
+#define SEMESTRALNIPRACE_OPENFILE_HPP
+
+#include <cstdint>
+#include <string>
+#include "Directory.hpp"
+#include "Session.hpp"
+
+/**
+ * File opened for random access reads and writes, addressed by a handle of the virtual file system.
+ * It keeps the i-node of the file, the directory whose sizes follow the size of the file and the
+ * session whose reserved clusters are used when the file grows.
+ */
+class OpenFile {
+public:
+
+    /**
+     * Constructor for open file
+     * @param inodeId - i-node of the file
+     * @param parentDir - directory containing the file
+     * @param session - session which opened the file
+     */
+    OpenFile(int32_t inodeId, Directory* parentDir, Session* session);
+
+    /**
+     * Gets the i-node of the file
+     * @return id of the i-node
+     */
+    int32_t getInodeId() const;
+
+    /**
+     * Gets the directory containing the file
+     * @return parent directory
+     */
+    Directory* getParentDir() const;
+
+    /**
+     * Sets the directory containing the file, after the file was moved
+     * @param newParentDir - new parent directory
+     */
+    void setParentDir(Directory* newParentDir);
+
+    /**
+     * Gets the session which opened the file
+     * @return session of the file
+     */
+    Session* getSession() const;
+
+private:
+    int32_t inodeId;
+    Directory* parentDir;
+    Session* session;
+};
+
+/**
+ * Data appended to a file and not yet written to its clusters ( delayed allocation ), one per i-node
+ */
+struct PendingAppend {
+    Directory* parentDir;   // Directory whose sizes follow the file when the data is written
+    std::string data;       // Appended bytes in order
+};
+
+#endif //SEMESTRALNIPRACE_OPENFILE_HPP
@@ -0,0 +1,122 @@
+#include "Readahead.hpp"
+#include "VirtualFileSystem.hpp"
+#include "Constants.hpp"
+#include <algorithm>
+#include <cstring>
+
+using std::min;
+using std::max;
+
+Readahead::Readahead(VirtualFileSystem* vfs, int32_t inodeId, const vector<int32_t>& blocks, int blockCount)
+        : vfs(vfs), inodeId(inodeId), blocks(blocks), blockCount(blockCount),
+          clusterSize(vfs->getClusterSize()), maxWindow(max(READAHEAD_MAX_BYTES / clusterSize, 1)),
+          state(vfs->getReadaheadState(inodeId)), windowStart(0), windowCount(0), windowUsed(0),
+          hits(0), misses(0) {
+    state.window = min(state.window, maxWindow);
+}
+
+Readahead::~Readahead() {
+    adapt();
+    vfs->setReadaheadState(inodeId, state);
+}
+
+streamsize Readahead::read(int index, char* buffer, size_t size) {
+    if (index < 0 || index >= blockCount) {
+        return -1;
+    }
+    size = min(size, static_cast<size_t>(clusterSize));
+
+    if (index < windowStart || index >= windowStart + windowCount) {
+        misses++;
+        adapt();
+
+        // Starting over from the beginning of the file is sequential too
+        bool sequential = index == state.nextIndex || index == 0;
+        int count = sequential ? min(state.window, blockCount - index) : 1;
+        if (!fill(index, count)) {
+            windowCount = 0;
+            return -1;
+        }
+        if (sequential) {
+            prefetch(index + count, min(state.window, blockCount - index - count));
+        }
+    } else {
+        hits++;
+    }
+
+    windowUsed++;
+    state.nextIndex = index + 1;
+    memcpy(buffer, window.data() + static_cast<size_t>(index - windowStart) * clusterSize, size);
+    return static_cast<streamsize>(size);
+}
+
+int32_t Readahead::getHits() const {
+    return hits;
+}
+
+int32_t Readahead::getMisses() const {
+    return misses;
+}
+
+bool Readahead::fill(int index, int count) {
+    window.resize(static_cast<size_t>(count) * clusterSize);
+    windowStart = index;
+    windowCount = count;
+    windowUsed = 0;
+
+    int i = 0;
+    while (i < count) {
+        // Holes read as zeros without touching the image
+        int run = 1;
+        if (blocks[index + i] == ID_ITEM_FREE) {
+            while (i + run < count && blocks[index + i + run] == ID_ITEM_FREE) {
+                run++;
+            }
+            memset(window.data() + static_cast<size_t>(i) * clusterSize, 0, static_cast<size_t>(run) * clusterSize);
+            i += run;
+            continue;
+        }
+
+        // Physically adjacent clusters are read at once
+        while (i + run < count && blocks[index + i + run] == blocks[index + i + run - 1] + 1) {
+            run++;
+        }
+
+        streamsize runBytes = static_cast<streamsize>(run) * clusterSize;
+        if (vfs->readDataClusters(blocks[index + i], window.data() + static_cast<size_t>(i) * clusterSize,
+                                  static_cast<size_t>(runBytes)) != runBytes) {
+            return false;
+        }
+        i += run;
+    }
+    return true;
+}
+
+void Readahead::prefetch(int index, int count) const {
+    int i = 0;
+    while (i < count) {
+        int run = 1;
+        while (i + run < count && blocks[index + i + run] == blocks[index + i + run - 1] + 1) {
+            run++;
+        }
+        if (blocks[index + i] != ID_ITEM_FREE) {
+            vfs->adviseDataClusters(blocks[index + i], run);
+        }
+        i += run;
+    }
+}
+
+void Readahead::adapt() {
+    // Only windows read ahead tell something about the hit rate
+    if (windowCount <= 1) {
+        return;
+    }
+
+    if (windowUsed >= windowCount) {
+        state.window = min(state.window * 2, maxWindow);
+    } else if (windowUsed * 2 < windowCount) {
+        state.window = max(state.window / 2, min(READAHEAD_MIN_CLUSTERS, maxWindow));
+    }
+    windowCount = 0;
+    windowUsed = 0;
+}
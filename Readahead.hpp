@@ -0,0 +1,106 @@
+#ifndef SEMESTRALNIPRACE_READAHEAD_HPP
+#define SEMESTRALNIPRACE_READAHEAD_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <ios>
+
+using std::vector;
+using std::streamsize;
+
+class VirtualFileSystem;
+
+/**
+ * Readahead state of one i-node, kept by the virtual file system between reads of the file
+ */
+struct ReadaheadState {
+    int32_t window;         // Number of clusters read ahead by the next miss
+    int32_t nextIndex;      // Index of the cluster expected by a sequential read
+};
+
+/**
+ * Reads data clusters of one file through a readahead window. When the clusters are read in file order,
+ * the next clusters of the file are read together with the requested one; physically adjacent clusters
+ * are merged into a single read and the kernel is asked to prefetch the window after that.
+ * The window doubles when all read ahead clusters were used and halves when less than half of them were.
+ */
+class Readahead {
+public:
+
+    /**
+     * Constructor for readahead, the window is restored from the state kept for the i-node
+     * @param vfs - virtual file system to read from
+     * @param inodeId - i-node of the file
+     * @param blocks - data blocks of the file in file order
+     * @param blockCount - number of data blocks of the file
+     */
+    Readahead(VirtualFileSystem* vfs, int32_t inodeId, const vector<int32_t>& blocks, int blockCount);
+
+    /**
+     * Destructor for readahead, stores the window back to the state of the i-node
+     */
+    ~Readahead();
+
+    Readahead(const Readahead&) = delete;
+    Readahead& operator=(const Readahead&) = delete;
+
+    /**
+     * Reads one data cluster of the file
+     * @param index - index of the cluster in the file
+     * @param buffer - buffer to read data into
+     * @param size - number of bytes to read ( at most the cluster size )
+     * @return number of bytes read, -1 on error
+     */
+    streamsize read(int index, char* buffer, size_t size);
+
+    /**
+     * Gets the number of clusters which were already in the window when they were read
+     * @return number of hits
+     */
+    int32_t getHits() const;
+
+    /**
+     * Gets the number of clusters which had to be read from the image
+     * @return number of misses
+     */
+    int32_t getMisses() const;
+
+private:
+
+    /**
+     * Reads clusters of the file starting with the given index into the window
+     * @param index - index of the first cluster
+     * @param count - number of clusters to read
+     * @return true if all clusters were read, false otherwise
+     */
+    bool fill(int index, int count);
+
+    /**
+     * Asks the kernel to prefetch clusters of the file, the call does not wait for the data
+     * @param index - index of the first cluster
+     * @param count - number of clusters to prefetch
+     */
+    void prefetch(int index, int count) const;
+
+    /**
+     * Adapts the window size to the part of the last window which was used
+     */
+    void adapt();
+
+    VirtualFileSystem* vfs;
+    int32_t inodeId;
+    const vector<int32_t>& blocks;
+    int blockCount;
+    int32_t clusterSize;
+    int32_t maxWindow;      // READAHEAD_MAX_BYTES in clusters
+    ReadaheadState state;
+    vector<char> window;
+    int windowStart;
+    int windowCount;
+    int windowUsed;
+    int32_t hits;
+    int32_t misses;
+};
+
+#endif //SEMESTRALNIPRACE_READAHEAD_HPP
@@ -0,0 +1,202 @@
+#include "Scrubber.hpp"
+#include "VirtualFileSystem.hpp"
+#include "ConsistencyChecker.hpp"
+#include <algorithm>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using std::lock_guard;
+using std::unique_lock;
+using std::min;
+using std::max;
+using std::stringstream;
+using std::chrono::duration;
+using std::chrono::duration_cast;
+
+static const int IOPRIO_WHO_PROCESS = 1;
+static const int IOPRIO_CLASS_IDLE = 3;
+static const int IOPRIO_CLASS_SHIFT = 13;
+
+/**
+ * Lowers the CPU and I/O priority of the calling thread, both are only hints and failures are ignored
+ */
+static void lowerThreadPriority() {
+    ::setpriority(PRIO_PROCESS, static_cast<id_t>(::syscall(SYS_gettid)), SCRUB_NICE);
+#ifdef SYS_ioprio_set
+    ::syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+}
+
+string ScrubStatus::summary() const {
+    double megabytes = bytesRead / 1000000.0;
+    stringstream ss;
+    ss << (state == ScrubState::RUNNING ? "Scrub running" : state == ScrubState::STOPPED ? "Scrub stopped" : "Scrub finished")
+       << ": " << (dataClusters > 0 ? 100.0 * walkedClusters / dataClusters : 100.0) << " % of the data region"
+       << ", used clusters checked: " << scrubbedClusters
+       << ", bytes: " << bytesRead
+       << ", time: " << elapsedSeconds << " s"
+       << ", throughput: " << (elapsedSeconds > 0 ? megabytes / elapsedSeconds : 0) << " MB/s"
+       << " ( limit " << rateLimit / 1000000.0 << " MB/s )" << '\n'
+       << "Bad clusters: " << badClusters
+       << ", orphaned clusters: " << orphanedClusters
+       << ", miscounted clusters: " << miscountedClusters;
+    return ss.str();
+}
+
+Scrubber::Scrubber(VirtualFileSystem* vfs)
+        : vfs(vfs), stopping(false), status() {
+    status.state = ScrubState::IDLE;
+}
+
+Scrubber::~Scrubber() {
+    stop();
+}
+
+bool Scrubber::start(int64_t rateLimit) {
+    lock_guard<mutex> lock(statusMutex);
+    if (status.state == ScrubState::RUNNING) {
+        return false;
+    }
+    if (worker.joinable()) {
+        worker.join();      // The last pass has finished, its thread only has to be collected
+    }
+
+    status = ScrubStatus();
+    status.state = ScrubState::RUNNING;
+    status.rateLimit = rateLimit;
+    status.dataClusters = vfs->getSuperblock()->getDataClusterCount();
+    stopping = false;
+    started = steady_clock::now();
+    worker = thread([this]() { run(); });
+    return true;
+}
+
+void Scrubber::stop() {
+    {
+        lock_guard<mutex> lock(statusMutex);
+        stopping = true;
+    }
+    stopRequested.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+ScrubStatus Scrubber::getStatus() const {
+    lock_guard<mutex> lock(statusMutex);
+    ScrubStatus copy = status;
+    auto end = status.state == ScrubState::RUNNING ? steady_clock::now() : finished;
+    copy.elapsedSeconds = status.state == ScrubState::IDLE ? 0 : duration<double>(end - started).count();
+    return copy;
+}
+
+void Scrubber::run() {
+    // The worker of the reference counter inherits the lowered priority
+    lowerThreadPriority();
+    ConsistencyChecker counter(vfs, 1);
+    vector<int32_t> references;
+    vector<char> buffer;
+    uint64_t countedModifications = 0;
+    bool counted = false;
+    bool completed = false;
+
+    int64_t cluster = 0;
+    while (pace()) {
+        auto lock = vfs->lockShared();
+        if (!vfs->getIsFormatted() || vfs->getSuperblock()->getDataClusterCount() != status.dataClusters) {
+            break;          // Formatted again, the pass cannot continue on the new file system
+        }
+        if (cluster >= status.dataClusters) {
+            completed = true;
+            break;
+        }
+        if (!counted || vfs->getModificationCount() != countedModifications) {
+            countedModifications = vfs->getModificationCount();
+            references = counter.countReferences();
+            counted = true;
+        }
+        cluster = scrubBatch(cluster, references, buffer);
+    }
+
+    lock_guard<mutex> lock(statusMutex);
+    status.state = completed ? ScrubState::FINISHED : ScrubState::STOPPED;
+    finished = steady_clock::now();
+}
+
+int64_t Scrubber::scrubBatch(int64_t first, const vector<int32_t>& references, vector<char>& buffer) {
+    const Superblock* superblock = vfs->getSuperblock();
+    const int8_t* bitmap = vfs->getDataBitmap();
+    int64_t clusterSize = superblock->getClusterSize();
+    int64_t end = min(first + max<int64_t>(1, SCRUB_BATCH_BYTES / clusterSize), status.dataClusters);
+    bool shared = superblock->hasFeature(FEATURE_DEDUP);
+
+    // Free clusters at both ends of the batch are not read, the used ones are read at once
+    while (first < end && bitmap[first] <= 0) {
+        first++;
+    }
+    int64_t last = end - 1;
+    while (last >= first && bitmap[last] <= 0) {
+        last--;
+    }
+    if (first > last) {
+        lock_guard<mutex> lock(statusMutex);
+        status.walkedClusters = end;
+        return end;
+    }
+
+    size_t size = static_cast<size_t>((last - first + 1) * clusterSize);
+    buffer.resize(size);
+    streamsize count = vfs->readAt(superblock->getDataStartAddress() + first * clusterSize, buffer.data(), size);
+
+    int64_t scrubbed = 0;
+    for (int64_t cluster = first; cluster <= last; cluster++) {
+        if (bitmap[cluster] <= 0) {
+            continue;
+        }
+        scrubbed++;
+
+        char* data = buffer.data() + (cluster - first) * clusterSize;
+        if (count < (cluster - first + 1) * clusterSize
+            && vfs->readAt(superblock->getDataStartAddress() + cluster * clusterSize, data, static_cast<size_t>(clusterSize)) != clusterSize) {
+            record(static_cast<int32_t>(cluster), ScrubProblem::READ_ERROR);
+        } else if (!vfs->matchesChecksum(static_cast<int32_t>(cluster), data)) {
+            record(static_cast<int32_t>(cluster), ScrubProblem::CHECKSUM_MISMATCH);
+        }
+
+        int32_t expected = min<int32_t>(references[cluster], shared ? DEDUP_MAX_REFERENCES : 1);
+        if (references[cluster] == 0) {
+            record(static_cast<int32_t>(cluster), ScrubProblem::ORPHANED);
+        } else if (bitmap[cluster] != expected || (!shared && references[cluster] > 1)) {
+            record(static_cast<int32_t>(cluster), ScrubProblem::MISCOUNTED);
+        }
+    }
+
+    lock_guard<mutex> lock(statusMutex);
+    status.walkedClusters = end;
+    status.scrubbedClusters += scrubbed;
+    status.bytesRead += static_cast<int64_t>(size);
+    return end;
+}
+
+void Scrubber::record(int32_t cluster, ScrubProblem problem) {
+    lock_guard<mutex> lock(statusMutex);
+    if (problem == ScrubProblem::READ_ERROR || problem == ScrubProblem::CHECKSUM_MISMATCH) {
+        status.badClusters++;
+    } else if (problem == ScrubProblem::ORPHANED) {
+        status.orphanedClusters++;
+    } else {
+        status.miscountedClusters++;
+    }
+    if (status.findings.size() < static_cast<size_t>(SCRUB_RECORD_LIMIT)) {
+        status.findings.push_back(ScrubFinding{cluster, problem});
+    }
+}
+
+bool Scrubber::pace() {
+    unique_lock<mutex> lock(statusMutex);
+    auto due = started + duration_cast<steady_clock::duration>(duration<double>(
+            static_cast<double>(status.bytesRead) / static_cast<double>(status.rateLimit)));
+    return !stopRequested.wait_until(lock, due, [this]() { return stopping; });
+}
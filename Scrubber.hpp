@@ -0,0 +1,152 @@
+#ifndef SEMESTRALNIPRACE_SCRUBBER_HPP
+#define SEMESTRALNIPRACE_SCRUBBER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::condition_variable;
+using std::mutex;
+using std::string;
+using std::thread;
+using std::vector;
+using std::chrono::steady_clock;
+
+class VirtualFileSystem;
+
+/**
+ * State of the background scrub
+ */
+enum class ScrubState {
+    IDLE,       // No scrub was started yet
+    RUNNING,
+    STOPPED,    // Stopped before all clusters were read ( stop command or a new format )
+    FINISHED
+};
+
+/**
+ * Problem of a data cluster found by the scrub
+ */
+enum class ScrubProblem {
+    READ_ERROR,         // The cluster could not be read
+    CHECKSUM_MISMATCH,  // The content does not match the stored checksum
+    ORPHANED,           // Marked as used, referenced by no i-node
+    MISCOUNTED          // Referenced by another number of block pointers than the bitmap records
+};
+
+/**
+ * Data cluster with a problem
+ */
+struct ScrubFinding {
+    int32_t cluster;
+    ScrubProblem problem;
+};
+
+/**
+ * Progress and findings of the last scrub pass
+ */
+struct ScrubStatus {
+    ScrubState state;
+    int64_t dataClusters;           // Size of the data region
+    int64_t walkedClusters;         // Data clusters of the bitmap walked so far
+    int64_t scrubbedClusters;       // Used data clusters checked so far
+    int64_t bytesRead;
+    int64_t rateLimit;              // Bytes per second
+    double elapsedSeconds;
+    int64_t badClusters;            // Unreadable or with a checksum mismatch
+    int64_t orphanedClusters;
+    int64_t miscountedClusters;
+    vector<ScrubFinding> findings;  // First SCRUB_RECORD_LIMIT problems
+
+    /**
+     * Describes the progress and the numbers of problems on two lines
+     * @return summary of the pass
+     */
+    string summary() const;
+};
+
+/**
+ * Background scrub of the used data clusters. A low priority thread walks the bitmap and reads the used
+ * clusters in large sequential reads limited to the given bandwidth, verifies their checksums and checks
+ * that every cluster is referenced by as many block pointers as its bitmap entry records. Each batch is
+ * read under the shared state lock, so commands modifying the file system wait for one batch at most;
+ * the references are counted again whenever a command changed the file system since the last batch.
+ */
+class Scrubber {
+public:
+
+    /**
+     * Constructor for scrubber, no thread is started until start is called
+     * @param vfs - virtual file system to scrub
+     */
+    explicit Scrubber(VirtualFileSystem* vfs);
+
+    /**
+     * Destructor, stops the running scrub
+     */
+    ~Scrubber();
+
+    Scrubber(const Scrubber&) = delete;
+    Scrubber& operator=(const Scrubber&) = delete;
+
+    /**
+     * Starts a new pass over all used data clusters, the caller holds the shared state lock
+     * @param rateLimit - bytes read per second at most
+     * @return false if a pass is already running, true otherwise
+     */
+    bool start(int64_t rateLimit);
+
+    /**
+     * Stops the running pass and waits for its thread, the caller must not hold the state lock
+     */
+    void stop();
+
+    /**
+     * Gets the progress and findings of the running or the last pass
+     * @return status of the scrub
+     */
+    ScrubStatus getStatus() const;
+
+private:
+    /**
+     * Reads all used data clusters batch by batch, runs on the scrub thread
+     */
+    void run();
+
+    /**
+     * Checks the used clusters of one batch, the caller holds the shared state lock
+     * @param first - first data cluster of the batch
+     * @param references - references of every data cluster counted from the block maps
+     * @param buffer - buffer for the read clusters
+     * @return first data cluster of the next batch
+     */
+    int64_t scrubBatch(int64_t first, const vector<int32_t>& references, vector<char>& buffer);
+
+    /**
+     * Counts a problem of a cluster and keeps it if the list of findings is not full
+     * @param cluster - data cluster
+     * @param problem - problem of the cluster
+     */
+    void record(int32_t cluster, ScrubProblem problem);
+
+    /**
+     * Waits until the bytes read so far fit into the rate limit
+     * @return false if the pass was stopped meanwhile, true otherwise
+     */
+    bool pace();
+
+    VirtualFileSystem* vfs;
+    thread worker;
+    mutable mutex statusMutex;
+    condition_variable stopRequested;
+    bool stopping;
+    ScrubStatus status;
+    steady_clock::time_point started;
+    steady_clock::time_point finished;
+};
+
+#endif //SEMESTRALNIPRACE_SCRUBBER_HPP
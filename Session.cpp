@@ -0,0 +1,20 @@
+#include "Session.hpp"
+
+Session::Session(Directory* currentDir, ClusterReservation* reservation)
+        : currentDir(currentDir), reservation(reservation) {}
+
+Session::~Session() {
+    delete reservation;
+}
+
+Directory* Session::getCurrentDir() const {
+    return currentDir;
+}
+
+void Session::setCurrentDir(Directory* newCurrentDir) {
+    currentDir = newCurrentDir;
+}
+
+ClusterReservation* Session::getReservation() const {
+    return reservation;
+}
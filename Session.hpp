@@ -0,0 +1,51 @@
+#ifndef SEMESTRALNIPRACE_SESSION_HPP
+#define SEMESTRALNIPRACE_SESSION_HPP
+
+#include "Directory.hpp"
+#include "ClusterReservation.hpp"
+
+/**
+ * Class representing one client of the virtual file system ( keeps its own current directory )
+ */
+class Session {
+public:
+
+    /**
+     * Constructor for session
+     * @param currentDir - initial current directory
+     * @param reservation - pool of reserved clusters of the session ( owned by the session )
+     */
+    Session(Directory* currentDir, ClusterReservation* reservation);
+
+    /**
+     * Destructor for session, the reservation has to be released before
+     */
+    ~Session();
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    /**
+     * Gets current directory of the session
+     * @return current directory of the session
+     */
+    Directory* getCurrentDir() const;
+
+    /**
+     * Sets current directory of the session
+     * @param newCurrentDir - new current directory
+     */
+    void setCurrentDir(Directory* newCurrentDir);
+
+    /**
+     * Gets pool of clusters reserved for the session
+     * @return pool of reserved clusters
+     */
+    ClusterReservation* getReservation() const;
+
+private:
+    Directory* currentDir;
+    ClusterReservation* reservation;
+};
+
+#endif //SEMESTRALNIPRACE_SESSION_HPP
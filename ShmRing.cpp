@@ -0,0 +1,116 @@
+#include <initializer_list>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include "ShmRing.hpp"
+
+static const uint64_t PAGE_BYTES = 4096;
+
+ShmRing::ShmRing()
+        : memoryFd(-1), submitFd(-1), completeFd(-1), slotCount(0), dataAreaOffset(0), dataAreaSize(0), mappedSize(0),
+          memory(nullptr), header(nullptr), requests(nullptr), completions(nullptr) {}
+
+ShmRing::~ShmRing() {
+    if (memory != nullptr) {
+        munmap(memory, mappedSize);
+    }
+    for (int fd : {memoryFd, submitFd, completeFd}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+bool ShmRing::create(uint32_t slots, uint64_t dataSize) {
+    if (slots == 0 || slots > SHM_MAX_SLOTS || (slots & (slots - 1)) != 0 || dataSize == 0 || dataSize > SHM_MAX_DATA_BYTES) {
+        return false;
+    }
+
+    uint64_t queueBytes = sizeof(ShmRingHeader) + slots * (sizeof(ShmRequest) + sizeof(ShmCompletion));
+    slotCount = slots;
+    dataAreaOffset = (queueBytes + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES;
+    dataAreaSize = dataSize;
+    mappedSize = static_cast<size_t>(dataAreaOffset + (dataSize + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES);
+
+    memoryFd = memfd_create("vfs-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    submitFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    completeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (memoryFd < 0 || submitFd < 0 || completeFd < 0 || ftruncate(memoryFd, static_cast<off_t>(mappedSize)) != 0
+        || fcntl(memoryFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    memory = static_cast<char*>(mapped);
+
+    // A new memfd is filled with zeros, so both queues start empty
+    header = new(memory) ShmRingHeader();
+    header->magic = SHM_RING_MAGIC;
+    header->slotCount = slotCount;
+    header->dataOffset = dataAreaOffset;
+    header->dataSize = dataAreaSize;
+    requests = reinterpret_cast<ShmRequest*>(memory + sizeof(ShmRingHeader));
+    completions = reinterpret_cast<ShmCompletion*>(requests + slotCount);
+    return true;
+}
+
+int ShmRing::getMemoryFd() const {
+    return memoryFd;
+}
+
+int ShmRing::getSubmitFd() const {
+    return submitFd;
+}
+
+int ShmRing::getCompleteFd() const {
+    return completeFd;
+}
+
+uint64_t ShmRing::getDataOffset() const {
+    return dataAreaOffset;
+}
+
+bool ShmRing::popRequest(ShmRequest& request) {
+    uint32_t head = header->submitHead.load(std::memory_order_relaxed);
+    if (head == header->submitTail.load(std::memory_order_acquire)) {
+        return false;
+    }
+    request = requests[head & (slotCount - 1)];
+    header->submitHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool ShmRing::hasCompletionSpace() const {
+    uint32_t tail = header->completeTail.load(std::memory_order_relaxed);
+    return tail - header->completeHead.load(std::memory_order_acquire) < slotCount;
+}
+
+void ShmRing::pushCompletion(const ShmCompletion& completion) {
+    uint32_t tail = header->completeTail.load(std::memory_order_relaxed);
+    completions[tail & (slotCount - 1)] = completion;
+    header->completeTail.store(tail + 1, std::memory_order_release);
+}
+
+void ShmRing::notifyClient() {
+    uint64_t one = 1;
+    if (write(completeFd, &one, sizeof(one)) < 0) {
+        return;     // The counter is full, the client is woken anyway
+    }
+}
+
+void ShmRing::clearSubmitEvents() {
+    uint64_t value;
+    while (read(submitFd, &value, sizeof(value)) == sizeof(value)) {}
+}
+
+char* ShmRing::getBuffer(uint64_t offset, int64_t size) const {
+    if (size < 0 || offset > dataAreaSize || static_cast<uint64_t>(size) > dataAreaSize - offset) {
+        return nullptr;
+    }
+    return memory + dataAreaOffset + offset;
+}
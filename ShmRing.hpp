@@ -0,0 +1,172 @@
+#ifndef SEMESTRALNIPRACE_SHMRING_HPP
+#define SEMESTRALNIPRACE_SHMRING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+using std::atomic;
+
+/*
+ * Shared memory ring of a server connection, one memfd mapped by the server and the client:
+ *
+ *   ShmRingHeader | slotCount x ShmRequest | slotCount x ShmCompletion | data area ( from dataOffset )
+ *
+ * The client owns the data area, it places requests to the submission queue and reads completions from the completion
+ * queue; the server reads the data of a file straight into the buffer of a request or writes a file from it. Both
+ * queues have one producer and one consumer and work without locks: indexes run freely and are taken modulo slotCount,
+ * the producer writes the slot before it publishes the new tail ( release ) and the consumer reads the tail ( acquire )
+ * before the slot. After placing requests, or after taking completions while the completion queue was full, the client
+ * writes 1 to the submit eventfd; the server writes 1 to the complete eventfd after adding completions.
+ */
+
+static const uint32_t SHM_RING_MAGIC = 0x47525356;      // "VSRG"
+static const uint32_t SHM_MAX_SLOTS = 4096;
+static const uint64_t SHM_MAX_DATA_BYTES = 1ULL << 32;
+static const size_t SHM_PATH_LENGTH = 216;
+
+/**
+ * Header at the start of the shared memory, every index has its own cache line
+ */
+struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t slotCount;                     // Power of two
+    uint64_t dataOffset;                    // Offset of the data area from the start of the memory
+    uint64_t dataSize;
+    alignas(64) atomic<uint32_t> submitHead;      // Next request the server takes
+    alignas(64) atomic<uint32_t> submitTail;      // Next free request slot, written by the client
+    alignas(64) atomic<uint32_t> completeHead;    // Next completion the client takes
+    alignas(64) atomic<uint32_t> completeTail;    // Next free completion slot, written by the server
+};
+
+/**
+ * Request descriptor of the submission queue
+ */
+struct ShmRequest {
+    uint64_t userData;          // Returned in the completion
+    int64_t offset;             // Offset in the file
+    int64_t size;               // Bytes to read or write
+    uint64_t bufferOffset;      // Offset of the buffer in the data area
+    uint16_t opcode;            // ServerOpcode::READ or ServerOpcode::WRITE
+    uint16_t pathLength;
+    uint32_t reserved;
+    char path[SHM_PATH_LENGTH]; // Absolute path of the file, not terminated
+};
+
+/**
+ * Completion descriptor of the completion queue
+ */
+struct ShmCompletion {
+    uint64_t userData;
+    int64_t result;             // Bytes read or written
+    int32_t status;             // VfsStatus
+    uint32_t reserved;
+};
+
+static_assert(sizeof(ShmRingHeader) == 320, "Layout of the shared header is part of the protocol");
+static_assert(sizeof(ShmRequest) == 256, "Layout of the request descriptor is part of the protocol");
+static_assert(sizeof(ShmCompletion) == 24, "Layout of the completion descriptor is part of the protocol");
+
+/**
+ * Server side of a shared memory ring: the sealed memfd, its mapping and the two eventfds
+ */
+class ShmRing {
+public:
+
+    /**
+     * Constructor for ring, nothing is allocated until create is called
+     */
+    ShmRing();
+
+    /**
+     * Destructor, unmaps the memory and closes the descriptors
+     */
+    ~ShmRing();
+
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    /**
+     * Creates the memory and the eventfds, the size of the memory is sealed so the client cannot shrink it
+     * @param slots - number of descriptors of each queue, a power of two up to SHM_MAX_SLOTS
+     * @param dataSize - size of the data area
+     * @return true if the ring was created
+     */
+    bool create(uint32_t slots, uint64_t dataSize);
+
+    /**
+     * Gets the memfd of the shared memory, sent to the client
+     * @return file descriptor
+     */
+    int getMemoryFd() const;
+
+    /**
+     * Gets the eventfd the client writes after placing requests
+     * @return file descriptor
+     */
+    int getSubmitFd() const;
+
+    /**
+     * Gets the eventfd the server writes after adding completions
+     * @return file descriptor
+     */
+    int getCompleteFd() const;
+
+    /**
+     * Gets the offset of the data area, which starts on a page
+     * @return offset from the start of the memory
+     */
+    uint64_t getDataOffset() const;
+
+    /**
+     * Takes the next request of the submission queue
+     * @param request - copy of the request
+     * @return false if the queue is empty
+     */
+    bool popRequest(ShmRequest& request);
+
+    /**
+     * Checks that a completion may be added
+     * @return false if the client has not taken enough completions yet
+     */
+    bool hasCompletionSpace() const;
+
+    /**
+     * Adds a completion, hasCompletionSpace has to be true
+     * @param completion - completion to add
+     */
+    void pushCompletion(const ShmCompletion& completion);
+
+    /**
+     * Wakes the client waiting on the complete eventfd
+     */
+    void notifyClient();
+
+    /**
+     * Resets the submit eventfd before the queue is drained
+     */
+    void clearSubmitEvents();
+
+    /**
+     * Gets a buffer of the data area
+     * @param offset - offset of the buffer in the data area
+     * @param size - size of the buffer
+     * @return start of the buffer, nullptr if it does not fit into the data area
+     */
+    char* getBuffer(uint64_t offset, int64_t size) const;
+
+private:
+    int memoryFd;
+    int submitFd;
+    int completeFd;
+    uint32_t slotCount;         // Own copies of the layout, the client may overwrite the shared header
+    uint64_t dataAreaOffset;
+    uint64_t dataAreaSize;
+    size_t mappedSize;
+    char* memory;
+    ShmRingHeader* header;
+    ShmRequest* requests;
+    ShmCompletion* completions;
+};
+
+#endif //SEMESTRALNIPRACE_SHMRING_HPP
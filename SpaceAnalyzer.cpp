@@ -0,0 +1,268 @@
+#include "SpaceAnalyzer.hpp"
+#include "VirtualFileSystem.hpp"
+#include "Defragmenter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+using std::min;
+using std::stringstream;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+static const uint64_t ALL_FREE_WORD = 0;
+static const uint64_t ALL_SINGLE_WORD = 0x0101010101010101ULL;  // Eight clusters referenced once
+static const int WORD_CLUSTERS = sizeof(uint64_t);
+
+/**
+ * Computes a share in percent
+ * @param part - part of the whole
+ * @param whole - the whole
+ * @return part in percent of the whole, 0 for an empty whole
+ */
+static double percent(int64_t part, int64_t whole) {
+    return whole > 0 ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0;
+}
+
+/**
+ * Writes the buckets of a histogram as a JSON array
+ * @param ss - stream to write to
+ * @param histogram - histogram
+ */
+static void writeJsonHistogram(stringstream& ss, const vector<HistogramBucket>& histogram) {
+    ss << '[';
+    for (size_t i = 0; i < histogram.size(); i++) {
+        const HistogramBucket& bucket = histogram[i];
+        ss << (i > 0 ? "," : "") << "{\"min\":" << bucket.min << ",\"max\":" << bucket.max
+           << ",\"count\":" << bucket.count << ",\"clusters\":" << bucket.clusters << '}';
+    }
+    ss << ']';
+}
+
+string FsStatReport::summary() const {
+    int64_t fileClusters = dataClusterPointers + mapClusters;
+    int32_t filesWithClusters = files - inlineFiles - packedFiles - emptyFiles;
+    stringstream ss;
+    ss << "Data clusters: " << dataClusters << " of " << clusterSize << " B"
+       << ", used: " << usedClusters << " ( " << percent(usedClusters, dataClusters) << " % )"
+       << ", free: " << freeClusters
+       << ", reserved: " << reservedClusters
+       << ", shared: " << sharedClusters << '\n'
+       << "Free extents: " << freeExtents
+       << ", largest: " << largestFreeExtent << " clusters ( " << largestFreeExtent * clusterSize << " B )"
+       << ", average: " << (freeExtents > 0 ? static_cast<double>(freeClusters) / freeExtents : 0) << " clusters" << '\n';
+    for (const HistogramBucket& bucket : freeExtentHistogram) {
+        ss << "  " << bucket.min << " - " << bucket.max << " clusters: " << bucket.count << " extents, "
+           << bucket.clusters << " clusters ( " << percent(bucket.clusters, freeClusters) << " % of free )" << '\n';
+    }
+    ss << "I-nodes: " << usedInodes << " of " << inodes << " used ( " << percent(usedInodes, inodes) << " % )"
+       << ", directories: " << directories
+       << ", files: " << files
+       << " ( inline " << inlineFiles << ", packed " << packedFiles << ", empty " << emptyFiles
+       << ", compressed " << compressedFiles << " )"
+       << ", file sizes: " << logicalBytes << " B" << '\n'
+       << "Block maps: " << mapClusters << " indirect clusters for " << dataClusterPointers << " data clusters"
+       << " ( " << percent(mapClusters, fileClusters) << " % overhead )" << '\n'
+       << "Fragments: " << fragments << " in " << filesWithClusters << " files with data clusters"
+       << ", fragmented files: " << fragmentedFiles
+       << ", average: " << (filesWithClusters > 0 ? static_cast<double>(fragments) / filesWithClusters : 0) << " per file" << '\n';
+    for (const HistogramBucket& bucket : fragmentHistogram) {
+        ss << "  " << bucket.min << " - " << bucket.max << " fragments: " << bucket.count << " files, "
+           << bucket.clusters << " data clusters" << '\n';
+    }
+    for (const FragmentedFile& file : mostFragmented) {
+        ss << "  i-node " << file.inodeId << ": " << file.fragments << " fragments, " << file.clusters << " data clusters" << '\n';
+    }
+    ss << "Time: " << elapsedSeconds << " s";
+    return ss.str();
+}
+
+string FsStatReport::toJson() const {
+    stringstream ss;
+    ss << "{\"clusterSize\":" << clusterSize
+       << ",\"dataClusters\":" << dataClusters
+       << ",\"usedClusters\":" << usedClusters
+       << ",\"freeClusters\":" << freeClusters
+       << ",\"reservedClusters\":" << reservedClusters
+       << ",\"sharedClusters\":" << sharedClusters
+       << ",\"freeExtents\":" << freeExtents
+       << ",\"largestFreeExtent\":" << largestFreeExtent
+       << ",\"freeExtentHistogram\":";
+    writeJsonHistogram(ss, freeExtentHistogram);
+    ss << ",\"inodes\":" << inodes
+       << ",\"usedInodes\":" << usedInodes
+       << ",\"directories\":" << directories
+       << ",\"files\":" << files
+       << ",\"inlineFiles\":" << inlineFiles
+       << ",\"packedFiles\":" << packedFiles
+       << ",\"emptyFiles\":" << emptyFiles
+       << ",\"compressedFiles\":" << compressedFiles
+       << ",\"logicalBytes\":" << logicalBytes
+       << ",\"dataClusterPointers\":" << dataClusterPointers
+       << ",\"mapClusters\":" << mapClusters
+       << ",\"fragmentedFiles\":" << fragmentedFiles
+       << ",\"fragments\":" << fragments
+       << ",\"fragmentHistogram\":";
+    writeJsonHistogram(ss, fragmentHistogram);
+    ss << ",\"mostFragmented\":[";
+    for (size_t i = 0; i < mostFragmented.size(); i++) {
+        ss << (i > 0 ? "," : "") << "{\"inode\":" << mostFragmented[i].inodeId
+           << ",\"fragments\":" << mostFragmented[i].fragments
+           << ",\"clusters\":" << mostFragmented[i].clusters << '}';
+    }
+    ss << "],\"elapsedSeconds\":" << elapsedSeconds << '}';
+    return ss.str();
+}
+
+SpaceAnalyzer::SpaceAnalyzer(VirtualFileSystem* vfs)
+        : vfs(vfs) {}
+
+FsStatReport SpaceAnalyzer::analyze() {
+    auto start = steady_clock::now();
+    FsStatReport report = FsStatReport();
+    report.clusterSize = vfs->getSuperblock()->getClusterSize();
+    report.dataClusters = vfs->getSuperblock()->getDataClusterCount();
+    report.inodes = vfs->getSuperblock()->getInodeCount();
+
+    scanBitmap(report);
+    scanInodes(report);
+
+    report.elapsedSeconds = duration<double>(steady_clock::now() - start).count();
+    return report;
+}
+
+void SpaceAnalyzer::scanBitmap(FsStatReport& report) {
+    const int8_t* bitmap = vfs->getDataBitmap();
+    int64_t clusterCount = report.dataClusters;
+    int64_t freeRun = 0;
+
+    auto endRun = [&report, &freeRun]() {
+        if (freeRun > 0) {
+            report.freeExtents++;
+            report.largestFreeExtent = std::max(report.largestFreeExtent, freeRun);
+            addToHistogram(report.freeExtentHistogram, freeRun, freeRun);
+            freeRun = 0;
+        }
+    };
+
+    int64_t cluster = 0;
+    while (cluster < clusterCount) {
+        if (clusterCount - cluster >= WORD_CLUSTERS) {
+            uint64_t word;
+            memcpy(&word, bitmap + cluster, sizeof(word));
+            if (word == ALL_FREE_WORD) {
+                freeRun += WORD_CLUSTERS;
+                report.freeClusters += WORD_CLUSTERS;
+                cluster += WORD_CLUSTERS;
+                continue;
+            }
+            if (word == ALL_SINGLE_WORD) {
+                endRun();
+                report.usedClusters += WORD_CLUSTERS;
+                cluster += WORD_CLUSTERS;
+                continue;
+            }
+        }
+
+        // Mixed word or the last clusters of the bitmap
+        int64_t end = min<int64_t>(cluster + WORD_CLUSTERS, clusterCount);
+        for (; cluster < end; cluster++) {
+            int8_t entry = bitmap[cluster];
+            if (entry == 0) {
+                freeRun++;
+                report.freeClusters++;
+                continue;
+            }
+            endRun();
+            report.usedClusters++;
+            report.reservedClusters += entry == BITMAP_RESERVED ? 1 : 0;
+            report.sharedClusters += entry > 1 ? 1 : 0;
+        }
+    }
+    endRun();
+    dropEmptyBuckets(report.freeExtentHistogram);
+}
+
+void SpaceAnalyzer::scanInodes(FsStatReport& report) {
+    const Inode* inodes = vfs->getInodes();
+    vector<FragmentedFile> files;
+
+    for (int32_t id = 0; id < report.inodes; id++) {
+        const Inode& node = inodes[id];
+        if (node.getNodeId() == ID_ITEM_FREE) {
+            continue;
+        }
+        report.usedInodes++;
+
+        if (node.getIsDirectory()) {
+            report.directories++;
+        } else {
+            report.files++;
+            report.logicalBytes += node.getFileSize();
+            report.compressedFiles += node.getIsCompressed() ? 1 : 0;
+        }
+        if (node.getIsInline()) {
+            report.inlineFiles++;
+            continue;
+        }
+        if (node.getTailCluster() != ID_ITEM_FREE) {
+            report.packedFiles++;
+            continue;
+        }
+
+        int blockCount;
+        vector<int32_t> blocks = vfs->getDataBlocks(id, &blockCount, nullptr);
+        blocks.resize(static_cast<size_t>(blockCount));
+        int64_t clusters = blockCount - std::count(blocks.begin(), blocks.end(), ID_ITEM_FREE);
+        report.dataClusterPointers += clusters;
+
+        // The block map of a directory holds single indirect clusters only, the map of a file follows from its size
+        report.mapClusters += node.getIsDirectory()
+                ? static_cast<int64_t>(vfs->getMapBlocks(id).size())
+                : blockCount > 0 ? vfs->getBlockCountWithIndirect(blockCount) - blockCount : 0;
+
+        if (node.getIsDirectory()) {
+            continue;
+        }
+        if (clusters == 0) {
+            report.emptyFiles++;    // Also every empty file of images without inline data
+            continue;
+        }
+        int64_t fragments = Defragmenter::countFragments(blocks);
+        report.fragments += fragments;
+        report.fragmentedFiles += fragments > 1 ? 1 : 0;
+        addToHistogram(report.fragmentHistogram, fragments, clusters);
+        if (fragments > 1) {
+            files.push_back(FragmentedFile{id, fragments, clusters});
+        }
+    }
+    dropEmptyBuckets(report.fragmentHistogram);
+
+    // Most fragmented files first, the larger one of two equally fragmented files first
+    size_t top = min(files.size(), static_cast<size_t>(FSSTAT_TOP_FILES));
+    std::partial_sort(files.begin(), files.begin() + top, files.end(), [](const FragmentedFile& a, const FragmentedFile& b) {
+        return a.fragments != b.fragments ? a.fragments > b.fragments : a.clusters > b.clusters;
+    });
+    files.resize(top);
+    report.mostFragmented = files;
+}
+
+void SpaceAnalyzer::addToHistogram(vector<HistogramBucket>& histogram, int64_t length, int64_t clusters) {
+    size_t bucket = 0;
+    while ((length >> (bucket + 1)) > 0) {
+        bucket++;
+    }
+    while (histogram.size() <= bucket) {
+        int64_t min = int64_t(1) << histogram.size();
+        histogram.push_back(HistogramBucket{min, 2 * min - 1, 0, 0});
+    }
+    histogram[bucket].count++;
+    histogram[bucket].clusters += clusters;
+}
+
+void SpaceAnalyzer::dropEmptyBuckets(vector<HistogramBucket>& histogram) {
+    histogram.erase(std::remove_if(histogram.begin(), histogram.end(), [](const HistogramBucket& bucket) {
+        return bucket.count == 0;
+    }), histogram.end());
+}
@@ -0,0 +1,126 @@
+#ifndef SEMESTRALNIPRACE_SPACEANALYZER_HPP
+#define SEMESTRALNIPRACE_SPACEANALYZER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+class VirtualFileSystem;
+
+/**
+ * Bucket of a histogram, the lengths from min to max belong to it
+ */
+struct HistogramBucket {
+    int64_t min;
+    int64_t max;
+    int64_t count;                  // Extents or files of the bucket
+    int64_t clusters;               // Clusters of the extents, or data clusters of the files
+};
+
+/**
+ * File with its number of fragments
+ */
+struct FragmentedFile {
+    int32_t inodeId;
+    int64_t fragments;
+    int64_t clusters;
+};
+
+/**
+ * Space usage and fragmentation of the file system
+ */
+struct FsStatReport {
+    int32_t clusterSize;
+    int64_t dataClusters;           // Size of the data region
+    int64_t usedClusters;           // Data and block map clusters, reserved ones included
+    int64_t freeClusters;
+    int64_t reservedClusters;       // Held by the reservations of sessions or a running defragmentation
+    int64_t sharedClusters;         // Referenced by more than one block pointer
+    int64_t freeExtents;            // Runs of free clusters
+    int64_t largestFreeExtent;
+    vector<HistogramBucket> freeExtentHistogram;
+    int32_t inodes;
+    int32_t usedInodes;
+    int32_t directories;
+    int32_t files;
+    int32_t inlineFiles;            // Data stored in the i-node record
+    int32_t packedFiles;            // Data stored in a pack cluster
+    int32_t emptyFiles;             // Files in clusters without any data cluster ( empty or all holes )
+    int32_t compressedFiles;
+    int64_t logicalBytes;           // Sizes of the files
+    int64_t dataClusterPointers;    // Data clusters referenced by the block maps of files and directories
+    int64_t mapClusters;            // Single, double and triple indirect clusters of the block maps
+    int32_t fragmentedFiles;        // Files with more than one fragment
+    int64_t fragments;              // Fragments of all files with data clusters
+    vector<HistogramBucket> fragmentHistogram;
+    vector<FragmentedFile> mostFragmented;
+    double elapsedSeconds;
+
+    /**
+     * Describes the report in human readable lines
+     * @return description of the space usage
+     */
+    string summary() const;
+
+    /**
+     * Describes the report as a single JSON object
+     * @return JSON object of the report
+     */
+    string toJson() const;
+};
+
+/**
+ * Computes space usage and fragmentation statistics in one pass over the bitmap and one pass over the
+ * i-node table. The bitmap is walked a 64-bit word at a time, words of eight free or eight singly used
+ * clusters are counted at once and only mixed words are looked at byte by byte. Block maps are read
+ * only for files and directories with indirect clusters; the caller holds the shared state lock.
+ */
+class SpaceAnalyzer {
+public:
+
+    /**
+     * Constructor for space analyzer
+     * @param vfs - virtual file system to analyze
+     */
+    explicit SpaceAnalyzer(VirtualFileSystem* vfs);
+
+    /**
+     * Computes the statistics of the file system
+     * @return report of the space usage
+     */
+    FsStatReport analyze();
+
+private:
+    /**
+     * Counts the clusters of the bitmap and the runs of free clusters
+     * @param report - report to fill
+     */
+    void scanBitmap(FsStatReport& report);
+
+    /**
+     * Counts the i-nodes, their block maps and the fragments of their data clusters
+     * @param report - report to fill
+     */
+    void scanInodes(FsStatReport& report);
+
+    /**
+     * Adds a length to a histogram of power of two buckets
+     * @param histogram - histogram, grown as needed
+     * @param length - length of the extent or number of fragments
+     * @param clusters - clusters added to the bucket
+     */
+    static void addToHistogram(vector<HistogramBucket>& histogram, int64_t length, int64_t clusters);
+
+    /**
+     * Removes the empty buckets of a histogram
+     * @param histogram - histogram
+     */
+    static void dropEmptyBuckets(vector<HistogramBucket>& histogram);
+
+    VirtualFileSystem* vfs;
+};
+
+#endif //SEMESTRALNIPRACE_SPACEANALYZER_HPP
@@ -0,0 +1,159 @@
+#include "SubtreeExporter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+
+using std::string;
+using std::vector;
+using std::ofstream;
+using std::ios;
+using std::move;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+SubtreeExporter::SubtreeExporter(VirtualFileSystem* vfs, size_t threadCount)
+        : vfs(vfs), pool(threadCount), exportedFiles(0), failedItems(0),
+          exportedBytes(0), elapsedSeconds(0) {}
+
+bool SubtreeExporter::exportDirectory(Directory* dir, const string& hostPath) {
+    dirLevels.clear();
+    fileJobs.clear();
+    exportedFiles = 0;
+    failedItems = 0;
+    exportedBytes = 0;
+
+    auto start = steady_clock::now();
+
+    collect(dir, hostPath, 0);
+
+    // Directories of one level do not depend on each other
+    for (const vector<string>& level : dirLevels) {
+        for (const string& path : level) {
+            pool.submit([this, path]() { createHostDirectory(path); });
+        }
+        pool.wait();
+    }
+
+    for (const FileJob& job : fileJobs) {
+        pool.submit([this, &job]() { exportFile(job); });
+    }
+    pool.wait();
+
+    elapsedSeconds = duration<double>(steady_clock::now() - start).count();
+
+    return failedItems == 0;
+}
+
+void SubtreeExporter::collect(Directory* dir, const string& hostPath, size_t depth) {
+    if (dirLevels.size() <= depth) {
+        dirLevels.resize(depth + 1);
+    }
+    dirLevels[depth].push_back(hostPath);
+
+    for (DirectoryItem* item = dir->getFile(); item != nullptr; item = item->getNext()) {
+        FileJob job;
+        int blockCount = 0, rest = 0;
+        job.hostPath = hostPath + PATH_DELIMETER + item->getItemName();
+        job.fileSize = vfs->getInodes()[item->getInode()].getFileSize();
+        job.compressed = vfs->getInodes()[item->getInode()].getIsCompressed();
+        job.blocks = vfs->getDataBlocks(item->getInode(), &blockCount, &rest);
+        job.blocks.resize(blockCount);
+        vfs->readSmallFile(item->getInode(), job.smallData);
+        fileJobs.push_back(move(job));
+    }
+
+    for (DirectoryItem* item = dir->getSubdir(); item != nullptr; item = item->getNext()) {
+        Directory* subdir = vfs->getDirectory(item->getInode());
+        if (subdir != nullptr) {
+            collect(subdir, hostPath + PATH_DELIMETER + item->getItemName(), depth + 1);
+        }
+    }
+}
+
+void SubtreeExporter::createHostDirectory(const string& hostPath) {
+    if (mkdir(hostPath.c_str(), 0755) != 0 && errno != EEXIST) {
+        failedItems++;
+    }
+}
+
+void SubtreeExporter::exportFile(const FileJob& job) {
+    ofstream outputFile(job.hostPath, ios::binary | ios::out);
+    if (!outputFile) {
+        failedItems++;
+        return;
+    }
+
+    // Small files have no blocks, the loop below does nothing for them
+    outputFile.write(job.smallData.data(), static_cast<std::streamsize>(job.smallData.size()));
+
+    if (job.compressed) {
+        bool read = vfs->readCompressedFile(job.blocks, job.fileSize, [&outputFile](const char* unit, size_t length) {
+            outputFile.write(unit, static_cast<std::streamsize>(length));
+            return static_cast<bool>(outputFile);
+        });
+        if (!read) {
+            failedItems++;
+            return;
+        }
+    }
+
+    int32_t clusterSize = vfs->getClusterSize();
+    size_t runClusterCount = std::max(EXPORT_RUN_BYTES / clusterSize, 1);
+    vector<char> buffer(runClusterCount * clusterSize);
+    int64_t remaining = job.compressed ? 0 : job.fileSize;
+    size_t i = 0;
+
+    while (i < job.blocks.size() && remaining > 0) {
+        // Merge physically consecutive clusters into one read, a run of holes is written as zeros
+        bool hole = job.blocks[i] == ID_ITEM_FREE;
+        size_t runLength = 1;
+        while (i + runLength < job.blocks.size() && runLength < runClusterCount
+               && job.blocks[i + runLength] == (hole ? ID_ITEM_FREE : job.blocks[i] + static_cast<int32_t>(runLength))) {
+            runLength++;
+        }
+
+        int64_t runBytes = static_cast<int64_t>(runLength) * clusterSize;
+        if (runBytes > remaining) {
+            runBytes = remaining;
+        }
+
+        if (hole) {
+            memset(buffer.data(), 0, static_cast<size_t>(runBytes));
+        } else if (vfs->readDataClusters(job.blocks[i], buffer.data(), static_cast<size_t>(runBytes)) != runBytes) {
+            failedItems++;
+            return;
+        }
+        outputFile.write(buffer.data(), runBytes);
+
+        remaining -= runBytes;
+        i += runLength;
+    }
+
+    outputFile.close();
+    if (!outputFile) {
+        failedItems++;
+        return;
+    }
+
+    exportedBytes += job.fileSize;
+    exportedFiles++;
+}
+
+int32_t SubtreeExporter::getExportedFiles() const {
+    return exportedFiles;
+}
+
+int32_t SubtreeExporter::getFailedItems() const {
+    return failedItems;
+}
+
+int64_t SubtreeExporter::getExportedBytes() const {
+    return exportedBytes;
+}
+
+double SubtreeExporter::getElapsedSeconds() const {
+    return elapsedSeconds;
+}
@@ -0,0 +1,104 @@
+#ifndef SEMESTRALNIPRACE_SUBTREEEXPORTER_HPP
+#define SEMESTRALNIPRACE_SUBTREEEXPORTER_HPP
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include "VirtualFileSystem.hpp"
+#include "ThreadPool.hpp"
+
+using std::string;
+using std::vector;
+using std::atomic;
+
+/**
+ * Exports whole directory subtree of the virtual file system to the hard disk.
+ * The tree is walked on the calling thread, the host directories and file contents
+ * are then written by a pool of worker threads using positional reads from the image.
+ */
+class SubtreeExporter {
+public:
+
+    /**
+     * Constructor for subtree exporter
+     * @param vfs - virtual file system to export from
+     * @param threadCount - number of worker threads
+     */
+    SubtreeExporter(VirtualFileSystem* vfs, size_t threadCount);
+
+    /**
+     * Exports the given directory with all its files and subdirectories to the given host path
+     * @param dir - directory in the virtual file system
+     * @param hostPath - destination directory on the hard disk (created if it does not exist)
+     * @return true if every directory and file was exported, false otherwise
+     */
+    bool exportDirectory(Directory* dir, const string& hostPath);
+
+    /**
+     * Gets the number of exported files
+     * @return number of exported files
+     */
+    int32_t getExportedFiles() const;
+
+    /**
+     * Gets the number of files or directories which could not be exported
+     * @return number of failures
+     */
+    int32_t getFailedItems() const;
+
+    /**
+     * Gets the number of exported bytes
+     * @return number of exported bytes
+     */
+    int64_t getExportedBytes() const;
+
+    /**
+     * Gets the duration of the last export in seconds
+     * @return duration of the last export in seconds
+     */
+    double getElapsedSeconds() const;
+
+private:
+    /**
+     * One file to export, block list is resolved on the calling thread
+     */
+    struct FileJob {
+        string hostPath;
+        vector<int32_t> blocks;
+        int64_t fileSize;
+        string smallData;       // Data of files stored inline or in a pack cluster
+        bool compressed;        // Blocks hold compression units
+    };
+
+    /**
+     * Walks the directory tree and fills directory levels and file jobs
+     * @param dir - directory to walk
+     * @param hostPath - host path of the directory
+     * @param depth - depth of the directory in the exported subtree
+     */
+    void collect(Directory* dir, const string& hostPath, size_t depth);
+
+    /**
+     * Creates one directory on the hard disk
+     * @param hostPath - path of the directory
+     */
+    void createHostDirectory(const string& hostPath);
+
+    /**
+     * Writes one file to the hard disk, physically consecutive clusters are read at once
+     * @param job - file to export
+     */
+    void exportFile(const FileJob& job);
+
+    VirtualFileSystem* vfs;
+    ThreadPool pool;
+    vector<vector<string>> dirLevels;
+    vector<FileJob> fileJobs;
+    atomic<int32_t> exportedFiles;
+    atomic<int32_t> failedItems;
+    atomic<int64_t> exportedBytes;
+    double elapsedSeconds;
+};
+
+#endif //SEMESTRALNIPRACE_SUBTREEEXPORTER_HPP
@@ -3,6 +3,7 @@
 #include "Constants.hpp"
 #include <cstring>
 #include <cmath>
+#include <algorithm>
 
 using std::strncpy;
 
@@ -11,23 +12,45 @@ Superblock::Superblock()
         : signature(nullptr), diskSize(0), clusterSize(CLUSTER_SIZE),
           clusterCount(0), inodeCount(0), bitmapClusterCount(0),
           inodeClusterCount(0), dataClusterCount(0), bitmapStartAddress(0),
-          inodeStartAddress(0), dataStartAddress(0) {
+          inodeStartAddress(0), dataStartAddress(0), features(0), groupCount(1),
+          clustersPerGroup(0), inodesPerGroup(0), dedupClusterCount(0), dedupStartAddress(0),
+          checksumClusterCount(0), checksumStartAddress(0) {
     signature = new char[SIGNATURE_LENGTH + 1];
     strncpy(signature, SIGNATURE, SIGNATURE_LENGTH);
     signature[SIGNATURE_LENGTH] = '\0';
 }
 
-Superblock::Superblock(int32_t diskSize)
+Superblock::Superblock(int64_t diskSize, int32_t clusterSize)
         : Superblock() {
     this->diskSize = diskSize;
-    clusterCount = diskSize / CLUSTER_SIZE;
-    inodeClusterCount = clusterCount / 20;
-    inodeCount = (inodeClusterCount * CLUSTER_SIZE) / INODE_SIZE;
-    bitmapClusterCount = static_cast<int32_t>(ceil((clusterCount - inodeClusterCount - 1) / static_cast<float>(CLUSTER_SIZE)));
-    dataClusterCount = clusterCount - 1 - bitmapClusterCount - inodeClusterCount;
-    bitmapStartAddress = CLUSTER_SIZE;
-    inodeStartAddress = bitmapStartAddress + CLUSTER_SIZE * bitmapClusterCount;
-    dataStartAddress = inodeStartAddress + CLUSTER_SIZE * inodeClusterCount;
+    this->clusterSize = clusterSize;
+    clusterCount = diskSize / clusterSize;
+
+    // The i-node table takes a twentieth of the disk, large images are capped at MAX_INODE_COUNT i-nodes
+    int64_t maxInodeClusterCount = (static_cast<int64_t>(MAX_INODE_COUNT) * INODE_INLINE_SIZE + clusterSize - 1) / clusterSize;
+    inodeClusterCount = std::min(clusterCount / 20, maxInodeClusterCount);
+    inodeCount = static_cast<int32_t>(std::min<int64_t>((inodeClusterCount * clusterSize) / INODE_INLINE_SIZE, MAX_INODE_COUNT));
+    bitmapClusterCount = (clusterCount - inodeClusterCount - 1 + clusterSize - 1) / clusterSize;
+    // One hash slot for every data cluster, counted from the same upper bound as the bitmap
+    dedupClusterCount = ((clusterCount - inodeClusterCount - 1) * DEDUP_SLOT_SIZE + clusterSize - 1) / clusterSize;
+    // One checksum for every cluster of the image, the table itself is left out of the verification
+    checksumClusterCount = (clusterCount * CHECKSUM_SIZE + clusterSize - 1) / clusterSize;
+    dataClusterCount = clusterCount - 1 - bitmapClusterCount - inodeClusterCount - dedupClusterCount - checksumClusterCount;
+    bitmapStartAddress = clusterSize;
+    inodeStartAddress = bitmapStartAddress + clusterSize * bitmapClusterCount;
+    dedupStartAddress = inodeStartAddress + clusterSize * inodeClusterCount;
+    checksumStartAddress = dedupStartAddress + clusterSize * dedupClusterCount;
+    dataStartAddress = checksumStartAddress + clusterSize * checksumClusterCount;
+
+    // Every group owns exactly one cluster of the bitmap and an equal slice of the i-node table
+    features = FEATURE_ALLOCATION_GROUPS | FEATURE_LARGE_FILES | FEATURE_64BIT | FEATURE_INLINE_DATA | FEATURE_TAIL_PACKING
+               | FEATURE_DEDUP | FEATURE_CHECKSUMS | FEATURE_SPARSE_FILES | FEATURE_WIDE_UNITS;
+    clustersPerGroup = clusterSize;
+    groupCount = static_cast<int32_t>((dataClusterCount + clustersPerGroup - 1) / clustersPerGroup);
+    if (groupCount < 1) {
+        groupCount = 1;
+    }
+    inodesPerGroup = (inodeCount + groupCount - 1) / groupCount;
 }
 
 Superblock::Superblock(const Superblock& other)
@@ -36,7 +59,10 @@ Superblock::Superblock(const Superblock& other)
           bitmapClusterCount(other.bitmapClusterCount), inodeClusterCount(other.inodeClusterCount),
           dataClusterCount(other.dataClusterCount), bitmapStartAddress(other.bitmapStartAddress),
           inodeStartAddress(other.inodeStartAddress), dataStartAddress(other.dataStartAddress),
-          signature(new char[SIGNATURE_LENGTH + 1]) {
+          features(other.features), groupCount(other.groupCount), clustersPerGroup(other.clustersPerGroup),
+          inodesPerGroup(other.inodesPerGroup), dedupClusterCount(other.dedupClusterCount),
+          dedupStartAddress(other.dedupStartAddress), checksumClusterCount(other.checksumClusterCount),
+          checksumStartAddress(other.checksumStartAddress), signature(new char[SIGNATURE_LENGTH + 1]) {
     strcpy(signature, other.signature);
 }
 
@@ -55,6 +81,14 @@ Superblock& Superblock::operator=(const Superblock& other) {
         bitmapStartAddress = other.bitmapStartAddress;
         inodeStartAddress = other.inodeStartAddress;
         dataStartAddress = other.dataStartAddress;
+        features = other.features;
+        groupCount = other.groupCount;
+        clustersPerGroup = other.clustersPerGroup;
+        inodesPerGroup = other.inodesPerGroup;
+        dedupClusterCount = other.dedupClusterCount;
+        dedupStartAddress = other.dedupStartAddress;
+        checksumClusterCount = other.checksumClusterCount;
+        checksumStartAddress = other.checksumStartAddress;
     }
     return *this;
 }
@@ -84,14 +118,14 @@ void Superblock::setSignature(const char* newSignature) {
  *
  * @return disk size
  */
-int32_t Superblock::getDiskSize() const { return diskSize; }
+int64_t Superblock::getDiskSize() const { return diskSize; }
 
 /**
  * Sets disk size
  *
  * @param newDiskSize - new disk size
  */
-void Superblock::setDiskSize(int32_t newDiskSize) { diskSize = newDiskSize; }
+void Superblock::setDiskSize(int64_t newDiskSize) { diskSize = newDiskSize; }
 
 /**
  * Gets cluster size
@@ -112,14 +146,14 @@ void Superblock::setClusterSize(int32_t newClusterSize) { clusterSize = newClust
  *
  * @return cluster count
  */
-int32_t Superblock::getClusterCount() const { return clusterCount; }
+int64_t Superblock::getClusterCount() const { return clusterCount; }
 
 /**
  * Sets cluster count
  *
  * @param newClusterCount - new cluster count
  */
-void Superblock::setClusterCount(int32_t newClusterCount) { clusterCount = newClusterCount; }
+void Superblock::setClusterCount(int64_t newClusterCount) { clusterCount = newClusterCount; }
 
 /**
  * Gets inode count
@@ -140,86 +174,218 @@ void Superblock::setInodeCount(int32_t newInodeCount) { inodeCount = newInodeCou
  *
  * @return bitmap cluster count
  */
-int32_t Superblock::getBitmapClusterCount() const { return bitmapClusterCount; }
+int64_t Superblock::getBitmapClusterCount() const { return bitmapClusterCount; }
 
 /**
  * Sets bitmap cluster count
  *
  * @param newBitmapClusterCount - new bitmap cluster count
  */
-void Superblock::setBitmapClusterCount(int32_t newBitmapClusterCount) { bitmapClusterCount = newBitmapClusterCount; }
+void Superblock::setBitmapClusterCount(int64_t newBitmapClusterCount) { bitmapClusterCount = newBitmapClusterCount; }
 
 /**
  * Gets inode cluster count
  *
  * @return inode cluster count
  */
-int32_t Superblock::getInodeClusterCount() const { return inodeClusterCount; }
+int64_t Superblock::getInodeClusterCount() const { return inodeClusterCount; }
 
 /**
  * Sets inode cluster count
  *
  * @param newInodeClusterCount - new inode cluster count
  */
-void Superblock::setInodeClusterCount(int32_t newInodeClusterCount) { inodeClusterCount = newInodeClusterCount; }
+void Superblock::setInodeClusterCount(int64_t newInodeClusterCount) { inodeClusterCount = newInodeClusterCount; }
 
 /**
  * Gets data cluster count
  *
  * @return data cluster count
  */
-int32_t Superblock::getDataClusterCount() const { return dataClusterCount; }
+int64_t Superblock::getDataClusterCount() const { return dataClusterCount; }
 
 /**
  * Sets data cluster count
  *
  * @param newDataClusterCount - new data cluster count
  */
-void Superblock::setDataClusterCount(int32_t newDataClusterCount) { dataClusterCount = newDataClusterCount; }
+void Superblock::setDataClusterCount(int64_t newDataClusterCount) { dataClusterCount = newDataClusterCount; }
 
 /**
  * Gets bitmap start address
  *
  * @return bitmap start address
  */
-int32_t Superblock::getBitmapStartAddress() const { return bitmapStartAddress; }
+int64_t Superblock::getBitmapStartAddress() const { return bitmapStartAddress; }
 
 /**
  * Sets bitmap start address
  *
  * @param newBitmapStartAddress - new bitmap start address
  */
-void Superblock::setBitmapStartAddress(int32_t newBitmapStartAddress) { bitmapStartAddress = newBitmapStartAddress; }
+void Superblock::setBitmapStartAddress(int64_t newBitmapStartAddress) { bitmapStartAddress = newBitmapStartAddress; }
 
 /**
  * Gets inode start address
  *
  * @return inode start address
  */
-int32_t Superblock::getInodeStartAddress() const { return inodeStartAddress; }
+int64_t Superblock::getInodeStartAddress() const { return inodeStartAddress; }
 
 /**
  * Sets inode start address
  *
  * @param newInodeStartAddress - new inode start address
  */
-void Superblock::setInodeStartAddress(int32_t newInodeStartAddress) { inodeStartAddress = newInodeStartAddress; }
+void Superblock::setInodeStartAddress(int64_t newInodeStartAddress) { inodeStartAddress = newInodeStartAddress; }
 
 /**
  * Gets data start address
  *
  * @return data start address
  */
-int32_t Superblock::getDataStartAddress() const { return dataStartAddress; }
+int64_t Superblock::getDataStartAddress() const { return dataStartAddress; }
 
 /**
  * Sets data start address
  *
  * @param newDataStartAddress - new data start address
  */
-void Superblock::setDataStartAddress(int32_t newDataStartAddress) { dataStartAddress = newDataStartAddress; }
+void Superblock::setDataStartAddress(int64_t newDataStartAddress) { dataStartAddress = newDataStartAddress; }
+
+/**
+ * Gets feature flags
+ *
+ * @return feature flags
+ */
+int32_t Superblock::getFeatures() const { return features; }
+
+/**
+ * Sets feature flags
+ *
+ * @param newFeatures - new feature flags
+ */
+void Superblock::setFeatures(int32_t newFeatures) { features = newFeatures; }
+
+/**
+ * Checks whether the given feature is enabled
+ *
+ * @param feature - feature flag to check
+ * @return true if the feature is enabled, false otherwise
+ */
+bool Superblock::hasFeature(int32_t feature) const { return (features & feature) != 0; }
+
+/**
+ * Gets size of one i-node record in the i-node table ( depends on the i-node revision )
+ *
+ * @return size of one i-node record in bytes
+ */
+int32_t Superblock::getInodeSize() const {
+    if (hasFeature(FEATURE_INLINE_DATA)) {
+        return INODE_INLINE_SIZE;
+    }
+    return hasFeature(FEATURE_LARGE_FILES) ? INODE_LARGE_SIZE : INODE_SIZE;
+}
+
+/**
+ * Gets allocation group count
+ *
+ * @return allocation group count
+ */
+int32_t Superblock::getGroupCount() const { return groupCount; }
+
+/**
+ * Sets allocation group count
+ *
+ * @param newGroupCount - new allocation group count
+ */
+void Superblock::setGroupCount(int32_t newGroupCount) { groupCount = newGroupCount; }
+
+/**
+ * Gets number of data clusters in one allocation group
+ *
+ * @return number of data clusters in one allocation group
+ */
+int32_t Superblock::getClustersPerGroup() const { return clustersPerGroup; }
+
+/**
+ * Sets number of data clusters in one allocation group
+ *
+ * @param newClustersPerGroup - new number of data clusters in one allocation group
+ */
+void Superblock::setClustersPerGroup(int32_t newClustersPerGroup) { clustersPerGroup = newClustersPerGroup; }
+
+/**
+ * Gets number of i-nodes in one allocation group
+ *
+ * @return number of i-nodes in one allocation group
+ */
+int32_t Superblock::getInodesPerGroup() const { return inodesPerGroup; }
+
+/**
+ * Sets number of i-nodes in one allocation group
+ *
+ * @param newInodesPerGroup - new number of i-nodes in one allocation group
+ */
+void Superblock::setInodesPerGroup(int32_t newInodesPerGroup) { inodesPerGroup = newInodesPerGroup; }
+
+/**
+ * Gets number of clusters of the table of cluster hashes
+ *
+ * @return number of clusters of the table of cluster hashes
+ */
+int64_t Superblock::getDedupClusterCount() const { return dedupClusterCount; }
+
+/**
+ * Sets number of clusters of the table of cluster hashes
+ *
+ * @param newDedupClusterCount - new number of clusters of the table of cluster hashes
+ */
+void Superblock::setDedupClusterCount(int64_t newDedupClusterCount) { dedupClusterCount = newDedupClusterCount; }
+
+/**
+ * Gets start address of the table of cluster hashes
+ *
+ * @return start address of the table of cluster hashes
+ */
+int64_t Superblock::getDedupStartAddress() const { return dedupStartAddress; }
+
+/**
+ * Sets start address of the table of cluster hashes
+ *
+ * @param newDedupStartAddress - new start address of the table of cluster hashes
+ */
+void Superblock::setDedupStartAddress(int64_t newDedupStartAddress) { dedupStartAddress = newDedupStartAddress; }
+
+/**
+ * Gets number of clusters of the table of cluster checksums
+ *
+ * @return number of clusters of the table of cluster checksums
+ */
+int64_t Superblock::getChecksumClusterCount() const { return checksumClusterCount; }
+
+/**
+ * Sets number of clusters of the table of cluster checksums
+ *
+ * @param newChecksumClusterCount - new number of clusters of the table of cluster checksums
+ */
+void Superblock::setChecksumClusterCount(int64_t newChecksumClusterCount) { checksumClusterCount = newChecksumClusterCount; }
+
+/**
+ * Gets start address of the table of cluster checksums
+ *
+ * @return start address of the table of cluster checksums
+ */
+int64_t Superblock::getChecksumStartAddress() const { return checksumStartAddress; }
+
+/**
+ * Sets start address of the table of cluster checksums
+ *
+ * @param newChecksumStartAddress - new start address of the table of cluster checksums
+ */
+void Superblock::setChecksumStartAddress(int64_t newChecksumStartAddress) { checksumStartAddress = newChecksumStartAddress; }
 
 
-Superblock* superblockInit(int32_t disk_size) {
-    return new Superblock(disk_size);
+Superblock* superblockInit(int64_t disk_size, int32_t cluster_size) {
+    return new Superblock(disk_size, cluster_size);
 }
@@ -21,8 +21,9 @@ public:
      * Constructor for superblock
      *
      * @param diskSize - size of disk in bytes
+     * @param clusterSize - size of one cluster in bytes ( power of two )
      */
-    Superblock(int32_t diskSize);
+    Superblock(int64_t diskSize, int32_t clusterSize);
 
     /**
      * Copy constructor
@@ -63,14 +64,14 @@ public:
      *
      * @return disk size
      */
-    int32_t getDiskSize() const;
+    int64_t getDiskSize() const;
 
     /**
      * Sets disk size
      *
      * @param diskSize - new disk size
      */
-    void setDiskSize(int32_t diskSize);
+    void setDiskSize(int64_t diskSize);
 
     /**
      * Gets cluster size
@@ -91,14 +92,14 @@ public:
      *
      * @return cluster count
      */
-    int32_t getClusterCount() const;
+    int64_t getClusterCount() const;
 
     /**
      * Sets cluster count
      *
      * @param clusterCount - new cluster count
      */
-    void setClusterCount(int32_t clusterCount);
+    void setClusterCount(int64_t clusterCount);
 
     /**
      * Gets inode count
@@ -119,105 +120,241 @@ public:
      *
      * @return bitmap cluster count
      */
-    int32_t getBitmapClusterCount() const;
+    int64_t getBitmapClusterCount() const;
 
     /**
      * Sets bitmap cluster count
      *
      * @param bitmapClusterCount - new bitmap cluster count
      */
-    void setBitmapClusterCount(int32_t bitmapClusterCount);
+    void setBitmapClusterCount(int64_t bitmapClusterCount);
 
     /**
      * Gets inode cluster count
      *
      * @return inode cluster count
      */
-    int32_t getInodeClusterCount() const;
+    int64_t getInodeClusterCount() const;
 
     /**
      * Sets inode cluster count
      *
      * @param inodeClusterCount - new inode cluster count
      */
-    void setInodeClusterCount(int32_t inodeClusterCount);
+    void setInodeClusterCount(int64_t inodeClusterCount);
 
     /**
      * Gets data cluster count
      *
      * @return data cluster count
      */
-    int32_t getDataClusterCount() const;
+    int64_t getDataClusterCount() const;
 
     /**
      * Sets data cluster count
      *
      * @param dataClusterCount - new data cluster count
      */
-    void setDataClusterCount(int32_t dataClusterCount);
+    void setDataClusterCount(int64_t dataClusterCount);
 
     /**
      * Gets bitmap start address
      *
      * @return bitmap start address
      */
-    int32_t getBitmapStartAddress() const;
+    int64_t getBitmapStartAddress() const;
 
     /**
      * Sets bitmap start address
      *
      * @param bitmapStartAddress - new bitmap start address
      */
-    void setBitmapStartAddress(int32_t bitmapStartAddress);
+    void setBitmapStartAddress(int64_t bitmapStartAddress);
 
     /**
      * Gets inode start address
      *
      * @return inode start address
      */
-    int32_t getInodeStartAddress() const;
+    int64_t getInodeStartAddress() const;
 
     /**
      * Sets inode start address
      *
      * @param inodeStartAddress - new inode start address
      */
-    void setInodeStartAddress(int32_t inodeStartAddress);
+    void setInodeStartAddress(int64_t inodeStartAddress);
 
     /**
      * Gets data start address
      *
      * @return data start address
      */
-    int32_t getDataStartAddress() const;
+    int64_t getDataStartAddress() const;
 
     /**
      * Sets data start address
      *
      * @param dataStartAddress - new data start address
      */
-    void setDataStartAddress(int32_t dataStartAddress);
+    void setDataStartAddress(int64_t dataStartAddress);
+
+    /**
+     * Gets feature flags ( 0 for images created before the flags existed )
+     *
+     * @return feature flags
+     */
+    int32_t getFeatures() const;
+
+    /**
+     * Sets feature flags
+     *
+     * @param features - new feature flags
+     */
+    void setFeatures(int32_t features);
+
+    /**
+     * Checks whether the given feature is enabled
+     *
+     * @param feature - feature flag to check
+     * @return true if the feature is enabled, false otherwise
+     */
+    bool hasFeature(int32_t feature) const;
+
+    /**
+     * Gets size of one i-node record in the i-node table ( depends on the i-node revision )
+     *
+     * @return size of one i-node record in bytes
+     */
+    int32_t getInodeSize() const;
+
+    /**
+     * Gets allocation group count
+     *
+     * @return allocation group count
+     */
+    int32_t getGroupCount() const;
+
+    /**
+     * Sets allocation group count
+     *
+     * @param groupCount - new allocation group count
+     */
+    void setGroupCount(int32_t groupCount);
+
+    /**
+     * Gets number of data clusters in one allocation group
+     *
+     * @return number of data clusters in one allocation group
+     */
+    int32_t getClustersPerGroup() const;
+
+    /**
+     * Sets number of data clusters in one allocation group
+     *
+     * @param clustersPerGroup - new number of data clusters in one allocation group
+     */
+    void setClustersPerGroup(int32_t clustersPerGroup);
+
+    /**
+     * Gets number of i-nodes in one allocation group
+     *
+     * @return number of i-nodes in one allocation group
+     */
+    int32_t getInodesPerGroup() const;
+
+    /**
+     * Sets number of i-nodes in one allocation group
+     *
+     * @param inodesPerGroup - new number of i-nodes in one allocation group
+     */
+    void setInodesPerGroup(int32_t inodesPerGroup);
+
+    /**
+     * Gets number of clusters of the table of cluster hashes ( 0 without FEATURE_DEDUP )
+     *
+     * @return number of clusters of the table of cluster hashes
+     */
+    int64_t getDedupClusterCount() const;
+
+    /**
+     * Sets number of clusters of the table of cluster hashes
+     *
+     * @param dedupClusterCount - new number of clusters of the table of cluster hashes
+     */
+    void setDedupClusterCount(int64_t dedupClusterCount);
+
+    /**
+     * Gets start address of the table of cluster hashes
+     *
+     * @return start address of the table of cluster hashes
+     */
+    int64_t getDedupStartAddress() const;
+
+    /**
+     * Sets start address of the table of cluster hashes
+     *
+     * @param dedupStartAddress - new start address of the table of cluster hashes
+     */
+    void setDedupStartAddress(int64_t dedupStartAddress);
+
+    /**
+     * Gets number of clusters of the table of cluster checksums ( 0 without FEATURE_CHECKSUMS )
+     *
+     * @return number of clusters of the table of cluster checksums
+     */
+    int64_t getChecksumClusterCount() const;
+
+    /**
+     * Sets number of clusters of the table of cluster checksums
+     *
+     * @param checksumClusterCount - new number of clusters of the table of cluster checksums
+     */
+    void setChecksumClusterCount(int64_t checksumClusterCount);
+
+    /**
+     * Gets start address of the table of cluster checksums
+     *
+     * @return start address of the table of cluster checksums
+     */
+    int64_t getChecksumStartAddress() const;
+
+    /**
+     * Sets start address of the table of cluster checksums
+     *
+     * @param checksumStartAddress - new start address of the table of cluster checksums
+     */
+    void setChecksumStartAddress(int64_t checksumStartAddress);
 
 private:
     char* signature;
-    int32_t diskSize;
+    int64_t diskSize;
     int32_t clusterSize;
-    int32_t clusterCount;
+    int64_t clusterCount;
     int32_t inodeCount;
-    int32_t bitmapClusterCount;
-    int32_t inodeClusterCount;
-    int32_t dataClusterCount;
-    int32_t bitmapStartAddress;
-    int32_t inodeStartAddress;
-    int32_t dataStartAddress;
+    int64_t bitmapClusterCount;
+    int64_t inodeClusterCount;
+    int64_t dataClusterCount;
+    int64_t bitmapStartAddress;
+    int64_t inodeStartAddress;
+    int64_t dataStartAddress;
+    int32_t features;
+    int32_t groupCount;
+    int32_t clustersPerGroup;
+    int32_t inodesPerGroup;
+    int64_t dedupClusterCount;
+    int64_t dedupStartAddress;
+    int64_t checksumClusterCount;
+    int64_t checksumStartAddress;
 };
 
 /**
  * Initializes superblock
  *
  * @param disk_size - size of disk in bytes
+ * @param cluster_size - size of one cluster in bytes
  * @return pointer to superblock
  */
-Superblock* superblockInit(int32_t disk_size);
+Superblock* superblockInit(int64_t disk_size, int32_t cluster_size);
 
 #endif //SEMESTRALNIPRACE_SUPERBLOCK_HPP
@@ -0,0 +1,85 @@
+#include "TailPacker.hpp"
+#include "Constants.hpp"
+#include <algorithm>
+#include <climits>
+
+using std::lower_bound;
+using std::make_pair;
+
+TailPacker::TailPacker(int32_t clusterSize)
+        : clusterSize(clusterSize) {}
+
+void TailPacker::reset(int32_t newClusterSize) {
+    clusterSize = newClusterSize;
+    clusters.clear();
+    byFreeSpace.clear();
+}
+
+void TailPacker::add(int32_t cluster, const PackedTail& tail) {
+    int32_t oldUsed = getUsed(cluster);
+    vector<PackedTail>& tails = clusters[cluster];
+    auto position = lower_bound(tails.begin(), tails.end(), tail,
+                                [](const PackedTail& a, const PackedTail& b) { return a.offset < b.offset; });
+    tails.insert(position, tail);
+    reindex(cluster, oldUsed, getUsed(cluster));
+}
+
+int32_t TailPacker::findCluster(int32_t length) const {
+    auto it = byFreeSpace.lower_bound(make_pair(length, INT32_MIN));
+    return it != byFreeSpace.end() ? it->second : ID_ITEM_FREE;
+}
+
+int32_t TailPacker::append(int32_t cluster, int32_t inodeId, int32_t length) {
+    int32_t offset = getUsed(cluster);
+    clusters[cluster].push_back(PackedTail{inodeId, offset, length});
+    reindex(cluster, offset, offset + length);
+    return offset;
+}
+
+vector<PackedTail> TailPacker::remove(int32_t cluster, int32_t inodeId) {
+    vector<PackedTail> moved;
+    auto found = clusters.find(cluster);
+    if (found == clusters.end()) {
+        return moved;
+    }
+
+    vector<PackedTail>& tails = found->second;
+    int32_t oldUsed = getUsed(cluster);
+    for (size_t i = 0; i < tails.size(); i++) {
+        if (tails[i].inodeId != inodeId) {
+            continue;
+        }
+
+        // Every following tail slides down by the length of the removed one
+        int32_t gap = tails[i].length;
+        tails.erase(tails.begin() + static_cast<long>(i));
+        for (size_t j = i; j < tails.size(); j++) {
+            tails[j].offset -= gap;
+            moved.push_back(tails[j]);
+        }
+        break;
+    }
+
+    int32_t newUsed = getUsed(cluster);
+    reindex(cluster, oldUsed, newUsed);
+    if (tails.empty()) {
+        clusters.erase(found);
+    }
+    return moved;
+}
+
+int32_t TailPacker::getUsed(int32_t cluster) const {
+    auto found = clusters.find(cluster);
+    if (found == clusters.end() || found->second.empty()) {
+        return 0;
+    }
+    const PackedTail& last = found->second.back();
+    return last.offset + last.length;
+}
+
+void TailPacker::reindex(int32_t cluster, int32_t oldUsed, int32_t newUsed) {
+    byFreeSpace.erase(make_pair(clusterSize - oldUsed, cluster));
+    if (newUsed > 0) {
+        byFreeSpace.insert(make_pair(clusterSize - newUsed, cluster));
+    }
+}
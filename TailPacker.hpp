@@ -0,0 +1,98 @@
+#ifndef SEMESTRALNIPRACE_TAILPACKER_HPP
+#define SEMESTRALNIPRACE_TAILPACKER_HPP
+
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using std::set;
+using std::pair;
+using std::unordered_map;
+using std::vector;
+
+/**
+ * Tail of a file stored in a shared pack cluster
+ */
+struct PackedTail {
+    int32_t inodeId;        // Owner of the tail
+    int32_t offset;         // Offset of the tail in the pack cluster
+    int32_t length;         // Length of the tail in bytes
+};
+
+/**
+ * Bookkeeping of the pack clusters - data clusters shared by tails of several small files. Tails of one cluster
+ * are kept packed from its start, so the free space of a cluster is always one run at its end. The state is
+ * rebuilt from the i-nodes when the file system is loaded, the virtual file system does all I/O and calls
+ * this class under its exclusive state lock.
+ */
+class TailPacker {
+public:
+
+    /**
+     * Constructor for tail packer
+     * @param clusterSize - size of one pack cluster in bytes
+     */
+    explicit TailPacker(int32_t clusterSize = 0);
+
+    /**
+     * Forgets all pack clusters and sets the cluster size
+     * @param clusterSize - size of one pack cluster in bytes
+     */
+    void reset(int32_t clusterSize);
+
+    /**
+     * Registers a tail which is already stored in the given cluster ( used while loading the file system )
+     * @param cluster - pack cluster
+     * @param tail - stored tail
+     */
+    void add(int32_t cluster, const PackedTail& tail);
+
+    /**
+     * Finds the pack cluster with the smallest free run which still fits the tail ( best fit )
+     * @param length - length of the tail
+     * @return pack cluster or ID_ITEM_FREE if no pack cluster has enough space
+     */
+    int32_t findCluster(int32_t length) const;
+
+    /**
+     * Appends a tail after the last tail of the given cluster, unknown cluster becomes a new pack cluster
+     * @param cluster - pack cluster with enough free space
+     * @param inodeId - owner of the tail
+     * @param length - length of the tail
+     * @return offset of the tail in the cluster
+     */
+    int32_t append(int32_t cluster, int32_t inodeId, int32_t length);
+
+    /**
+     * Removes the tail of the given i-node and moves the following tails down to close the gap
+     * @param cluster - pack cluster of the tail
+     * @param inodeId - owner of the tail
+     * @return tails which were moved, with their new offsets
+     */
+    vector<PackedTail> remove(int32_t cluster, int32_t inodeId);
+
+    /**
+     * Gets the number of bytes used from the start of the cluster
+     * @param cluster - pack cluster
+     * @return end of the last tail in the cluster, 0 for unknown or empty cluster
+     */
+    int32_t getUsed(int32_t cluster) const;
+
+private:
+
+    /**
+     * Updates the free space index of the given cluster
+     * @param cluster - pack cluster
+     * @param oldUsed - used bytes before the change
+     * @param newUsed - used bytes after the change ( 0 forgets the cluster )
+     */
+    void reindex(int32_t cluster, int32_t oldUsed, int32_t newUsed);
+
+    int32_t clusterSize;
+    unordered_map<int32_t, vector<PackedTail>> clusters;   // Tails of every pack cluster ordered by offset
+    set<pair<int32_t, int32_t>> byFreeSpace;                // Free bytes and pack cluster
+};
+
+#endif //SEMESTRALNIPRACE_TAILPACKER_HPP
@@ -0,0 +1,74 @@
+#include "ThreadPool.hpp"
+
+using std::unique_lock;
+using std::lock_guard;
+using std::move;
+
+ThreadPool::ThreadPool(size_t threadCount)
+        : runningJobs(0), stopping(false) {
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+
+    workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; i++) {
+        workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(function<void()> job) {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        jobs.push(move(job));
+    }
+    jobAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+    unique_lock<mutex> lock(queueMutex);
+    allDone.wait(lock, [this]() { return jobs.empty() && runningJobs == 0; });
+}
+
+size_t ThreadPool::getThreadCount() const {
+    return workers.size();
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        function<void()> job;
+        {
+            unique_lock<mutex> lock(queueMutex);
+            jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping && jobs.empty()) {
+                return;
+            }
+            job = move(jobs.front());
+            jobs.pop();
+            runningJobs++;
+        }
+
+        job();
+
+        {
+            lock_guard<mutex> lock(queueMutex);
+            runningJobs--;
+            if (jobs.empty() && runningJobs == 0) {
+                allDone.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef SEMESTRALNIPRACE_THREADPOOL_HPP
+#define SEMESTRALNIPRACE_THREADPOOL_HPP
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using std::function;
+using std::mutex;
+using std::condition_variable;
+using std::queue;
+using std::thread;
+using std::vector;
+
+/**
+ * Simple fixed size pool of worker threads executing queued jobs
+ */
+class ThreadPool {
+public:
+
+    /**
+     * Constructor for thread pool, starts the worker threads
+     * @param threadCount - number of worker threads (at least one thread is always started)
+     */
+    explicit ThreadPool(size_t threadCount);
+
+    /**
+     * Destructor, waits for all queued jobs and joins the worker threads
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * Adds job to the queue
+     * @param job - job to execute on one of the worker threads
+     */
+    void submit(function<void()> job);
+
+    /**
+     * Blocks until the queue is empty and no job is running
+     */
+    void wait();
+
+    /**
+     * Gets the number of worker threads
+     * @return number of worker threads
+     */
+    size_t getThreadCount() const;
+
+private:
+    void workerLoop();
+
+    vector<thread> workers;
+    queue<function<void()>> jobs;
+    mutex queueMutex;
+    condition_variable jobAvailable;
+    condition_variable allDone;
+    size_t runningJobs;
+    bool stopping;
+};
+
+#endif //SEMESTRALNIPRACE_THREADPOOL_HPP
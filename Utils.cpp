@@ -12,6 +12,7 @@ using std::endl;
 using std::cerr;
 using std::cout;
 using std::strtol;
+using std::strtoll;
 using std::ptr_fun;
 using std::istringstream;
 using std::to_string;
@@ -40,7 +41,7 @@ string removeEndOfLine(const string& message) {
     return newMessage;
 }
 
-int32_t getSizeFromString(const string& stringSize) {
+int64_t getSizeFromString(const string& stringSize) {
     if (stringSize.empty()) {
         return ERROR_CODE;
     }
@@ -64,6 +65,47 @@ int32_t getSizeFromString(const string& stringSize) {
         number = 0;
     }
 
+    return static_cast<int64_t>(number);
+}
+
+int64_t getOffsetFromString(const string& stringOffset) {
+    char* end;
+    long long number = strtoll(stringOffset.c_str(), &end, 10);
+
+    string units(end);
+    if (stringOffset.empty() || end == stringOffset.c_str() || number < 0
+        || !(units.empty() || units == K_SIZE || units == M_SIZE || units == G_SIZE)) {
+        log(ERROR_PARSING_OFFSET_STRING_TEXT + stringOffset);
+        return ERROR_CODE;
+    }
+
+    if (units == K_SIZE) {
+        number *= 1000;
+    } else if (units == M_SIZE) {
+        number *= 1000000;
+    } else if (units == G_SIZE) {
+        number *= 1000000000;
+    }
+
+    return static_cast<int64_t>(number);
+}
+
+int32_t getClusterSizeFromString(const string& stringSize) {
+    char* end;
+    long number = strtol(stringSize.c_str(), &end, 10);
+
+    string units(end);
+    if (units == K_SIZE) {
+        number *= 1024;
+    } else if (units == M_SIZE) {
+        number *= 1024 * 1024;
+    } else if (!units.empty()) {
+        return ERROR_CODE;
+    }
+
+    if (number < MIN_CLUSTER_SIZE || number > MAX_CLUSTER_SIZE || (number & (number - 1)) != 0) {
+        return ERROR_CODE;
+    }
     return static_cast<int32_t>(number);
 }
 
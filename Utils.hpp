@@ -36,7 +36,21 @@ string removeEndOfLine(const string& message);
  * @param stringSize
  * @return size in bytes
  */
-int32_t getSizeFromString(const string& stringSize);
+int64_t getSizeFromString(const string& stringSize);
+
+/**
+ * Converts offset string (e.g. 0, 512, 10K) to bytes, unlike sizes offsets may be zero and have no unit
+ * @param stringOffset offset string
+ * @return offset in bytes or ERROR_CODE if it is not a non-negative number with an optional unit
+ */
+int64_t getOffsetFromString(const string& stringOffset);
+
+/**
+ * Converts cluster size string (e.g. 1024, 4K, 1M) to bytes, units are binary (4K is 4096)
+ * @param stringSize cluster size string
+ * @return cluster size in bytes or ERROR_CODE if it is not a power of two from MIN_CLUSTER_SIZE to MAX_CLUSTER_SIZE
+ */
+int32_t getClusterSizeFromString(const string& stringSize);
 
 /**
  * Trims string from start
@@ -0,0 +1,474 @@
+#include "VfsApi.hpp"
+#include "Utils.hpp"
+#include "VirtualFileSystem.hpp"
+#include "DirectoryItem.hpp"
+
+VfsApi::VfsApi() : vfs(nullptr), ownsVfs(false), session(nullptr) {}
+
+VfsApi::VfsApi(VirtualFileSystem* vfs) : vfs(vfs), ownsVfs(false), session(vfs->openSession()) {}
+
+VfsApi::~VfsApi() {
+    unmount();
+}
+
+VfsStatus VfsApi::mount(const string& imagePath) {
+    unmount();
+    vfs = new VirtualFileSystem(imagePath);
+    ownsVfs = true;
+    session = vfs->openSession();
+    return vfs->getIsFormatted() ? VfsStatus::OK : VfsStatus::NOT_FORMATTED;
+}
+
+void VfsApi::unmount() {
+    if (vfs == nullptr) {
+        return;
+    }
+    if (ownsVfs) {
+        flush();
+    }
+    vfs->closeSession(session);
+    if (ownsVfs) {
+        delete vfs;     // Stops the background threads
+    }
+    vfs = nullptr;
+    session = nullptr;
+    ownsVfs = false;
+}
+
+VfsStatus VfsApi::format(int64_t size, int32_t clusterSize, int32_t optionalFeatures) {
+    if (vfs == nullptr) {
+        return VfsStatus::NOT_FORMATTED;
+    }
+    if (size <= 0 || clusterSize < MIN_CLUSTER_SIZE || clusterSize > MAX_CLUSTER_SIZE
+        || (clusterSize & (clusterSize - 1)) != 0 || size / clusterSize > INT32_MAX) {
+        return VfsStatus::INVALID_ARGUMENT;
+    }
+
+    auto lock = vfs->lockExclusive();
+    bool formatted = vfs->format(size, clusterSize, optionalFeatures);
+    vfs->syncChecksums();
+    return formatted ? VfsStatus::OK : VfsStatus::NO_SPACE;
+}
+
+VirtualFileSystem* VfsApi::getFileSystem() const {
+    return vfs;
+}
+
+Session* VfsApi::getSession() const {
+    return session;
+}
+
+bool VfsApi::isReady() const {
+    return vfs != nullptr && vfs->getIsFormatted();
+}
+
+void VfsApi::splitPath(const string& path, string& dirPath, string& name) {
+    dirPath = getDirPath(path);
+    name = getFileName(path);
+    if (dirPath.empty() && !path.empty() && path[0] == '/') {
+        dirPath = PATH_DELIMETER;   // Items directly under the root
+    }
+}
+
+VfsStatus VfsApi::changeDirectory(const string& path) {
+    if (!isReady()) {
+        return VfsStatus::NOT_FORMATTED;
+    }
+
+    auto lock = vfs->lockShared();
+    Directory* dir = vfs->findDirectory(path, session);
+    if (dir == nullptr) {
+        return VfsStatus::NOT_FOUND;
+    }
+    session->setCurrentDir(dir);
+    return VfsStatus::OK;
+}
+
+VfsResult<VfsStat> VfsApi::lookup(const string& path) {
+    if (!isReady()) {
+        return {VfsStatus::NOT_FORMATTED, {}};
+    }
+
+    auto lock = vfs->lockShared();
+    int32_t inodeId;
+    int64_t size;
+    Directory* dir = vfs->findDirectory(path, session);
+    if (dir != nullptr) {
+        inodeId = dir->getCurrent()->getInode();
+        size = vfs->getInodes()[inodeId].getFileSize();
+    } else {
+        string dirPath, name;
+        splitPath(path, dirPath, name);
+        Directory* parentDir = vfs->findDirectory(dirPath, session);
+        if (parentDir == nullptr) {
+            return {VfsStatus::PATH_NOT_FOUND, {}};
+        }
+        DirectoryItem* item = findItem(parentDir->getFile(), name.c_str());
+        if (item == nullptr) {
+            return {VfsStatus::NOT_FOUND, {}};
+        }
+
+        // The size of an open file includes its appended data
+        inodeId = item->getInode();
+        int32_t handle = vfs->open(path, session);
+        size = vfs->getFileSize(handle);
+        vfs->close(handle);
+    }
+
+    const Inode& node = vfs->getInodes()[inodeId];
+    return {VfsStatus::OK, VfsStat{inodeId, node.getIsDirectory(), size, node.getReferences(), node.getIsCompressed()}};
+}
+
+VfsResult<vector<VfsEntry>> VfsApi::list(const string& path) {
+    if (!isReady()) {
+        return {VfsStatus::NOT_FORMATTED, {}};
+    }
+
+    auto lock = vfs->lockShared();
+    Directory* dir = vfs->findDirectory(path, session);
+    if (dir == nullptr) {
+        return {VfsStatus::NOT_FOUND, {}};
+    }
+
+    vector<VfsEntry> entries;
+    for (DirectoryItem* item = dir->getSubdir(); item != nullptr; item = item->getNext()) {
+        entries.push_back(VfsEntry{item->getItemName(), item->getInode(), true});
+    }
+    for (DirectoryItem* item = dir->getFile(); item != nullptr; item = item->getNext()) {
+        entries.push_back(VfsEntry{item->getItemName(), item->getInode(), false});
+    }
+    return {VfsStatus::OK, entries};
+}
+
+VfsStatus VfsApi::openFile(const string& path, bool create, int32_t& handle) {
+    string dirPath, name;
+    splitPath(path, dirPath, name);
+    Directory* dir = vfs->findDirectory(dirPath, session);
+    if (dir == nullptr) {
+        return VfsStatus::PATH_NOT_FOUND;
+    }
+    if (findItem(dir->getSubdir(), name.c_str()) != nullptr) {
+        return VfsStatus::IS_DIRECTORY;
+    }
+    if (name.empty() || name.length() >= FILENAME_LENGTH) {
+        return VfsStatus::NAME_TOO_LONG;
+    }
+    bool exists = findItem(dir->getFile(), name.c_str()) != nullptr;
+    if (!exists && !create) {
+        return VfsStatus::NOT_FOUND;
+    }
+
+    handle = vfs->open(dirPath + PATH_DELIMETER + name, session, create);
+    return handle != ERROR_CODE ? VfsStatus::OK : VfsStatus::NO_SPACE;
+}
+
+VfsResult<int64_t> VfsApi::read(const string& path, int64_t offset, char* buffer, int64_t size) {
+    if (!isReady()) {
+        return {VfsStatus::NOT_FORMATTED, 0};
+    }
+    if (offset < 0 || size < 0) {
+        return {VfsStatus::INVALID_ARGUMENT, 0};
+    }
+
+    auto lock = vfs->lockShared();
+    int32_t handle;
+    VfsStatus status = openFile(path, false, handle);
+    if (status != VfsStatus::OK) {
+        return {status, 0};
+    }
+    int64_t read = vfs->pread(handle, offset, buffer, size);
+    vfs->close(handle);
+    return read >= 0 ? VfsResult<int64_t>{VfsStatus::OK, read} : VfsResult<int64_t>{VfsStatus::IO_ERROR, 0};
+}
+
+VfsResult<int64_t> VfsApi::write(const string& path, int64_t offset, const char* data, int64_t size, bool compress) {
+    if (!isReady()) {
+        return {VfsStatus::NOT_FORMATTED, 0};
+    }
+    if (offset < 0 || size < 0 || offset + size > vfs->getMaxFileSize()) {
+        return {VfsStatus::INVALID_ARGUMENT, 0};
+    }
+
+    auto lock = vfs->lockExclusive();
+    int32_t handle;
+    VfsStatus status = openFile(path, true, handle);
+    if (status != VfsStatus::OK) {
+        return {status, 0};
+    }
+    int64_t written = vfs->pwrite(handle, offset, data, size, compress);
+    vfs->close(handle);
+    vfs->syncChecksums();
+    return written >= 0 ? VfsResult<int64_t>{VfsStatus::OK, written} : VfsResult<int64_t>{VfsStatus::NO_SPACE, 0};
+}
+
+VfsResult<int64_t> VfsApi::append(const string& path, const char* data, int64_t size) {
+    if (!isReady()) {
+        return {VfsStatus::NOT_FORMATTED, 0};
+    }
+    if (size < 0) {
+        return {VfsStatus::INVALID_ARGUMENT, 0};
+    }
+
+    auto lock = vfs->lockExclusive();
+    int32_t handle;
+    VfsStatus status = openFile(path, true, handle);
+    if (status != VfsStatus::OK) {
+        return {status, 0};
+    }
+    bool fits = vfs->getFileSize(handle) + size <= vfs->getMaxFileSize();
+    int64_t appended = fits ? vfs->append(handle, data, size) : ERROR_CODE;
+    vfs->close(handle);
+    vfs->syncChecksums();
+
+    if (!fits) {
+        return {VfsStatus::INVALID_ARGUMENT, 0};
+    }
+    return appended >= 0 ? VfsResult<int64_t>{VfsStatus::OK, appended} : VfsResult<int64_t>{VfsStatus::NO_SPACE, 0};
+}
+
+VfsStatus VfsApi::flush() {
+    if (!isReady()) {
+        return VfsStatus::NOT_FORMATTED;
+    }
+    if (!vfs->hasPendingAppends()) {
+        return VfsStatus::OK;
+    }
+
+    auto lock = vfs->lockExclusive();
+    bool flushed = vfs->flushAppends(ID_ITEM_FREE, session);
+    vfs->syncChecksums();
+    return flushed ? VfsStatus::OK : VfsStatus::NO_SPACE;
+}
+
+VfsStatus VfsApi::truncate(const string& path, int64_t size) {
+    if (!isReady()) {
+        return VfsStatus::NOT_FORMATTED;
+    }
+    if (size < 0 || size > vfs->getMaxFileSize()) {
+        return VfsStatus::INVALID_ARGUMENT;
+    }
+
+    auto lock = vfs->lockExclusive();
+    int32_t handle;
+    VfsStatus status = openFile(path, false, handle);
+    if (status != VfsStatus::OK) {
+        return status;
+    }
+    bool truncated = vfs->truncate(handle, size);
+    vfs->close(handle);
+    vfs->syncChecksums();
+    return truncated ? VfsStatus::OK : VfsStatus::NO_SPACE;
+}
+
+VfsStatus VfsApi::fallocate(const string& path, int64_t size) {
+    if (!isReady()) {
+        return VfsStatus::NOT_FORMATTED;
+    }
+    if (size < 0 || size > vfs->getMaxFileSize()) {
+        return VfsStatus::INVALID_ARGUMENT;
+    }
+
+    auto lock = vfs->lockExclusive();
+    int32_t handle;
+    VfsStatus status = openFile(path, true, handle);
+    if (status != VfsStatus::OK) {
+        return status;
+    }
+    bool allocated = vfs->fallocate(handle, size);
+    vfs->close(handle);
+    vfs->syncChecksums();
+    return allocated ? VfsStatus::OK : VfsStatus::NO_SPACE;
+}
+
+VfsStatus VfsApi::makeDirectory(const string& path) {
+    if (!isReady()) {
+        return VfsStatus::NOT_FORMATTED;
+    }
+
+    auto lock = vfs->lockExclusive();
+    string dirPath, name;
+    splitPath(path, dirPath, name);
+    Directory* parentDir = vfs->findDirectory(dirPath, session);
+    if (parentDir == nullptr) {
+        return VfsStatus::PATH_NOT_FOUND;
+    }
+    if (name.empty() || name.length() >= FILENAME_LENGTH) {
+        return VfsStatus::NAME_TOO_LONG;
+    }
+    if (findItem(parentDir->getSubdir(), name.c_str()) != nullptr || findItem(parentDir->getFile(), name.c_str()) != nullptr) {
+        return VfsStatus::ALREADY_EXISTS;
+    }
+
+    // Getting free inode and the first cluster of the directory
+    int32_t inodeId = vfs->findFreeInode(parentDir->getCurrent()->getInode(), true);
+    if (inodeId == ERROR_CODE) {
+        return VfsStatus::NO_SPACE;
+    }
+    vector<int32_t> dataBlocks = vfs->allocateDataBlocks(1, inodeId, session);
+    if (dataBlocks.empty()) {
+        return VfsStatus::NO_SPACE;
+    }
+
+    // Creating new directory and directory item
+    auto newDir = new Directory();
+    auto newDirItem = new DirectoryItem(inodeId, name.c_str());
+    newDir->setParent(parentDir);
+    newDir->setCurrent(newDirItem);
+    vfs->addDirectory(newDir, inodeId);
+
+    // Updating bitmap and inode
+    vfs->markCluster(dataBlocks[0], 1);
+    Inode& newInode = vfs->getInodes()[inodeId];
+    vfs->claimInode(inodeId);
+    newInode.setIsDirectory(true);
+    newInode.setReferences(1);
+    newInode.setFileSize(0);
+    newInode.setDirect(0, dataBlocks[0]);
+
+    parentDir->addSubdirectory(newDirItem);
+    vfs->updateDirectoryInFile(parentDir, newDirItem, true);
+
+    // Saving new directory to VFS
+    vfs->writeInodeToVfs(inodeId);
+    vfs->updateBitmapInFile(newDirItem, true, dataBlocks);
+    vfs->syncChecksums();
+    return VfsStatus::OK;
+}
+
+VfsStatus VfsApi::removeDirectory(const string& path) {
+    if (!isReady()) {
+        return VfsStatus::NOT_FORMATTED;
+    }
+
+    auto lock = vfs->lockExclusive();
+    string dirPath, name;
+    splitPath(path, dirPath, name);
+    Directory* parentDir = vfs->findDirectory(dirPath, session);
+    if (parentDir == nullptr || findItem(parentDir->getSubdir(), name.c_str()) == nullptr) {
+        return VfsStatus::NOT_FOUND;
+    }
+
+    bool removed = vfs->removeDirectory(parentDir, name);
+    vfs->syncChecksums();
+    return removed ? VfsStatus::OK : VfsStatus::NOT_EMPTY;
+}
+
+VfsStatus VfsApi::remove(const string& path) {
+    if (!isReady()) {
+        return VfsStatus::NOT_FORMATTED;
+    }
+
+    auto lock = vfs->lockExclusive();
+    string dirPath, name;
+    splitPath(path, dirPath, name);
+    Directory* dir = vfs->findDirectory(dirPath, session);
+    if (dir == nullptr) {
+        return VfsStatus::PATH_NOT_FOUND;
+    }
+    if (findItem(dir->getSubdir(), name.c_str()) != nullptr) {
+        return VfsStatus::IS_DIRECTORY;
+    }
+
+    DirectoryItem* item = dir->deleteFileFromDirectory(name);
+    if (item == nullptr) {
+        return VfsStatus::NOT_FOUND;
+    }
+    vfs->removeFile(dir, item);
+    vfs->syncChecksums();
+    return VfsStatus::OK;
+}
+
+VfsStatus VfsApi::move(const string& from, const string& to) {
+    if (!isReady()) {
+        return VfsStatus::NOT_FORMATTED;
+    }
+
+    auto lock = vfs->lockExclusive();
+    string srcDirPath, srcName;
+    splitPath(from, srcDirPath, srcName);
+    Directory* srcDir = vfs->findDirectory(srcDirPath, session);
+    if (srcDir == nullptr) {
+        return VfsStatus::PATH_NOT_FOUND;
+    }
+    if (findItem(srcDir->getFile(), srcName.c_str()) == nullptr) {
+        return VfsStatus::NOT_FOUND;
+    }
+
+    // A file moved into a directory keeps its name
+    string destName;
+    Directory* destDir = vfs->findDirectory(to, session);
+    if (destDir != nullptr) {
+        destName = srcName;
+    } else {
+        string destDirPath;
+        splitPath(to, destDirPath, destName);
+        destDir = vfs->findDirectory(destDirPath, session);
+        if (destDir == nullptr) {
+            return VfsStatus::PATH_NOT_FOUND;
+        }
+    }
+    if (destName.empty() || destName.length() >= FILENAME_LENGTH) {
+        return VfsStatus::NAME_TOO_LONG;
+    }
+    if (findItem(destDir->getFile(), destName.c_str()) != nullptr || findItem(destDir->getSubdir(), destName.c_str()) != nullptr) {
+        return VfsStatus::ALREADY_EXISTS;
+    }
+
+    // The entry is unlinked from the source directory and linked at the end of the destination one
+    DirectoryItem* item = srcDir->deleteFileFromDirectory(srcName);
+    int64_t size = vfs->getInodes()[item->getInode()].getFileSize();
+    vfs->updateSizesInFile(srcDir, -size);
+    vfs->updateDirectoryInFile(srcDir, item, false);
+
+    item->setItemName(destName.c_str());
+    item->setNext(nullptr);
+    destDir->addFile(item);
+    vfs->updateSizesInFile(destDir, size);
+    vfs->updateDirectoryInFile(destDir, item, true);
+    vfs->moveOpenFiles(item->getInode(), srcDir, destDir);
+    vfs->syncChecksums();
+    return VfsStatus::OK;
+}
+
+VfsStatus VfsApi::link(const string& target, const string& linkPath) {
+    if (!isReady()) {
+        return VfsStatus::NOT_FORMATTED;
+    }
+
+    auto lock = vfs->lockExclusive();
+    string sourceDirPath, sourceName;
+    splitPath(target, sourceDirPath, sourceName);
+    Directory* sourceDir = vfs->findDirectory(sourceDirPath, session);
+    if (sourceDir == nullptr) {
+        return VfsStatus::PATH_NOT_FOUND;
+    }
+    DirectoryItem* sourceItem = findItem(sourceDir->getFile(), sourceName.c_str());
+    if (sourceItem == nullptr) {
+        return VfsStatus::NOT_FOUND;
+    }
+
+    string linkDirPath, linkName;
+    splitPath(linkPath, linkDirPath, linkName);
+    Directory* targetDir = vfs->findDirectory(linkDirPath, session);
+    if (targetDir == nullptr) {
+        return VfsStatus::PATH_NOT_FOUND;
+    }
+    if (linkName.empty() || linkName.length() >= FILENAME_LENGTH) {
+        return VfsStatus::NAME_TOO_LONG;
+    }
+    if (findItem(targetDir->getFile(), linkName.c_str()) || findItem(targetDir->getSubdir(), linkName.c_str())) {
+        return VfsStatus::ALREADY_EXISTS;
+    }
+
+    int32_t inodeId = sourceItem->getInode();
+    DirectoryItem* newLinkItem = createDirectoryItem(inodeId, linkName.c_str());
+    targetDir->addFile(newLinkItem);
+
+    Inode& inode = vfs->getInodes()[inodeId];
+    inode.setReferences(inode.getReferences() + 1);
+    vfs->writeInodeToVfs(inodeId);
+    vfs->updateDirectoryInFile(targetDir, newLinkItem, true);
+    vfs->flushVfs();
+    vfs->syncChecksums();
+    return VfsStatus::OK;
+}
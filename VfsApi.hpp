@@ -0,0 +1,268 @@
+#ifndef SEMESTRALNIPRACE_VFSAPI_HPP
+#define SEMESTRALNIPRACE_VFSAPI_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Constants.hpp"
+#include "Session.hpp"
+
+class VirtualFileSystem;
+class Directory;
+
+using std::string;
+using std::vector;
+
+/**
+ * Status of an operation of the library API
+ */
+enum class VfsStatus {
+    OK,
+    NOT_FORMATTED,      // No image is mounted or the image is not formatted
+    NOT_FOUND,          // There is no file or directory with the path
+    PATH_NOT_FOUND,     // The directory containing the path does not exist
+    ALREADY_EXISTS,     // A file or directory with the name exists
+    NOT_EMPTY,          // The directory is not empty
+    IS_DIRECTORY,       // A file operation was given a directory
+    NAME_TOO_LONG,      // The name does not fit into a directory entry
+    INVALID_ARGUMENT,   // Negative offset or size, or a size beyond the maximum file size
+    NO_SPACE,           // No free data cluster or i-node ( or a damaged cluster which had to be copied )
+    IO_ERROR            // Data could not be read ( damaged cluster or compressed unit )
+};
+
+/**
+ * Result of an operation returning a value, the value is only meaningful with VfsStatus::OK
+ */
+template<typename T>
+struct VfsResult {
+    VfsStatus status;
+    T value;
+
+    bool ok() const {
+        return status == VfsStatus::OK;
+    }
+};
+
+/**
+ * Information about a file or a directory
+ */
+struct VfsStat {
+    int32_t inodeId;
+    bool isDirectory;
+    int64_t size;           // Bytes of the file including appended data not written yet, bytes of all files for directories
+    int32_t references;     // Hard links of the file
+    bool isCompressed;
+};
+
+/**
+ * Item of a directory listing
+ */
+struct VfsEntry {
+    string name;
+    int32_t inodeId;
+    bool isDirectory;
+};
+
+/**
+ * Result-returning API of the file system engine for programs embedding it. Every call takes the lock of the file
+ * system it needs and writes the checksums of the clusters it changed, so one mounted image may be used by several
+ * API objects from several threads at once. Data is passed in caller buffers ( pointer and length ), nothing is
+ * printed and no text has to be parsed. Relative paths start in the current directory of the API object, which is
+ * the root after mounting.
+ */
+class VfsApi {
+public:
+
+    /**
+     * Constructor of an API object without a mounted image, see mount
+     */
+    VfsApi();
+
+    /**
+     * Constructor of an API object using an already mounted file system, which it does not own
+     * @param vfs - mounted file system
+     */
+    explicit VfsApi(VirtualFileSystem* vfs);
+
+    /**
+     * Destructor, the image is unmounted if the object mounted it
+     */
+    ~VfsApi();
+
+    VfsApi(const VfsApi&) = delete;
+    VfsApi& operator=(const VfsApi&) = delete;
+
+    /**
+     * Mounts an image, an empty or missing image has to be formatted before use
+     * @param imagePath - path of the image on the hard disk
+     * @return OK, or NOT_FORMATTED if the image is empty
+     */
+    VfsStatus mount(const string& imagePath);
+
+    /**
+     * Writes the appended data and unmounts the image mounted by mount, a file system given to the constructor is only detached
+     */
+    void unmount();
+
+    /**
+     * Formats the mounted image
+     * @param size - size of the file system in bytes
+     * @param clusterSize - size of a data cluster, a power of two from MIN_CLUSTER_SIZE to MAX_CLUSTER_SIZE
+     * @param optionalFeatures - FEATURE_COMPRESSION and FEATURE_INLINE_DEDUP flags
+     * @return OK, NOT_FORMATTED without a mounted image, INVALID_ARGUMENT for a wrong size or NO_SPACE if the image was not written
+     */
+    VfsStatus format(int64_t size, int32_t clusterSize = CLUSTER_SIZE, int32_t optionalFeatures = 0);
+
+    /**
+     * Gets the file system the API works with
+     * @return mounted file system, nullptr if there is none
+     */
+    VirtualFileSystem* getFileSystem() const;
+
+    /**
+     * Gets the session of the API object, it holds its current directory and reserved clusters
+     * @return session, nullptr if there is no mounted file system
+     */
+    Session* getSession() const;
+
+    /**
+     * Changes the current directory of the API object
+     * @param path - path of the directory
+     * @return OK or NOT_FOUND
+     */
+    VfsStatus changeDirectory(const string& path);
+
+    /**
+     * Looks up a file or a directory
+     * @param path - path of the item
+     * @return information about the item, NOT_FOUND or PATH_NOT_FOUND
+     */
+    VfsResult<VfsStat> lookup(const string& path);
+
+    /**
+     * Lists a directory, subdirectories come first
+     * @param path - path of the directory
+     * @return items of the directory, NOT_FOUND
+     */
+    VfsResult<vector<VfsEntry>> list(const string& path);
+
+    /**
+     * Reads a range of a file
+     * @param path - path of the file
+     * @param offset - offset of the first byte
+     * @param buffer - buffer for the data
+     * @param size - size of the buffer
+     * @return number of bytes read ( less than size at the end of the file ), NOT_FOUND, IS_DIRECTORY, IO_ERROR
+     */
+    VfsResult<int64_t> read(const string& path, int64_t offset, char* buffer, int64_t size);
+
+    /**
+     * Writes a range of a file, the file is created if it does not exist and grows if the range ends behind it
+     * @param path - path of the file
+     * @param offset - offset of the first byte, a gap behind the end of the file reads as zeros
+     * @param data - data to write
+     * @param size - number of bytes to write
+     * @param compress - true to store a new or empty file compressed ( images with inline data )
+     * @return number of bytes written, PATH_NOT_FOUND, IS_DIRECTORY, INVALID_ARGUMENT, NO_SPACE
+     */
+    VfsResult<int64_t> write(const string& path, int64_t offset, const char* data, int64_t size, bool compress = false);
+
+    /**
+     * Appends data to a file, the file is created if it does not exist. The data is buffered until flush or until
+     * the file is written otherwise, reads see it at once
+     * @param path - path of the file
+     * @param data - data to append
+     * @param size - number of bytes to append
+     * @return number of bytes appended, PATH_NOT_FOUND, IS_DIRECTORY, INVALID_ARGUMENT, NO_SPACE
+     */
+    VfsResult<int64_t> append(const string& path, const char* data, int64_t size);
+
+    /**
+     * Writes data appended by all API objects of the file system to the clusters of the files
+     * @return OK or NO_SPACE, the data which did not fit stays buffered
+     */
+    VfsStatus flush();
+
+    /**
+     * Shrinks or extends a file, an extension reads as zeros
+     * @param path - path of the file
+     * @param size - new size of the file
+     * @return OK, NOT_FOUND, IS_DIRECTORY, INVALID_ARGUMENT, NO_SPACE
+     */
+    VfsStatus truncate(const string& path, int64_t size);
+
+    /**
+     * Preallocates the clusters of a file up to the size, the file is created if it does not exist
+     * @param path - path of the file
+     * @param size - number of bytes from the start of the file
+     * @return OK, PATH_NOT_FOUND, IS_DIRECTORY, INVALID_ARGUMENT, NO_SPACE
+     */
+    VfsStatus fallocate(const string& path, int64_t size);
+
+    /**
+     * Creates a directory
+     * @param path - path of the new directory
+     * @return OK, PATH_NOT_FOUND, ALREADY_EXISTS, NAME_TOO_LONG, NO_SPACE
+     */
+    VfsStatus makeDirectory(const string& path);
+
+    /**
+     * Removes an empty directory
+     * @param path - path of the directory
+     * @return OK, NOT_FOUND, NOT_EMPTY
+     */
+    VfsStatus removeDirectory(const string& path);
+
+    /**
+     * Removes a file, its data is freed with its last hard link
+     * @param path - path of the file
+     * @return OK, NOT_FOUND, IS_DIRECTORY
+     */
+    VfsStatus remove(const string& path);
+
+    /**
+     * Moves or renames a file
+     * @param from - path of the file
+     * @param to - new path of the file, an existing directory keeps the name of the file
+     * @return OK, NOT_FOUND, PATH_NOT_FOUND, ALREADY_EXISTS, NAME_TOO_LONG
+     */
+    VfsStatus move(const string& from, const string& to);
+
+    /**
+     * Creates a hard link to a file
+     * @param target - path of the file
+     * @param linkPath - path of the new link
+     * @return OK, NOT_FOUND, PATH_NOT_FOUND, ALREADY_EXISTS, NAME_TOO_LONG
+     */
+    VfsStatus link(const string& target, const string& linkPath);
+
+private:
+    VirtualFileSystem* vfs;
+    bool ownsVfs;
+    Session* session;
+
+    /**
+     * Checks that a formatted file system is mounted
+     * @return true if the file system may be used
+     */
+    bool isReady() const;
+
+    /**
+     * Splits a path into the directory containing the item and the name of the item
+     * @param path - path of the item
+     * @param dirPath - path of the directory, the root for items directly under it
+     * @param name - name of the item
+     */
+    static void splitPath(const string& path, string& dirPath, string& name);
+
+    /**
+     * Opens a file of the path
+     * @param path - path of the file
+     * @param create - true to create the file if it does not exist
+     * @param handle - handle of the open file
+     * @return OK, NOT_FOUND, PATH_NOT_FOUND, IS_DIRECTORY, NAME_TOO_LONG or NO_SPACE
+     */
+    VfsStatus openFile(const string& path, bool create, int32_t& handle);
+};
+
+#endif //SEMESTRALNIPRACE_VFSAPI_HPP
@@ -0,0 +1,704 @@
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "VfsServer.hpp"
+#include "VirtualFileSystem.hpp"
+
+static const int MAX_EVENTS = 64;
+static const size_t READ_CHUNK = 64 << 10;
+static const size_t MAX_READ_PER_EVENT = 1 << 20;   // Other connections get their turn after this many bytes
+
+template<typename T>
+static T getValue(const char* data) {
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+template<typename T>
+static void putValue(string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void putString(string& out, const string& value) {
+    putValue<uint16_t>(out, static_cast<uint16_t>(value.size()));
+    out += value;
+}
+
+static bool readInt64(const string& request, size_t& pos, int64_t& value) {
+    if (request.size() - pos < sizeof(int64_t)) {
+        return false;
+    }
+    value = getValue<int64_t>(request.data() + pos);
+    pos += sizeof(int64_t);
+    return true;
+}
+
+static bool readString(const string& request, size_t& pos, string& value) {
+    if (request.size() - pos < sizeof(uint16_t)) {
+        return false;
+    }
+    size_t length = getValue<uint16_t>(request.data() + pos);
+    pos += sizeof(uint16_t);
+    if (request.size() - pos < length) {
+        return false;
+    }
+    value.assign(request, pos, length);
+    pos += length;
+    return true;
+}
+
+VfsServer::VfsServer(VirtualFileSystem* vfs, size_t threadCount)
+        : vfs(vfs), threadCount(threadCount), listenFd(-1), epollFd(-1), wakeFd(-1), signalFd(-1), stopping(false) {}
+
+VfsServer::~VfsServer() {
+    vector<shared_ptr<Connection>> open;
+    for (auto& pair : connections) {
+        open.push_back(pair.second);
+    }
+    for (const shared_ptr<Connection>& connection : open) {
+        closeConnection(connection);
+    }
+    // Waits for the workers, the last of them release the API objects
+    pool.reset();
+    readyConnections.clear();
+
+    for (int fd : {listenFd, epollFd, wakeFd, signalFd}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    if (listenFd >= 0) {
+        unlink(socketPath.c_str());
+    }
+}
+
+bool VfsServer::start(const string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    socketPath = path;
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    // Signals are blocked before the workers start, so only the signal descriptor receives them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    // A socket left by a server which did not stop cleanly is replaced, other files are not touched
+    struct stat info{};
+    if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path.c_str());
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        return false;
+    }
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFd, SOMAXCONN) != 0) {
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0 || signalFd < 0) {
+        return false;
+    }
+    for (int fd : {listenFd, wakeFd, signalFd}) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    pool.reset(new ThreadPool(threadCount));
+    return true;
+}
+
+void VfsServer::run() {
+    epoll_event events[MAX_EVENTS];
+    while (!stopping) {
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptClients();
+            } else if (fd == signalFd) {
+                signalfd_siginfo info{};
+                while (read(signalFd, &info, sizeof(info)) == sizeof(info)) {}
+                stopping = true;
+            } else if (fd == wakeFd) {
+                uint64_t value;
+                while (read(wakeFd, &value, sizeof(value)) == sizeof(value)) {}
+
+                vector<shared_ptr<Connection>> ready;
+                {
+                    std::lock_guard<mutex> lock(readyMutex);
+                    ready.swap(readyConnections);
+                }
+                for (const shared_ptr<Connection>& connection : ready) {
+                    if (connection->fd >= 0 && sendResponses(connection)) {
+                        updateEvents(connection);
+                    }
+                }
+            } else {
+                auto it = connections.find(fd);
+                if (it == connections.end()) {
+                    shared_ptr<Connection> ringConnection;
+                    {
+                        std::lock_guard<mutex> lock(ringsMutex);
+                        auto ring = ringConnections.find(fd);
+                        if (ring != ringConnections.end()) {
+                            ringConnection = ring->second;
+                        }
+                    }
+                    if (ringConnection) {
+                        wakeRing(ringConnection);
+                    }
+                    continue;
+                }
+                shared_ptr<Connection> connection = it->second;
+                if ((events[i].events & EPOLLIN) && !readRequests(connection)) {
+                    continue;
+                }
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    closeConnection(connection);
+                    continue;
+                }
+                if ((events[i].events & EPOLLOUT) && !sendResponses(connection)) {
+                    continue;
+                }
+                updateEvents(connection);
+            }
+        }
+    }
+}
+
+void VfsServer::stop() {
+    stopping = true;
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        return;
+    }
+}
+
+void VfsServer::acceptClients() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+
+        auto connection = std::make_shared<Connection>();
+        connection->fd = fd;
+        connection->busy = false;
+        connection->closed = false;
+        connection->inputClosed = false;
+        connection->events = EPOLLIN;
+        connection->outputFdsOffset = 0;
+        connection->ringBusy = false;
+        connection->ringRerun = false;
+        {
+            // Opening a session reads the directory tree
+            auto lock = vfs->lockShared();
+            connection->api.reset(new VfsApi(vfs));
+        }
+        connections[fd] = connection;
+
+        epoll_event event{};
+        event.events = connection->events;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+bool VfsServer::readRequests(const shared_ptr<Connection>& connection) {
+    char buffer[READ_CHUNK];
+    size_t received = 0;
+    while (received < MAX_READ_PER_EVENT) {
+        ssize_t count = read(connection->fd, buffer, sizeof(buffer));
+        if (count > 0) {
+            connection->input.append(buffer, static_cast<size_t>(count));
+            received += static_cast<size_t>(count);
+        } else if (count == 0) {
+            // The client may shut down its side after the last request, its responses are still sent
+            connection->inputClosed = true;
+            break;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno != EINTR) {
+            closeConnection(connection);
+            return false;
+        }
+    }
+
+    // Complete requests are queued, a partial one waits for the rest of its bytes
+    vector<string> requests;
+    size_t pos = 0;
+    const string& input = connection->input;
+    while (input.size() - pos >= SERVER_REQUEST_HEADER_SIZE) {
+        uint32_t payloadSize = getValue<uint32_t>(input.data() + pos);
+        if (payloadSize > SERVER_MAX_PAYLOAD) {
+            closeConnection(connection);
+            return false;
+        }
+        size_t frameSize = SERVER_REQUEST_HEADER_SIZE + payloadSize;
+        if (input.size() - pos < frameSize) {
+            break;
+        }
+        requests.emplace_back(input, pos, frameSize);
+        pos += frameSize;
+    }
+    connection->input.erase(0, pos);
+
+    if (!requests.empty()) {
+        bool schedule;
+        {
+            std::lock_guard<mutex> lock(connection->stateMutex);
+            for (string& request : requests) {
+                connection->requests.push_back(std::move(request));
+            }
+            schedule = !connection->busy;
+            connection->busy = true;
+        }
+        if (schedule) {
+            pool->submit([this, connection]() { executeRequests(connection); });
+        }
+    }
+    return true;
+}
+
+bool VfsServer::sendResponses(const shared_ptr<Connection>& connection) {
+    bool failed = false;
+    {
+        std::lock_guard<mutex> lock(connection->stateMutex);
+        string& output = connection->output;
+        vector<int>& fds = connection->outputFds;
+        size_t sent = 0;
+        while (sent < output.size()) {
+            ssize_t count;
+            if (!fds.empty() && connection->outputFdsOffset == sent) {
+                // The descriptors arrive with the first byte of their response
+                char control[CMSG_SPACE(3 * sizeof(int))] = {};
+                iovec data{const_cast<char*>(output.data() + sent), output.size() - sent};
+                msghdr message{};
+                message.msg_iov = &data;
+                message.msg_iovlen = 1;
+                message.msg_control = control;
+                message.msg_controllen = CMSG_SPACE(fds.size() * sizeof(int));
+                cmsghdr* header = CMSG_FIRSTHDR(&message);
+                header->cmsg_level = SOL_SOCKET;
+                header->cmsg_type = SCM_RIGHTS;
+                header->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+                memcpy(CMSG_DATA(header), fds.data(), fds.size() * sizeof(int));
+                count = sendmsg(connection->fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (count > 0) {
+                    fds.clear();
+                }
+            } else {
+                size_t end = fds.empty() ? output.size() : connection->outputFdsOffset;
+                count = send(connection->fd, output.data() + sent, end - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            }
+
+            if (count > 0) {
+                sent += static_cast<size_t>(count);
+            } else if (count < 0 && errno == EINTR) {
+                continue;
+            } else {
+                failed = count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+                break;
+            }
+        }
+        output.erase(0, sent);
+        if (!fds.empty()) {
+            connection->outputFdsOffset -= sent;
+        }
+    }
+
+    if (failed) {
+        closeConnection(connection);
+        return false;
+    }
+    return true;
+}
+
+void VfsServer::updateEvents(const shared_ptr<Connection>& connection) {
+    uint32_t events = 0;
+    bool finished;
+    {
+        std::lock_guard<mutex> lock(connection->stateMutex);
+        bool canRead = connection->requests.size() < SERVER_MAX_QUEUED_REQUESTS && connection->output.size() < SERVER_MAX_OUTPUT_BYTES;
+        if (canRead && !connection->inputClosed) {
+            events |= EPOLLIN;
+        }
+        if (!connection->output.empty()) {
+            events |= EPOLLOUT;
+        }
+        finished = connection->inputClosed && !connection->busy && connection->requests.empty() && connection->output.empty();
+    }
+
+    if (finished) {
+        closeConnection(connection);
+        return;
+    }
+    if (events != connection->events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = connection->fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = events;
+    }
+}
+
+void VfsServer::closeConnection(const shared_ptr<Connection>& connection) {
+    if (connection->fd < 0) {
+        return;
+    }
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    close(connection->fd);
+    connections.erase(connection->fd);
+    connection->fd = -1;
+
+    bool release, releaseRingApi;
+    {
+        std::lock_guard<mutex> lock(connection->stateMutex);
+        connection->closed = true;
+        connection->requests.clear();
+        connection->output.clear();
+        connection->outputFds.clear();
+        release = !connection->busy;
+        releaseRingApi = connection->ring && !connection->ringBusy;
+        if (connection->ring) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->ring->getSubmitFd(), nullptr);
+            std::lock_guard<mutex> ringsLock(ringsMutex);
+            ringConnections.erase(connection->ring->getSubmitFd());
+        }
+    }
+    // The workers executing the requests release the API objects themselves when they see the connection closed
+    if (release) {
+        pool->submit([this, connection]() { releaseApi(*connection); });
+    }
+    if (releaseRingApi) {
+        pool->submit([this, connection]() { releaseRing(*connection); });
+    }
+}
+
+void VfsServer::releaseApi(Connection& connection) {
+    connection.api->flush();
+    auto lock = vfs->lockExclusive();
+    connection.api.reset();
+}
+
+void VfsServer::executeRequests(const shared_ptr<Connection>& connection) {
+    while (true) {
+        string request;
+        {
+            std::lock_guard<mutex> lock(connection->stateMutex);
+            if (connection->closed || connection->requests.empty()) {
+                connection->busy = false;
+                if (!connection->closed) {
+                    break;
+                }
+            } else {
+                request = std::move(connection->requests.front());
+                connection->requests.pop_front();
+            }
+        }
+        if (request.empty()) {
+            releaseApi(*connection);
+            break;
+        }
+
+        string payload;
+        auto opcode = static_cast<ServerOpcode>(getValue<uint16_t>(request.data() + 2 * sizeof(uint32_t)));
+        VfsStatus status = opcode == ServerOpcode::ATTACH_RING ? attachRing(connection, request, payload)
+                                                               : execute(*connection->api, request, payload);
+
+        string response;
+        response.reserve(SERVER_RESPONSE_HEADER_SIZE + payload.size());
+        putValue<uint32_t>(response, static_cast<uint32_t>(payload.size()));
+        putValue<uint32_t>(response, getValue<uint32_t>(request.data() + sizeof(uint32_t)));
+        putValue<int32_t>(response, static_cast<int32_t>(status));
+        response += payload;
+        {
+            std::lock_guard<mutex> lock(connection->stateMutex);
+            if (connection->closed) {
+                continue;
+            }
+            if (opcode == ServerOpcode::ATTACH_RING && status == VfsStatus::OK) {
+                const ShmRing& ring = *connection->ring;
+                connection->outputFds = {ring.getMemoryFd(), ring.getSubmitFd(), ring.getCompleteFd()};
+                connection->outputFdsOffset = connection->output.size();
+            }
+            connection->output += response;
+        }
+        {
+            std::lock_guard<mutex> lock(readyMutex);
+            readyConnections.push_back(connection);
+        }
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            continue;
+        }
+    }
+
+    // The event loop closes a connection whose client shut down once the last response is sent
+    std::lock_guard<mutex> lock(readyMutex);
+    readyConnections.push_back(connection);
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        return;
+    }
+}
+
+VfsStatus VfsServer::attachRing(const shared_ptr<Connection>& connection, const string& request, string& payload) {
+    if (request.size() != SERVER_REQUEST_HEADER_SIZE + sizeof(uint32_t) + sizeof(uint64_t)) {
+        return VfsStatus::INVALID_ARGUMENT;
+    }
+    auto slotCount = getValue<uint32_t>(request.data() + SERVER_REQUEST_HEADER_SIZE);
+    auto dataSize = getValue<uint64_t>(request.data() + SERVER_REQUEST_HEADER_SIZE + sizeof(uint32_t));
+    {
+        std::lock_guard<mutex> lock(connection->stateMutex);
+        if (connection->ring) {
+            return VfsStatus::ALREADY_EXISTS;
+        }
+    }
+
+    auto ring = std::make_shared<ShmRing>();
+    if (!ring->create(slotCount, dataSize)) {
+        bool valid = slotCount != 0 && slotCount <= SHM_MAX_SLOTS && (slotCount & (slotCount - 1)) == 0
+                     && dataSize != 0 && dataSize <= SHM_MAX_DATA_BYTES;
+        return valid ? VfsStatus::IO_ERROR : VfsStatus::INVALID_ARGUMENT;
+    }
+    unique_ptr<VfsApi> api;
+    {
+        auto lock = vfs->lockShared();
+        api.reset(new VfsApi(vfs));
+    }
+
+    // Registered under the state lock, so a connection closed meanwhile never gets the ring
+    std::lock_guard<mutex> lock(connection->stateMutex);
+    if (connection->closed) {
+        auto exclusiveLock = vfs->lockExclusive();
+        api.reset();
+        return VfsStatus::IO_ERROR;
+    }
+    connection->ring = ring;
+    connection->ringApi = std::move(api);
+    {
+        std::lock_guard<mutex> ringsLock(ringsMutex);
+        ringConnections[ring->getSubmitFd()] = connection;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = ring->getSubmitFd();
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, ring->getSubmitFd(), &event);
+
+    putValue<uint64_t>(payload, ring->getDataOffset());
+    return VfsStatus::OK;
+}
+
+void VfsServer::wakeRing(const shared_ptr<Connection>& connection) {
+    connection->ring->clearSubmitEvents();
+    bool schedule;
+    {
+        std::lock_guard<mutex> lock(connection->stateMutex);
+        if (connection->closed) {
+            return;
+        }
+        connection->ringRerun = connection->ringBusy;
+        schedule = !connection->ringBusy;
+        connection->ringBusy = true;
+    }
+    if (schedule) {
+        pool->submit([this, connection]() { executeRingRequests(connection); });
+    }
+}
+
+void VfsServer::executeRingRequests(const shared_ptr<Connection>& connection) {
+    ShmRing& ring = *connection->ring;
+    int unnotified = 0;
+    while (true) {
+        bool closed;
+        {
+            std::lock_guard<mutex> lock(connection->stateMutex);
+            closed = connection->closed;
+        }
+
+        // A full completion queue waits until the client takes completions and writes the submit eventfd
+        ShmRequest request{};
+        if (!closed && ring.hasCompletionSpace() && ring.popRequest(request)) {
+            ring.pushCompletion(executeRingRequest(*connection->ringApi, ring, request));
+            if (++unnotified == SERVER_RING_NOTIFY_BATCH) {
+                ring.notifyClient();
+                unnotified = 0;
+            }
+            continue;
+        }
+        if (unnotified > 0) {
+            ring.notifyClient();
+            unnotified = 0;
+        }
+
+        {
+            std::lock_guard<mutex> lock(connection->stateMutex);
+            if (!connection->closed && connection->ringRerun) {
+                connection->ringRerun = false;
+                continue;
+            }
+            connection->ringBusy = false;
+            if (!connection->closed) {
+                return;
+            }
+        }
+        releaseRing(*connection);
+        return;
+    }
+}
+
+void VfsServer::releaseRing(Connection& connection) {
+    connection.ringApi->flush();
+    auto lock = vfs->lockExclusive();
+    connection.ringApi.reset();
+}
+
+ShmCompletion VfsServer::executeRingRequest(VfsApi& api, const ShmRing& ring, const ShmRequest& request) {
+    ShmCompletion completion{request.userData, 0, static_cast<int32_t>(VfsStatus::INVALID_ARGUMENT), 0};
+    auto opcode = static_cast<ServerOpcode>(request.opcode);
+    char* buffer = ring.getBuffer(request.bufferOffset, request.size);
+    if (buffer == nullptr || request.pathLength > SHM_PATH_LENGTH || (opcode != ServerOpcode::READ && opcode != ServerOpcode::WRITE)) {
+        return completion;
+    }
+
+    // The data goes between the image and the buffer of the client without another copy
+    string path(request.path, request.pathLength);
+    VfsResult<int64_t> result = opcode == ServerOpcode::READ ? api.read(path, request.offset, buffer, request.size)
+                                                             : api.write(path, request.offset, buffer, request.size);
+    completion.status = static_cast<int32_t>(result.status);
+    completion.result = result.ok() ? result.value : 0;
+    return completion;
+}
+
+VfsStatus VfsServer::execute(VfsApi& api, const string& request, string& payload) {
+    auto opcode = static_cast<ServerOpcode>(getValue<uint16_t>(request.data() + 2 * sizeof(uint32_t)));
+    size_t pos = SERVER_REQUEST_HEADER_SIZE;
+    string path, otherPath;
+    int64_t offset, size;
+
+    switch (opcode) {
+        case ServerOpcode::LOOKUP: {
+            if (!readString(request, pos, path) || pos != request.size()) {
+                return VfsStatus::INVALID_ARGUMENT;
+            }
+            VfsResult<VfsStat> stat = api.lookup(path);
+            if (stat.ok()) {
+                putValue<int32_t>(payload, stat.value.inodeId);
+                putValue<uint8_t>(payload, stat.value.isDirectory);
+                putValue<int64_t>(payload, stat.value.size);
+                putValue<int32_t>(payload, stat.value.references);
+                putValue<uint8_t>(payload, stat.value.isCompressed);
+            }
+            return stat.status;
+        }
+        case ServerOpcode::LIST: {
+            if (!readString(request, pos, path) || pos != request.size()) {
+                return VfsStatus::INVALID_ARGUMENT;
+            }
+            VfsResult<vector<VfsEntry>> entries = api.list(path);
+            if (entries.ok()) {
+                putValue<uint32_t>(payload, static_cast<uint32_t>(entries.value.size()));
+                for (const VfsEntry& entry : entries.value) {
+                    putValue<int32_t>(payload, entry.inodeId);
+                    putValue<uint8_t>(payload, entry.isDirectory);
+                    putString(payload, entry.name);
+                }
+            }
+            return entries.status;
+        }
+        case ServerOpcode::READ: {
+            if (!readString(request, pos, path) || !readInt64(request, pos, offset) || !readInt64(request, pos, size)
+                || pos != request.size() || offset < 0 || size < 0 || size > SERVER_MAX_PAYLOAD) {
+                return VfsStatus::INVALID_ARGUMENT;
+            }
+            // Only the bytes up to the end of the file are buffered
+            VfsResult<VfsStat> stat = api.lookup(path);
+            if (!stat.ok()) {
+                return stat.status;
+            }
+            payload.resize(static_cast<size_t>(std::max<int64_t>(0, std::min(size, stat.value.size - offset))));
+            VfsResult<int64_t> read = api.read(path, offset, &payload[0], static_cast<int64_t>(payload.size()));
+            payload.resize(read.ok() ? static_cast<size_t>(read.value) : 0);
+            return read.status;
+        }
+        case ServerOpcode::WRITE:
+        case ServerOpcode::APPEND: {
+            offset = 0;
+            if (!readString(request, pos, path) || (opcode == ServerOpcode::WRITE && !readInt64(request, pos, offset))) {
+                return VfsStatus::INVALID_ARGUMENT;
+            }
+            const char* data = request.data() + pos;
+            auto length = static_cast<int64_t>(request.size() - pos);
+            VfsResult<int64_t> written = opcode == ServerOpcode::WRITE ? api.write(path, offset, data, length) : api.append(path, data, length);
+            if (written.ok()) {
+                putValue<int64_t>(payload, written.value);
+            }
+            return written.status;
+        }
+        case ServerOpcode::FLUSH:
+            return pos == request.size() ? api.flush() : VfsStatus::INVALID_ARGUMENT;
+        case ServerOpcode::TRUNCATE:
+        case ServerOpcode::FALLOCATE:
+            if (!readString(request, pos, path) || !readInt64(request, pos, size) || pos != request.size()) {
+                return VfsStatus::INVALID_ARGUMENT;
+            }
+            return opcode == ServerOpcode::TRUNCATE ? api.truncate(path, size) : api.fallocate(path, size);
+        case ServerOpcode::MKDIR:
+        case ServerOpcode::RMDIR:
+        case ServerOpcode::REMOVE:
+        case ServerOpcode::CHDIR:
+            if (!readString(request, pos, path) || pos != request.size()) {
+                return VfsStatus::INVALID_ARGUMENT;
+            }
+            if (opcode == ServerOpcode::MKDIR) {
+                return api.makeDirectory(path);
+            } else if (opcode == ServerOpcode::RMDIR) {
+                return api.removeDirectory(path);
+            } else if (opcode == ServerOpcode::REMOVE) {
+                return api.remove(path);
+            }
+            return api.changeDirectory(path);
+        case ServerOpcode::MOVE:
+        case ServerOpcode::LINK:
+            if (!readString(request, pos, path) || !readString(request, pos, otherPath) || pos != request.size()) {
+                return VfsStatus::INVALID_ARGUMENT;
+            }
+            return opcode == ServerOpcode::MOVE ? api.move(path, otherPath) : api.link(path, otherPath);
+        case ServerOpcode::ATTACH_RING:
+            break;      // Handled by attachRing, it needs the connection
+    }
+    return VfsStatus::INVALID_ARGUMENT;
+}
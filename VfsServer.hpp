@@ -0,0 +1,239 @@
+#ifndef SEMESTRALNIPRACE_VFSSERVER_HPP
+#define SEMESTRALNIPRACE_VFSSERVER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ThreadPool.hpp"
+#include "VfsApi.hpp"
+#include "ShmRing.hpp"
+
+using std::atomic;
+using std::deque;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::unordered_map;
+using std::vector;
+
+class VirtualFileSystem;
+
+/*
+ * Protocol of the server, all integers are in the byte order of the host ( the socket is local ).
+ *
+ * Request:  uint32 payload size, uint32 request id, uint16 opcode, uint16 zero, payload
+ * Response: uint32 payload size, uint32 request id, int32 status ( VfsStatus ), payload
+ *
+ * Strings of the payload are an uint16 length followed by the bytes. A client may send any number of requests without
+ * waiting for the responses ( pipelining ); requests of one connection are executed in the order they were sent and
+ * answered in that order, requests of different connections run in parallel on the worker threads.
+ *
+ * Bulk data may bypass the socket: after ATTACH_RING the client places READ and WRITE descriptors into a shared memory
+ * ring and the server reads the file data straight into the buffers of the client. Ring requests run in order on their
+ * own session, independently of the requests sent over the socket.
+ */
+
+/**
+ * Operation of a request, the payload of the request and of the OK response follows the name
+ */
+enum class ServerOpcode : uint16_t {
+    LOOKUP = 1,     // path -> int32 i-node, uint8 is directory, int64 size, int32 references, uint8 is compressed
+    LIST,           // path -> uint32 count, count x ( int32 i-node, uint8 is directory, name )
+    READ,           // path, int64 offset, int64 size -> data ( shorter at the end of the file )
+    WRITE,          // path, int64 offset, data up to the end of the payload -> int64 bytes written
+    APPEND,         // path, data up to the end of the payload -> int64 bytes appended
+    FLUSH,          // nothing -> nothing
+    TRUNCATE,       // path, int64 size -> nothing
+    FALLOCATE,      // path, int64 size -> nothing
+    MKDIR,          // path -> nothing
+    RMDIR,          // path -> nothing
+    REMOVE,         // path -> nothing
+    MOVE,           // path, new path -> nothing
+    LINK,           // path of the file, path of the link -> nothing
+    CHDIR,          // path -> nothing, relative paths of the connection start in the directory
+    ATTACH_RING     // uint32 slot count, uint64 data size -> uint64 offset of the data area in the memory; the memfd,
+                    // the submit eventfd and the complete eventfd are attached to the response ( SCM_RIGHTS ), see ShmRing.hpp
+};
+
+static const size_t SERVER_REQUEST_HEADER_SIZE = 12;
+static const size_t SERVER_RESPONSE_HEADER_SIZE = 12;
+static const uint32_t SERVER_MAX_PAYLOAD = 16 << 20;        // Larger requests close the connection, larger reads are refused
+static const size_t SERVER_MAX_QUEUED_REQUESTS = 1024;      // Reading a connection pauses while it has this many requests queued
+static const size_t SERVER_MAX_OUTPUT_BYTES = 64 << 20;     // ... or this many bytes of responses not sent yet
+static const int SERVER_RING_NOTIFY_BATCH = 16;             // The client is woken at least after this many completions
+
+/**
+ * Server keeping one mounted image and serving local clients over a Unix domain socket. One thread runs the epoll
+ * event loop accepting connections, reading requests and sending responses, the requests are executed by worker
+ * threads through the library API. Every connection has its own API object and so its own session.
+ */
+class VfsServer {
+public:
+
+    /**
+     * Constructor for server, nothing is started until start is called
+     * @param vfs - mounted file system
+     * @param threadCount - number of worker threads
+     */
+    VfsServer(VirtualFileSystem* vfs, size_t threadCount);
+
+    /**
+     * Destructor, closes the connections and removes the socket
+     */
+    ~VfsServer();
+
+    VfsServer(const VfsServer&) = delete;
+    VfsServer& operator=(const VfsServer&) = delete;
+
+    /**
+     * Creates the socket and the event loop, SIGINT and SIGTERM are blocked and stop the server from then on
+     * @param socketPath - path of the socket, an old socket with the path is replaced
+     * @return true if the socket listens
+     */
+    bool start(const string& socketPath);
+
+    /**
+     * Runs the event loop until a stop signal or stop is called
+     */
+    void run();
+
+    /**
+     * Stops the event loop, may be called from any thread
+     */
+    void stop();
+
+private:
+
+    /**
+     * Connection of one client
+     */
+    struct Connection {
+        int fd;                             // -1 once closed ( event loop only, like the two fields below )
+        unique_ptr<VfsApi> api;
+        string input;                       // Received bytes not parsed yet
+        bool inputClosed;                   // The client shut down its side, the connection closes after the last response
+        uint32_t events;                    // Events the event loop waits for
+        mutex stateMutex;                   // Guards the fields below
+        deque<string> requests;             // Parsed requests waiting for a worker, header included
+        string output;                      // Responses not sent yet
+        vector<int> outputFds;              // Descriptors sent with the response starting at outputFdsOffset
+        size_t outputFdsOffset;
+        bool busy;                          // A worker executes the requests
+        bool closed;                        // The client went away, remaining requests are dropped
+        shared_ptr<ShmRing> ring;           // Shared memory ring, set once by ATTACH_RING
+        unique_ptr<VfsApi> ringApi;         // Session of the ring requests
+        bool ringBusy;                      // A worker drains the ring
+        bool ringRerun;                     // The client submitted while the ring was drained
+    };
+
+    VirtualFileSystem* vfs;
+    size_t threadCount;
+    unique_ptr<ThreadPool> pool;
+    string socketPath;
+    int listenFd;
+    int epollFd;
+    int wakeFd;                             // Eventfd written by the workers when responses are ready
+    int signalFd;
+    atomic<bool> stopping;
+    unordered_map<int, shared_ptr<Connection>> connections;
+    mutex readyMutex;
+    vector<shared_ptr<Connection>> readyConnections;  // Connections with new responses
+    mutex ringsMutex;
+    unordered_map<int, shared_ptr<Connection>> ringConnections;  // Connections by the submit eventfd of their ring
+
+    /**
+     * Accepts all waiting clients
+     */
+    void acceptClients();
+
+    /**
+     * Reads the bytes of the client and queues the complete requests
+     * @param connection - readable connection
+     * @return false if the connection was closed
+     */
+    bool readRequests(const shared_ptr<Connection>& connection);
+
+    /**
+     * Sends as many buffered responses as the socket takes
+     * @param connection - connection to send to
+     * @return false if the connection was closed
+     */
+    bool sendResponses(const shared_ptr<Connection>& connection);
+
+    /**
+     * Sets the events the event loop waits for, reading pauses while too much work is queued
+     * @param connection - connection to update
+     */
+    void updateEvents(const shared_ptr<Connection>& connection);
+
+    /**
+     * Closes the socket of a connection, its API object goes away with the last worker using it
+     * @param connection - connection to close
+     */
+    void closeConnection(const shared_ptr<Connection>& connection);
+
+    /**
+     * Writes the data the client appended and closes the session of the connection
+     * @param connection - closed connection no worker uses
+     */
+    void releaseApi(Connection& connection);
+
+    /**
+     * Executes the queued requests of a connection one by one, on a worker thread
+     * @param connection - connection with queued requests
+     */
+    void executeRequests(const shared_ptr<Connection>& connection);
+
+    /**
+     * Creates the shared memory ring of a connection and registers its submit eventfd
+     * @param connection - connection of the request
+     * @param request - ATTACH_RING request with its header
+     * @param payload - payload of the response
+     * @return OK, ALREADY_EXISTS if the connection has a ring, INVALID_ARGUMENT or IO_ERROR if it was not created
+     */
+    VfsStatus attachRing(const shared_ptr<Connection>& connection, const string& request, string& payload);
+
+    /**
+     * Schedules draining of the ring whose client wrote the submit eventfd
+     * @param connection - connection of the ring
+     */
+    void wakeRing(const shared_ptr<Connection>& connection);
+
+    /**
+     * Executes the requests of the ring until it is empty, on a worker thread
+     * @param connection - connection of the ring
+     */
+    void executeRingRequests(const shared_ptr<Connection>& connection);
+
+    /**
+     * Writes the data appended through the ring and closes its session
+     * @param connection - closed connection no worker drains the ring of
+     */
+    void releaseRing(Connection& connection);
+
+    /**
+     * Executes one request of a ring
+     * @param api - API object of the ring
+     * @param ring - ring with the buffer of the request
+     * @param request - copy of the request descriptor
+     * @return completion of the request
+     */
+    static ShmCompletion executeRingRequest(VfsApi& api, const ShmRing& ring, const ShmRequest& request);
+
+    /**
+     * Executes one request
+     * @param api - API object of the connection
+     * @param request - request with its header
+     * @param payload - payload of the response
+     * @return status of the response
+     */
+    static VfsStatus execute(VfsApi& api, const string& request, string& payload);
+};
+
+#endif //SEMESTRALNIPRACE_VFSSERVER_HPP
@@ -1,11 +1,20 @@
 #include "VirtualFileSystem.hpp"
 #include "Utils.hpp"
+#include "LzCodec.hpp"
+#include "ThreadPool.hpp"
+#include "Crc32c.hpp"
+#include "ZeroScanner.hpp"
+#include <chrono>
 #include <iostream>
 #include <algorithm>
 #include <cstring>
 #include <sstream>
+#include <streambuf>
+#include <fcntl.h>
+#include <unistd.h>
 
 using std::streamsize;
+using std::istream;
 using std::unordered_map;
 using std::string;
 using std::vector;
@@ -13,22 +22,73 @@ using std::ios;
 using std::runtime_error;
 using std::ofstream;
 using std::stringstream;
+using std::lock_guard;
+using std::thread;
+using std::pair;
+
+/**
+ * Stores value to the buffer in the byte order of the virtual file system file
+ * @param buffer buffer to store the value to
+ * @param value value to store
+ * @return position in the buffer behind the value
+ */
+template<typename T>
+static char* putValue(char* buffer, T value) {
+    memcpy(buffer, &value, sizeof(T));
+    return buffer + sizeof(T);
+}
+
+/**
+ * Loads value from the buffer and moves the buffer behind it
+ * @param buffer buffer to load the value from
+ * @return loaded value
+ */
+template<typename T>
+static T getValue(const char*& buffer) {
+    T value;
+    memcpy(&value, buffer, sizeof(T));
+    buffer += sizeof(T);
+    return value;
+}
+
+/**
+ * Stream buffer reading a block of memory without copying it, lets written data take the path of imported files
+ */
+struct MemoryStreamBuffer : std::streambuf {
+    MemoryStreamBuffer(const char* data, size_t size) {
+        char* start = const_cast<char*>(data);   // Only ever read
+        setg(start, start, start + size);
+    }
+};
+
+/**
+ * Opens a descriptor of the virtual file system file for positioned reads and punching holes
+ * @param name name of the virtual file system file
+ * @return descriptor opened for reading and writing, for reading only if the file is read only, -1 on error
+ */
+static int openDescriptor(const string& name) {
+    int fd = ::open(name.c_str(), O_RDWR);
+    return fd >= 0 ? fd : ::open(name.c_str(), O_RDONLY);
+}
 
 VirtualFileSystem::VirtualFileSystem()
-        : superblock(nullptr), inodes(nullptr), dataBitmap(nullptr),
-          isFormatted(false), currentDir(nullptr), name(""), vfsFile(nullptr) {}
+        : superblock(nullptr), inodes(nullptr), dataBitmap(nullptr), clusterIo(nullptr),
+          scrubber(new Scrubber(this)), defragmenter(new Defragmenter(this)), isFormatted(false), name(""),
+          vfsFile(nullptr), vfsFd(-1) {}
 
 VirtualFileSystem::VirtualFileSystem(Superblock* superblock, Inode* inodes, int8_t* dataBitmap,
-                                     bool isFormatted, Directory* currentDir,
-                                     const string& name, fstream* vfsFile)
+                                     bool isFormatted, const string& name, fstream* vfsFile)
         : superblock(superblock), inodes(inodes), dataBitmap(dataBitmap),
-          isFormatted(isFormatted), currentDir(currentDir), name(name), vfsFile(vfsFile) {}
+          clusterIo(superblock ? ClusterIo::forClusterSize(superblock->getClusterSize()) : nullptr),
+          scrubber(new Scrubber(this)), defragmenter(new Defragmenter(this)), isFormatted(isFormatted), name(name), vfsFile(vfsFile),
+          vfsFd(openDescriptor(name)) {}
 
 VirtualFileSystem::VirtualFileSystem(const string& vfsName)
-        : superblock(nullptr), inodes(nullptr), dataBitmap(nullptr),
-          isFormatted(false), currentDir(nullptr), name(vfsName), vfsFile(nullptr) {
+        : superblock(nullptr), inodes(nullptr), dataBitmap(nullptr), clusterIo(nullptr),
+          scrubber(new Scrubber(this)), defragmenter(new Defragmenter(this)), isFormatted(false), name(vfsName),
+          vfsFile(nullptr), vfsFd(-1) {
 
-    vfsFile = new fstream(vfsName, ios::in | ios::out | ios::binary);
+    openVfsFile();
 
     if (vfsFile->is_open()) {
         vfsFile->seekg(0, ios::end);
@@ -48,9 +108,14 @@ VirtualFileSystem::VirtualFileSystem(const string& vfsName)
 }
 
 VirtualFileSystem::~VirtualFileSystem() {
+    // Background threads use the file system until they are stopped
+    delete scrubber;
+    delete defragmenter;
+
     delete superblock;
     delete[] inodes;
     delete[] dataBitmap;
+    clearAllocationGroups();
 
     // Delete all directories
     for (auto& pair : allDirs) {
@@ -59,350 +124,2047 @@ VirtualFileSystem::~VirtualFileSystem() {
     // Clear the map
     allDirs.clear();
 
+    for (Session* session : sessions) {
+        delete session;
+    }
+
     delete vfsFile;
+
+    if (vfsFd >= 0) {
+        ::close(vfsFd);
+    }
 }
 
 Directory* VirtualFileSystem::getDirectory(int32_t id) {
-    if (id >= 0 && id <= allDirs.size()) {
-        return allDirs[id];
+    auto it = allDirs.find(id); // find() does not insert, so it is safe for concurrent readers
+    if (it != allDirs.end()) {
+        return it->second;
     }
     return nullptr; // return nullptr if id is invalid
 }
 
-void VirtualFileSystem::addDirectory(Directory* dir, int32_t index) {
-    allDirs[index] = dir;
+shared_lock<shared_mutex> VirtualFileSystem::lockShared() const {
+    return shared_lock<shared_mutex>(stateMutex);
 }
 
-unordered_map<int, Directory*>& VirtualFileSystem::getAllDirectories() {
-    return allDirs;
+unique_lock<shared_mutex> VirtualFileSystem::lockExclusive() const {
+    return unique_lock<shared_mutex>(stateMutex);
 }
 
+Session* VirtualFileSystem::openSession() {
+    auto* session = new Session(getDirectory(0), new ClusterReservation(this));
 
-void VirtualFileSystem::loadDirectoryFromVfs(Directory* dir, int id) {
-    int blockCount;
-    const int inodeCount = 64;
-    char filename[12];
-
-    vector<int32_t> dataBlocks = getDataBlocks(dir->getCurrent()->getInode(), &blockCount, nullptr);
+    lock_guard<mutex> lock(sessionsMutex);
+    sessions.insert(session);
+    return session;
+}
 
-    for (int i = 0; i < blockCount; i++) {
-        seekDataCluster(dataBlocks[i]);
-        for (int j = 0; j < inodeCount; j++) {
-            int32_t nodeId;
-            readFromFile(&nodeId);
-            if (nodeId > 0) {
-                readFromFile(reinterpret_cast<int8_t*>(filename), sizeof(filename));
-                DirectoryItem* item = createDirectoryItem(nodeId, filename);
-                if (inodes[nodeId].getIsDirectory()) {
-                    dir->addSubdirectory(item);
-                } else {
-                    dir->addFile(item);
-                }
+void VirtualFileSystem::closeSession(Session* session) {
+    {
+        lock_guard<mutex> lock(sessionsMutex);
+        sessions.erase(session);
+    }
+    {
+        lock_guard<mutex> lock(openFilesMutex);
+        for (auto it = openFiles.begin(); it != openFiles.end();) {
+            if (it->second->getSession() == session) {
+                delete it->second;
+                it = openFiles.erase(it);
             } else {
-                seekCur(sizeof(filename));
+                ++it;
             }
         }
     }
+    // Not reachable by releaseAllReservations any more, so only this thread touches the pool
+    session->getReservation()->release();
+    delete session;
+}
 
-    // Recursively load subdirectories
-    for (auto tempSubdir = dir->getSubdir(); tempSubdir != nullptr; tempSubdir = tempSubdir->getNext()) {
-        auto newDirectory = new Directory();
-        newDirectory->setParent(dir);
-        newDirectory->setCurrent(tempSubdir);
+void VirtualFileSystem::moveSessions(Directory* from, Directory* to) {
+    lock_guard<mutex> lock(sessionsMutex);
+    for (Session* session : sessions) {
+        if (session->getCurrentDir() == from) {
+            session->setCurrentDir(to);
+        }
+    }
+}
 
-        delete allDirs[tempSubdir->getInode()];
-        allDirs[tempSubdir->getInode()] = newDirectory;
-        loadDirectoryFromVfs(newDirectory, tempSubdir->getInode());
+int32_t VirtualFileSystem::open(const string& path, Session* session, bool create) {
+    Directory* dir = findDirectory(getDirPath(path), session);
+    string fileName = getFileName(path);
+    if (dir == nullptr || fileName.empty() || fileName.length() >= FILENAME_LENGTH) {
+        return ERROR_CODE;
+    }
+
+    DirectoryItem* item = findItem(dir->getFile(), fileName.c_str());
+    if (item != nullptr && inodes[item->getInode()].getIsDirectory()) {
+        return ERROR_CODE;
     }
+    if (item == nullptr) {
+        if (!create) {
+            return ERROR_CODE;
+        }
+        int32_t inodeId = findFreeInode(dir->getCurrent()->getInode());
+        if (inodeId == ERROR_CODE) {
+            return ERROR_CODE;
+        }
+
+        // The file starts empty, it is stored like an imported empty file
+        vector<int32_t> noBlocks;
+        if (isSmallFile(0)) {
+            storeSmallFile(inodeId, string(), session);
+        } else {
+            initializeInode(inodeId, 0, 0, noBlocks);
+        }
+        item = new DirectoryItem(inodeId, fileName.c_str());
+        dir->addFile(item);
+        writeInodeToVfs(inodeId);
+        updateDirectoryInFile(dir, item, true);
+        flushVfs();
+    }
+
+    lock_guard<mutex> lock(openFilesMutex);
+    int32_t handle = nextHandle++;
+    openFiles[handle] = new OpenFile(item->getInode(), dir, session);
+    return handle;
 }
 
-void VirtualFileSystem::loadVfs() {
-    if (!vfsFile->is_open()) {
-        log(PLEASE_FORMAT_VFS_TEXT);
-        isFormatted = false;
-        return;  // File is not open
+bool VirtualFileSystem::close(int32_t handle) {
+    lock_guard<mutex> lock(openFilesMutex);
+    auto it = openFiles.find(handle);
+    if (it == openFiles.end()) {
+        return false;
+    }
+    delete it->second;
+    openFiles.erase(it);
+    return true;
+}
+
+OpenFile* VirtualFileSystem::getOpenFile(int32_t handle) {
+    lock_guard<mutex> lock(openFilesMutex);
+    auto it = openFiles.find(handle);
+    return it != openFiles.end() ? it->second : nullptr;
+}
+
+void VirtualFileSystem::closeOpenFiles(int32_t inodeId) {
+    lock_guard<mutex> lock(openFilesMutex);
+    for (auto it = openFiles.begin(); it != openFiles.end();) {
+        if (inodeId == ID_ITEM_FREE || it->second->getInodeId() == inodeId) {
+            delete it->second;
+            it = openFiles.erase(it);
+        } else {
+            ++it;
+        }
     }
 
-    // Superblock initialization
-    superblock = new Superblock();
-    rewindVfs();
+    // Data appended to a removed file is dropped with it
+    for (auto it = pendingAppends.begin(); it != pendingAppends.end();) {
+        if (inodeId == ID_ITEM_FREE || it->first == inodeId) {
+            pendingAppendBytes -= static_cast<int64_t>(it->second.data.size());
+            it = pendingAppends.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
 
-    char signatureBuffer[SIGNATURE_LENGTH + 1];
-    vfsFile->read(signatureBuffer, SIGNATURE_LENGTH);
-    signatureBuffer[SIGNATURE_LENGTH] = '\0';
-    superblock->setSignature(signatureBuffer);
-    readAndSet(*vfsFile, *superblock, &Superblock::setDiskSize);
-    readAndSet(*vfsFile, *superblock, &Superblock::setClusterSize);
-    readAndSet(*vfsFile, *superblock, &Superblock::setClusterCount);
-    readAndSet(*vfsFile, *superblock, &Superblock::setInodeCount);
-    readAndSet(*vfsFile, *superblock, &Superblock::setBitmapClusterCount);
-    readAndSet(*vfsFile, *superblock, &Superblock::setInodeClusterCount);
-    readAndSet(*vfsFile, *superblock, &Superblock::setDataClusterCount);
-    readAndSet(*vfsFile, *superblock, &Superblock::setBitmapStartAddress);
-    readAndSet(*vfsFile, *superblock, &Superblock::setInodeStartAddress);
-    readAndSet(*vfsFile, *superblock, &Superblock::setDataStartAddress);
+void VirtualFileSystem::moveOpenFiles(int32_t inodeId, Directory* from, Directory* to) {
+    lock_guard<mutex> lock(openFilesMutex);
+    for (auto& entry : openFiles) {
+        if (entry.second->getInodeId() == inodeId && entry.second->getParentDir() == from) {
+            entry.second->setParentDir(to);
+        }
+    }
 
-    dataBitmap = new int8_t[superblock->getClusterCount()];
-    seekSet(superblock->getBitmapStartAddress());
-    vfsFile->read(reinterpret_cast<char*>(dataBitmap), sizeof(int8_t) * superblock->getDataClusterCount());
+    auto it = pendingAppends.find(inodeId);
+    if (it != pendingAppends.end() && it->second.parentDir == from) {
+        it->second.parentDir = to;
+    }
+}
 
-    inodes = new Inode[superblock->getInodeCount()];
-    for (int i = 0; i < superblock->getInodeCount(); i++) {
-        seekSet(superblock->getInodeStartAddress() + i * INODE_SIZE);
-        auto* inode = new Inode();
-        readInodeFromFile(inode);
+uint64_t VirtualFileSystem::getFileWrites(int32_t inodeId) const {
+    auto it = fileWrites.find(inodeId);
+    return it != fileWrites.end() ? it->second : 0;
+}
 
-        inodes[i] = *inode;
-        delete inode;
+int64_t VirtualFileSystem::getFileSize(int32_t handle) {
+    OpenFile* file = getOpenFile(handle);
+    if (file == nullptr) {
+        return ERROR_CODE;
     }
+    auto it = pendingAppends.find(file->getInodeId());
+    int64_t pending = it != pendingAppends.end() ? static_cast<int64_t>(it->second.data.size()) : 0;
+    return inodes[file->getInodeId()].getFileSize() + pending;
+}
 
-    auto* rootItem = new DirectoryItem(0, "/");
-    auto* rootDirectory = new Directory();
-    rootDirectory->setCurrent(rootItem);
-    rootDirectory->setParent(rootDirectory); // rootDirectory refers to itself as parent
+int64_t VirtualFileSystem::pread(int32_t handle, int64_t offset, char* buffer, int64_t size) {
+    OpenFile* file = getOpenFile(handle);
+    if (file == nullptr || offset < 0 || size < 0) {
+        return ERROR_CODE;
+    }
 
-    allDirs[0] = rootDirectory;
+    int32_t id = file->getInodeId();
+    int64_t fileSize = inodes[id].getFileSize();
+    int64_t length = std::max<int64_t>(0, std::min(size, getFileSize(handle) - offset));
+    if (length == 0) {
+        return 0;
+    }
 
-    // Set current directory to root
-    currentDir = allDirs[0];
+    // Bytes behind the stored end are still buffered appends
+    int64_t stored = std::max<int64_t>(0, std::min(length, fileSize - offset));
+    if (stored < length) {
+        const string& pending = pendingAppends.at(id).data;
+        int64_t from = std::max(offset, fileSize) - fileSize;
+        memcpy(buffer + stored, pending.data() + from, static_cast<size_t>(length - stored));
+    }
+    if (stored == 0) {
+        return length;
+    }
 
-    // Load directory from vfs
-    loadDirectoryFromVfs(currentDir, 0);
+    string data;
+    if (readSmallFile(id, data)) {
+        if (static_cast<int64_t>(data.size()) != fileSize) {
+            return ERROR_CODE;  // Damaged tail in the strict mode
+        }
+        memcpy(buffer, data.data() + offset, static_cast<size_t>(stored));
+        return length;
+    }
+    bool read = inodes[id].getIsCompressed() ? readCompressedRange(id, offset, buffer, stored)
+                                             : readPlainRange(id, offset, buffer, stored);
+    return read ? length : ERROR_CODE;
 }
 
-string VirtualFileSystem::getCurrentPath() {
-    Directory* temp_dir = getCurrentDir();
-    string result;
+int64_t VirtualFileSystem::pwrite(int32_t handle, int64_t offset, const char* data, int64_t size, bool compress) {
+    OpenFile* file = getOpenFile(handle);
+    if (file == nullptr || offset < 0 || size < 0 || offset + size > getMaxFileSize()) {
+        return ERROR_CODE;
+    }
+    if (size == 0) {
+        return 0;
+    }
 
-    while (temp_dir->getCurrent()->getInode() != allDirs[0]->getCurrent()->getInode()) {
-        result = "/" + string(temp_dir->getCurrent()->getItemName()) + result;
-        temp_dir = temp_dir->getParent();
+    // Appended data lies before or under the range, so it is written first
+    if (!flushAppends(file->getInodeId(), file->getSession())) {
+        return ERROR_CODE;
     }
+    return writeRange(file, offset, data, size, compress) ? size : ERROR_CODE;
+}
 
-    if (result.empty()) {
-        result = "/";
+bool VirtualFileSystem::writeRange(OpenFile* file, int64_t offset, const char* data, int64_t size, bool compress) {
+    int32_t id = file->getInodeId();
+    int64_t oldSize = inodes[id].getFileSize();
+    int64_t newSize = std::max(oldSize, offset + size);
+
+    string content;
+    if (readSmallFile(id, content)) {
+        if (static_cast<int64_t>(content.size()) != oldSize) {
+            return false;
+        }
+        if (oldSize > 0 || offset > 0 || isSmallFile(newSize)) {
+            content.resize(static_cast<size_t>(newSize), '\0');
+            memcpy(&content[static_cast<size_t>(offset)], data, static_cast<size_t>(size));
+            return rewriteSmallFile(file, content, newSize);
+        }
+
+        // An empty file filled from its start gets clusters like an imported file, the hard links stay
+        int32_t references = inodes[id].getReferences();
+        vector<int32_t> noBlocks;
+        initializeInode(id, 0, 0, noBlocks);
+        inodes[id].setReferences(references);
+        writeInodeToVfs(id);
     }
 
-    return result;
+    // Data behind the end of a file ending on a cluster ( or a compression unit ) is stored like an imported file
+    bool compressed = inodes[id].getIsCompressed() || (oldSize == 0 && shouldCompress(compress));
+    int64_t unitBytes = compressed ? static_cast<int64_t>(getCompressionUnitClusters()) * superblock->getClusterSize()
+                                   : superblock->getClusterSize();
+    if (offset == oldSize && oldSize % unitBytes == 0 && (compressed || isInlineDedup() || allowsHoles())) {
+        if (!extendStoredFile(file, data, size, compressed)) {
+            return false;
+        }
+        updateSizesInFile(file->getParentDir(), size);
+        return true;
+    }
+
+    if (inodes[id].getIsCompressed() && !expandCompressedFile(file)) {
+        return false;
+    }
+    if (!writePlainRange(file, newSize, offset, data, size)) {
+        return false;
+    }
+    if (newSize != oldSize) {
+        updateSizesInFile(file->getParentDir(), newSize - oldSize);
+    }
+    return true;
 }
 
-void VirtualFileSystem::freeInode(int id) {
-    if (id < 0 || id >= superblock->getInodeCount()) {
-        throw runtime_error("Invalid inode id.");
+int64_t VirtualFileSystem::append(int32_t handle, const char* data, int64_t size) {
+    OpenFile* file = getOpenFile(handle);
+    if (file == nullptr || size < 0 || getFileSize(handle) + size > getMaxFileSize()) {
+        return ERROR_CODE;
+    }
+    if (size == 0) {
+        return 0;
     }
 
-    inodes[id].setNodeId(ID_ITEM_FREE);
-    inodes[id].setIsDirectory(false);
-    inodes[id].setReferences(1);
-    inodes[id].setFileSize(0);
-    inodes[id].setDirect(0, ID_ITEM_FREE);
-    inodes[id].setDirect(1, ID_ITEM_FREE);
-    inodes[id].setDirect(2, ID_ITEM_FREE);
-    inodes[id].setDirect(3, ID_ITEM_FREE);
-    inodes[id].setDirect(4, ID_ITEM_FREE);
-    inodes[id].setIndirect(0, ID_ITEM_FREE);
-    inodes[id].setIndirect(1, ID_ITEM_FREE);
+    int32_t id = file->getInodeId();
+    PendingAppend& pending = pendingAppends[id];
+    pending.parentDir = file->getParentDir();
+    pending.data.append(data, static_cast<size_t>(size));
+    pendingAppendBytes += size;
 
+    // A full buffer is written at once, data which does not fit into the file system is not accepted
+    if (static_cast<int64_t>(pending.data.size()) >= APPEND_BUFFER_BYTES && !flushAppends(id, file->getSession())) {
+        pending.data.resize(pending.data.size() - static_cast<size_t>(size));
+        pendingAppendBytes -= size;
+        return ERROR_CODE;
+    }
+    return size;
 }
 
-Directory* VirtualFileSystem::findDirectory(const string& path) {
-    Directory* dir = (path[0] == '/') ? allDirs[0] : currentDir;
+bool VirtualFileSystem::flushAppends(int32_t inodeId, Session* session) {
+    bool flushed = true;
+    for (auto it = pendingAppends.begin(); it != pendingAppends.end();) {
+        if (inodeId != ID_ITEM_FREE && it->first != inodeId) {
+            ++it;
+            continue;
+        }
 
-    size_t start = 0;
-    size_t end = path.find(PATH_DELIMETER);
+        // The whole buffer is one write behind the end, its clusters are allocated together
+        OpenFile file(it->first, it->second.parentDir, session);
+        const string& data = it->second.data;
+        if (!data.empty() && !writeRange(&file, inodes[it->first].getFileSize(), data.data(), static_cast<int64_t>(data.size()))) {
+            flushed = false;
+            ++it;
+            continue;
+        }
+        pendingAppendBytes -= static_cast<int64_t>(data.size());
+        it = pendingAppends.erase(it);
+    }
+    return flushed;
+}
 
-    while (start != string::npos) {
-        string part = (end == string::npos) ? path.substr(start) : path.substr(start, end - start);
+bool VirtualFileSystem::hasPendingAppends() const {
+    return pendingAppendBytes > 0;
+}
 
-        if (part.empty() || part == ".") {
-            // Skip empty parts and current directory
-        } else if (part == "..") {
-            // Drop to parent directory
-            dir = dir->getParent();
-        } else {
-            // Search for subdirectory or file
-            bool found = false;
-            DirectoryItem* item = dir->getSubdir();
+bool VirtualFileSystem::truncate(int32_t handle, int64_t size) {
+    OpenFile* file = getOpenFile(handle);
+    if (file == nullptr || size < 0 || size > getMaxFileSize()) {
+        return false;
+    }
 
-            while (item != nullptr) {
-                Directory* subdir = allDirs[item->getInode()];
-                if (subdir && subdir->getCurrent()->getItemName() == part) {
-                    dir = subdir;
-                    found = true;
-                    break;
-                }
-                item = item->getNext();
-            }
+    int32_t id = file->getInodeId();
+    if (!flushAppends(id, file->getSession())) {
+        return false;
+    }
+    int64_t oldSize = inodes[id].getFileSize();
 
-            if (!found) {
-                return nullptr;  // Subdirectory or file not found
-            }
+    string content;
+    if (readSmallFile(id, content)) {
+        if (static_cast<int64_t>(content.size()) != oldSize) {
+            return false;
         }
+        // Only the kept content is passed, an extension reads as zeros
+        content.resize(static_cast<size_t>(std::min(size, oldSize)));
+        return rewriteSmallFile(file, content, size);
+    }
 
-        start = (end == string::npos) ? string::npos : end + 1;
-        end = path.find(PATH_DELIMETER, start);
+    // A file shrunk to a small size gives up its clusters and is stored like an imported small file
+    if (size < oldSize && isSmallFile(size)) {
+        content.assign(static_cast<size_t>(size), '\0');
+        bool read = size == 0 || (inodes[id].getIsCompressed() ? readCompressedRange(id, 0, &content[0], size)
+                                                               : readPlainRange(id, 0, &content[0], size));
+        if (!read || !writePlainRange(file, 0, 0, nullptr, 0)) {
+            return false;
+        }
+        updateSizesInFile(file->getParentDir(), -oldSize);
+        return rewriteSmallFile(file, content, size);
     }
 
-    return dir;
+    if (inodes[id].getIsCompressed() && !expandCompressedFile(file)) {
+        return false;
+    }
+    if (!writePlainRange(file, size, size, nullptr, 0)) {
+        return false;
+    }
+    if (size != oldSize) {
+        updateSizesInFile(file->getParentDir(), size - oldSize);
+    }
+    return true;
 }
 
-Superblock * VirtualFileSystem::getSuperblock() const {
-    return superblock;
+bool VirtualFileSystem::fallocate(int32_t handle, int64_t size) {
+    OpenFile* file = getOpenFile(handle);
+    if (file == nullptr || size < 0 || size > getMaxFileSize()) {
+        return false;
+    }
+
+    int32_t id = file->getInodeId();
+    if (!flushAppends(id, file->getSession())) {
+        return false;
+    }
+    int64_t oldSize = inodes[id].getFileSize();
+    int64_t newSize = std::max(oldSize, size);
+
+    string content;
+    if (readSmallFile(id, content)) {
+        if (static_cast<int64_t>(content.size()) != oldSize) {
+            return false;
+        }
+        return newSize == oldSize || rewriteSmallFile(file, content, newSize, true);
+    }
+
+    if (inodes[id].getIsCompressed() && !expandCompressedFile(file)) {
+        return false;
+    }
+    if (!writePlainRange(file, newSize, newSize, nullptr, 0, true)) {
+        return false;
+    }
+    if (newSize != oldSize) {
+        updateSizesInFile(file->getParentDir(), newSize - oldSize);
+    }
+    return true;
 }
 
-void VirtualFileSystem::setSuperblock(Superblock* newSuperblock) {
-    superblock = newSuperblock;
+bool VirtualFileSystem::readPlainRange(int32_t inodeId, int64_t offset, char* buffer, int64_t size) {
+    int64_t clusterSize = superblock->getClusterSize();
+    int blockCount;
+    vector<int32_t> blocks = getDataBlocks(inodeId, &blockCount, nullptr);
+    int64_t end = offset + size;
+    auto last = static_cast<int>((end - 1) / clusterSize);
+
+    // A read continuing the previous one of the file continues its readahead window, holes read as zeros
+    Readahead readahead(this, inodeId, blocks, blockCount);
+    vector<char> cluster;
+    for (auto i = static_cast<int>(offset / clusterSize); i <= last; i++) {
+        int64_t from = std::max(offset, i * clusterSize);
+        int64_t to = std::min(end, (i + 1) * clusterSize);
+        char* target = buffer + (from - offset);
+        if (from == i * clusterSize) {
+            if (readahead.read(i, target, static_cast<size_t>(to - from)) < 0) {
+                return false;
+            }
+            continue;
+        }
+        cluster.resize(static_cast<size_t>(clusterSize));
+        if (readahead.read(i, cluster.data(), cluster.size()) < 0) {
+            return false;
+        }
+        memcpy(target, cluster.data() + (from - i * clusterSize), static_cast<size_t>(to - from));
+    }
+    return true;
 }
 
-Inode* VirtualFileSystem::getInodes() const {
-    return inodes;
+bool VirtualFileSystem::readCompressedRange(int32_t inodeId, int64_t offset, char* buffer, int64_t size) {
+    int blockCount;
+    vector<int32_t> blocks = getDataBlocks(inodeId, &blockCount, nullptr);
+    int64_t fileSize = inodes[inodeId].getFileSize();
+    int64_t unitBytes = static_cast<int64_t>(getCompressionUnitClusters()) * superblock->getClusterSize();
+    vector<char> unit(static_cast<size_t>(unitBytes));
+    int64_t end = offset + size;
+
+    for (int64_t position = offset; position < end;) {
+        auto index = static_cast<int>(position / unitBytes);
+        int64_t length = readCompressedUnit(blocks, index, fileSize, unit.data());
+        int64_t from = position - index * unitBytes;
+        int64_t count = std::min(end - position, length - from);
+        if (length < 0 || count <= 0) {
+            return false;
+        }
+        memcpy(buffer + (position - offset), unit.data() + from, static_cast<size_t>(count));
+        position += count;
+    }
+    return true;
+}
+
+bool VirtualFileSystem::rewriteSmallFile(OpenFile* file, const string& data, int64_t newSize, bool allocate) {
+    int32_t id = file->getInodeId();
+    Inode& node = inodes[id];
+    int32_t references = node.getReferences();
+    int64_t oldSize = node.getFileSize();
+    string oldData;
+    readSmallFile(id, oldData);
+
+    if (node.getTailCluster() != ID_ITEM_FREE) {
+        releasePackedTail(id);
+    }
+
+    bool stored;
+    if (isSmallFile(newSize)) {
+        string content = data;
+        content.resize(static_cast<size_t>(newSize), '\0');
+        stored = storeSmallFile(id, content, file->getSession());
+    } else {
+        // The file gets data clusters of its own, it is written like a plain file growing from nothing
+        vector<int32_t> noBlocks;
+        initializeInode(id, 0, 0, noBlocks);
+        stored = writePlainRange(file, newSize, 0, data.data(), static_cast<int64_t>(data.size()), allocate);
+    }
+    if (!stored) {
+        storeSmallFile(id, oldData, file->getSession());    // Fits into the space it has just freed
+    }
+
+    // Storing initializes the i-node, its hard links stay
+    node.setReferences(references);
+    writeInodeToVfs(id);
+    if (stored && newSize != oldSize) {
+        updateSizesInFile(file->getParentDir(), newSize - oldSize);
+    }
+    flushVfs();
+    return stored;
+}
+
+bool VirtualFileSystem::expandCompressedFile(OpenFile* file) {
+    int32_t id = file->getInodeId();
+    Inode& node = inodes[id];
+    int64_t fileSize = node.getFileSize();
+    int blockCount;
+    vector<int32_t> blocks = getDataBlocks(id, &blockCount, nullptr);
+    blocks.resize(static_cast<size_t>(blockCount));
+
+    vector<int32_t> plain = blockCount > 0 ? allocateDataBlocks(blockCount, id, file->getSession()) : vector<int32_t>();
+    if (plain.size() != static_cast<size_t>(blockCount)) {
+        return false;
+    }
+
+    int32_t unitClusters = getCompressionUnitClusters();
+    vector<char> unit(static_cast<size_t>(unitClusters) * superblock->getClusterSize());
+    for (int index = 0; index < getCompressionUnitCount(fileSize); index++) {
+        int64_t length = readCompressedUnit(blocks, index, fileSize, unit.data());
+        if (length < 0) {
+            unreserveClusters(plain);
+            return false;
+        }
+        memset(unit.data() + length, 0, unit.size() - static_cast<size_t>(length));
+        int first = index * unitClusters;
+        writeClusterRuns(plain, first, std::min(unitClusters, blockCount - first), unit.data());
+    }
+
+    // The block map keeps its clusters, only its pointers change
+    vector<int32_t> pointers = plain;
+    vector<int32_t> mapBlocks = getMapBlocks(id);
+    pointers.insert(pointers.end(), mapBlocks.begin(), mapBlocks.end());
+    writeBitmapEntries(plain, 1);
+    writeBlockPointers(id, blockCount, pointers);
+    node.setIsCompressed(false);
+    writeInodeToVfs(id);
+
+    vector<int32_t> freed = releaseDataBlocks(blocks);
+    discardClusters(freed);
+    writeBitmapEntries(freed, 0);
+    flushVfs();
+    return true;
 }
 
+bool VirtualFileSystem::writePlainRange(OpenFile* file, int64_t newSize, int64_t offset, const char* data, int64_t size,
+                                        bool allocate) {
+    int32_t id = file->getInodeId();
+    Inode& node = inodes[id];
+    int64_t clusterSize = superblock->getClusterSize();
+    int64_t dataStart = superblock->getDataStartAddress();
+
+    int oldCount;
+    vector<int32_t> blocks = getDataBlocks(id, &oldCount, nullptr);
+    blocks.resize(static_cast<size_t>(oldCount));
+    vector<int32_t> mapBlocks = getMapBlocks(id);
+    int newCount = clusterIo->getBlockCount(newSize, nullptr);
+
+    // Clusters behind the new end are dropped, the cut last cluster has to read as zeros behind the end
+    vector<int32_t> dropped(blocks.begin() + std::min(oldCount, newCount), blocks.end());
+    vector<int32_t> source = blocks;
+    source.resize(static_cast<size_t>(newCount), ID_ITEM_FREE);
+    int cut = newSize < node.getFileSize() && newSize % clusterSize != 0 ? newCount - 1 : -1;
+    int64_t end = offset + size;
+    int first = size > 0 ? static_cast<int>(offset / clusterSize) : 0;
+    int last = size > 0 ? static_cast<int>((end - 1) / clusterSize) : -1;
+
+    // Written holes and written shared clusters get new clusters, so do all new blocks of an image without holes and
+    // all holes of a preallocated file ( free clusters read as zeros, so nothing is written to them )
+    vector<int> fresh;
+    for (int i = first; i <= last; i++) {
+        if (source[i] == ID_ITEM_FREE || dataBitmap[source[i]] > 1) {
+            fresh.push_back(i);
+        }
+    }
+    if (cut >= 0 && source[cut] != ID_ITEM_FREE && dataBitmap[source[cut]] > 1) {
+        fresh.push_back(cut);
+    }
+    for (int i = allocate ? 0 : oldCount; i < newCount && (allocate || !allowsHoles()); i++) {
+        if ((i < first || i > last) && source[i] == ID_ITEM_FREE) {
+            fresh.push_back(i);
+        }
+    }
+    std::sort(fresh.begin(), fresh.end());
+
+    bool remap = !fresh.empty() || newCount != oldCount;
+    int mapCount = newCount > 0 ? getBlockCountWithIndirect(newCount) - newCount : 0;
+    size_t keptMap = remap ? std::min(mapBlocks.size(), static_cast<size_t>(mapCount)) : mapBlocks.size();
+    size_t needed = fresh.size() + (remap ? static_cast<size_t>(mapCount) - keptMap : 0);
+    vector<int32_t> allocated;
+    if (needed > 0) {
+        // Clusters added behind the last cluster of the file continue it when the clusters behind it are free
+        if (!fresh.empty() && fresh.front() >= oldCount && oldCount > 0 && source[oldCount - 1] != ID_ITEM_FREE) {
+            allocated = claimFollowingClusters(source[oldCount - 1], static_cast<int>(needed));
+        }
+        // Preallocation wants one run, the reservation pool of the session holds shorter ones
+        if (allocated.empty() && allocate) {
+            allocated = reserveClusters(static_cast<int>(needed), id);
+            if (allocated.size() != needed) {
+                unreserveClusters(allocated);
+                allocated.clear();
+            }
+        }
+        if (allocated.empty()) {
+            allocated = allocateDataBlocks(static_cast<int>(needed), id, file->getSession());
+        }
+        if (allocated.size() != needed) {
+            return false;
+        }
+    }
+    vector<int32_t> target = source;
+    for (size_t k = 0; k < fresh.size(); k++) {
+        target[fresh[k]] = allocated[k];
+    }
+    auto moves = [&](int i) { return target[i] != source[i]; };
+
+    // Partly written clusters which move keep the rest of their content, it is read before anything is written
+    vector<char> head, tail;
+    auto readOld = [&](int i, vector<char>& content) {
+        content.assign(static_cast<size_t>(clusterSize), 0);
+        return source[i] == ID_ITEM_FREE || readDataClusters(source[i], content.data(), content.size()) == clusterSize;
+    };
+    bool readable = true;
+    if (last >= 0 && moves(first) && offset % clusterSize != 0) {
+        readable = readOld(first, head);
+    }
+    if (last >= 0 && moves(last) && end % clusterSize != 0) {
+        readable = readOld(last, tail) && readable;
+    }
+    if (cut >= 0 && moves(cut)) {
+        readable = readOld(cut, tail) && readable;
+    }
+    if (!readable) {
+        unreserveClusters(allocated);
+        return false;
+    }
+
+    // Physically consecutive clusters are written at once, clusters kept in place only where the range covers them
+    for (int i = first; i <= last;) {
+        int run = 1;
+        while (i + run <= last && target[i + run] == target[i] + run) {
+            run++;
+        }
+        int64_t runStart = i * clusterSize;
+        int64_t runEnd = (i + run) * clusterSize;
+        int64_t from = moves(i) ? runStart : std::max(offset, runStart);
+        int64_t to = moves(i + run - 1) ? runEnd : std::min(end, runEnd);
+        seekSet(dataStart + target[i] * clusterSize + (from - runStart));
+        if (from >= offset && to <= end) {
+            writeToFile(data + (from - offset), static_cast<size_t>(to - from));
+        } else {
+            vector<char> buffer(static_cast<size_t>(to - from));
+            if (from < offset) {
+                memcpy(buffer.data(), head.data(), static_cast<size_t>(offset - from));
+            }
+            if (to > end) {
+                memcpy(buffer.data() + (end - from), tail.data() + (end - (runEnd - clusterSize)), static_cast<size_t>(to - end));
+            }
+            int64_t dataFrom = std::max(offset, from);
+            memcpy(buffer.data() + (dataFrom - from), data + (dataFrom - offset), static_cast<size_t>(std::min(end, to) - dataFrom));
+            writeToFile(buffer.data(), buffer.size());
+        }
+        i += run;
+    }
+    if (cut >= 0 && target[cut] != ID_ITEM_FREE) {
+        // A copied cluster is written whole, a cluster kept in place only gets its end zeroed
+        int64_t keep = newSize - cut * clusterSize;
+        int64_t from = moves(cut) ? 0 : keep;
+        tail.resize(static_cast<size_t>(clusterSize), 0);
+        memset(tail.data() + keep, 0, static_cast<size_t>(clusterSize - keep));
+        seekSet(dataStart + target[cut] * clusterSize + from);
+        writeToFile(tail.data() + from, static_cast<size_t>(clusterSize - from));
+    }
+
+    // Hashes of clusters changed in place are forgotten, equal content is found again by the next dedup
+    if (superblock->hasFeature(FEATURE_DEDUP)) {
+        vector<int> changed;
+        for (int i = first; i <= last; i++) {
+            changed.push_back(i);
+        }
+        if (cut >= 0) {
+            changed.push_back(cut);
+        }
+        vector<pair<int32_t, Hash128>> slots;
+        for (int i : changed) {
+            if (target[i] != ID_ITEM_FREE && !moves(i)) {
+                dedupIndex.remove(target[i]);
+                slots.emplace_back(target[i], Hash128{0, 0});
+            }
+        }
+        writeDedupSlots(slots);
+    }
+
+    // New clusters are marked used before the i-node refers to them, the replaced ones are freed after the switch
+    writeBitmapEntries(allocated, 1);
+    node.setFileSize(newSize);
+    if (remap) {
+        target.insert(target.end(), mapBlocks.begin(), mapBlocks.begin() + static_cast<int64_t>(keptMap));
+        target.insert(target.end(), allocated.begin() + static_cast<int64_t>(fresh.size()), allocated.end());
+        writeBlockPointers(id, newCount, target);
+    }
+    writeInodeToVfs(id);
+
+    for (int i : fresh) {
+        if (source[i] != ID_ITEM_FREE) {
+            dropped.push_back(source[i]);   // Shared cluster replaced by its copy, it loses one reference
+        }
+    }
+    vector<int32_t> freed = releaseDataBlocks(dropped);
+    freed.insert(freed.end(), mapBlocks.begin() + static_cast<int64_t>(keptMap), mapBlocks.end());
+    discardClusters(freed);
+    writeBitmapEntries(freed, 0);
+    flushVfs();
+
+    fileWrites[id]++;
+    return true;
+}
+
+bool VirtualFileSystem::extendStoredFile(OpenFile* file, const char* data, int64_t size, bool compressed) {
+    int32_t id = file->getInodeId();
+    Inode& node = inodes[id];
+    int64_t clusterSize = superblock->getClusterSize();
+
+    int oldCount;
+    vector<int32_t> blocks = getDataBlocks(id, &oldCount, nullptr);
+    blocks.resize(static_cast<size_t>(oldCount));
+    vector<int32_t> mapBlocks = getMapBlocks(id);
+    int rest;
+    int addedCount = clusterIo->getBlockCount(size, &rest);
+    int newCount = oldCount + addedCount;
+    int mapCount = getBlockCountWithIndirect(newCount) - newCount;
+    size_t keptMap = std::min(mapBlocks.size(), static_cast<size_t>(mapCount));
+    auto needed = static_cast<int>(addedCount + mapCount - keptMap);
+
+    // The new clusters continue the last cluster of the file when the clusters behind it are free
+    vector<int32_t> allocated;
+    if (oldCount > 0 && blocks[oldCount - 1] != ID_ITEM_FREE) {
+        allocated = claimFollowingClusters(blocks[oldCount - 1], needed);
+    }
+    if (allocated.empty()) {
+        allocated = allocateDataBlocks(needed, id, file->getSession());
+    }
+    if (allocated.size() != static_cast<size_t>(needed)) {
+        unreserveClusters(allocated);
+        return false;
+    }
+    vector<int32_t> added(allocated.begin(), allocated.begin() + addedCount);
+    vector<int32_t> newMap(allocated.begin() + addedCount, allocated.end());
+
+    // The data decides which clusters become holes or shared ones, so it is written before the block map
+    int64_t consumed = 0;
+    auto source = [&consumed, data](char* buffer, size_t length) {
+        memcpy(buffer, data + consumed, length);
+        consumed += static_cast<int64_t>(length);
+        return true;
+    };
+    bool written;
+    if (compressed) {
+        written = writeCompressedData(size, source, added, addedCount);
+    } else if (isInlineDedup()) {
+        written = writeDedupData(size, source, added, addedCount);
+    } else {
+        MemoryStreamBuffer buffer(data, static_cast<size_t>(size));
+        istream stream(&buffer);
+        vector<int32_t> holes;
+        written = clusterIo->importClusters(this, stream, added, addedCount, rest == 0 ? static_cast<int>(clusterSize) : rest, holes);
+        unreserveClusters(holes);
+    }
+
+    // Written clusters are still reserved, shared ones already have their reference counts
+    vector<int32_t> fresh(newMap);
+    for (int32_t block : added) {
+        if (block != ID_ITEM_FREE && dataBitmap[block] == BITMAP_RESERVED) {
+            fresh.push_back(block);
+        }
+    }
+    if (!written) {
+        unreserveClusters(fresh);
+        return false;
+    }
+    writeBitmapEntries(fresh, 1);
+
+    node.setFileSize(node.getFileSize() + size);
+    node.setIsCompressed(compressed);
+    blocks.insert(blocks.end(), added.begin(), added.end());
+    blocks.insert(blocks.end(), mapBlocks.begin(), mapBlocks.begin() + static_cast<int64_t>(keptMap));
+    blocks.insert(blocks.end(), newMap.begin(), newMap.end());
+    writeBlockPointers(id, newCount, blocks);
+    writeInodeToVfs(id);
+
+    vector<int32_t> freed(mapBlocks.begin() + static_cast<int64_t>(keptMap), mapBlocks.end());
+    discardClusters(freed);
+    writeBitmapEntries(freed, 0);
+    flushVfs();
+
+    fileWrites[id]++;
+    return true;
+}
+
+vector<int32_t> VirtualFileSystem::claimFollowingClusters(int32_t previous, int count) {
+    vector<int32_t> claimed;
+    for (int32_t block = previous + 1; !groups.empty() && claimed.size() < static_cast<size_t>(count)
+                                       && block < superblock->getDataClusterCount(); block++) {
+        AllocationGroup* group = groups[getGroupOfCluster(block)];
+        if (dataBitmap[block] != 0) {
+            break;
+        }
+        dataBitmap[block] = BITMAP_RESERVED;
+        group->addFreeClusters(-1);
+        claimed.push_back(block);
+    }
+
+    if (claimed.size() < static_cast<size_t>(count)) {
+        unreserveClusters(claimed);
+        return {};
+    }
+    return claimed;
+}
+
+void VirtualFileSystem::writeBitmapEntries(vector<int32_t> clusters, int8_t value) {
+    std::sort(clusters.begin(), clusters.end());
+    for (size_t i = 0; i < clusters.size();) {
+        size_t run = 1;
+        while (i + run < clusters.size() && clusters[i + run] == clusters[i] + static_cast<int32_t>(run)) {
+            run++;
+        }
+        for (size_t j = i; j < i + run; j++) {
+            markCluster(clusters[j], value);
+        }
+        vector<char> entries(run, static_cast<char>(value));
+        seekSet(superblock->getBitmapStartAddress() + clusters[i]);
+        writeToFile(entries.data(), entries.size());
+        i += run;
+    }
+}
+
+void VirtualFileSystem::openVfsFile() {
+    vfsFile = new fstream();
+    vfsFile->rdbuf()->pubsetbuf(nullptr, 0); // Has to be called before open
+    vfsFile->open(name, ios::in | ios::out | ios::binary);
+
+    if (vfsFd >= 0) {
+        ::close(vfsFd);
+    }
+    vfsFd = openDescriptor(name);
+}
+
+void VirtualFileSystem::addDirectory(Directory* dir, int32_t index) {
+    allDirs[index] = dir;
+}
+
+unordered_map<int, Directory*>& VirtualFileSystem::getAllDirectories() {
+    return allDirs;
+}
+
+
+void VirtualFileSystem::loadDirectoryFromVfs(Directory* dir, int id) {
+    int blockCount;
+    char filename[FILENAME_LENGTH];
+    vector<char> cluster(superblock->getClusterSize());
+
+    vector<int32_t> dataBlocks = getDataBlocks(dir->getCurrent()->getInode(), &blockCount, nullptr);
+
+    for (int i = 0; i < blockCount; i++) {
+        readDataClusters(dataBlocks[i], cluster.data(), cluster.size());
+        for (int j = 0; j < clusterIo->getEntriesPerCluster(); j++) {
+            const char* entry = cluster.data() + static_cast<size_t>(j) * DIRECTORY_ENTRY_SIZE;
+            int32_t nodeId;
+            memcpy(&nodeId, entry, sizeof(int32_t));
+            if (nodeId > 0) {
+                memcpy(filename, entry + sizeof(int32_t), sizeof(filename));
+                DirectoryItem* item = createDirectoryItem(nodeId, filename);
+                if (inodes[nodeId].getIsDirectory()) {
+                    dir->addSubdirectory(item);
+                } else {
+                    dir->addFile(item);
+                }
+            }
+        }
+    }
+
+    // Recursively load subdirectories
+    for (auto tempSubdir = dir->getSubdir(); tempSubdir != nullptr; tempSubdir = tempSubdir->getNext()) {
+        auto newDirectory = new Directory();
+        newDirectory->setParent(dir);
+        newDirectory->setCurrent(tempSubdir);
+
+        delete allDirs[tempSubdir->getInode()];
+        allDirs[tempSubdir->getInode()] = newDirectory;
+        loadDirectoryFromVfs(newDirectory, tempSubdir->getInode());
+    }
+}
+
+void VirtualFileSystem::loadVfs() {
+    if (!vfsFile->is_open()) {
+        log(PLEASE_FORMAT_VFS_TEXT);
+        isFormatted = false;
+        return;  // File is not open
+    }
+
+    // Superblock initialization
+    superblock = new Superblock();
+    rewindVfs();
+
+    char signatureBuffer[SIGNATURE_LENGTH + 1];
+    vfsFile->read(signatureBuffer, SIGNATURE_LENGTH);
+    signatureBuffer[SIGNATURE_LENGTH] = '\0';
+    superblock->setSignature(signatureBuffer);
+    readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setDiskSize);
+    readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setClusterSize);
+    readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setClusterCount);
+    readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setInodeCount);
+    readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setBitmapClusterCount);
+    readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setInodeClusterCount);
+    readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setDataClusterCount);
+    readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setBitmapStartAddress);
+    readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setInodeStartAddress);
+    readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setDataStartAddress);
+    readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setFeatures);
+
+    if (superblock->hasFeature(FEATURE_ALLOCATION_GROUPS)) {
+        readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setGroupCount);
+        readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setClustersPerGroup);
+        readAndSet<int32_t>(*vfsFile, *superblock, &Superblock::setInodesPerGroup);
+    }
+
+    if (superblock->hasFeature(FEATURE_64BIT)) {
+        // 64-bit revision, the 32-bit fields above are zero
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setDiskSize);
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setClusterCount);
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setBitmapClusterCount);
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setInodeClusterCount);
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setDataClusterCount);
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setBitmapStartAddress);
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setInodeStartAddress);
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setDataStartAddress);
+    }
+
+    if (superblock->hasFeature(FEATURE_DEDUP)) {
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setDedupClusterCount);
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setDedupStartAddress);
+    }
+
+    if (superblock->hasFeature(FEATURE_CHECKSUMS)) {
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setChecksumClusterCount);
+        readAndSet<int64_t>(*vfsFile, *superblock, &Superblock::setChecksumStartAddress);
+    }
+
+    // Loops for the cluster size of the image are selected once here
+    clusterIo = ClusterIo::forClusterSize(superblock->getClusterSize());
+    if (clusterIo == nullptr) {
+        log(UNSUPPORTED_CLUSTER_SIZE_TEXT + std::to_string(superblock->getClusterSize()));
+        delete superblock;
+        superblock = nullptr;
+        isFormatted = false;
+        return;
+    }
+
+    if (!superblock->hasFeature(FEATURE_ALLOCATION_GROUPS)) {
+        // Images without groups behave as one group spanning the whole disk
+        superblock->setGroupCount(1);
+        superblock->setClustersPerGroup(static_cast<int32_t>(superblock->getDataClusterCount()));
+        superblock->setInodesPerGroup(superblock->getInodeCount());
+    }
+
+    checksums.reset(vfsFd, superblock->hasFeature(FEATURE_CHECKSUMS) ? superblock->getChecksumStartAddress() : 0,
+                    superblock->getClusterSize());
+
+    dataBitmap = new int8_t[superblock->getClusterCount()];
+    readVerified(superblock->getBitmapStartAddress(), reinterpret_cast<char*>(dataBitmap),
+                 sizeof(int8_t) * superblock->getDataClusterCount());
+
+    inodes = new Inode[superblock->getInodeCount()];
+    readInodeTable();
+
+    initAllocationGroups();
+    loadPackedTails();
+    dedupIndex.reset();
+
+    auto* rootItem = new DirectoryItem(0, "/");
+    auto* rootDirectory = new Directory();
+    rootDirectory->setCurrent(rootItem);
+    rootDirectory->setParent(rootDirectory); // rootDirectory refers to itself as parent
+
+    allDirs[0] = rootDirectory;
+
+    // Load directory from vfs
+    loadDirectoryFromVfs(rootDirectory, 0);
+
+    // Sessions opened before the load stand in the root directory
+    moveSessions(nullptr, rootDirectory);
+}
+
+void VirtualFileSystem::reloadVfs() {
+    syncChecksums();
+    cleanup();
+    loadVfs();
+    isFormatted = superblock != nullptr;
+}
+
+string VirtualFileSystem::getCurrentPath(const Session* session) {
+    Directory* temp_dir = session->getCurrentDir();
+    string result;
+
+    if (temp_dir == nullptr) {
+        return "/";
+    }
+
+    while (temp_dir->getCurrent()->getInode() != 0) {
+        result = "/" + string(temp_dir->getCurrent()->getItemName()) + result;
+        temp_dir = temp_dir->getParent();
+    }
+
+    if (result.empty()) {
+        result = "/";
+    }
+
+    return result;
+}
+
+void VirtualFileSystem::freeInode(int id) {
+    if (id < 0 || id >= superblock->getInodeCount()) {
+        throw runtime_error("Invalid inode id.");
+    }
+
+    if (!groups.empty() && inodes[id].getNodeId() != ID_ITEM_FREE) {
+        AllocationGroup* group = groups[getGroupOfInode(id)];
+        group->addFreeInodes(1);
+    }
+    forgetReadaheadState(id);
+
+    inodes[id].setNodeId(ID_ITEM_FREE);
+    inodes[id].setIsDirectory(false);
+    inodes[id].setReferences(1);
+    inodes[id].setFileSize(0);
+    inodes[id].setDirect(0, ID_ITEM_FREE);
+    inodes[id].setDirect(1, ID_ITEM_FREE);
+    inodes[id].setDirect(2, ID_ITEM_FREE);
+    inodes[id].setDirect(3, ID_ITEM_FREE);
+    inodes[id].setDirect(4, ID_ITEM_FREE);
+    inodes[id].setIndirect(0, ID_ITEM_FREE);
+    inodes[id].setIndirect(1, ID_ITEM_FREE);
+    inodes[id].setDoubleIndirect(ID_ITEM_FREE);
+    inodes[id].setTripleIndirect(ID_ITEM_FREE);
+    inodes[id].setIsInline(false);
+    inodes[id].setInlineData(string());
+    inodes[id].setTailCluster(ID_ITEM_FREE);
+    inodes[id].setTailOffset(0);
+    inodes[id].setIsCompressed(false);
+
+}
+
+Directory* VirtualFileSystem::findDirectory(const string& path, const Session* session) {
+    Directory* dir = (!path.empty() && path[0] == '/') ? getDirectory(0) : session->getCurrentDir();
+
+    if (dir == nullptr) {
+        return nullptr;
+    }
+
+    size_t start = 0;
+    size_t end = path.find(PATH_DELIMETER);
+
+    while (start != string::npos) {
+        string part = (end == string::npos) ? path.substr(start) : path.substr(start, end - start);
+
+        if (part.empty() || part == ".") {
+            // Skip empty parts and current directory
+        } else if (part == "..") {
+            // Drop to parent directory
+            dir = dir->getParent();
+        } else {
+            // Search for subdirectory or file
+            bool found = false;
+            DirectoryItem* item = dir->getSubdir();
+
+            while (item != nullptr) {
+                Directory* subdir = getDirectory(item->getInode());
+                if (subdir && subdir->getCurrent()->getItemName() == part) {
+                    dir = subdir;
+                    found = true;
+                    break;
+                }
+                item = item->getNext();
+            }
+
+            if (!found) {
+                return nullptr;  // Subdirectory or file not found
+            }
+        }
+
+        start = (end == string::npos) ? string::npos : end + 1;
+        end = path.find(PATH_DELIMETER, start);
+    }
+
+    return dir;
+}
+
+Superblock * VirtualFileSystem::getSuperblock() const {
+    return superblock;
+}
+
+void VirtualFileSystem::setSuperblock(Superblock* newSuperblock) {
+    superblock = newSuperblock;
+}
+
+Inode* VirtualFileSystem::getInodes() const {
+    return inodes;
+}
+
+
+void VirtualFileSystem::setInodes(Inode* newInodes) {
+    inodes = newInodes;
+}
+
+int8_t* VirtualFileSystem::getDataBitmap() const {
+    return dataBitmap;
+}
+
+void VirtualFileSystem::setDataBitmap(int8_t* newDataBitmap) {
+    dataBitmap = newDataBitmap;
+}
+
+bool VirtualFileSystem::getIsFormatted() const {
+    return isFormatted;
+}
+
+void VirtualFileSystem::setIsFormatted(bool newIsFormatted) {
+    isFormatted = newIsFormatted;
+}
+
+string VirtualFileSystem::getName() const {
+    return name;
+}
+
+void VirtualFileSystem::setName(const string& newName) {
+    name = newName;
+}
+
+fstream* VirtualFileSystem::getVfsFile() const {
+    return vfsFile;
+}
+
+void VirtualFileSystem::setVfsFile(fstream* newVfsFile) {
+    vfsFile = newVfsFile;
+}
+
+vector<int32_t> VirtualFileSystem::findFreeDataBlocks(int count, int32_t goalInode) {
+    vector<int32_t> blocks;
+    blocks.reserve(count);
+
+    size_t firstGroup = getGroupOfInode(goalInode);
+    for (size_t n = 0; n < groups.size(); n++) {
+        AllocationGroup* group = groups[(firstGroup + n) % groups.size()];
+        if (group->getFreeClusters() == 0) {
+            continue; // Full groups are skipped without scanning their bitmap
+        }
+
+        int32_t end = group->getFirstCluster() + group->getClusterCount();
+        for (int32_t i = std::max(1, group->getFirstCluster()); i < end; ++i) {
+            if (dataBitmap[i] == 0) {
+                blocks.push_back(i);
+                if (blocks.size() == static_cast<size_t>(count)) {
+                    return blocks;
+                }
+            }
+        }
+    }
+
+    return {};
+}
+
+int32_t VirtualFileSystem::initializeInode(int32_t inodeId, int64_t size, int blockCount, vector<int32_t>& blocks) {
+    Inode& node = inodes[inodeId];
+
+    claimInode(inodeId);
+    node.setIsDirectory(false);
+    node.setReferences(1);
+    node.setFileSize(size);
+    node.setIsInline(false);
+    node.setInlineData(string());
+    node.setTailCluster(ID_ITEM_FREE);
+    node.setTailOffset(0);
+    node.setIsCompressed(false);
+
+    writeBlockPointers(inodeId, blockCount, blocks);
+
+    return blockCount > 0 ? blockCount - 1 : 0;
+}
+
+void VirtualFileSystem::writeBlockPointers(int32_t inodeId, int blockCount, const vector<int32_t>& blocks) {
+    Inode& node = inodes[inodeId];
+
+    for (int i = 0; i < 5; i++) {
+        node.setDirect(i, i < blockCount ? blocks[i] : ID_ITEM_FREE);
+    }
+
+    // Work with indirect blocks, they follow the data blocks in the vector
+    int nextDataBlock = std::min(blockCount, 5);
+    int nextMapBlock = blockCount;
+    for (int i = 0; i < 2; i++) {
+        node.setIndirect(i, nextDataBlock < blockCount ? clusterIo->writeBlockMap(this, 1, blocks, nextDataBlock, blockCount, nextMapBlock) : ID_ITEM_FREE);
+    }
+    node.setDoubleIndirect(nextDataBlock < blockCount ? clusterIo->writeBlockMap(this, 2, blocks, nextDataBlock, blockCount, nextMapBlock) : ID_ITEM_FREE);
+    node.setTripleIndirect(nextDataBlock < blockCount ? clusterIo->writeBlockMap(this, 3, blocks, nextDataBlock, blockCount, nextMapBlock) : ID_ITEM_FREE);
+}
+
+bool VirtualFileSystem::canStoreInline(int64_t size) const {
+    return superblock->hasFeature(FEATURE_INLINE_DATA) && size <= INLINE_DATA_SIZE;
+}
+
+bool VirtualFileSystem::canPackTail(int64_t size) const {
+    // Above half of a cluster packing saves less than it costs
+    return superblock->hasFeature(FEATURE_TAIL_PACKING) && size > 0 && size <= superblock->getClusterSize() / 2;
+}
+
+bool VirtualFileSystem::isSmallFile(int64_t size) const {
+    return canStoreInline(size) || canPackTail(size);
+}
+
+bool VirtualFileSystem::storeSmallFile(int32_t inodeId, const string& data, Session* session) {
+    auto length = static_cast<int32_t>(data.size());
+    if (canStoreInline(length)) {
+        initializeSmallInode(inodeId, length);
+        inodes[inodeId].setIsInline(true);
+        inodes[inodeId].setInlineData(data);
+        return true;
+    }
+
+    int32_t cluster = tailPacker.findCluster(length);
+    if (cluster == ID_ITEM_FREE) {
+        vector<int32_t> blocks = allocateDataBlocks(1, inodeId, session);
+        if (blocks.empty()) {
+            return false;
+        }
+        cluster = blocks[0];
+        updateIndirectBlocksInBitmap(cluster, 1); // Pack clusters are owned by no file, like blocks of the block map
+    }
+
+    int32_t offset = tailPacker.append(cluster, inodeId, length);
+    seekSet(getPackedTailAddress(cluster, offset));
+    writeToFile(data.data(), data.size());
+    flushVfs();
+
+    initializeSmallInode(inodeId, length);
+    inodes[inodeId].setTailCluster(cluster);
+    inodes[inodeId].setTailOffset(offset);
+    return true;
+}
+
+bool VirtualFileSystem::readSmallFile(int32_t inodeId, string& data) const {
+    const Inode& node = inodes[inodeId];
+    if (node.getIsInline()) {
+        data = node.getInlineData();
+        return true;
+    }
+    if (node.getTailCluster() == ID_ITEM_FREE) {
+        return false;
+    }
+
+    data.assign(static_cast<size_t>(node.getFileSize()), '\0');
+    if (readVerified(getPackedTailAddress(node.getTailCluster(), node.getTailOffset()), &data[0], data.size()) < 0) {
+        data.clear();   // The mismatch is reported, a damaged tail reads as empty in the strict mode
+    }
+    return true;
+}
+
+void VirtualFileSystem::initializeSmallInode(int32_t inodeId, int32_t size) {
+    Inode& node = inodes[inodeId];
+
+    claimInode(inodeId);
+    node.setIsDirectory(false);
+    node.setReferences(1);
+    node.setFileSize(size);
+    for (int i = 0; i < 5; i++) {
+        node.setDirect(i, ID_ITEM_FREE);
+    }
+    node.setIndirect(0, ID_ITEM_FREE);
+    node.setIndirect(1, ID_ITEM_FREE);
+    node.setDoubleIndirect(ID_ITEM_FREE);
+    node.setTripleIndirect(ID_ITEM_FREE);
+    node.setIsInline(false);
+    node.setInlineData(string());
+    node.setTailCluster(ID_ITEM_FREE);
+    node.setTailOffset(0);
+    node.setIsCompressed(false);
+}
+
+void VirtualFileSystem::releasePackedTail(int32_t inodeId) {
+    Inode& node = inodes[inodeId];
+    int32_t cluster = node.getTailCluster();
+    auto length = static_cast<int32_t>(node.getFileSize());
+    int32_t end = tailPacker.getUsed(cluster);
+
+    // Compaction, the tails behind the removed one slide down and the freed run at the end is zeroed
+    vector<PackedTail> moved = tailPacker.remove(cluster, inodeId);
+    int32_t movedBytes = end - node.getTailOffset() - length;
+    vector<char> buffer(static_cast<size_t>(movedBytes + length), 0);
+    if (movedBytes > 0) {
+        readAt(getPackedTailAddress(cluster, node.getTailOffset() + length), buffer.data(), static_cast<size_t>(movedBytes));
+    }
+    seekSet(getPackedTailAddress(cluster, node.getTailOffset()));
+    writeToFile(buffer.data(), buffer.size());
+
+    for (const PackedTail& tail : moved) {
+        inodes[tail.inodeId].setTailOffset(tail.offset);
+        writeInodeToVfs(tail.inodeId);
+    }
+
+    if (tailPacker.getUsed(cluster) == 0) {
+        updateIndirectBlocksInBitmap(cluster, 0);
+    }
+    flushVfs();
+
+    node.setTailCluster(ID_ITEM_FREE);
+    node.setTailOffset(0);
+}
+
+void VirtualFileSystem::loadPackedTails() {
+    tailPacker.reset(superblock->getClusterSize());
+    for (int32_t i = 0; i < superblock->getInodeCount(); i++) {
+        if (inodes[i].getNodeId() != ID_ITEM_FREE && inodes[i].getTailCluster() != ID_ITEM_FREE) {
+            tailPacker.add(inodes[i].getTailCluster(),
+                           PackedTail{i, inodes[i].getTailOffset(), static_cast<int32_t>(inodes[i].getFileSize())});
+        }
+    }
+}
+
+int64_t VirtualFileSystem::getPackedTailAddress(int32_t cluster, int32_t offset) const {
+    return superblock->getDataStartAddress() + static_cast<int64_t>(cluster) * superblock->getClusterSize() + offset;
+}
+
+bool VirtualFileSystem::shouldCompress(bool requested) const {
+    // The layout byte marking compressed files only exists in the inline data revision
+    return superblock->hasFeature(FEATURE_INLINE_DATA) && (requested || superblock->hasFeature(FEATURE_COMPRESSION));
+}
+
+int32_t VirtualFileSystem::getCompressionUnitClusters() const {
+    // Older images have units of a single cluster with clusters of 64K and more, which can never be compressed
+    int32_t minimum = superblock->hasFeature(FEATURE_WIDE_UNITS) ? COMPRESSION_MIN_CLUSTERS : 1;
+    return std::max(COMPRESSION_UNIT_BYTES / superblock->getClusterSize(), minimum);
+}
+
+int VirtualFileSystem::getCompressionUnitCount(int64_t size) const {
+    int64_t unitBytes = static_cast<int64_t>(getCompressionUnitClusters()) * superblock->getClusterSize();
+    return static_cast<int>((size + unitBytes - 1) / unitBytes);
+}
+
+bool VirtualFileSystem::writeCompressedData(int64_t size, const function<bool(char*, size_t)>& source,
+                                            vector<int32_t>& blocks, int blockCount) {
+    int32_t clusterSize = superblock->getClusterSize();
+    int32_t unitClusters = getCompressionUnitClusters();
+    size_t unitBytes = static_cast<size_t>(unitClusters) * clusterSize;
+    int unitCount = getCompressionUnitCount(size);
+    int batchUnits = std::max(static_cast<int>(COMPRESSION_BATCH_BYTES / unitBytes), 1);
+
+    ThreadPool pool(std::max(1U, thread::hardware_concurrency()));
+    vector<char> raw(static_cast<size_t>(batchUnits) * unitBytes);
+    vector<char> packed(static_cast<size_t>(batchUnits) * unitBytes);
+    vector<int> packedLengths(static_cast<size_t>(batchUnits));
+    vector<char> zeroUnits(static_cast<size_t>(batchUnits));
+    vector<int32_t> holes;
+    bool sparse = allowsHoles();
+
+    for (int firstUnit = 0; firstUnit < unitCount; firstUnit += batchUnits) {
+        int count = std::min(batchUnits, unitCount - firstUnit);
+
+        // Reading is sequential, compressing the units of the batch is not
+        for (int u = 0; u < count; u++) {
+            int64_t rawLength = std::min<int64_t>(unitBytes, size - (firstUnit + u) * static_cast<int64_t>(unitBytes));
+            char* unit = raw.data() + u * unitBytes;
+            if (!source(unit, static_cast<size_t>(rawLength))) {
+                unreserveClusters(holes);
+                return false;
+            }
+            memset(unit + rawLength, 0, unitBytes - rawLength);
+            zeroUnits[u] = sparse && ZeroScanner::isZero(unit, unitBytes);
+            if (zeroUnits[u]) {
+                continue;
+            }
+
+            // Compression has to save at least one cluster, the unit starts with the compressed length
+            int usedClusters = clusterIo->getBlockCount(rawLength, nullptr);
+            int capacity = (usedClusters - 1) * clusterSize - static_cast<int>(sizeof(int32_t));
+            char* target = packed.data() + u * unitBytes;
+            pool.submit([unit, rawLength, target, capacity, &packedLengths, u]() {
+                packedLengths[u] = LzCodec::compress(unit, static_cast<int>(rawLength), target + sizeof(int32_t), capacity);
+            });
+        }
+        pool.wait();
+
+        for (int u = 0; u < count; u++) {
+            int first = (firstUnit + u) * unitClusters;
+            int usedClusters = std::min(unitClusters, blockCount - first);
+            const char* data = raw.data() + u * unitBytes;
+
+            // A unit of zeros has no stored cluster at all
+            if (zeroUnits[u]) {
+                for (int i = 0; i < usedClusters; i++) {
+                    holes.push_back(blocks[first + i]);
+                    blocks[first + i] = ID_ITEM_FREE;
+                }
+                continue;
+            }
+
+            if (packedLengths[u] >= 0) {
+                char* target = packed.data() + u * unitBytes;
+                auto packedLength = static_cast<int32_t>(packedLengths[u]);
+                memcpy(target, &packedLength, sizeof(int32_t));
+                int packedClusters = clusterIo->getBlockCount(sizeof(int32_t) + packedLength, nullptr);
+                memset(target + sizeof(int32_t) + packedLength, 0,
+                       static_cast<size_t>(packedClusters) * clusterSize - sizeof(int32_t) - packedLength);
+
+                // Clusters the unit does not need become holes
+                for (int i = packedClusters; i < usedClusters; i++) {
+                    holes.push_back(blocks[first + i]);
+                    blocks[first + i] = ID_ITEM_FREE;
+                }
+                usedClusters = packedClusters;
+                data = target;
+            }
+            writeClusterRuns(blocks, first, usedClusters, data);
+        }
+    }
+
+    unreserveClusters(holes);
+    return true;
+}
+
+int64_t VirtualFileSystem::readCompressedUnit(const vector<int32_t>& blocks, int unit, int64_t size, char* buffer) const {
+    int32_t clusterSize = superblock->getClusterSize();
+    int32_t unitClusters = getCompressionUnitClusters();
+    int64_t unitBytes = static_cast<int64_t>(unitClusters) * clusterSize;
+    int64_t rawLength = std::min(unitBytes, size - unit * unitBytes);
+    int expectedClusters = clusterIo->getBlockCount(rawLength, nullptr);
+    int first = unit * unitClusters;
+
+    // Stored clusters of the unit are followed by holes if the unit is compressed
+    int storedClusters = 0;
+    while (storedClusters < expectedClusters && blocks[first + storedClusters] != ID_ITEM_FREE) {
+        storedClusters++;
+    }
+    if (storedClusters == 0) {
+        memset(buffer, 0, static_cast<size_t>(rawLength));     // Unit of zeros
+        return rawLength;
+    }
+
+    vector<char> stored(static_cast<size_t>(storedClusters) * clusterSize);
+    for (int i = 0; i < storedClusters;) {
+        int run = 1;
+        while (i + run < storedClusters && blocks[first + i + run] == blocks[first + i] + run) {
+            run++;
+        }
+        size_t runBytes = static_cast<size_t>(run) * clusterSize;
+        if (readDataClusters(blocks[first + i], stored.data() + static_cast<size_t>(i) * clusterSize, runBytes)
+            != static_cast<streamsize>(runBytes)) {
+            return -1;
+        }
+        i += run;
+    }
+
+    if (storedClusters == expectedClusters) {
+        memcpy(buffer, stored.data(), static_cast<size_t>(rawLength));
+        return rawLength;
+    }
+
+    int32_t packedLength;
+    memcpy(&packedLength, stored.data(), sizeof(int32_t));
+    if (packedLength < 0 || packedLength > static_cast<int64_t>(stored.size() - sizeof(int32_t))
+        || !LzCodec::decompress(stored.data() + sizeof(int32_t), packedLength, buffer, static_cast<int>(rawLength))) {
+        return -1;
+    }
+    return rawLength;
+}
+
+bool VirtualFileSystem::readCompressedFile(const vector<int32_t>& blocks, int64_t size,
+                                           const function<bool(const char*, size_t)>& sink) const {
+    vector<char> buffer(static_cast<size_t>(getCompressionUnitClusters()) * superblock->getClusterSize());
+    int unitCount = getCompressionUnitCount(size);
+    for (int unit = 0; unit < unitCount; unit++) {
+        int64_t length = readCompressedUnit(blocks, unit, size, buffer.data());
+        if (length < 0 || !sink(buffer.data(), static_cast<size_t>(length))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VirtualFileSystem::copyCompressedData(const vector<int32_t>& source, vector<int32_t>& target, int blockCount) {
+    vector<char> buffer(superblock->getClusterSize());
+    vector<int32_t> holes;
+
+    for (int i = 0; i < blockCount; i++) {
+        if (source[i] == ID_ITEM_FREE) {
+            holes.push_back(target[i]);
+            target[i] = ID_ITEM_FREE;
+            continue;
+        }
+        if (readDataClusters(source[i], buffer.data(), buffer.size()) != static_cast<streamsize>(buffer.size())) {
+            unreserveClusters(holes);
+            return false;
+        }
+        writeClusterRuns(target, i, 1, buffer.data());
+    }
+
+    unreserveClusters(holes);
+    return true;
+}
+
+void VirtualFileSystem::writeClusterRuns(const vector<int32_t>& blocks, int first, int count, const char* data) {
+    int32_t clusterSize = superblock->getClusterSize();
+    for (int i = 0; i < count;) {
+        int run = 1;
+        while (i + run < count && blocks[first + i + run] == blocks[first + i] + run) {
+            run++;
+        }
+        seekDataCluster(blocks[first + i]);
+        writeToFile(data + static_cast<size_t>(i) * clusterSize, static_cast<size_t>(run) * clusterSize);
+        i += run;
+    }
+}
+
+bool VirtualFileSystem::isInlineDedup() const {
+    return superblock->hasFeature(FEATURE_INLINE_DEDUP);
+}
+
+bool VirtualFileSystem::allowsHoles() const {
+    return superblock->hasFeature(FEATURE_SPARSE_FILES);
+}
+
+void VirtualFileSystem::loadDedupIndex() {
+    if (dedupIndex.isLoaded()) {
+        return;
+    }
+
+    // Slots of free clusters may be left over from clusters freed by older versions, they are ignored
+    int64_t dataClusterCount = superblock->getDataClusterCount();
+    int64_t slotsPerRead = TABLE_IO_BYTES / DEDUP_SLOT_SIZE;
+    vector<Hash128> slots(static_cast<size_t>(slotsPerRead));
+    for (int64_t first = 0; first < dataClusterCount; first += slotsPerRead) {
+        int64_t count = std::min(slotsPerRead, dataClusterCount - first);
+        size_t bytes = static_cast<size_t>(count) * DEDUP_SLOT_SIZE;
+        if (readAt(superblock->getDedupStartAddress() + first * DEDUP_SLOT_SIZE, reinterpret_cast<char*>(slots.data()), bytes)
+            != static_cast<streamsize>(bytes)) {
+            break;
+        }
+        for (int64_t i = 0; i < count; i++) {
+            if (!slots[i].isEmpty() && dataBitmap[first + i] > 0) {
+                dedupIndex.add(static_cast<int32_t>(first + i), slots[i]);
+            }
+        }
+    }
+    dedupIndex.setLoaded();
+}
+
+void VirtualFileSystem::writeDedupSlots(vector<pair<int32_t, Hash128>>& slots) {
+    std::sort(slots.begin(), slots.end(),
+              [](const pair<int32_t, Hash128>& a, const pair<int32_t, Hash128>& b) { return a.first < b.first; });
+
+    // Slots of consecutive clusters are written at once
+    vector<Hash128> run;
+    for (size_t i = 0; i < slots.size(); i++) {
+        run.push_back(slots[i].second);
+        if (i + 1 < slots.size() && slots[i + 1].first == slots[i].first + 1) {
+            continue;
+        }
+        int32_t first = slots[i].first - static_cast<int32_t>(run.size()) + 1;
+        seekSet(superblock->getDedupStartAddress() + static_cast<int64_t>(first) * DEDUP_SLOT_SIZE);
+        writeToFile(reinterpret_cast<const char*>(run.data()), run.size() * DEDUP_SLOT_SIZE);
+        run.clear();
+    }
+}
+
+void VirtualFileSystem::moveDedupSlots(const vector<pair<int32_t, int32_t>>& moves) {
+    vector<pair<int32_t, Hash128>> slots;
+    for (const pair<int32_t, int32_t>& move : moves) {
+        Hash128 hash{0, 0};
+        if (readAt(superblock->getDedupStartAddress() + static_cast<int64_t>(move.first) * DEDUP_SLOT_SIZE,
+                   reinterpret_cast<char*>(&hash), sizeof(hash)) != static_cast<streamsize>(sizeof(hash))) {
+            hash = Hash128{0, 0};
+        }
+        slots.emplace_back(move.first, Hash128{0, 0});
+        slots.emplace_back(move.second, hash);
+
+        if (dedupIndex.isLoaded()) {
+            dedupIndex.remove(move.first);
+            if (!hash.isEmpty()) {
+                dedupIndex.add(move.second, hash);
+            }
+        }
+    }
+    writeDedupSlots(slots);
+}
+
+void VirtualFileSystem::setClusterReferences(int32_t cluster, int8_t count) {
+    markCluster(cluster, count);
+    seekSet(superblock->getBitmapStartAddress() + cluster);
+    writeToFile(&count, 1);
+}
+
+vector<int32_t> VirtualFileSystem::releaseDataBlocks(const vector<int32_t>& blocks) {
+    vector<int32_t> freed;
+    vector<pair<int32_t, Hash128>> clearedSlots;
+
+    for (int32_t block : blocks) {
+        if (block == ID_ITEM_FREE) {
+            continue;
+        }
+        if (dataBitmap[block] > 1) {
+            setClusterReferences(block, static_cast<int8_t>(dataBitmap[block] - 1));
+            continue;
+        }
+        freed.push_back(block);
+        if (superblock->hasFeature(FEATURE_DEDUP)) {
+            dedupIndex.remove(block);
+            clearedSlots.emplace_back(block, Hash128{0, 0});
+        }
+    }
+
+    writeDedupSlots(clearedSlots);
+    return freed;
+}
+
+bool VirtualFileSystem::hasSameContent(int32_t first, int32_t second) const {
+    size_t clusterSize = superblock->getClusterSize();
+    vector<char> a(clusterSize), b(clusterSize);
+    return readDataClusters(first, a.data(), clusterSize) == static_cast<streamsize>(clusterSize)
+           && readDataClusters(second, b.data(), clusterSize) == static_cast<streamsize>(clusterSize)
+           && memcmp(a.data(), b.data(), clusterSize) == 0;
+}
+
+bool VirtualFileSystem::writeDedupData(int64_t size, const function<bool(char*, size_t)>& source,
+                                       vector<int32_t>& blocks, int blockCount) {
+    size_t clusterSize = superblock->getClusterSize();
+    int batchClusters = std::max(static_cast<int>(DEDUP_BATCH_BYTES / clusterSize), 1);
+
+    loadDedupIndex();
+    ThreadPool pool(std::max(1U, thread::hardware_concurrency()));
+    vector<char> data(static_cast<size_t>(batchClusters) * clusterSize);
+    vector<Hash128> hashes(static_cast<size_t>(batchClusters));
+    vector<char> zeroClusters(static_cast<size_t>(batchClusters));
+    vector<char> candidate(clusterSize);
+    vector<int32_t> unused;
+    vector<pair<int32_t, Hash128>> slots;
+    bool success = true;
+
+    for (int first = 0; first < blockCount && success; first += batchClusters) {
+        int count = std::min(batchClusters, blockCount - first);
+        int64_t bytes = std::min<int64_t>(static_cast<int64_t>(count) * clusterSize, size - first * static_cast<int64_t>(clusterSize));
+        if (!source(data.data(), static_cast<size_t>(bytes))) {
+            success = false;
+            break;
+        }
+        memset(data.data() + bytes, 0, count * clusterSize - bytes);
+
+        // Hashing is parallel, the index is used in order so duplicates inside the batch are found too
+        for (int u = 0; u < count; u++) {
+            const char* cluster = data.data() + u * clusterSize;
+            pool.submit([this, cluster, clusterSize, &hashes, &zeroClusters, u]() {
+                zeroClusters[u] = allowsHoles() && ZeroScanner::isZero(cluster, clusterSize);
+                if (!zeroClusters[u]) {
+                    hashes[u] = ClusterHash::compute(cluster, clusterSize);
+                }
+            });
+        }
+        pool.wait();
+
+        for (int u = 0; u < count; u++) {
+            const char* cluster = data.data() + u * clusterSize;
+            if (zeroClusters[u]) {
+                unused.push_back(blocks[first + u]);
+                blocks[first + u] = ID_ITEM_FREE;
+                continue;       // Zero clusters become holes instead of sharing one cluster of zeros
+            }
+            int32_t match = dedupIndex.find(hashes[u]);
+            if (match != ID_ITEM_FREE && dataBitmap[match] > 0 && dataBitmap[match] < DEDUP_MAX_REFERENCES) {
+                // The match may have been written by this batch and still be buffered
+                flushVfs();
+                if (readDataClusters(match, candidate.data(), clusterSize) == static_cast<streamsize>(clusterSize)
+                    && memcmp(candidate.data(), cluster, clusterSize) == 0) {
+                    unused.push_back(blocks[first + u]);
+                    blocks[first + u] = match;
+                    setClusterReferences(match, static_cast<int8_t>(dataBitmap[match] + 1));
+                    continue;
+                }
+            }
+
+            int32_t block = blocks[first + u];
+            seekDataCluster(block);
+            writeToFile(cluster, clusterSize);
+            setClusterReferences(block, 1);
+            dedupIndex.add(block, hashes[u]);
+            slots.emplace_back(block, hashes[u]);
+        }
+        flushVfs();
+    }
+
+    writeDedupSlots(slots);
+    unreserveClusters(unused);
+    return success;
+}
+
+DedupReport VirtualFileSystem::deduplicate(size_t threadCount) {
+    auto start = std::chrono::steady_clock::now();
+    DedupReport report{0, 0, 0, 0, 0};
+    size_t clusterSize = superblock->getClusterSize();
+
+    // Distinct data clusters of all files, hard links share the i-node and count once
+    vector<int32_t> files;
+    vector<int32_t> clusters;
+    vector<bool> seen(static_cast<size_t>(superblock->getDataClusterCount()), false);
+    for (int32_t id = 0; id < superblock->getInodeCount(); id++) {
+        const Inode& node = inodes[id];
+        if (node.getReferences() <= 0 || node.getIsDirectory() || node.getIsInline()
+            || node.getTailCluster() != ID_ITEM_FREE || node.getFileSize() == 0) {
+            continue;
+        }
+        int blockCount;
+        vector<int32_t> blocks = getDataBlocks(id, &blockCount, nullptr);
+        for (int i = 0; i < blockCount; i++) {
+            if (blocks[i] != ID_ITEM_FREE && !seen[blocks[i]]) {
+                seen[blocks[i]] = true;
+                clusters.push_back(blocks[i]);
+            }
+        }
+        files.push_back(id);
+    }
+    report.hashedClusters = static_cast<int64_t>(clusters.size());
+
+    // Reading and hashing is split into chunks of clusters
+    flushVfs();
+    vector<Hash128> hashes(clusters.size());
+    {
+        ThreadPool pool(std::max<size_t>(threadCount, 1));
+        size_t chunk = std::max<size_t>(DEDUP_BATCH_BYTES / clusterSize, 1);
+        for (size_t first = 0; first < clusters.size(); first += chunk) {
+            size_t end = std::min(first + chunk, clusters.size());
+            pool.submit([this, &clusters, &hashes, first, end, clusterSize]() {
+                vector<char> buffer(clusterSize);
+                for (size_t i = first; i < end; i++) {
+                    readDataClusters(clusters[i], buffer.data(), clusterSize);
+                    hashes[i] = ClusterHash::compute(buffer.data(), clusterSize);
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    // The first cluster of every content stays, equal clusters are mapped onto it
+    unordered_map<Hash128, int32_t, Hash128Hasher> kept;
+    unordered_map<int32_t, int32_t> replaced;
+    vector<pair<int32_t, Hash128>> slots;
+    for (size_t i = 0; i < clusters.size(); i++) {
+        int32_t cluster = clusters[i];
+        auto found = kept.find(hashes[i]);
+        if (found != kept.end() && dataBitmap[found->second] + dataBitmap[cluster] <= DEDUP_MAX_REFERENCES
+            && hasSameContent(found->second, cluster)) {
+            setClusterReferences(found->second, static_cast<int8_t>(dataBitmap[found->second] + dataBitmap[cluster]));
+            replaced[cluster] = found->second;
+            slots.emplace_back(cluster, Hash128{0, 0});
+            continue;
+        }
+        if (found == kept.end() || dataBitmap[found->second] >= DEDUP_MAX_REFERENCES) {
+            kept[hashes[i]] = cluster;
+        }
+        slots.emplace_back(cluster, hashes[i]);
+    }
+
+    // Block pointers are rewritten in place, the map blocks of a file do not change
+    for (int32_t id : files) {
+        int blockCount;
+        vector<int32_t> blocks = getDataBlocks(id, &blockCount, nullptr);
+        blocks.resize(blockCount);
+        bool changed = false;
+        for (int32_t& block : blocks) {
+            auto found = block != ID_ITEM_FREE ? replaced.find(block) : replaced.end();
+            if (found != replaced.end()) {
+                block = found->second;
+                changed = true;
+            }
+        }
+        if (changed) {
+            vector<int32_t> mapBlocks = getMapBlocks(id);
+            blocks.insert(blocks.end(), mapBlocks.begin(), mapBlocks.end());
+            writeBlockPointers(id, blockCount, blocks);
+            writeInodeToVfs(id);
+            report.changedFiles++;
+        }
+    }
+
+    // Replaced clusters are discarded and freed
+    vector<int32_t> discarded;
+    for (const auto& entry : replaced) {
+        discarded.push_back(entry.first);
+    }
+    discardClusters(discarded);
+    for (int32_t cluster : discarded) {
+        setClusterReferences(cluster, 0);
+    }
+    writeDedupSlots(slots);
+    flushVfs();
 
-void VirtualFileSystem::setInodes(Inode* newInodes) {
-    inodes = newInodes;
-}
+    // The index is rebuilt from the table of cluster hashes on next use
+    dedupIndex.reset();
 
-int8_t* VirtualFileSystem::getDataBitmap() const {
-    return dataBitmap;
+    report.sharedClusters = static_cast<int64_t>(replaced.size());
+    report.reclaimedBytes = report.sharedClusters * static_cast<int64_t>(clusterSize);
+    report.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
 }
 
-void VirtualFileSystem::setDataBitmap(int8_t* newDataBitmap) {
-    dataBitmap = newDataBitmap;
+vector<int32_t> VirtualFileSystem::allocateDataBlocks(int count, int32_t goalInode, Session* session) {
+    vector<int32_t> blocks = session->getReservation()->take(count, goalInode);
+    if (blocks.empty()) {
+        // The free space may be held by reservations of other sessions
+        releaseAllReservations();
+        blocks = findFreeDataBlocks(count, goalInode);
+    }
+    return blocks;
 }
 
-bool VirtualFileSystem::getIsFormatted() const {
-    return isFormatted;
-}
+vector<int32_t> VirtualFileSystem::reserveClusters(int count, int32_t goalInode) {
+    vector<int32_t> reserved;
+    size_t firstGroup = getGroupOfInode(goalInode);
 
-void VirtualFileSystem::setIsFormatted(bool newIsFormatted) {
-    isFormatted = newIsFormatted;
-}
+    for (size_t n = 0; n < groups.size() && reserved.size() < static_cast<size_t>(count); n++) {
+        AllocationGroup* group = groups[(firstGroup + n) % groups.size()];
+        if (group->getFreeClusters() == 0) {
+            continue;
+        }
 
-Directory* VirtualFileSystem::getCurrentDir() const {
-    return currentDir;
-}
+        // First run long enough wins, otherwise the longest run of the group is taken
+        int32_t wanted = count - static_cast<int32_t>(reserved.size());
+        int32_t bestStart = 0, bestLength = 0, runStart = -1;
+        int32_t end = group->getFirstCluster() + group->getClusterCount();
+        for (int32_t i = std::max(1, group->getFirstCluster()); i <= end; ++i) {
+            if (i < end && dataBitmap[i] == 0) {
+                if (runStart < 0) runStart = i;
+                if (i - runStart + 1 == wanted) {
+                    bestStart = runStart;
+                    bestLength = wanted;
+                    break;
+                }
+            } else if (runStart >= 0) {
+                if (i - runStart > bestLength) {
+                    bestStart = runStart;
+                    bestLength = i - runStart;
+                }
+                runStart = -1;
+            }
+        }
 
-void VirtualFileSystem::setCurrentDir(Directory* newCurrentDir) {
-    currentDir = newCurrentDir;
+        for (int32_t i = bestStart; i < bestStart + bestLength; ++i) {
+            dataBitmap[i] = BITMAP_RESERVED;
+            reserved.push_back(i);
+        }
+        group->addFreeClusters(-bestLength);
+    }
+
+    return reserved;
 }
 
-string VirtualFileSystem::getName() const {
-    return name;
+void VirtualFileSystem::unreserveClusters(const vector<int32_t>& blocks) {
+    for (int32_t block : blocks) {
+        markCluster(block, 0);
+    }
 }
 
-void VirtualFileSystem::setName(const string& newName) {
-    name = newName;
+void VirtualFileSystem::discardClusters(vector<int32_t> blocks) {
+    blocks.erase(std::remove(blocks.begin(), blocks.end(), ID_ITEM_FREE), blocks.end());
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+
+    int64_t clusterSize = superblock->getClusterSize();
+    int64_t firstCluster = superblock->getDataStartAddress() / clusterSize;
+    bool secure = eraseMode == EraseMode::SECURE;
+    vector<char> zeros;
+    flushVfs();     // Nothing written before may land in a punched range later
+
+    for (size_t i = 0; i < blocks.size();) {
+        size_t run = 1;
+        while (i + run < blocks.size() && blocks[i + run] == blocks[i] + static_cast<int32_t>(run)) {
+            run++;
+        }
+        int64_t address = superblock->getDataStartAddress() + blocks[i] * clusterSize;
+        int64_t length = static_cast<int64_t>(run) * clusterSize;
+
+        if (!secure && punchHole(address, length)) {
+            for (size_t j = i; j < i + run && checksums.isEnabled(); j++) {
+                checksums.setZero(firstCluster + blocks[j]);
+            }
+        } else {
+            // Zeros are written in chunks, their checksums are set by the writes
+            for (int64_t done = 0; done < length; done += ERASE_CHUNK_BYTES) {
+                zeros.resize(static_cast<size_t>(std::min<int64_t>(ERASE_CHUNK_BYTES, length - done)), 0);
+                seekSet(address + done);
+                writeToFile(zeros.data(), zeros.size());
+            }
+        }
+        i += run;
+    }
+
+    if (secure && !blocks.empty()) {
+        flushVfs();
+        fdatasync(vfsFd);
+    }
 }
 
-fstream* VirtualFileSystem::getVfsFile() const {
-    return vfsFile;
+bool VirtualFileSystem::punchHole(int64_t address, int64_t length) {
+    if (!punchHoles) {
+        return false;
+    }
+#ifdef FALLOC_FL_PUNCH_HOLE
+    if (::fallocate(vfsFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, address, length) == 0) {
+        return true;
+    }
+#endif
+    punchHoles = false;     // Refused by the host file system, freed clusters are zeroed from now on
+    return false;
 }
 
-void VirtualFileSystem::setVfsFile(fstream* newVfsFile) {
-    vfsFile = newVfsFile;
+void VirtualFileSystem::releaseAllReservations() {
+    lock_guard<mutex> lock(sessionsMutex);
+    for (Session* session : sessions) {
+        session->getReservation()->release();
+    }
 }
 
-vector<int32_t> VirtualFileSystem::findFreeDataBlocks(int count) {
-    vector<int32_t> blocks;
-    blocks.reserve(count);
+int32_t VirtualFileSystem::findFreeInode(int32_t parentInode, bool isDirectory) {
+    size_t firstGroup = getGroupOfInode(parentInode);
 
-    for (int32_t i = 1; i < this->getSuperblock()->getDataClusterCount(); ++i) {
-        if (this->getDataBitmap()[i] == 0) {
-            blocks.push_back(i);
-            if (blocks.size() == static_cast<size_t>(count)) {
-                return blocks;
+    if (isDirectory) {
+        // Spread directories, their files will follow them into the group
+        int32_t mostFreeInodes = -1;
+        for (size_t g = 0; g < groups.size(); g++) {
+            if (groups[g]->getFreeInodes() > mostFreeInodes) {
+                mostFreeInodes = groups[g]->getFreeInodes();
+                firstGroup = g;
             }
         }
     }
 
-    return {};
-}
-
-int32_t VirtualFileSystem::initializeInode(int32_t inodeId, int32_t size, int blockCount, vector<int32_t>& blocks) {
-    int32_t lastDataBlock = 0;
-    Inode& node = inodes[inodeId];
-
-    node.setNodeId(inodeId);
-    node.setIsDirectory(false);
-    node.setReferences(1);
-    node.setFileSize(size);
-    node.setDirect(0, blocks[0]);
+    for (size_t n = 0; n < groups.size(); n++) {
+        AllocationGroup* group = groups[(firstGroup + n) % groups.size()];
+        if (group->getFreeInodes() == 0) {
+            continue;
+        }
 
-    if (blockCount > 1) {
-        node.setDirect(1, blocks[1]);
-        lastDataBlock = 1;
+        int32_t end = group->getFirstInode() + group->getInodeCount();
+        for (int32_t i = std::max(1, group->getFirstInode()); i < end; ++i) {
+            if (inodes[i].getNodeId() == ID_ITEM_FREE) {
+                return i;
+            }
+        }
     }
+    return ERROR_CODE;
+}
 
-    if (blockCount > 2) {
-        node.setDirect(2, blocks[2]);
-        lastDataBlock = 2;
+void VirtualFileSystem::claimInode(int32_t id) {
+    if (!groups.empty() && inodes[id].getNodeId() == ID_ITEM_FREE) {
+        AllocationGroup* group = groups[getGroupOfInode(id)];
+        group->addFreeInodes(-1);
     }
+    inodes[id].setNodeId(id);
+}
 
-    if (blockCount > 3) {
-        node.setDirect(3, blocks[3]);
-        lastDataBlock = 3;
+void VirtualFileSystem::markCluster(int32_t block, int8_t value) {
+    if (groups.empty()) {
+        dataBitmap[block] = value;
+        return;
     }
 
-    if (blockCount > 4) {
-        node.setDirect(4, blocks[4]);
-        lastDataBlock = 4;
+    AllocationGroup* group = groups[getGroupOfCluster(block)];
+    if ((dataBitmap[block] == 0) != (value == 0)) {
+        group->addFreeClusters(value == 0 ? 1 : -1);
     }
+    dataBitmap[block] = value;
+}
+
+void VirtualFileSystem::initAllocationGroups() {
+    clearAllocationGroups();
 
-    // Work with indirect blocks
-    if (blockCount > 5) {
-        int blockCountWithIndirect = getBlockCountWithIndirect(blockCount);
-        node.setIndirect(0, blocks[blockCountWithIndirect - 1]); // Add first indirect block
+    int32_t clustersPerGroup = superblock->getClustersPerGroup();
+    int32_t inodesPerGroup = superblock->getInodesPerGroup();
 
-        if (blockCount > (CLUSTER_SIZE / sizeof(int32_t)) + 5) {
-            node.setIndirect(1, blocks[blockCountWithIndirect - 2]); // Add second indirect block
-            seekDataCluster(node.getIndirect(0));
-            writeToFile(&blocks[5], sizeof(int32_t) * (CLUSTER_SIZE / sizeof(int32_t)));
-            int tmpBlockCount = blockCount - (CLUSTER_SIZE / sizeof(int32_t) + 5);
-            seekDataCluster(node.getIndirect(1));
-            writeToFile(&blocks[(CLUSTER_SIZE / sizeof(int32_t) + 5)], sizeof(int32_t) * tmpBlockCount);
+    for (int32_t g = 0; g < superblock->getGroupCount(); g++) {
+        int32_t firstCluster = g * clustersPerGroup;
+        int32_t clusterCount = static_cast<int32_t>(std::min<int64_t>(clustersPerGroup, superblock->getDataClusterCount() - firstCluster));
+        int32_t firstInode = g * inodesPerGroup;
+        int32_t inodeCount = std::min(inodesPerGroup, superblock->getInodeCount() - firstInode);
+
+        auto* group = new AllocationGroup(firstCluster, std::max(0, clusterCount), firstInode, std::max(0, inodeCount));
+
+        int32_t freeClusters = 0;
+        for (int32_t i = firstCluster; i < firstCluster + group->getClusterCount(); i++) {
+            if (dataBitmap[i] == 0) freeClusters++;
         }
-        else {
-            int tmpBlockCount = blockCount - 5;
-            seekDataCluster(node.getIndirect(0));
-            writeToFile(&blocks[5], sizeof(int32_t) * tmpBlockCount);
+        int32_t freeInodes = 0;
+        for (int32_t i = firstInode; i < firstInode + group->getInodeCount(); i++) {
+            if (inodes[i].getNodeId() == ID_ITEM_FREE) freeInodes++;
         }
 
-        lastDataBlock = blockCount - 1;
+        group->addFreeClusters(freeClusters);
+        group->addFreeInodes(freeInodes);
+        groups.push_back(group);
+    }
+}
+
+void VirtualFileSystem::clearAllocationGroups() {
+    for (AllocationGroup* group : groups) {
+        delete group;
     }
+    groups.clear();
+}
 
-    return lastDataBlock;
+const vector<AllocationGroup*>& VirtualFileSystem::getAllocationGroups() const {
+    return groups;
 }
 
-int32_t VirtualFileSystem::findFreeInode() {
-    for (int32_t i = 1; i < this->getSuperblock()->getInodeCount(); ++i) {
-        if (this->getInodes()[i].getNodeId() == ID_ITEM_FREE) {
-            return i;
-        }
+size_t VirtualFileSystem::getGroupOfCluster(int32_t block) const {
+    if (groups.empty() || block < 0) {
+        return 0;
     }
-    return ERROR_CODE;
+    return std::min(static_cast<size_t>(block / superblock->getClustersPerGroup()), groups.size() - 1);
+}
+
+size_t VirtualFileSystem::getGroupOfInode(int32_t id) const {
+    if (groups.empty() || id < 0) {
+        return 0;
+    }
+    return std::min(static_cast<size_t>(id / superblock->getInodesPerGroup()), groups.size() - 1);
 }
 
 vector<int32_t> VirtualFileSystem::getDataBlocks(int32_t nodeid, int* block_count, int* rest) {
     vector<int32_t> data_blocks;
     int32_t number;
-    int max_numbers = 2 * (CLUSTER_SIZE / 4) + 5; // Max number of blocks in i-node
+    int32_t pointers = clusterIo->getPointersPerCluster();
+    int max_numbers = 2 * pointers + 5; // Max number of blocks in i-node
     Inode& node = inodes[nodeid];
 
-    if (node.getIsDirectory()) {
+    if (node.getIsInline() || node.getTailCluster() != ID_ITEM_FREE) {
+        // Data lives in the i-node record or in a pack cluster
+        *block_count = 0;
+        if (rest != nullptr) {
+            *rest = 0;
+        }
+    } else if (node.getIsDirectory()) {
         data_blocks.reserve(max_numbers);
         addDirectBlocks(node, data_blocks);
-        addIndirectBlocks(node.getIndirect(0), data_blocks, CLUSTER_SIZE / sizeof(int32_t));
-        addIndirectBlocks(node.getIndirect(1), data_blocks, CLUSTER_SIZE / sizeof(int32_t));
+        addIndirectBlocks(node.getIndirect(0), data_blocks, pointers);
+        addIndirectBlocks(node.getIndirect(1), data_blocks, pointers);
         *block_count = static_cast<int>(data_blocks.size());
     } else {
-        *block_count = node.getFileSize() / CLUSTER_SIZE;
-        if (rest != nullptr) {
-            *rest = node.getFileSize() % CLUSTER_SIZE;
-        }
-        if (node.getFileSize() % CLUSTER_SIZE != 0) {
-            (*block_count)++;
-        }
+        *block_count = clusterIo->getBlockCount(node.getFileSize(), rest);
 
         if (*block_count == 0) {
             data_blocks.resize(1);
@@ -427,10 +2189,9 @@ void VirtualFileSystem::addDirectBlocks(const Inode& node, vector<int32_t>& bloc
 
 void VirtualFileSystem::addIndirectBlocks(int32_t indirect_block_address, vector<int32_t>& blocks, int max_blocks) {
     if (indirect_block_address != ID_ITEM_FREE) {
-        seekDataCluster(indirect_block_address);
-        int32_t number;
-        for (int i = 0; i < max_blocks; ++i) {
-            readFromFile(&number, 1);
+        vector<int32_t> numbers(max_blocks);
+        readDataClusters(indirect_block_address, reinterpret_cast<char*>(numbers.data()), sizeof(int32_t) * max_blocks);
+        for (int32_t number : numbers) {
             if (number > 0) blocks.push_back(number);
         }
     }
@@ -445,16 +2206,36 @@ void VirtualFileSystem::fillDirectBlocks(const Inode& node, vector<int32_t>& blo
 }
 
 void VirtualFileSystem::fillIndirectBlocks(const Inode& node, vector<int32_t>& blocks, int block_count) {
-    if (block_count > 5) {
-        int tmp = block_count - 5;
-        seekDataCluster(node.getIndirect(0));
-        readFromFile(&blocks[5], tmp);
-        if (block_count > (CLUSTER_SIZE / sizeof(int32_t)) + 5) {
-            tmp = block_count - (CLUSTER_SIZE / sizeof(int32_t)) - 5;
-            seekDataCluster(node.getIndirect(1));
-            readFromFile(&blocks[(CLUSTER_SIZE / sizeof(int32_t)) + 5], tmp);
-        }
+    int next = std::min(block_count, 5);
+    if (next < block_count) clusterIo->readBlockMap(this, node.getIndirect(0), 1, blocks, next, block_count);
+    if (next < block_count) clusterIo->readBlockMap(this, node.getIndirect(1), 1, blocks, next, block_count);
+    if (next < block_count) clusterIo->readBlockMap(this, node.getDoubleIndirect(), 2, blocks, next, block_count);
+    if (next < block_count) clusterIo->readBlockMap(this, node.getTripleIndirect(), 3, blocks, next, block_count);
+}
+
+vector<int32_t> VirtualFileSystem::getMapBlocks(int32_t inodeId) {
+    vector<int32_t> mapBlocks;
+    const Inode& node = inodes[inodeId];
+
+    if (node.getIndirect(0) != ID_ITEM_FREE) mapBlocks.push_back(node.getIndirect(0));
+    if (node.getIndirect(1) != ID_ITEM_FREE) mapBlocks.push_back(node.getIndirect(1));
+    if (node.getIsDirectory()) {
+        return mapBlocks; // Directories use single indirect blocks only
+    }
+
+    // Data blocks left for the double and triple indirect trees
+    int64_t pointers = clusterIo->getPointersPerCluster();
+    int64_t rest = clusterIo->getBlockCount(node.getFileSize(), nullptr) - 5 - 2 * pointers;
+    int64_t span = pointers * pointers;
+    if (rest > 0 && node.getDoubleIndirect() != ID_ITEM_FREE) {
+        clusterIo->collectMapBlocks(this, node.getDoubleIndirect(), 2, std::min(rest, span), mapBlocks);
     }
+    rest -= span;
+    if (rest > 0 && node.getTripleIndirect() != ID_ITEM_FREE) {
+        clusterIo->collectMapBlocks(this, node.getTripleIndirect(), 3, rest, mapBlocks);
+    }
+
+    return mapBlocks;
 }
 
 void VirtualFileSystem::writeInodeToVfs(int id) {
@@ -463,7 +2244,7 @@ void VirtualFileSystem::writeInodeToVfs(int id) {
     }
 
     // Positioning to the beginning of the i-node
-    seekSet(superblock->getInodeStartAddress() + id * INODE_SIZE);
+    seekSet(superblock->getInodeStartAddress() + static_cast<int64_t>(id) * superblock->getInodeSize());
 
     // Data writing to the file of the i-node
     writeInodeToFile(&inodes[id]);
@@ -472,7 +2253,7 @@ void VirtualFileSystem::writeInodeToVfs(int id) {
     flushVfs();
 }
 
-void VirtualFileSystem::updateSizesInFile(Directory* dir, int32_t size) {
+void VirtualFileSystem::updateSizesInFile(Directory* dir, int64_t size) {
     Directory* d = dir;
     while (d != allDirs[0]) { // While not root
         inodes[d->getCurrent()->getInode()].setFileSize(inodes[d->getCurrent()->getInode()].getFileSize() + size);
@@ -490,8 +2271,31 @@ void VirtualFileSystem::printDirItemInfo(const DirectoryItem* item) {
     stringstream ss;
     ss << "Name: " << item->getItemName() << "\n"
        << "Size: " << node.getFileSize() << "B\n"
-       << "i-node: " << node.getNodeId() << "\n"
-       << "Direct blocks:\n";
+       << "i-node: " << node.getNodeId() << "\n";
+    if (node.getIsInline()) {
+        ss << "Inline data: " << node.getInlineData().size() << "B ( no data blocks )";
+        log(ss.str());
+        return;
+    }
+    if (node.getTailCluster() != ID_ITEM_FREE) {
+        ss << "Packed in cluster: " << node.getTailCluster() << " ( offset " << node.getTailOffset()
+           << ", length " << node.getFileSize() << "B )";
+        log(ss.str());
+        return;
+    }
+
+    // Holes of sparse and compressed files take no cluster, the block map does
+    int blockCount;
+    vector<int32_t> blocks = getDataBlocks(item->getInode(), &blockCount, nullptr);
+    int64_t stored = std::count_if(blocks.begin(), blocks.begin() + blockCount,
+                                   [](int32_t block) { return block != ID_ITEM_FREE; });
+    auto mapBlockCount = static_cast<int64_t>(getMapBlocks(item->getInode()).size());
+    ss << "Allocated: " << (stored + mapBlockCount) * superblock->getClusterSize() << "B ( " << stored
+       << " data blocks, " << blockCount - stored << " holes, " << mapBlockCount << " block map blocks )\n";
+    if (node.getIsCompressed()) {
+        ss << "Compressed: " << stored << " of " << blockCount << " data blocks stored\n";
+    }
+    ss << "Direct blocks:\n";
     for (int i = 0; i < 5; ++i) {
         if (node.getDirect(i) != ID_ITEM_FREE) {
             ss << "  [" << i << "]: " << node.getDirect(i) << "\n";
@@ -501,6 +2305,10 @@ void VirtualFileSystem::printDirItemInfo(const DirectoryItem* item) {
     printIndirectBlocks(node.getIndirect(0), ss);
     ss << "\nIndirect 2 blocks:";
     printIndirectBlocks(node.getIndirect(1), ss);
+    if (superblock->hasFeature(FEATURE_LARGE_FILES)) {
+        ss << "\nDouble indirect block: " << node.getDoubleIndirect()
+           << "\nTriple indirect block: " << node.getTripleIndirect();
+    }
     log(ss.str());
 }
 
@@ -510,45 +2318,83 @@ void VirtualFileSystem::printIndirectBlocks(int32_t indirectBlockAddress, string
         return;
     }
 
-    int32_t blockNumber;
-    seekDataCluster(indirectBlockAddress);
-    for (int i = 0; i < INT32_COUNT_IN_BLOCK; ++i) {
-        readFromFile(&blockNumber, 1);
+    vector<int32_t> blockNumbers(clusterIo->getPointersPerCluster());
+    readDataClusters(indirectBlockAddress, reinterpret_cast<char*>(blockNumbers.data()), sizeof(int32_t) * blockNumbers.size());
+    for (int32_t blockNumber : blockNumbers) {
         if (blockNumber > 0) {
             ss << blockNumber << " ";
-        } else {
-            break;
+        } else if (blockNumber != ID_ITEM_FREE) {
+            break;      // Holes of compressed files are skipped, zero ends the used pointers
         }
     }
 }
 
 int VirtualFileSystem::getBlockCountWithIndirect(int blockCount) {
-    if (blockCount <= 5) { // Only direct blocks
-        return blockCount;
+    int64_t pointers = clusterIo->getPointersPerCluster();
+    int64_t rest = blockCount - 5; // Blocks behind the direct blocks
+    int mapBlockCount = 0;
+
+    // Two single indirect blocks
+    for (int i = 0; i < 2 && rest > 0; i++) {
+        mapBlockCount++;
+        rest -= pointers;
     }
 
-    if (blockCount <= CLUSTER_SIZE / sizeof(int32_t) + 5) { // One indirect block
-        return blockCount + 1;
-    } else { // Two indirect blocks
-        return blockCount + 2;
+    // Double and triple indirect trees, every level needs one block per started span of its pointers
+    int64_t treeSpan = pointers;
+    for (int level = 2; level <= 3 && rest > 0; level++) {
+        treeSpan *= pointers;
+        int64_t covered = std::min(rest, treeSpan);
+        for (int64_t span = treeSpan; span >= pointers; span /= pointers) {
+            mapBlockCount += static_cast<int>((covered + span - 1) / span);
+        }
+        rest -= treeSpan;
+    }
+
+    return blockCount + mapBlockCount;
+}
+
+int64_t VirtualFileSystem::getMaxFileSize() const {
+    int64_t pointers = clusterIo->getPointersPerCluster();
+    int64_t maxBlockCount = 5 + 2 * pointers;
+    if (superblock->hasFeature(FEATURE_LARGE_FILES)) {
+        maxBlockCount += pointers * pointers + pointers * pointers * pointers;
     }
 
+    // Block counts are 32-bit
+    maxBlockCount = std::min<int64_t>(maxBlockCount, INT32_MAX - 3 * pointers);
+    return maxBlockCount * superblock->getClusterSize();
+}
+
+const ClusterIo* VirtualFileSystem::getClusterIo() const {
+    return clusterIo;
+}
+
+int32_t VirtualFileSystem::getClusterSize() const {
+    return superblock->getClusterSize();
 }
 
 void VirtualFileSystem::updateBitmapInFile(DirectoryItem* item, int8_t value, vector<int32_t> const& dataBlocks) {
     int block_count;
     vector<int32_t> blocks = dataBlocks.empty() ? getDataBlocks(item->getInode(), &block_count, nullptr) : dataBlocks;
 
-    // Update values in bitmap and write them to the file
+    // Update values in bitmap and write them to the file, holes of compressed files have no cluster
     for (int32_t block : blocks) {
-        dataBitmap[block] = value;
+        if (block == ID_ITEM_FREE) {
+            continue;
+        }
+        if (value != 0 && dataBitmap[block] > value) {
+            continue;   // Marking a cluster used never lowers the reference count of a shared cluster
+        }
+        markCluster(block, value);
         seekSet(superblock->getBitmapStartAddress() + block);
         writeToFile(&value, 1);
     }
 
     // Indirect blocks
-    updateIndirectBlocksInBitmap(inodes[item->getInode()].getIndirect(0), value);
-    updateIndirectBlocksInBitmap(inodes[item->getInode()].getIndirect(1), value);
+    for (int32_t mapBlock : getMapBlocks(item->getInode())) {
+        updateIndirectBlocksInBitmap(mapBlock, value);
+    }
 
     // flush the file ( saving changes )
     flushVfs();
@@ -556,7 +2402,7 @@ void VirtualFileSystem::updateBitmapInFile(DirectoryItem* item, int8_t value, ve
 
 void VirtualFileSystem::updateIndirectBlocksInBitmap(int32_t indirectBlock, int8_t value) {
     if (indirectBlock != ID_ITEM_FREE) {
-        dataBitmap[indirectBlock] = value;
+        markCluster(indirectBlock, value);
         seekSet(superblock->getBitmapStartAddress() + indirectBlock);
         writeToFile(&value, 1);
     }
@@ -571,6 +2417,16 @@ void VirtualFileSystem::cleanup() {
 
     delete[] dataBitmap;
     dataBitmap = nullptr;
+    clusterIo = nullptr;
+
+    clearAllocationGroups();
+
+    {
+        lock_guard<mutex> lock(readaheadMutex);
+        readaheadStates.clear();
+    }
+    closeOpenFiles(ID_ITEM_FREE);
+    fileWrites.clear();
 
     vector<unordered_map<int, Directory*>::iterator> deletionOrder;
 
@@ -583,7 +2439,12 @@ void VirtualFileSystem::cleanup() {
         allDirs.erase(*it); // remove directory from map
     }
 
-    currentDir = nullptr;
+    // Directories are gone, sessions wait for the next format or load
+    lock_guard<mutex> lock(sessionsMutex);
+    for (Session* session : sessions) {
+        session->setCurrentDir(nullptr);
+        session->getReservation()->discard();
+    }
 
     isFormatted = false;
 }
@@ -605,9 +2466,7 @@ bool VirtualFileSystem::removeDirectory(Directory* parentDir, const string& name
 
             *itemAddress = item->getNext();
 
-            if (currentDir == dirToDelete) {
-                currentDir = dirToDelete->getParent();
-            }
+            moveSessions(dirToDelete, dirToDelete->getParent());
 
             updateBitmapInFile(item, 0, {});
             freeInode(item->getInode());
@@ -625,7 +2484,7 @@ bool VirtualFileSystem::removeDirectory(Directory* parentDir, const string& name
     return false;
 }
 
-bool VirtualFileSystem::format(int32_t filesystemSize) {
+bool VirtualFileSystem::format(int64_t filesystemSize, int32_t clusterSize, int32_t optionalFeatures) {
     cleanup();
     if (!vfsFile || !vfsFile->is_open()) {
         ofstream fileCreator(name, ios::out | ios::binary);
@@ -634,7 +2493,7 @@ bool VirtualFileSystem::format(int32_t filesystemSize) {
         }
 
         delete vfsFile;
-        vfsFile = new fstream(name, ios::in | ios::out | ios::binary);
+        openVfsFile();
         if (!vfsFile->is_open()) {
             return false;
         }
@@ -642,7 +2501,14 @@ bool VirtualFileSystem::format(int32_t filesystemSize) {
 
     flushVfs();
     delete superblock;
-    superblock = ::superblockInit(filesystemSize);
+    superblock = ::superblockInit(filesystemSize, clusterSize);
+    clusterIo = ClusterIo::forClusterSize(clusterSize);
+    if (clusterIo == nullptr || superblock->getInodeCount() < 1 || superblock->getDataClusterCount() < 1) {
+        delete superblock;
+        superblock = nullptr;
+        return false;
+    }
+    superblock->setFeatures(superblock->getFeatures() | optionalFeatures);
 
     delete dataBitmap;
     delete inodes;
@@ -657,11 +2523,10 @@ bool VirtualFileSystem::format(int32_t filesystemSize) {
     rootDirectory->setParent(rootDirectory); // Root directory refers to itself as parent
 
     delete allDirs[0];
-    delete currentDir;
 
     // Add root directory to the map
     allDirs[0] = rootDirectory;
-    currentDir = rootDirectory;
+    moveSessions(nullptr, rootDirectory);
 
     // Free all i-nodes
     for (int i = 0; i < superblock->getInodeCount(); i++) {
@@ -674,12 +2539,14 @@ bool VirtualFileSystem::format(int32_t filesystemSize) {
     inodes[0].setReferences(1);
     inodes[0].setDirect(0, 0); // First direct block is the first data block
 
-    // Fill the file with empty data clusters
-    char buffer[CLUSTER_SIZE];
-    memset(buffer, 0, CLUSTER_SIZE);
-    for (int i = 0; i < superblock->getClusterCount(); i++) {
-        vfsFile->write(buffer, sizeof(buffer));
+    // Fill the file with empty data clusters, the host file system returns zeros for the resized range
+    // without writing them ( large images would take minutes to fill )
+    if (::truncate(name.c_str(), 0) != 0
+        || ::truncate(name.c_str(), superblock->getClusterCount() * clusterSize) != 0) {
+        return false;
     }
+    // The zero filled table of cluster checksums matches the zero filled clusters
+    checksums.reset(vfsFd, superblock->getChecksumStartAddress(), clusterSize);
 
     for (int i = 0; i < superblock->getDataClusterCount(); i++) {
         dataBitmap[i] = 0;
@@ -696,9 +2563,13 @@ bool VirtualFileSystem::format(int32_t filesystemSize) {
 
     // Update bitmap in file
     updateBitmapInFile(rootItem, 1, {0});
-    for (int i = 0; i < superblock->getInodeCount(); i++) {
-        writeInodeToVfs(i);
-    }
+    writeInodeTable();
+
+    initAllocationGroups();
+    tailPacker.reset(clusterSize);
+    dedupIndex.reset();
+    dedupIndex.setLoaded();     // The table of cluster hashes of a new image is empty
+    syncChecksums();
 
     isFormatted = true;
 
@@ -716,33 +2587,169 @@ void VirtualFileSystem::writeSuperblock() {
     // Writing signature
     vfsFile->write(superblock->getSignature(), SIGNATURE_LENGTH);
 
+    // The 64-bit revision keeps the widened fields zero here and stores them after the group fields
+    bool wide = superblock->hasFeature(FEATURE_64BIT);
+
     int32_t temp;
-    temp = superblock->getDiskSize();             writeToFile(&temp);
-    temp = superblock->getClusterSize();          writeToFile(&temp);
-    temp = superblock->getClusterCount();         writeToFile(&temp);
-    temp = superblock->getInodeCount();           writeToFile(&temp);
-    temp = superblock->getBitmapClusterCount();   writeToFile(&temp);
-    temp = superblock->getInodeClusterCount();    writeToFile(&temp);
-    temp = superblock->getDataClusterCount();     writeToFile(&temp);
-    temp = superblock->getBitmapStartAddress();   writeToFile(&temp);
-    temp = superblock->getInodeStartAddress();    writeToFile(&temp);
-    temp = superblock->getDataStartAddress();     writeToFile(&temp);
+    temp = wide ? 0 : static_cast<int32_t>(superblock->getDiskSize());             writeToFile(&temp);
+    temp = superblock->getClusterSize();                                            writeToFile(&temp);
+    temp = wide ? 0 : static_cast<int32_t>(superblock->getClusterCount());         writeToFile(&temp);
+    temp = superblock->getInodeCount();                                             writeToFile(&temp);
+    temp = wide ? 0 : static_cast<int32_t>(superblock->getBitmapClusterCount());   writeToFile(&temp);
+    temp = wide ? 0 : static_cast<int32_t>(superblock->getInodeClusterCount());    writeToFile(&temp);
+    temp = wide ? 0 : static_cast<int32_t>(superblock->getDataClusterCount());     writeToFile(&temp);
+    temp = wide ? 0 : static_cast<int32_t>(superblock->getBitmapStartAddress());   writeToFile(&temp);
+    temp = wide ? 0 : static_cast<int32_t>(superblock->getInodeStartAddress());    writeToFile(&temp);
+    temp = wide ? 0 : static_cast<int32_t>(superblock->getDataStartAddress());     writeToFile(&temp);
+    temp = superblock->getFeatures();                                               writeToFile(&temp);
+    temp = superblock->getGroupCount();                                             writeToFile(&temp);
+    temp = superblock->getClustersPerGroup();                                       writeToFile(&temp);
+    temp = superblock->getInodesPerGroup();                                         writeToFile(&temp);
+
+    if (wide) {
+        int64_t wideTemp;
+        wideTemp = superblock->getDiskSize();             writeToFile(&wideTemp);
+        wideTemp = superblock->getClusterCount();         writeToFile(&wideTemp);
+        wideTemp = superblock->getBitmapClusterCount();   writeToFile(&wideTemp);
+        wideTemp = superblock->getInodeClusterCount();    writeToFile(&wideTemp);
+        wideTemp = superblock->getDataClusterCount();     writeToFile(&wideTemp);
+        wideTemp = superblock->getBitmapStartAddress();   writeToFile(&wideTemp);
+        wideTemp = superblock->getInodeStartAddress();    writeToFile(&wideTemp);
+        wideTemp = superblock->getDataStartAddress();     writeToFile(&wideTemp);
+    }
+
+    if (superblock->hasFeature(FEATURE_DEDUP)) {
+        int64_t wideTemp;
+        wideTemp = superblock->getDedupClusterCount();    writeToFile(&wideTemp);
+        wideTemp = superblock->getDedupStartAddress();    writeToFile(&wideTemp);
+    }
+
+    if (superblock->hasFeature(FEATURE_CHECKSUMS)) {
+        int64_t wideTemp;
+        wideTemp = superblock->getChecksumClusterCount();    writeToFile(&wideTemp);
+        wideTemp = superblock->getChecksumStartAddress();    writeToFile(&wideTemp);
+    }
 }
 
 void VirtualFileSystem::flushVfs() {
     vfsFile->flush();
 }
 
-int VirtualFileSystem::seekDataCluster(int blockNumber) const {
-    return seekSet(superblock->getDataStartAddress() + blockNumber * CLUSTER_SIZE);
+void VirtualFileSystem::syncChecksums() {
+    modificationCount++;
+    if (!checksums.isEnabled()) {
+        return;
+    }
+
+    int32_t clusterSize = superblock->getClusterSize();
+    vector<char> cluster(static_cast<size_t>(clusterSize));
+    for (int64_t stale : checksums.getStaleClusters()) {
+        if (readAt(stale * clusterSize, cluster.data(), cluster.size()) == clusterSize) {
+            checksums.set(stale, Crc32c::compute(cluster.data(), cluster.size()));
+        }
+    }
+
+    checksums.flush([this](int64_t address, const char* data, size_t size) {
+        seekSet(address);
+        writeToFile(data, size);
+    });
+    flushVfs();
+}
+
+uint64_t VirtualFileSystem::getModificationCount() const {
+    return modificationCount;
+}
+
+bool VirtualFileSystem::matchesChecksum(int32_t blockNumber, const char* data) const {
+    uint32_t stored;
+    int64_t cluster = superblock->getDataStartAddress() / superblock->getClusterSize() + blockNumber;
+    return !checksums.isEnabled() || !checksums.get(cluster, stored)
+           || Crc32c::compute(data, static_cast<size_t>(superblock->getClusterSize())) == stored;
+}
+
+Scrubber* VirtualFileSystem::getScrubber() const {
+    return scrubber;
+}
+
+Defragmenter* VirtualFileSystem::getDefragmenter() const {
+    return defragmenter;
+}
+
+bool VirtualFileSystem::hasChecksums() const {
+    return checksums.isEnabled();
+}
+
+VerifyMode VirtualFileSystem::getVerifyMode() const {
+    return verifyMode;
+}
+
+void VirtualFileSystem::setVerifyMode(VerifyMode mode) {
+    verifyMode = mode;
+}
+
+int64_t VirtualFileSystem::getChecksumErrors() const {
+    return checksumErrors;
+}
+
+EraseMode VirtualFileSystem::getEraseMode() const {
+    return eraseMode;
+}
+
+void VirtualFileSystem::setEraseMode(EraseMode mode) {
+    eraseMode = mode;
+}
+
+bool VirtualFileSystem::canPunchHoles() const {
+    return punchHoles;
+}
+
+bool VirtualFileSystem::isChecksummed(int64_t cluster) const {
+    int64_t address = cluster * superblock->getClusterSize();
+    int64_t metadataEnd = superblock->getInodeStartAddress()
+                          + superblock->getInodeClusterCount() * superblock->getClusterSize();
+    int64_t dataEnd = superblock->getDataStartAddress()
+                      + superblock->getDataClusterCount() * superblock->getClusterSize();
+    return (address >= superblock->getBitmapStartAddress() && address < metadataEnd)
+           || (address >= superblock->getDataStartAddress() && address < dataEnd);
+}
+
+void VirtualFileSystem::noteWrite(int64_t offset, const char* data, size_t size) {
+    int64_t clusterSize = superblock->getClusterSize();
+    int64_t end = offset + static_cast<int64_t>(size);
+    for (int64_t cluster = offset / clusterSize; cluster * clusterSize < end; cluster++) {
+        if (!isChecksummed(cluster)) {
+            continue;
+        }
+        int64_t start = cluster * clusterSize;
+        if (start >= offset && start + clusterSize <= end) {
+            checksums.set(cluster, Crc32c::compute(data + (start - offset), static_cast<size_t>(clusterSize)));
+        } else {
+            checksums.markStale(cluster);
+        }
+    }
+}
+
+bool VirtualFileSystem::verifyCluster(int64_t cluster, const char* data) const {
+    uint32_t stored;
+    if (!checksums.get(cluster, stored)
+        || Crc32c::compute(data, static_cast<size_t>(superblock->getClusterSize())) == stored) {
+        return true;    // Clusters written partly by the running command have no checksum yet
+    }
+    checksumErrors++;
+    log(CHECKSUM_MISMATCH_TEXT + std::to_string(cluster));
+    return false;
+}
+
+int VirtualFileSystem::seekDataCluster(int32_t blockNumber) const {
+    return seekSet(superblock->getDataStartAddress() + static_cast<int64_t>(blockNumber) * superblock->getClusterSize());
 }
 
-int VirtualFileSystem::seekSet(long int offset) const {
+int VirtualFileSystem::seekSet(int64_t offset) const {
     vfsFile->seekg(offset, ios::beg);
     return vfsFile->good() ? 0 : -1;
 }
 
-int VirtualFileSystem::seekCur(long int offset) {
+int VirtualFileSystem::seekCur(int64_t offset) {
     vfsFile->seekg(offset, ios::cur);
     return vfsFile->good() ? 0 : -1;
 }
@@ -752,16 +2759,93 @@ void VirtualFileSystem::rewindVfs() const {
     vfsFile->seekg(0, ios::beg);
 }
 
-template<typename T>
+streamsize VirtualFileSystem::readAt(int64_t offset, char* buffer, size_t size) const {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t count = ::pread(vfsFd, buffer + done, size - done, offset + static_cast<int64_t>(done));
+        if (count < 0) {
+            return -1;
+        }
+        if (count == 0) {
+            break; // End of file
+        }
+        done += static_cast<size_t>(count);
+    }
+    return static_cast<streamsize>(done);
+}
+
+streamsize VirtualFileSystem::readDataClusters(int32_t blockNumber, char* buffer, size_t size) const {
+    return readVerified(superblock->getDataStartAddress() + static_cast<int64_t>(blockNumber) * superblock->getClusterSize(), buffer, size);
+}
+
+streamsize VirtualFileSystem::readVerified(int64_t offset, char* buffer, size_t size) const {
+    streamsize count = readAt(offset, buffer, size);
+    if (count <= 0 || !checksums.isEnabled() || verifyMode == VerifyMode::OFF) {
+        return count;
+    }
+
+    int64_t clusterSize = superblock->getClusterSize();
+    int64_t end = offset + count;
+    vector<char> edge;
+    bool valid = true;
+    for (int64_t cluster = offset / clusterSize; cluster * clusterSize < end; cluster++) {
+        if (!isChecksummed(cluster)) {
+            continue;
+        }
+        int64_t start = cluster * clusterSize;
+        if (start >= offset && start + clusterSize <= end) {
+            valid = verifyCluster(cluster, buffer + (start - offset)) && valid;
+            continue;
+        }
+        edge.resize(static_cast<size_t>(clusterSize));
+        if (readAt(start, edge.data(), edge.size()) == clusterSize) {
+            valid = verifyCluster(cluster, edge.data()) && valid;
+        }
+    }
+    return valid || verifyMode != VerifyMode::STRICT ? count : -1;
+}
+
+void VirtualFileSystem::adviseDataClusters(int32_t blockNumber, int32_t count) const {
+    if (count > 0) {
+        ::posix_fadvise(vfsFd, superblock->getDataStartAddress() + static_cast<int64_t>(blockNumber) * superblock->getClusterSize(),
+                        static_cast<int64_t>(count) * superblock->getClusterSize(), POSIX_FADV_WILLNEED);
+    }
+}
+
+ReadaheadState VirtualFileSystem::getReadaheadState(int32_t id) {
+    lock_guard<mutex> lock(readaheadMutex);
+    auto it = readaheadStates.find(id);
+    if (it == readaheadStates.end()) {
+        return ReadaheadState{READAHEAD_INITIAL_CLUSTERS, 0};
+    }
+    return it->second;
+}
+
+void VirtualFileSystem::setReadaheadState(int32_t id, const ReadaheadState& state) {
+    lock_guard<mutex> lock(readaheadMutex);
+    readaheadStates[id] = state;
+}
+
+void VirtualFileSystem::forgetReadaheadState(int32_t id) {
+    lock_guard<mutex> lock(readaheadMutex);
+    readaheadStates.erase(id);
+}
+
+template<typename Stored, typename T>
 void VirtualFileSystem::readAndSet(fstream& file, Superblock& superblock, void(Superblock::*setter)(T)) {
-    T temp;
-    file.read(reinterpret_cast<char*>(&temp), sizeof(T));
-    (superblock.*setter)(temp);
+    Stored temp;
+    file.read(reinterpret_cast<char*>(&temp), sizeof(Stored));
+    (superblock.*setter)(static_cast<T>(temp));
 }
 
 template<typename T>
 streamsize VirtualFileSystem::writeToFile(const T* ptr, size_t count) {
+    // The stream has no buffer, its position is the position of the file
+    int64_t offset = checksums.isEnabled() ? static_cast<int64_t>(vfsFile->tellp()) : -1;
     vfsFile->write(reinterpret_cast<const char*>(ptr), sizeof(T) * count);
+    if (offset >= 0) {
+        noteWrite(offset, reinterpret_cast<const char*>(ptr), sizeof(T) * count);
+    }
     return vfsFile->good() ? count : 0;
 }
 
@@ -772,30 +2856,26 @@ streamsize VirtualFileSystem::readFromFile(T* ptr, size_t count) {
 }
 
 int VirtualFileSystem::createDirectoryInFile(Directory* dir, DirectoryItem* item) {
-    const int maxItemsInBlock = 64;
     int blockCount = 0, rest = 0;
     vector<int32_t> blocks = getDataBlocks(dir->getCurrent()->getInode(), &blockCount, &rest);
+    vector<char> cluster(superblock->getClusterSize());
 
     for (int block_number = 0; block_number < blockCount; block_number++) {
-        this->seekDataCluster(blocks[block_number]);
-        for (int j = 0; j < maxItemsInBlock; j++) {
-            int32_t nodeId;
-            readFromFile(&nodeId, 1);
-            if (nodeId == 0) {
-                seekCur(-4); // go back -4 bytes
-                int32_t temp = item->getInode();
-                writeToFile(&temp, 1); // Write address of i-node
-                writeToFile(item->getItemName(), FILENAME_LENGTH); // Write filename to file
-                flushVfs();
-                return NO_ERROR_CODE;
-            } else {
-                seekCur(FILENAME_LENGTH); // skip filename length
-            }
+        readDataClusters(blocks[block_number], cluster.data(), cluster.size());
+        int entry = clusterIo->findEntry(cluster.data(), 0, nullptr);
+        if (entry >= 0) {
+            seekSet(superblock->getDataStartAddress() + static_cast<int64_t>(blocks[block_number]) * superblock->getClusterSize()
+                    + entry * DIRECTORY_ENTRY_SIZE);
+            int32_t temp = item->getInode();
+            writeToFile(&temp, 1); // Write address of i-node
+            writeToFile(item->getItemName(), FILENAME_LENGTH); // Write filename to file
+            flushVfs();
+            return NO_ERROR_CODE;
         }
     }
 
     // If there is no empty space
-    vector<int32_t> freeBlock = findFreeDataBlocks(1);
+    vector<int32_t> freeBlock = findFreeDataBlocks(1, dir->getCurrent()->getInode());
     if (freeBlock.empty()) {
         return ERROR_CODE;
     }
@@ -809,7 +2889,7 @@ int VirtualFileSystem::createDirectoryInFile(Directory* dir, DirectoryItem* item
     else if (dirNode.getDirect(3) == ID_ITEM_FREE) dirNode.setDirect(3, freeBlock[0]);
     else if (dirNode.getDirect(4) == ID_ITEM_FREE) dirNode.setDirect(4, freeBlock[0]);
     else {
-        freeBlock = findFreeDataBlocks(2);
+        freeBlock = findFreeDataBlocks(2, dir->getCurrent()->getInode());
         if (freeBlock.empty()) return ERROR_CODE;
 
         if (dirNode.getIndirect(0) == ID_ITEM_FREE) {
@@ -846,26 +2926,29 @@ bool VirtualFileSystem::removeFile(Directory* parentDir, DirectoryItem* item) {
     if (inode.getReferences() == 0) {
         int block_count, rest;
         vector<int32_t> blocks = getDataBlocks(item->getInode(), &block_count, &rest);
+        blocks.resize(block_count);
 
-        // Clear data blocks
-        char buffer[CLUSTER_SIZE];
-        memset(buffer, 0, CLUSTER_SIZE);
-        for (int32_t block : blocks) {
-            seekDataCluster(block);
-            writeToFile(buffer, sizeof(buffer));
+        // Shared clusters lose one reference, only clusters of no other file are discarded and freed
+        blocks = releaseDataBlocks(blocks);
+
+        if (inode.getTailCluster() != ID_ITEM_FREE) {
+            releasePackedTail(item->getInode());
         }
 
-        // Clear indirect blocks
+        // Indirect blocks are discarded and freed in the bitmap together with the data blocks
+        vector<int32_t> mapBlocks = getMapBlocks(item->getInode());
+        blocks.insert(blocks.end(), mapBlocks.begin(), mapBlocks.end());
         clearIndirectBlocks(item->getInode());
+        discardClusters(blocks);
 
+        // Clear bitmap of the freed clusters only, none are freed if every cluster is shared with another file
+        writeBitmapEntries(blocks, 0);
         flushVfs();
 
-        // Clear bitmap
-        updateBitmapInFile(item, 0, blocks);
-
         // Update sizes in file
         updateSizesInFile(parentDir, -inode.getFileSize());
 
+        closeOpenFiles(item->getInode());
         freeInode(item->getInode());
     }
 
@@ -886,53 +2969,32 @@ Directory* VirtualFileSystem::getParentDirectory(DirectoryItem* item) {
 
 void VirtualFileSystem::clearIndirectBlocks(int32_t inodeId) {
     Inode& inode = inodes[inodeId]; // Find inode by id
-    char buffer[CLUSTER_SIZE];
-    memset(buffer, 0, CLUSTER_SIZE); // Fill buffer with zeros
 
-    // Clear indirect blocks if they are not empty
-    if (inode.getIndirect(0) != ID_ITEM_FREE) {
-        seekDataCluster(inode.getIndirect(0));
-        writeToFile(buffer, sizeof(buffer));
-        inode.setIndirect(0, ID_ITEM_FREE);
-    }
-    if (inode.getIndirect(1) != ID_ITEM_FREE) {
-        seekDataCluster(inode.getIndirect(1));
-        writeToFile(buffer, sizeof(buffer));
-        inode.setIndirect(1, ID_ITEM_FREE);
-    }
+    inode.setIndirect(0, ID_ITEM_FREE);
+    inode.setIndirect(1, ID_ITEM_FREE);
+    inode.setDoubleIndirect(ID_ITEM_FREE);
+    inode.setTripleIndirect(ID_ITEM_FREE);
 }
 
 
 int VirtualFileSystem::removeDirectoryFromFile(Directory* dir, DirectoryItem* item) {
-    const int maxItemsInBlock = 64;
     int empty[4];
     int32_t itemCount, block_count, rest;
-    int32_t nodeId;
     vector<int32_t> blocks = this->getDataBlocks(dir->getCurrent()->getInode(), &block_count, &rest);
+    vector<char> cluster(superblock->getClusterSize());
 
     memset(empty, 0, sizeof(empty));
 
     for (int block_number = 0; block_number < block_count; block_number++) {
-        this->seekDataCluster(blocks[block_number]);
-        itemCount = 0;
-        bool found = false;
-
-        for (int j = 0; j < maxItemsInBlock; j++) {
-            this->readFromFile(&nodeId, 1);
-            if (nodeId > 0) {
-                itemCount++;
-            }
-
-            if (!found) {
-                if (nodeId == item->getInode()) {
-                    this->seekCur(-4);
-                    this->writeToFile(&empty, 1);
-                    this->flushVfs();
-                    found = true;
-                    if (itemCount > 1) break;
-                }
-            }
+        readDataClusters(blocks[block_number], cluster.data(), cluster.size());
+        int entry = clusterIo->findEntry(cluster.data(), item->getInode(), &itemCount);
+        bool found = entry >= 0;
 
+        if (found) {
+            this->seekSet(superblock->getDataStartAddress() + static_cast<int64_t>(blocks[block_number]) * superblock->getClusterSize()
+                          + entry * DIRECTORY_ENTRY_SIZE);
+            this->writeToFile(&empty, 1);
+            this->flushVfs();
         }
 
         if (found) {
@@ -962,7 +3024,7 @@ int VirtualFileSystem::removeDirectoryFromFile(Directory* dir, DirectoryItem* it
 
                             int32_t count = 0, number;
                             found = false;
-                            for (int j = 0; j < INT32_COUNT_IN_BLOCK; j++) {
+                            for (int j = 0; j < clusterIo->getPointersPerCluster(); j++) {
                                 readFromFile(&number);
                                 if (number > 0)
                                     count++;
@@ -1015,35 +3077,120 @@ int VirtualFileSystem::updateDirectoryInFile(Directory* dir, DirectoryItem* item
 }
 
 void VirtualFileSystem::writeInodeToFile(Inode* ptr) {
-    int32_t int32;
-    int8_t  int8;
-    int32 = ptr->getNodeId();            writeToFile(&int32);
-    int8  = ptr->getIsDirectory();       writeToFile(&int8);
-    int8  = ptr->getReferences();        writeToFile(&int8);
-    int32 = ptr->getFileSize();          writeToFile(&int32);
-    int32 = ptr->getDirect(0);     writeToFile(&int32);
-    int32 = ptr->getDirect(1);     writeToFile(&int32);
-    int32 = ptr->getDirect(2);     writeToFile(&int32);
-    int32 = ptr->getDirect(3);     writeToFile(&int32);
-    int32 = ptr->getDirect(4);     writeToFile(&int32);
-    int32 = ptr->getIndirect(0);   writeToFile(&int32);
-    int32 = ptr->getIndirect(1);   writeToFile(&int32);
+    vector<char> buffer(superblock->getInodeSize());
+    encodeInode(ptr, buffer.data());
+    writeToFile(buffer.data(), buffer.size());
 }
 
 void VirtualFileSystem::readInodeFromFile(Inode* ptr, size_t count) {
-    int32_t  int32;
-    int8_t   int8;
-    readFromFile(&int32); ptr->setNodeId(int32);
-    readFromFile(&int8);  ptr->setIsDirectory(int8);
-    readFromFile(&int8);  ptr->setReferences(int8);
-    readFromFile(&int32); ptr->setFileSize(int32);
-    readFromFile(&int32); ptr->setDirect(0, int32);
-    readFromFile(&int32); ptr->setDirect(1, int32);
-    readFromFile(&int32); ptr->setDirect(2, int32);
-    readFromFile(&int32); ptr->setDirect(3, int32);
-    readFromFile(&int32); ptr->setDirect(4, int32);
-    readFromFile(&int32); ptr->setIndirect(0, int32);
-    readFromFile(&int32); ptr->setIndirect(1, int32);
-}
-
-template streamsize VirtualFileSystem::readFromFile<char>(char*, size_t);
\ No newline at end of file
+    vector<char> buffer(superblock->getInodeSize());
+    readFromFile(buffer.data(), buffer.size());
+    decodeInode(ptr, buffer.data());
+}
+
+void VirtualFileSystem::encodeInode(const Inode* ptr, char* buffer) const {
+    bool large = superblock->hasFeature(FEATURE_LARGE_FILES);
+    buffer = putValue<int32_t>(buffer, ptr->getNodeId());
+    buffer = putValue<int8_t>(buffer, ptr->getIsDirectory());
+    buffer = putValue<int8_t>(buffer, ptr->getReferences());
+    if (large) {
+        buffer = putValue<int64_t>(buffer, ptr->getFileSize());
+    } else {
+        buffer = putValue<int32_t>(buffer, static_cast<int32_t>(ptr->getFileSize()));
+    }
+    for (int i = 0; i < 5; i++) {
+        buffer = putValue<int32_t>(buffer, ptr->getDirect(i));
+    }
+    buffer = putValue<int32_t>(buffer, ptr->getIndirect(0));
+    buffer = putValue<int32_t>(buffer, ptr->getIndirect(1));
+    if (large) {
+        buffer = putValue<int32_t>(buffer, ptr->getDoubleIndirect());
+        buffer = putValue<int32_t>(buffer, ptr->getTripleIndirect());
+    }
+    if (superblock->hasFeature(FEATURE_INLINE_DATA)) {
+        // The area after the layout byte holds inline data or the address of the packed tail, the rest is zero
+        memset(buffer, 0, INLINE_DATA_SIZE + 1);
+        if (ptr->getIsInline()) {
+            buffer = putValue<int8_t>(buffer, DATA_INLINE);
+            memcpy(buffer, ptr->getInlineData().data(), ptr->getInlineData().size());
+        } else if (ptr->getTailCluster() != ID_ITEM_FREE) {
+            buffer = putValue<int8_t>(buffer, DATA_PACKED_TAIL);
+            buffer = putValue<int32_t>(buffer, ptr->getTailCluster());
+            putValue<int32_t>(buffer, ptr->getTailOffset());
+        } else if (ptr->getIsCompressed()) {
+            putValue<int8_t>(buffer, DATA_COMPRESSED);
+        }
+    }
+}
+
+void VirtualFileSystem::decodeInode(Inode* ptr, const char* buffer) const {
+    bool large = superblock->hasFeature(FEATURE_LARGE_FILES);
+    ptr->setNodeId(getValue<int32_t>(buffer));
+    ptr->setIsDirectory(getValue<int8_t>(buffer));
+    ptr->setReferences(getValue<int8_t>(buffer));
+    if (large) {
+        ptr->setFileSize(getValue<int64_t>(buffer));
+    } else {
+        ptr->setFileSize(getValue<int32_t>(buffer));
+    }
+    for (int i = 0; i < 5; i++) {
+        ptr->setDirect(i, getValue<int32_t>(buffer));
+    }
+    ptr->setIndirect(0, getValue<int32_t>(buffer));
+    ptr->setIndirect(1, getValue<int32_t>(buffer));
+    if (large) {
+        ptr->setDoubleIndirect(getValue<int32_t>(buffer));
+        ptr->setTripleIndirect(getValue<int32_t>(buffer));
+    } else {
+        ptr->setDoubleIndirect(ID_ITEM_FREE);
+        ptr->setTripleIndirect(ID_ITEM_FREE);
+    }
+    int8_t layout = superblock->hasFeature(FEATURE_INLINE_DATA) ? getValue<int8_t>(buffer) : DATA_IN_CLUSTERS;
+    ptr->setIsInline(layout == DATA_INLINE);
+    ptr->setIsCompressed(layout == DATA_COMPRESSED);
+    ptr->setInlineData(layout == DATA_INLINE
+                       ? string(buffer, static_cast<size_t>(std::min<int64_t>(ptr->getFileSize(), INLINE_DATA_SIZE)))
+                       : string());
+    if (layout == DATA_PACKED_TAIL) {
+        ptr->setTailCluster(getValue<int32_t>(buffer));
+        ptr->setTailOffset(getValue<int32_t>(buffer));
+    } else {
+        ptr->setTailCluster(ID_ITEM_FREE);
+        ptr->setTailOffset(0);
+    }
+}
+
+void VirtualFileSystem::writeInodeTable() {
+    int32_t inodeSize = superblock->getInodeSize();
+    int32_t chunkInodes = TABLE_IO_BYTES / inodeSize;
+    vector<char> buffer(static_cast<size_t>(chunkInodes) * inodeSize);
+
+    for (int32_t first = 0; first < superblock->getInodeCount(); first += chunkInodes) {
+        int32_t count = std::min(chunkInodes, superblock->getInodeCount() - first);
+        for (int32_t i = 0; i < count; i++) {
+            encodeInode(&inodes[first + i], buffer.data() + static_cast<size_t>(i) * inodeSize);
+        }
+        seekSet(superblock->getInodeStartAddress() + static_cast<int64_t>(first) * inodeSize);
+        writeToFile(buffer.data(), static_cast<size_t>(count) * inodeSize);
+    }
+    flushVfs();
+}
+
+void VirtualFileSystem::readInodeTable() {
+    int32_t inodeSize = superblock->getInodeSize();
+    int32_t chunkInodes = TABLE_IO_BYTES / inodeSize;
+    vector<char> buffer(static_cast<size_t>(chunkInodes) * inodeSize);
+
+    for (int32_t first = 0; first < superblock->getInodeCount(); first += chunkInodes) {
+        int32_t count = std::min(chunkInodes, superblock->getInodeCount() - first);
+        readVerified(superblock->getInodeStartAddress() + static_cast<int64_t>(first) * inodeSize,
+                     buffer.data(), static_cast<size_t>(count) * inodeSize);
+        for (int32_t i = 0; i < count; i++) {
+            decodeInode(&inodes[first + i], buffer.data() + static_cast<size_t>(i) * inodeSize);
+        }
+    }
+}
+
+template streamsize VirtualFileSystem::readFromFile<char>(char*, size_t);
+template streamsize VirtualFileSystem::writeToFile<char>(const char*, size_t);
+template streamsize VirtualFileSystem::writeToFile<int32_t>(const int32_t*, size_t);
\ No newline at end of file
@@ -7,10 +7,25 @@
 #include <vector>
 #include <fstream>
 #include <unordered_map>
+#include <set>
+#include <mutex>
+#include <shared_mutex>
+#include <functional>
+#include <atomic>
 #include "Constants.hpp"
 #include "Inode.hpp"
 #include "Directory.hpp"
 #include "Superblock.hpp"
+#include "Session.hpp"
+#include "OpenFile.hpp"
+#include "AllocationGroup.hpp"
+#include "Readahead.hpp"
+#include "ClusterIo.hpp"
+#include "TailPacker.hpp"
+#include "DedupIndex.hpp"
+#include "ChecksumTable.hpp"
+#include "Scrubber.hpp"
+#include "Defragmenter.hpp"
 
 using std::streamsize;
 using std::unordered_map;
@@ -18,6 +33,21 @@ using std::fstream;
 using std::string;
 using std::vector;
 using std::stringstream;
+using std::set;
+using std::mutex;
+using std::shared_mutex;
+using std::shared_lock;
+using std::unique_lock;
+using std::function;
+using std::pair;
+
+/**
+ * Handling of the content of freed data clusters
+ */
+enum class EraseMode {
+    DISCARD,    // The host file system deallocates the clusters, only metadata is written
+    SECURE      // The clusters are overwritten with zeros and synced before they are freed
+};
 
 class VirtualFileSystem {
 public:
@@ -33,7 +63,6 @@ public:
      * @param inodes reference to inodes
      * @param dataBitmap reference to data bitmap
      * @param isFormatted flag indicating whether the file system is formatted
-     * @param currentDir reference to current directory
      * @param name name of the file system file
      * @param vfsFile reference to file stream
      */
@@ -41,7 +70,6 @@ public:
                       Inode* inodes,
                       int8_t* dataBitmap,
                       bool isFormatted,
-                      Directory* currentDir,
                       const string& name,
                       fstream* vfsFile);
 
@@ -57,17 +85,150 @@ public:
     ~VirtualFileSystem();
 
     /**
-     * Gets current path in the virtual file system (e.g. /home/user)
+     * Takes the lock of the virtual file system for reading, any number of readers may hold it at once
+     * @return held shared lock
+     */
+    shared_lock<shared_mutex> lockShared() const;
+
+    /**
+     * Takes the lock of the virtual file system for modification, waits until all readers are gone
+     * @return held exclusive lock
+     */
+    unique_lock<shared_mutex> lockExclusive() const;
+
+    /**
+     * Opens new session with its own current directory ( root directory at the beginning )
+     * @return new session, has to be closed with closeSession
+     */
+    Session* openSession();
+
+    /**
+     * Closes session opened with openSession
+     * @param session session to close
+     */
+    void closeSession(Session* session);
+
+    /**
+     * Opens a file for random access reads and writes
+     * @param path path of the file
+     * @param session session opening the file, clusters reserved for it are used when the file grows
+     * @param create true to create an empty file if there is no file with the path
+     * @return handle of the open file, ERROR_CODE if there is no such file or it could not be created
+     */
+    int32_t open(const string& path, Session* session, bool create = false);
+
+    /**
+     * Closes an open file
+     * @param handle handle of the open file
+     * @return true if the handle was open, false otherwise
+     */
+    bool close(int32_t handle);
+
+    /**
+     * Gets the size of an open file
+     * @param handle handle of the open file
+     * @return size of the file in bytes, ERROR_CODE for an unknown handle
+     */
+    int64_t getFileSize(int32_t handle);
+
+    /**
+     * Reads a range of an open file, holes and ranges of compressed files read like any other data
+     * @param handle handle of the open file
+     * @param offset offset of the first byte to read
+     * @param buffer buffer for the data
+     * @param size number of bytes to read
+     * @return number of bytes read ( less than size at the end of the file ), ERROR_CODE on an unknown handle or a read error
+     */
+    int64_t pread(int32_t handle, int64_t offset, char* buffer, int64_t size);
+
+    /**
+     * Writes a range of an open file, the file grows if the range ends behind it. Only clusters touched by the range are
+     * written; holes get new clusters and clusters shared with other files are copied first. Inline, packed and compressed
+     * files are turned into files with plain clusters when they have to be. Data written at the end of a file which ends
+     * on a cluster ( on a compression unit if it is compressed ) is stored like an imported file: compressed, shared with
+     * equal clusters or with holes for zero clusters, as the image stores new files
+     * @param handle handle of the open file
+     * @param offset offset of the first byte to write, the gap behind the end of the file reads as zeros
+     * @param data data to write
+     * @param size number of bytes to write
+     * @param compress true to store an empty file compressed, as the images compressing all new files do
+     * @return number of bytes written, ERROR_CODE on an unknown handle, a too large file or a lack of space
+     */
+    int64_t pwrite(int32_t handle, int64_t offset, const char* data, int64_t size, bool compress = false);
+
+    /**
+     * Changes the size of an open file, the clusters behind the new end are freed and an extension reads as zeros
+     * @param handle handle of the open file
+     * @param size new size of the file
+     * @return true if the size was changed, false on an unknown handle, a too large size or a lack of space
+     */
+    bool truncate(int32_t handle, int64_t size);
+
+    /**
+     * Appends data to the end of an open file. The data is buffered per i-node and clusters are allocated only when
+     * the buffer is flushed, so a stream of small appends is written as one contiguous run with one update of the
+     * i-node and the bitmap. The buffer is flushed when it reaches APPEND_BUFFER_BYTES, other writes of the file flush
+     * it first and reads see the buffered data
+     * @param handle handle of the open file
+     * @param data data to append
+     * @param size number of bytes to append
+     * @return number of bytes appended, ERROR_CODE on an unknown handle, a too large file or a lack of space
+     */
+    int64_t append(int32_t handle, const char* data, int64_t size);
+
+    /**
+     * Preallocates data clusters for an open file without writing them, taken as one contiguous run when a long enough
+     * run is free. The clusters read as zeros like every free cluster, so later writes land in place; holes below the
+     * size get clusters too and a smaller file grows to the size
+     * @param handle handle of the open file
+     * @param size number of bytes from the start of the file to preallocate
+     * @return false on an unknown handle, a too large size or a lack of space
+     */
+    bool fallocate(int32_t handle, int64_t size);
+
+    /**
+     * Writes the appended data of a file, or of all files, to their clusters
+     * @param inodeId i-node of the file, ID_ITEM_FREE for all files
+     * @param session session allocating the clusters
+     * @return false if some data could not be written ( lack of space ), it stays buffered then
+     */
+    bool flushAppends(int32_t inodeId, Session* session);
+
+    /**
+     * Checks whether some appended data is waiting for flushAppends
+     * @return true if there is buffered data
+     */
+    bool hasPendingAppends() const;
+
+    /**
+     * Gets the number of writes and size changes of a file through open handles
+     * @param inodeId i-node of the file
+     * @return number of changes since the file system was loaded
+     */
+    uint64_t getFileWrites(int32_t inodeId) const;
+
+    /**
+     * Moves every open file of the i-node from one directory to the other one
+     * @param inodeId i-node of the moved file
+     * @param from directory the file was in
+     * @param to directory the file is in now
+     */
+    void moveOpenFiles(int32_t inodeId, Directory* from, Directory* to);
+
+    /**
+     * Gets current path of the session in the virtual file system (e.g. /home/user)
+     * @param session session to get the current path of
      * @return current path in the virtual file system
      */
-    string getCurrentPath();
+    string getCurrentPath(const Session* session);
 
     /**
      * Finds directory with the given path in the virtual file system or nullptr if the directory is not found
-     * @param path path to the directory
+     * @param path path to the directory ( relative paths start in the current directory of the session )
+     * @param session session the path belongs to
      * @return directory with the given path in the virtual file system or nullptr if the directory is not found
      */
-    Directory* findDirectory(const string& path);
+    Directory* findDirectory(const string& path, const Session* session);
 
     /**
      * Gets superblock of the virtual file system
@@ -95,11 +256,37 @@ public:
 
     /**
      * Gets the number of blocks with indirect blocks for the given number of blocks if its needed
+     * ( single, double and triple indirect blocks of the block map are counted )
      * @param blockCount number of blocks
      * @return number of blocks with indirect blocks for the given number of blocks if its needed
      */
     int getBlockCountWithIndirect(int blockCount);
 
+    /**
+     * Gets the largest file size the i-node revision of the virtual file system can address
+     * @return max file size in bytes
+     */
+    int64_t getMaxFileSize() const;
+
+    /**
+     * Gets the loops compiled for the cluster size of the virtual file system
+     * @return cluster size dependent loops
+     */
+    const ClusterIo* getClusterIo() const;
+
+    /**
+     * Gets the cluster size of the virtual file system
+     * @return cluster size in bytes
+     */
+    int32_t getClusterSize() const;
+
+    /**
+     * Gets all blocks of the block map of the given i-node ( indirect blocks, not the data blocks they point to )
+     * @param inodeId id of the i-node
+     * @return blocks of the block map
+     */
+    vector<int32_t> getMapBlocks(int32_t inodeId);
+
     /**
      * Gets data bitmap of the virtual file system
      * @return data bitmap of the virtual file system
@@ -124,18 +311,6 @@ public:
      */
     void setIsFormatted(bool newIsFormatted);
 
-    /**
-     * Gets current directory in the virtual file system
-     * @return current directory in the virtual file system
-     */
-    Directory* getCurrentDir() const;
-
-    /**
-     * Sets current directory in the virtual file system
-     * @param newCurrentDir new current directory
-     */
-    void setCurrentDir(Directory* newCurrentDir);
-
     /**
      * Gets name of the virtual file system file
      * @return name of the virtual file system file
@@ -179,16 +354,129 @@ public:
 
     /**
      * Findes free data blocks in the virtual file system and returns them
+     * Blocks are taken from the allocation group of the goal i-node first, the following groups are used only when it is full
      * @param count number of blocks to find
+     * @param goalInode i-node the blocks should be placed near to ( e.g. the file itself or its parent directory )
      * @return vector of free data blocks
      */
-    vector<int32_t> findFreeDataBlocks(int count);
+    vector<int32_t> findFreeDataBlocks(int count, int32_t goalInode = 0);
+
+    /**
+     * Allocates data blocks for the session, blocks are taken from the reservation pool of the session without
+     * scanning the bitmap. Has to be called with the exclusive lock held ( reservations of other sessions may be reclaimed ).
+     * @param count number of blocks to allocate
+     * @param goalInode i-node the blocks should be placed near to
+     * @param session session allocating the blocks
+     * @return vector of data blocks ( written to the bitmap by updateBitmapInFile ) or empty vector if there is not enough space
+     */
+    vector<int32_t> allocateDataBlocks(int count, int32_t goalInode, Session* session);
+
+    /**
+     * Reserves free data blocks, one contiguous run is preferred. Reserved blocks are marked in memory only.
+     * @param count number of blocks to reserve
+     * @param goalInode i-node the blocks should be placed near to
+     * @return reserved blocks ( may be less than count )
+     */
+    vector<int32_t> reserveClusters(int count, int32_t goalInode);
+
+    /**
+     * Returns reserved data blocks back to the bitmap as free
+     * @param blocks reserved blocks
+     */
+    void unreserveClusters(const vector<int32_t>& blocks);
+
+    /**
+     * Drops the content of data clusters which are being freed, they read as zeros afterwards. Consecutive clusters
+     * are merged into extents; an extent is punched out of the image unless secure erase is on or the host file system
+     * cannot punch holes, then it is overwritten with zeros
+     * @param blocks data clusters in any order, holes are skipped
+     */
+    void discardClusters(vector<int32_t> blocks);
+
+    /**
+     * Returns unused reservations of all sessions back to the bitmap
+     */
+    void releaseAllReservations();
 
     /**
      * Finds free i-node in the virtual file system and returns its id or -1 if there is no free i-node
+     * Files are placed into the allocation group of their parent directory, new directories are spread
+     * to the group with the most free i-nodes
+     * @param parentInode i-node of the parent directory
+     * @param isDirectory true if the i-node is for a directory
      * @return free i-node id or -1 if there is no free i-node
      */
-    int32_t findFreeInode();
+    int32_t findFreeInode(int32_t parentInode = 0, bool isDirectory = false);
+
+    /**
+     * Marks the i-node with the given id as used and updates the free counter of its allocation group
+     * @param id id of the i-node
+     */
+    void claimInode(int32_t id);
+
+    /**
+     * Sets value of the data block in the bitmap ( in memory only ) and updates the free counter of its allocation group
+     * @param block data block
+     * @param value new value in the bitmap ( 0 - free )
+     */
+    void markCluster(int32_t block, int8_t value);
+
+    /**
+     * Builds allocation groups and their free counters from the bitmap and i-nodes
+     */
+    void initAllocationGroups();
+
+    /**
+     * Deletes all allocation groups
+     */
+    void clearAllocationGroups();
+
+    /**
+     * Registers tails of all packed files in the tail packer
+     */
+    void loadPackedTails();
+
+    /**
+     * Initializes i-node of a small file without data blocks, inline data and packed tail are cleared
+     * @param inodeId id of the i-node
+     * @param size size of the file
+     */
+    void initializeSmallInode(int32_t inodeId, int32_t size);
+
+    /**
+     * Removes the packed tail of the given i-node from its pack cluster, the following tails are moved down
+     * and the cluster is freed if it becomes empty
+     * @param inodeId id of the i-node
+     */
+    void releasePackedTail(int32_t inodeId);
+
+    /**
+     * Gets the address of a packed tail in the virtual file system file
+     * @param cluster pack cluster
+     * @param offset offset of the tail in the cluster
+     * @return address in bytes
+     */
+    int64_t getPackedTailAddress(int32_t cluster, int32_t offset) const;
+
+    /**
+     * Gets allocation groups of the virtual file system
+     * @return allocation groups
+     */
+    const vector<AllocationGroup*>& getAllocationGroups() const;
+
+    /**
+     * Gets index of the allocation group the data block belongs to
+     * @param block data block
+     * @return index of the allocation group
+     */
+    size_t getGroupOfCluster(int32_t block) const;
+
+    /**
+     * Gets index of the allocation group the i-node belongs to
+     * @param id id of the i-node
+     * @return index of the allocation group
+     */
+    size_t getGroupOfInode(int32_t id) const;
 
     /**
      * Gets vector of data blocks of the given i-node in the virtual file system and returns it
@@ -239,7 +527,7 @@ public:
      * Updates bitmap in the virtual file system file for the given directory item with the given value and data blocks
      * @param item directory item to update bitmap for
      * @param value value to update bitmap with
-     * @param dataBlocks data blocks to update bitmap with
+     * @param dataBlocks data blocks to update bitmap with, all blocks of the i-node if empty
      */
     void updateBitmapInFile(DirectoryItem* item, int8_t value, vector<int32_t> const& dataBlocks);
 
@@ -253,9 +541,11 @@ public:
     /**
      * Formats the virtual file system with the given size and returns true if the virtual file system was formatted successfully, false otherwise
      * @param filesystemSize size of the virtual file system
+     * @param clusterSize size of one cluster in bytes ( power of two from MIN_CLUSTER_SIZE to MAX_CLUSTER_SIZE )
+     * @param optionalFeatures features chosen by the user ( FEATURE_COMPRESSION, FEATURE_INLINE_DEDUP )
      * @return true if the virtual file system was formatted successfully, false otherwise
      */
-    bool format(int32_t filesystemSize);
+    bool format(int64_t filesystemSize, int32_t clusterSize = CLUSTER_SIZE, int32_t optionalFeatures = 0);
 
     /**
      * Writes superblock to the virtual file system file or throws an exception if the file is not open
@@ -267,6 +557,80 @@ public:
      */
     void flushVfs();
 
+    /**
+     * Computes the checksums of partly written clusters and writes the changed clusters of the table of
+     * cluster checksums, called once at the end of every command changing the virtual file system; counts the change
+     */
+    void syncChecksums();
+
+    /**
+     * Gets the number of commands which changed the virtual file system ( counted by syncChecksums )
+     * @return number of changes since the program started
+     */
+    uint64_t getModificationCount() const;
+
+    /**
+     * Compares the checksum of a data cluster with the stored one without counting or reporting a mismatch
+     * @param blockNumber data cluster
+     * @param data content of the whole cluster
+     * @return false on a mismatch, true if the checksum matches or the cluster has none
+     */
+    bool matchesChecksum(int32_t blockNumber, const char* data) const;
+
+    /**
+     * Gets the background scrub of the data clusters
+     * @return scrubber of the virtual file system
+     */
+    Scrubber* getScrubber() const;
+
+    /**
+     * Gets the defragmenter running the background defragmentation
+     * @return defragmenter of the virtual file system
+     */
+    Defragmenter* getDefragmenter() const;
+
+    /**
+     * Checks whether the image keeps checksums of its clusters
+     * @return true if the image has a table of cluster checksums, false otherwise
+     */
+    bool hasChecksums() const;
+
+    /**
+     * Gets the verification of cluster checksums on read
+     * @return verification mode
+     */
+    VerifyMode getVerifyMode() const;
+
+    /**
+     * Sets the verification of cluster checksums on read
+     * @param mode new verification mode
+     */
+    void setVerifyMode(VerifyMode mode);
+
+    /**
+     * Gets the number of checksum mismatches found since the program started
+     * @return number of mismatches
+     */
+    int64_t getChecksumErrors() const;
+
+    /**
+     * Gets the handling of the content of freed data clusters
+     * @return erase mode
+     */
+    EraseMode getEraseMode() const;
+
+    /**
+     * Sets the handling of the content of freed data clusters
+     * @param mode new erase mode
+     */
+    void setEraseMode(EraseMode mode);
+
+    /**
+     * Checks whether freed clusters are punched out of the image, false once the host file system refused it
+     * @return true if holes are punched, false if freed clusters are overwritten with zeros
+     */
+    bool canPunchHoles() const;
+
     /**
      * Frees the i-node with the given id in the virtual file system or throws an exception if the id is invalid ( initialized with ID_ITEM_FREE )
      * @param id id of the i-node to free
@@ -278,35 +642,142 @@ public:
      * @param blockNumber The block number to seek.
      * @return 0 if successful, -1 on error.
      */
-    int seekDataCluster(int blockNumber) const;
+    int seekDataCluster(int32_t blockNumber) const;
 
     /**
      * Seeks to a specific offset in the virtual file system file.
      * @param offset The offset to seek to.
      * @return 0 if successful, -1 on error.
      */
-    int seekSet(long int offset) const;
+    int seekSet(int64_t offset) const;
+
+    /**
+     * Writes clusters of the given block slots, physically consecutive blocks are written at once
+     * @param blocks data blocks of the file
+     * @param first first block slot to write
+     * @param count number of block slots to write
+     * @param data data of count clusters
+     */
+    void writeClusterRuns(const vector<int32_t>& blocks, int first, int count, const char* data);
+
+    /**
+     * Writes direct pointers and block maps of a file, the i-node itself is not written to the file
+     * @param inodeId id of the i-node
+     * @param blockCount number of data blocks
+     * @param blocks data blocks followed by the map blocks ( in the order the maps are written )
+     */
+    void writeBlockPointers(int32_t inodeId, int blockCount, const vector<int32_t>& blocks);
+
+    /**
+     * Builds the index of cluster hashes from the table of cluster hashes if it was not built yet
+     */
+    void loadDedupIndex();
+
+    /**
+     * Writes slots of the table of cluster hashes, slots of consecutive clusters are written at once
+     * @param slots data clusters and their hashes ( empty hash clears the slot ), sorted in place
+     */
+    void writeDedupSlots(vector<pair<int32_t, Hash128>>& slots);
+
+    /**
+     * Moves hashes of data clusters to the clusters their content was copied to, the old slots are cleared
+     * @param moves old and new data cluster of every moved cluster
+     */
+    void moveDedupSlots(const vector<pair<int32_t, int32_t>>& moves);
+
+    /**
+     * Sets reference count of a data cluster in the bitmap and writes it to the file
+     * @param cluster data cluster
+     * @param count number of block pointers referencing the cluster, 0 frees it
+     */
+    void setClusterReferences(int32_t cluster, int8_t count);
+
+    /**
+     * Compares content of two data clusters
+     * @param first first data cluster
+     * @param second second data cluster
+     * @return true if both clusters were read and are equal, false otherwise
+     */
+    bool hasSameContent(int32_t first, int32_t second) const;
 
     /**
      * Seeks to a specific offset relative to the current position in the file.
      * @param offset The offset to seek to.
      * @return 0 if successful, -1 on error.
      */
-    int seekCur(long int offset);
+    int seekCur(int64_t offset);
 
     /**
      * Rewinds the virtual file system file to the beginning.
      */
     void rewindVfs() const;
 
+    /**
+     * Reads bytes from the virtual file system file at the given offset without touching the stream cursor.
+     * Uses positional reads, so it may be called from several threads at once.
+     * @param offset The offset to read from.
+     * @param buffer The buffer to read data into.
+     * @param size The number of bytes to read.
+     * @return The number of bytes read, -1 on error.
+     */
+    streamsize readAt(int64_t offset, char* buffer, size_t size) const;
+
+    /**
+     * Reads a run of physically consecutive data clusters starting with the given block number.
+     * Uses positional reads, so it may be called from several threads at once.
+     * @param blockNumber The first block number of the run.
+     * @param buffer The buffer to read data into.
+     * @param size The number of bytes to read.
+     * @return The number of bytes read, -1 on error.
+     */
+    streamsize readDataClusters(int32_t blockNumber, char* buffer, size_t size) const;
+
+    /**
+     * Reads data at the given offset and verifies the checksums of all clusters it touches. Clusters read only
+     * partly are read whole once more for the verification. Uses positional reads like readAt.
+     * @param offset The offset in the file.
+     * @param buffer The buffer to read data into.
+     * @param size The number of bytes to read.
+     * @return The number of bytes read, -1 on error or on a checksum mismatch in the strict mode.
+     */
+    streamsize readVerified(int64_t offset, char* buffer, size_t size) const;
+
+    /**
+     * Asks the kernel to prefetch a run of physically consecutive data clusters, does not wait for the data.
+     * @param blockNumber The first block number of the run.
+     * @param count The number of clusters in the run.
+     */
+    void adviseDataClusters(int32_t blockNumber, int32_t count) const;
+
+    /**
+     * Gets readahead state of the i-node, a new state is returned for i-nodes which were not read yet
+     * @param id id of the i-node
+     * @return readahead state of the i-node
+     */
+    ReadaheadState getReadaheadState(int32_t id);
+
+    /**
+     * Stores readahead state of the i-node
+     * @param id id of the i-node
+     * @param state readahead state of the i-node
+     */
+    void setReadaheadState(int32_t id, const ReadaheadState& state);
+
+    /**
+     * Forgets readahead state of the i-node ( the i-node was freed )
+     * @param id id of the i-node
+     */
+    void forgetReadaheadState(int32_t id);
+
     /**
      * Reads a value from a file and sets it in the superblock.
-     * @tparam T The type of the value to read.
+     * @tparam Stored The type of the value in the file.
+     * @tparam T The type of the value in the superblock.
      * @param file The file to read from.
      * @param superblock The superblock to set the value in.
      * @param setter A pointer to a setter function in the superblock.
      */
-    template<typename T> void readAndSet(fstream& file, Superblock& superblock, void(Superblock::*setter)(T));
+    template<typename Stored, typename T> void readAndSet(fstream& file, Superblock& superblock, void(Superblock::*setter)(T));
 
     /**
      * Writes data to the virtual file system file.
@@ -353,11 +824,19 @@ public:
     int updateDirectoryInFile(Directory* dir, DirectoryItem* item, bool create);
 
     /**
-     * Clear indirect blocks of inode by id
+     * Clear indirect blocks of inode by id, the caller discards the clusters of the block map
      * @param inodeId id of inode to clear indirect blocks
      */
     void clearIndirectBlocks(int32_t inodeId);
 
+    /**
+     * Deallocates a range of the image in the host file system, the range reads as zeros afterwards
+     * @param address start address of the range
+     * @param length length of the range in bytes
+     * @return true if the hole was punched, false if the host file system does not support it
+     */
+    bool punchHole(int64_t address, int64_t length);
+
     /**
      * Remove file from directory and from file system ( including linking links )
      * @param parentDir directory where file is located
@@ -378,17 +857,163 @@ public:
      * @param inodeId id of the i-node
      * @param size size of file
      * @param blockCount number of blocks
-     * @param blocks vector of blocks
-     * @return last data block
+     * @param blocks data blocks followed by the blocks of the block map ( see getBlockCountWithIndirect )
+     * @return index of the last data block in blocks
+     */
+    int32_t initializeInode(int32_t inode_id, int64_t size, int block_count, vector<int32_t>& blocks);
+
+    /**
+     * Checks whether a file of the given size is stored inline in its i-node record
+     * @param size size of the file
+     * @return true if the file fits into the i-node record of this file system, false otherwise
+     */
+    bool canStoreInline(int64_t size) const;
+
+    /**
+     * Checks whether a file of the given size is packed into a cluster shared with other small files
+     * @param size size of the file
+     * @return true if the file is packed, false otherwise
+     */
+    bool canPackTail(int64_t size) const;
+
+    /**
+     * Checks whether a file of the given size uses no data blocks of its own ( inline or packed )
+     * @param size size of the file
+     * @return true if the file is stored by storeSmallFile, false otherwise
+     */
+    bool isSmallFile(int64_t size) const;
+
+    /**
+     * Initializes i-node of a small file and stores its data inline in the i-node record or into a pack cluster
+     * ( see isSmallFile ), the i-node is not written to the file
+     * @param inodeId id of the i-node
+     * @param data data of the file
+     * @param session session allocating a new pack cluster if no pack cluster has enough space
+     * @return true if the data was stored, false if there is no free cluster
+     */
+    bool storeSmallFile(int32_t inodeId, const string& data, Session* session);
+
+    /**
+     * Reads data of a small file ( inline or packed )
+     * @param inodeId id of the i-node
+     * @param data data of the file
+     * @return true if the file is small and the data was read, false if the file uses data blocks
+     */
+    bool readSmallFile(int32_t inodeId, string& data) const;
+
+    /**
+     * Checks whether a new file should be stored compressed
+     * @param requested true if compression was requested for the file
+     * @return true if the file should be compressed, false if the image cannot hold compressed files or compression is off
+     */
+    bool shouldCompress(bool requested) const;
+
+    /**
+     * Gets the number of clusters in one compression unit, every unit owns a fixed range of block slots. A unit is
+     * 64 KB but at least COMPRESSION_MIN_CLUSTERS clusters ( FEATURE_WIDE_UNITS ), so it can save clusters even
+     * with large clusters; images formatted by older versions keep units of one cluster from 64K clusters up
+     * @return number of clusters in one compression unit
+     */
+    int32_t getCompressionUnitClusters() const;
+
+    /**
+     * Gets the number of compression units of a file of the given size
+     * @param size size of the file
+     * @return number of compression units
+     */
+    int getCompressionUnitCount(int64_t size) const;
+
+    /**
+     * Writes data of a file compressed unit by unit into its reserved blocks. A unit is stored compressed
+     * ( 32-bit compressed length followed by the compressed data ) only if it saves at least one cluster, the
+     * unused blocks of the unit become holes ( ID_ITEM_FREE ) and are returned to the bitmap; a unit of zeros
+     * keeps no block at all if the image allows holes. Units of one batch are compressed in parallel.
+     * @param size size of the file
+     * @param source reads the given number of raw bytes of the file into the buffer, returns false on error
+     * @param blocks reserved blocks of the file, holes are set in place
+     * @param blockCount number of data blocks of the file
+     * @return true if the data was written, false if the source failed
+     */
+    bool writeCompressedData(int64_t size, const function<bool(char*, size_t)>& source, vector<int32_t>& blocks,
+                             int blockCount);
+
+    /**
+     * Reads and decompresses one compression unit of a compressed file
+     * @param blocks data blocks of the file including holes
+     * @param unit index of the unit
+     * @param size size of the file
+     * @param buffer buffer for the raw data of the unit ( unit size at least )
+     * @return number of raw bytes of the unit or -1 if the unit is damaged
+     */
+    int64_t readCompressedUnit(const vector<int32_t>& blocks, int unit, int64_t size, char* buffer) const;
+
+    /**
+     * Reads the whole compressed file unit by unit
+     * @param blocks data blocks of the file including holes
+     * @param size size of the file
+     * @param sink receives raw data of every unit in order, returns false to stop
+     * @return true if all units were read and accepted, false otherwise
+     */
+    bool readCompressedFile(const vector<int32_t>& blocks, int64_t size, const function<bool(const char*, size_t)>& sink) const;
+
+    /**
+     * Copies stored clusters of a compressed file without decompressing them, blocks of the target matching
+     * holes of the source become holes too and are returned to the bitmap
+     * @param source data blocks of the source file including holes
+     * @param target reserved blocks of the copy, holes are set in place
+     * @param blockCount number of data blocks of the file
+     * @return true if the data was copied, false on read error
      */
-    int32_t initializeInode(int32_t inode_id, int32_t size, int block_count, vector<int32_t>& blocks);
+    bool copyCompressedData(const vector<int32_t>& source, vector<int32_t>& target, int blockCount);
+
+    /**
+     * Checks whether written clusters are shared with equal clusters at once ( FEATURE_INLINE_DEDUP )
+     * @return true if writes are deduplicated, false otherwise
+     */
+    bool isInlineDedup() const;
+
+    /**
+     * Checks whether zero clusters of files are stored as holes ( FEATURE_SPARSE_FILES ), images formatted by
+     * older versions keep every cluster of a plain file
+     * @return true if zero clusters get no cluster of their own, false otherwise
+     */
+    bool allowsHoles() const;
+
+    /**
+     * Writes data of a file into its reserved blocks, a cluster equal to an already stored cluster is not written
+     * and the stored cluster gets one more reference instead ( its reserved block goes back to the bitmap ). Block
+     * slots are updated in place and the reference counts of all used clusters are written to the bitmap; zero
+     * clusters become holes if the image allows them.
+     * @param size size of the file
+     * @param source reads the given number of bytes of the file into the buffer, returns false on error
+     * @param blocks reserved blocks of the file
+     * @param blockCount number of data blocks of the file
+     * @return true if the data was written, false if the source failed
+     */
+    bool writeDedupData(int64_t size, const function<bool(char*, size_t)>& source, vector<int32_t>& blocks,
+                        int blockCount);
+
+    /**
+     * Drops one reference of every data block of a removed file
+     * @param blocks data blocks of the file, holes are skipped
+     * @return blocks which lost their last reference and have to be cleared and freed
+     */
+    vector<int32_t> releaseDataBlocks(const vector<int32_t>& blocks);
+
+    /**
+     * Shares equal data clusters of all files. Clusters are hashed in parallel, equal hashes are confirmed by
+     * comparing the clusters, block pointers of the files are rewritten in place and the replaced clusters are freed.
+     * @param threadCount number of threads hashing the clusters
+     * @return report of the deduplication
+     */
+    DedupReport deduplicate(size_t threadCount);
 
     /**
      * Updates the directory in the virtual file system file
      * @param dir directory to update in the virtual file system file
      * @param size size of the directory to update in the virtual file system file
      */
-    void updateSizesInFile(Directory* dir, int32_t size);
+    void updateSizesInFile(Directory* dir, int64_t size);
 
     /**
      * Write inode to file
@@ -403,6 +1028,30 @@ public:
      */
     void readInodeFromFile(Inode* ptr, size_t count = 1);
 
+    /**
+     * Encodes i-node to its record in the i-node table ( layout depends on the i-node revision )
+     * @param ptr pointer to inode with data to encode
+     * @param buffer buffer of the record, at least getInodeSize() bytes
+     */
+    void encodeInode(const Inode* ptr, char* buffer) const;
+
+    /**
+     * Decodes i-node from its record in the i-node table ( layout depends on the i-node revision )
+     * @param ptr pointer to inode the decoded data to store
+     * @param buffer buffer of the record, at least getInodeSize() bytes
+     */
+    void decodeInode(Inode* ptr, const char* buffer) const;
+
+    /**
+     * Writes the whole i-node table to the virtual file system file in large chunks
+     */
+    void writeInodeTable();
+
+    /**
+     * Reads the whole i-node table from the virtual file system file in large chunks
+     */
+    void readInodeTable();
+
     /**
      * Loads the directory from the virtual file system
      * @param dir directory to load
@@ -415,6 +1064,12 @@ public:
      */
     void loadVfs();
 
+    /**
+     * Loads the virtual file system from the file again, all in-memory state is dropped and built from
+     * the image ( e.g. after a repair written directly to the image ); sessions return to the root directory
+     */
+    void reloadVfs();
+
     /**
      * Gets all directories in the virtual file system ( map<int, Directory*> )
      * @return all directories in the virtual file system ( map<int, Directory*> )
@@ -447,13 +1102,177 @@ private:
     Superblock* superblock;
     Inode* inodes;
     int8_t* dataBitmap;
+    const ClusterIo* clusterIo;
+    vector<AllocationGroup*> groups;
+    TailPacker tailPacker;
+    DedupIndex dedupIndex;
+    mutable ChecksumTable checksums;
+    std::atomic<VerifyMode> verifyMode{VerifyMode::STRICT};
+    mutable std::atomic<int64_t> checksumErrors{0};
+    std::atomic<EraseMode> eraseMode{EraseMode::DISCARD};
+    std::atomic<bool> punchHoles{true};
+    std::atomic<uint64_t> modificationCount{0};
+    Scrubber* scrubber;
+    Defragmenter* defragmenter;
 
     bool isFormatted;
-    Directory* currentDir;
     unordered_map<int, Directory*> allDirs;
 
     string name;
     fstream* vfsFile;
+    int vfsFd;
+
+    mutable shared_mutex stateMutex;
+    mutex sessionsMutex;
+    set<Session*> sessions;
+
+    mutex readaheadMutex;
+    unordered_map<int32_t, ReadaheadState> readaheadStates;
+
+    mutex openFilesMutex;
+    unordered_map<int32_t, OpenFile*> openFiles;
+    int32_t nextHandle = 0;
+    unordered_map<int32_t, uint64_t> fileWrites;    // Changed under the exclusive state lock only
+    unordered_map<int32_t, PendingAppend> pendingAppends;   // Likewise, read under the shared lock
+    std::atomic<int64_t> pendingAppendBytes{0};
+
+    /**
+     * Moves every session standing in the given directory to the other one
+     * @param from directory the sessions stand in
+     * @param to new current directory of the sessions
+     */
+    void moveSessions(Directory* from, Directory* to);
+
+    /**
+     * Gets an open file by its handle
+     * @param handle handle of the open file
+     * @return open file, nullptr for an unknown handle
+     */
+    OpenFile* getOpenFile(int32_t handle);
+
+    /**
+     * Closes every open file of the i-node, or of all i-nodes
+     * @param inodeId i-node of the closed files, ID_ITEM_FREE for all open files
+     */
+    void closeOpenFiles(int32_t inodeId);
+
+    /**
+     * Reads a range of a file with data clusters of its own
+     * @param inodeId i-node of the file
+     * @param offset offset of the first byte, inside the file
+     * @param buffer buffer for the data
+     * @param size number of bytes, the range ends inside the file
+     * @return false on a read error, true otherwise
+     */
+    bool readPlainRange(int32_t inodeId, int64_t offset, char* buffer, int64_t size);
+
+    /**
+     * Reads a range of a compressed file unit by unit
+     * @param inodeId i-node of the file
+     * @param offset offset of the first byte, inside the file
+     * @param buffer buffer for the data
+     * @param size number of bytes, the range ends inside the file
+     * @return false on a read error or damaged data, true otherwise
+     */
+    bool readCompressedRange(int32_t inodeId, int64_t offset, char* buffer, int64_t size);
+
+    /**
+     * Stores new content of an inline or packed file, as a small file again if it is small enough
+     * and in data clusters of its own otherwise
+     * @param file open file
+     * @param data new content of the start of the file
+     * @param newSize new size of the file, the bytes behind the content read as zeros
+     * @param allocate true to give all clusters of the file data clusters when it gets them ( see fallocate )
+     * @return false if there was no space for the content, the old content is kept then
+     */
+    bool rewriteSmallFile(OpenFile* file, const string& data, int64_t newSize, bool allocate = false);
+
+    /**
+     * Writes a range of an open file of any kind ( see pwrite ), the appended data of the file is not flushed
+     * @param file open file
+     * @param offset offset of the first byte to write
+     * @param data data to write
+     * @param size number of bytes to write, more than zero
+     * @param compress true to store an empty file compressed
+     * @return false on a lack of space or a read error, the file is left as it was then
+     */
+    bool writeRange(OpenFile* file, int64_t offset, const char* data, int64_t size, bool compress = false);
+
+    /**
+     * Adds data behind the end of a file with data clusters of its own ( or an empty one ) which ends on a cluster, or
+     * on a compression unit if it is compressed. The new clusters are written like the clusters of an imported file:
+     * compressed units, clusters shared with equal ones on images deduplicating on write, holes for zero clusters
+     * @param file open file
+     * @param data data to add
+     * @param size number of bytes to add, more than zero
+     * @param compressed true if the file is ( or becomes ) compressed
+     * @return false on a lack of space, nothing is changed then
+     */
+    bool extendStoredFile(OpenFile* file, const char* data, int64_t size, bool compressed);
+
+    /**
+     * Claims the free clusters following the given cluster, so data appended to a file continues its last cluster
+     * @param previous last cluster of the file
+     * @param count number of clusters to claim
+     * @return claimed clusters ( marked reserved ), empty vector if one of them is not free
+     */
+    vector<int32_t> claimFollowingClusters(int32_t previous, int count);
+
+    /**
+     * Decompresses a compressed file into plain data clusters, the block map clusters are kept
+     * @param file open file
+     * @return false on a lack of space or damaged data, the file is left compressed then
+     */
+    bool expandCompressedFile(OpenFile* file);
+
+    /**
+     * Resizes a file with data clusters of its own and writes a range of it. The block map is written again only when
+     * its pointers change: the file grows or shrinks, a hole is filled or a shared cluster is copied on write
+     * @param file open file
+     * @param newSize new size of the file
+     * @param offset offset of the written range
+     * @param data data to write, nullptr if only the size changes
+     * @param size number of bytes to write
+     * @param allocate true to give every hole of the file a cluster, the new clusters are taken as one run if possible
+     * @return false on a lack of space or a read error of a partly written cluster, nothing is changed then
+     */
+    bool writePlainRange(OpenFile* file, int64_t newSize, int64_t offset, const char* data, int64_t size,
+                         bool allocate = false);
+
+    /**
+     * Writes bitmap entries of data clusters, consecutive entries are written at once
+     * @param clusters data clusters
+     * @param value new bitmap entry
+     */
+    void writeBitmapEntries(vector<int32_t> clusters, int8_t value);
+
+    /**
+     * Opens the virtual file system file ( stream without buffering, so positional reads always see written data )
+     */
+    void openVfsFile();
+
+    /**
+     * Updates the checksums of the clusters touched by a write to the file
+     * @param offset offset of the written data in the file
+     * @param data written data
+     * @param size number of written bytes
+     */
+    void noteWrite(int64_t offset, const char* data, size_t size);
+
+    /**
+     * Checks whether the cluster is covered by the table of cluster checksums ( bitmap, i-node table and data )
+     * @param cluster cluster of the image
+     * @return true if the cluster has a checksum, false otherwise
+     */
+    bool isChecksummed(int64_t cluster) const;
+
+    /**
+     * Compares the checksum of a cluster with the stored one, mismatches are counted and reported
+     * @param cluster cluster of the image
+     * @param data content of the whole cluster
+     * @return false on a mismatch, true otherwise
+     */
+    bool verifyCluster(int64_t cluster, const char* data) const;
 };
 
 #endif //SEMESTRALNIPRACE_VIRTUALFILESYSTEM_HPP
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "ZeroScanner.hpp"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZERO_SCANNER_HAS_SIMD 1
+#endif
+
+static const size_t BLOCK_BYTES = 64;      // Bytes compared before the next early exit
+
+/**
+ * Checks the data eight bytes at once
+ * @param data - data to check
+ * @param size - size of the data
+ * @return true if every byte is zero, false otherwise
+ */
+static bool isZeroWords(const uint8_t* data, size_t size) {
+    while (size >= BLOCK_BYTES) {
+        uint64_t words[BLOCK_BYTES / sizeof(uint64_t)];
+        memcpy(words, data, sizeof(words));
+        if ((words[0] | words[1] | words[2] | words[3] | words[4] | words[5] | words[6] | words[7]) != 0) {
+            return false;
+        }
+        data += BLOCK_BYTES;
+        size -= BLOCK_BYTES;
+    }
+    uint8_t any = 0;
+    while (size-- > 0) {
+        any |= *data++;
+    }
+    return any == 0;
+}
+
+#ifdef ZERO_SCANNER_HAS_SIMD
+/**
+ * Checks the data sixteen bytes at once
+ * @param data - data to check
+ * @param size - size of the data
+ * @return true if every byte is zero, false otherwise
+ */
+__attribute__((target("sse2")))
+static bool isZeroSse2(const uint8_t* data, size_t size) {
+    const __m128i zero = _mm_setzero_si128();
+    while (size >= BLOCK_BYTES) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48));
+        __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF) {
+            return false;
+        }
+        data += BLOCK_BYTES;
+        size -= BLOCK_BYTES;
+    }
+    return isZeroWords(data, size);
+}
+
+/**
+ * Checks the data thirty two bytes at once
+ * @param data - data to check
+ * @param size - size of the data
+ * @return true if every byte is zero, false otherwise
+ */
+__attribute__((target("avx2")))
+static bool isZeroAvx2(const uint8_t* data, size_t size) {
+    while (size >= BLOCK_BYTES) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32));
+        __m256i any = _mm256_or_si256(a, b);
+        if (!_mm256_testz_si256(any, any)) {
+            return false;
+        }
+        data += BLOCK_BYTES;
+        size -= BLOCK_BYTES;
+    }
+    return isZeroWords(data, size);
+}
+#endif
+
+using ScanFunction = bool (*)(const uint8_t*, size_t);
+
+/**
+ * Selects the fastest variant supported by the processor
+ * @return function checking the data
+ */
+static ScanFunction selectScan() {
+#ifdef ZERO_SCANNER_HAS_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return isZeroAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return isZeroSse2;
+    }
+#endif
+    return isZeroWords;
+}
+
+static const ScanFunction SCAN = selectScan();
+
+bool ZeroScanner::isZero(const char* data, size_t size) {
+    return SCAN(reinterpret_cast<const uint8_t*>(data), size);
+}
+
+bool ZeroScanner::isAccelerated() {
+    return SCAN != isZeroWords;
+}
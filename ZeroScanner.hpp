@@ -0,0 +1,30 @@
+#ifndef SEMESTRALNIPRACE_ZEROSCANNER_HPP
+#define SEMESTRALNIPRACE_ZEROSCANNER_HPP
+
+#include <cstddef>
+
+/**
+ * Detection of clusters containing only zero bytes, such clusters of a file are stored as holes.
+ * AVX2 or SSE2 compares are used when the processor has them, otherwise eight bytes are compared
+ * at once; the variant is selected once on first use. Data with a non zero byte near its beginning
+ * is rejected after the first 64 bytes.
+ */
+class ZeroScanner {
+public:
+
+    /**
+     * Checks whether the data contains only zero bytes
+     * @param data - data to check
+     * @param size - size of the data
+     * @return true if every byte is zero, false otherwise
+     */
+    static bool isZero(const char* data, size_t size);
+
+    /**
+     * Checks whether vector compares are used
+     * @return true if AVX2 or SSE2 is used, false if words are compared
+     */
+    static bool isAccelerated();
+};
+
+#endif //SEMESTRALNIPRACE_ZEROSCANNER_HPP